@@ -54,7 +54,29 @@ static void display_help( void )
              "    --version      Display version information\n"
              "    --box          Dump box structure\n"
              "    --chapter      Extract chapter list\n"
-             "    --timestamp    Dump media timestamps\n" );
+             "    --timestamp    Dump media timestamps\n"
+             "  options for dumping box structure:\n"
+             "    --stream       Dump each box as soon as it is read\n"
+             "                   Memory usage doesn't grow with the number of movie fragments.\n"
+             "    --json         Dump box headers as JSON lines (implies --stream)\n"
+             "    --max-level <integer>\n"
+             "                   Dump boxes up to the specified nesting level (implies --stream)\n"
+             "    --type <4cc>[,<4cc>...]\n"
+             "                   Dump only boxes of the specified types and their descendants\n"
+             "                   (implies --stream)\n" );
+}
+
+#define BOXDUMPER_MAX_TYPES 16
+
+static int parse_box_types( char *arg, lsmash_compact_box_type_t *types, uint32_t *type_count )
+{
+    for( char *type = strtok( arg, "," ); type; type = strtok( NULL, "," ) )
+    {
+        if( strlen( type ) != 4 || *type_count == BOXDUMPER_MAX_TYPES )
+            return -1;
+        types[ (*type_count)++ ] = LSMASH_4CC( type[0], type[1], type[2], type[3] );
+    }
+    return *type_count ? 0 : -1;
 }
 
 static int boxdumper_error
@@ -92,27 +114,57 @@ int main( int argc, char *argv[] )
     }
     int dump_box = 1;
     int chapter = 0;
-    char *filename;
+    int stream = 0;
+    lsmash_print_parameters_t print_param = { 0 };
+    lsmash_compact_box_type_t types[BOXDUMPER_MAX_TYPES];
     lsmash_get_mainargs( &argc, &argv );
-    if( argc > 2 )
+    for( int i = 1; i < argc - 1; i++ )
     {
-        if( !strcasecmp( argv[1], "--box" ) )
+        if( !strcasecmp( argv[i], "--box" ) )
             DO_NOTHING;
-        else if( !strcasecmp( argv[1], "--chapter" ) )
+        else if( !strcasecmp( argv[i], "--chapter" ) )
             chapter = 1;
-        else if( !strcasecmp( argv[1], "--timestamp" ) )
+        else if( !strcasecmp( argv[i], "--timestamp" ) )
             dump_box = 0;
+        else if( !strcasecmp( argv[i], "--stream" ) )
+            stream = 1;
+        else if( !strcasecmp( argv[i], "--json" ) )
+        {
+            print_param.format = LSMASH_PRINT_FORMAT_JSON_LINES;
+            stream = 1;
+        }
+        else if( !strcasecmp( argv[i], "--max-level" ) && i + 1 < argc - 1 )
+        {
+            print_param.max_level = atoi( argv[++i] );
+            if( print_param.max_level <= 0 )
+            {
+                display_help();
+                return -1;
+            }
+            stream = 1;
+        }
+        else if( !strcasecmp( argv[i], "--type" ) && i + 1 < argc - 1 )
+        {
+            if( parse_box_types( argv[++i], types, &print_param.type_count ) < 0 )
+            {
+                display_help();
+                return -1;
+            }
+            print_param.types = types;
+            stream = 1;
+        }
         else
         {
             display_help();
             return -1;
         }
-        filename = argv[2];
     }
-    else
+    if( stream && (chapter || !dump_box) )
     {
-        filename = argv[1];
+        display_help();
+        return -1;
     }
+    char *filename = argv[argc - 1];
     /* Open the input file. */
     lsmash_root_t *root = lsmash_create_root();
     if( !root )
@@ -128,10 +180,14 @@ int main( int argc, char *argv[] )
     lsmash_file_t *file = lsmash_set_file( root, &file_param );
     if( !file )
         return BOXDUMPER_ERR( "Failed to add a file into a ROOT.\n" );
+    if( stream && lsmash_set_print_stream( file, "-", &print_param ) < 0 )
+        return BOXDUMPER_ERR( "Failed to set up dumping box structure.\n" );
     if( lsmash_read_file( file, &file_param ) < 0 )
         return BOXDUMPER_ERR( "Failed to read a file\n" );
     /* Dump the input file. */
-    if( chapter )
+    if( stream )
+        DO_NOTHING;     /* Already dumped while reading. */
+    else if( chapter )
     {
         if( lsmash_print_chapter_list( root ) )
             return BOXDUMPER_ERR( "Failed to extract chapter.\n" );
@@ -31,6 +31,10 @@
 
 #include "config.h"
 
+#ifdef LSMASH_THREADS_ENABLED
+#include <pthread.h>
+#endif
+
 #include "importer/importer.h"
 
 #define MAX_NUM_OF_BRANDS 50
@@ -65,6 +69,8 @@ typedef struct
     int      qtff;
     int      brand_3gx;
     int      optimize_pd;
+    int      compact_sample_size;
+    int      compress_movie;
     int      timeline_shift;
     uint32_t interleave;
     uint32_t num_of_brands;
@@ -111,6 +117,34 @@ typedef struct
     int   num_of_track_delimiters;
 } input_option_t;
 
+#ifdef LSMASH_THREADS_ENABLED
+#define IMPORT_QUEUE_DEPTH 64
+
+typedef struct
+{
+    lsmash_sample_t  *sample;
+    lsmash_summary_t *summary;          /* the new summary if ret is 1 */
+    uint32_t          last_delta;       /* the last sample delta if ret is 2 */
+    int               ret;              /* the return value of lsmash_importer_get_access_unit() */
+} import_slot_t;
+
+typedef struct
+{
+    pthread_t         thread;
+    pthread_mutex_t   mutex;
+    pthread_cond_t    filled;           /* signaled when a slot is queued */
+    pthread_cond_t    drained;          /* signaled when a queued slot is taken or the importer shall quit */
+    import_slot_t     slot[IMPORT_QUEUE_DEPTH];
+    uint32_t          head;             /* the index of the slot to be taken next */
+    uint32_t          count;            /* the number of queued slots */
+    int               quit;
+    importer_t       *importer;
+    uint32_t          track_number;
+    lsmash_summary_t *summary;          /* taken from the last slot, not handed over yet */
+    uint32_t          last_delta;       /* taken from the last slot */
+} import_thread_t;
+#endif
+
 typedef struct
 {
     input_option_t     opt;
@@ -120,6 +154,9 @@ typedef struct
     uint32_t           num_of_tracks;
     uint32_t           num_of_active_tracks;
     uint32_t           current_track_number;
+#ifdef LSMASH_THREADS_ENABLED
+    import_thread_t   *thread;
+#endif
 } input_t;
 
 typedef struct
@@ -170,10 +207,167 @@ typedef struct
     uint32_t num_of_inputs;
 } muxer_t;
 
+#ifdef LSMASH_THREADS_ENABLED
+/* Read access units ahead of the interleaver on a dedicated thread per input. */
+static void *import_worker( void *arg )
+{
+    import_thread_t *thread = (import_thread_t *)arg;
+    int ret;
+    do
+    {
+        import_slot_t slot = { NULL, NULL, 0, 0 };
+        ret = lsmash_importer_get_access_unit( thread->importer, thread->track_number, &slot.sample );
+        if( ret == 1 )
+            slot.summary = lsmash_duplicate_summary( thread->importer, thread->track_number );
+        else if( ret == 2 )
+            slot.last_delta = lsmash_importer_get_last_delta( thread->importer, thread->track_number );
+        slot.ret = ret;
+        pthread_mutex_lock( &thread->mutex );
+        while( thread->count == IMPORT_QUEUE_DEPTH && !thread->quit )
+            pthread_cond_wait( &thread->drained, &thread->mutex );
+        if( thread->quit )
+        {
+            pthread_mutex_unlock( &thread->mutex );
+            lsmash_delete_sample( slot.sample );
+            lsmash_cleanup_summary( slot.summary );
+            break;
+        }
+        thread->slot[ (thread->head + thread->count) % IMPORT_QUEUE_DEPTH ] = slot;
+        ++ thread->count;
+        pthread_cond_signal( &thread->filled );
+        pthread_mutex_unlock( &thread->mutex );
+    } while( ret >= 0 && ret != 2 );
+    return NULL;
+}
+
+static void start_import_thread( input_t *input )
+{
+    import_thread_t *thread = lsmash_malloc_zero( sizeof(import_thread_t) );
+    if( !thread )
+        return;
+    thread->importer     = input->importer;
+    thread->track_number = 1;
+    if( pthread_mutex_init( &thread->mutex, NULL ) )
+        goto fail_mutex;
+    if( pthread_cond_init( &thread->filled, NULL ) )
+        goto fail_filled;
+    if( pthread_cond_init( &thread->drained, NULL ) )
+        goto fail_drained;
+    if( pthread_create( &thread->thread, NULL, import_worker, thread ) )
+        goto fail_thread;
+    input->thread = thread;
+    return;
+fail_thread:
+    pthread_cond_destroy( &thread->drained );
+fail_drained:
+    pthread_cond_destroy( &thread->filled );
+fail_filled:
+    pthread_mutex_destroy( &thread->mutex );
+fail_mutex:
+    /* Just import synchronously. */
+    lsmash_free( thread );
+}
+
+static void stop_import_thread( input_t *input )
+{
+    import_thread_t *thread = input->thread;
+    if( !thread )
+        return;
+    pthread_mutex_lock( &thread->mutex );
+    thread->quit = 1;
+    pthread_cond_signal( &thread->drained );
+    pthread_mutex_unlock( &thread->mutex );
+    pthread_join( thread->thread, NULL );
+    pthread_cond_destroy( &thread->drained );
+    pthread_cond_destroy( &thread->filled );
+    pthread_mutex_destroy( &thread->mutex );
+    for( ; thread->count; -- thread->count )
+    {
+        import_slot_t *slot = &thread->slot[ thread->head ];
+        lsmash_delete_sample( slot->sample );
+        lsmash_cleanup_summary( slot->summary );
+        thread->head = (thread->head + 1) % IMPORT_QUEUE_DEPTH;
+    }
+    lsmash_cleanup_summary( thread->summary );
+    lsmash_free( thread );
+    input->thread = NULL;
+}
+#endif
+
+static int get_access_unit( input_t *input, lsmash_sample_t **sample )
+{
+#ifdef LSMASH_THREADS_ENABLED
+    import_thread_t *thread = input->thread;
+    if( thread )
+    {
+        pthread_mutex_lock( &thread->mutex );
+        while( thread->count == 0 )
+            pthread_cond_wait( &thread->filled, &thread->mutex );
+        import_slot_t slot = thread->slot[ thread->head ];
+        thread->head = (thread->head + 1) % IMPORT_QUEUE_DEPTH;
+        -- thread->count;
+        pthread_cond_signal( &thread->drained );
+        pthread_mutex_unlock( &thread->mutex );
+        lsmash_cleanup_summary( thread->summary );
+        thread->summary    = slot.summary;
+        thread->last_delta = slot.last_delta;
+        *sample = slot.sample;
+        return slot.ret;
+    }
+#endif
+    return lsmash_importer_get_access_unit( input->importer, input->current_track_number, sample );
+}
+
+static lsmash_summary_t *duplicate_summary( input_t *input )
+{
+#ifdef LSMASH_THREADS_ENABLED
+    import_thread_t *thread = input->thread;
+    if( thread )
+    {
+        lsmash_summary_t *summary = thread->summary;
+        thread->summary = NULL;
+        return summary;
+    }
+#endif
+    return lsmash_duplicate_summary( input->importer, input->current_track_number );
+}
+
+static uint32_t get_last_delta( input_t *input )
+{
+#ifdef LSMASH_THREADS_ENABLED
+    if( input->thread )
+        return input->thread->last_delta;
+#endif
+    return lsmash_importer_get_last_delta( input->importer, input->current_track_number );
+}
+
+static void start_importing( muxer_t *muxer )
+{
+#ifdef LSMASH_THREADS_ENABLED
+    /* Each track of an input with multiple tracks is read through the shared importer,
+     * so only inputs consisting of a single track are handed over to their own threads. */
+    for( uint32_t i = 0; i < muxer->num_of_inputs; i++ )
+    {
+        input_t *input = &muxer->input[i];
+        if( input->num_of_tracks == 1 && input->track[0].active )
+            start_import_thread( input );
+    }
+#endif
+}
+
+static void stop_importing( muxer_t *muxer )
+{
+#ifdef LSMASH_THREADS_ENABLED
+    for( uint32_t i = 0; i < muxer->num_of_inputs; i++ )
+        stop_import_thread( &muxer->input[i] );
+#endif
+}
+
 static void cleanup_muxer( muxer_t *muxer )
 {
     if( !muxer )
         return;
+    stop_importing( muxer );
     output_t *output = &muxer->output;
     lsmash_close_file( &output->file.param );
     lsmash_destroy_root( output->root );
@@ -239,6 +433,10 @@ static void display_help( void )
              "    --help                    Display help\n"
              "    --version                 Display version information\n"
              "    --optimize-pd             Optimize for progressive download\n"
+             "    --compact-sample-size     Use compact sample size tables if smaller\n"
+             "                              This option is ignored for QuickTime file format\n"
+             "    --compress-movie          Compress the movie header with zlib\n"
+             "                              This option is valid only for QuickTime file format\n"
              "    --interleave <integer>    Specify time interval for media interleaving in milliseconds\n"
              "    --file-format <string>    Specify output file format\n"
              "                              Multiple file format can be specified by comma separators\n"
@@ -465,6 +663,10 @@ static int parse_global_options( int argc, char **argv, muxer_t *muxer )
         }
         else if( !strcasecmp( argv[i], "--optimize-pd" ) )
             opt->optimize_pd = 1;
+        else if( !strcasecmp( argv[i], "--compact-sample-size" ) )
+            opt->compact_sample_size = 1;
+        else if( !strcasecmp( argv[i], "--compress-movie" ) )
+            opt->compress_movie = 1;
         else if( !strcasecmp( argv[i], "--interleave" ) )
         {
             CHECK_NEXT_ARG;
@@ -733,11 +935,15 @@ static int open_input_files( muxer_t *muxer )
              input->current_track_number ++ )
         {
             input_track_t *in_track = &input->track[input->current_track_number - 1];
-            int err = lsmash_importer_construct_timeline( input->importer, input->current_track_number );
-            if( err < 0 && err != LSMASH_ERR_PATCH_WELCOME )
+            /* Elementary streams are read sequentially, so don't index them. */
+            if( lsmash_importer_needs_timeline( input->importer ) )
             {
-                in_track->active = 0;
-                continue;
+                int err = lsmash_importer_construct_timeline( input->importer, input->current_track_number );
+                if( err < 0 && err != LSMASH_ERR_PATCH_WELCOME )
+                {
+                    in_track->active = 0;
+                    continue;
+                }
             }
             in_track->summary = lsmash_duplicate_summary( input->importer, input->current_track_number );
             if( !in_track->summary )
@@ -855,10 +1061,12 @@ static int prepare_output( muxer_t *muxer )
     lsmash_file_parameters_t *file_param = &out_file->param;
     if( lsmash_open_file( out_file->name, 0, file_param ) < 0 )
         return ERROR_MSG( "failed to open an output file.\n" );
-    file_param->major_brand   = opt->major_brand;
-    file_param->brands        = opt->brands;
-    file_param->brand_count   = opt->num_of_brands;
-    file_param->minor_version = opt->minor_version;
+    file_param->major_brand         = opt->major_brand;
+    file_param->brands              = opt->brands;
+    file_param->brand_count         = opt->num_of_brands;
+    file_param->minor_version       = opt->minor_version;
+    file_param->compact_sample_size = opt->compact_sample_size;
+    file_param->compress_movie      = opt->compress_movie;
     if( opt->interleave )
         file_param->max_chunk_duration = opt->interleave * 1e-3;
     out_file->fh = lsmash_set_file( output->root, file_param );
@@ -1050,6 +1258,7 @@ static int do_mux( muxer_t *muxer )
     uint32_t num_active_input_tracks = out_movie->num_of_tracks;
     uint64_t total_media_size = 0;
     uint8_t  sample_count = 0;
+    start_importing( muxer );
     while( 1 )
     {
         input_t *input = &muxer->input[current_input_number - 1];
@@ -1061,7 +1270,7 @@ static int do_mux( muxer_t *muxer )
             if( !sample )
             {
                 /* lsmash_importer_get_access_unit() returns 1 if there're any changes in stream's properties. */
-                int ret = lsmash_importer_get_access_unit( input->importer, input->current_track_number, &sample );
+                int ret = get_access_unit( input, &sample );
                 if( ret == LSMASH_ERR_MEMORY_ALLOC )
                     return ERROR_MSG( "failed to alloc memory for buffer.\n" );
                 else if( ret <= -1 )
@@ -1075,7 +1284,7 @@ static int do_mux( muxer_t *muxer )
                 {
                     input_track_t *in_track = &input->track[input->current_track_number - 1];
                     lsmash_cleanup_summary( in_track->summary );
-                    in_track->summary = lsmash_duplicate_summary( input->importer, input->current_track_number );
+                    in_track->summary = duplicate_summary( input );
                     out_track->summary      = in_track->summary;
                     out_track->sample_entry = lsmash_add_sample_entry( output->root, out_track->track_ID, out_track->summary );
                     if( !out_track->sample_entry )
@@ -1090,7 +1299,7 @@ static int do_mux( muxer_t *muxer )
                     lsmash_delete_sample( sample );
                     sample = NULL;
                     out_track->active = 0;
-                    out_track->last_delta = lsmash_importer_get_last_delta( input->importer, input->current_track_number );
+                    out_track->last_delta = get_last_delta( input );
                     if( out_track->last_delta == 0 )
                         ERROR_MSG( "failed to get the last sample delta.\n" );
                     out_track->last_delta *= out_track->timebase;
@@ -1154,6 +1363,7 @@ static int do_mux( muxer_t *muxer )
                 current_input_number = 1;       /* Back the first input movie. */
         }
     }
+    stop_importing( muxer );
     for( out_movie->current_track_number = 1;
          out_movie->current_track_number <= out_movie->num_of_tracks;
          out_movie->current_track_number ++ )
@@ -80,12 +80,16 @@ void h264_cleanup_parser
 {
     if( !info )
         return;
-    lsmash_remove_entries( info->sps_list,   NULL );
-    lsmash_remove_entries( info->pps_list,   NULL );
+    for( int i = 0; i <= H264_MAX_SPS_ID; i++ )
+        lsmash_freep( &info->sps_table[i] );
+    for( int i = 0; i <= H264_MAX_PPS_ID; i++ )
+        lsmash_freep( &info->pps_table[i] );
     lsmash_remove_entries( info->slice_list, NULL );
     lsmash_destroy_h264_parameter_sets( &info->avcC_param );
     lsmash_destroy_h264_parameter_sets( &info->avcC_param_next );
     lsmash_destroy_multiple_buffers( info->buffer.bank );
+    lsmash_freep( &info->au.data );
+    lsmash_freep( &info->au.incomplete_data );
     lsmash_bits_adhoc_cleanup( info->bits );
     info->bits = NULL;
 }
@@ -101,23 +105,27 @@ int h264_setup_parser
     info->avcC_param     .lengthSizeMinusOne = NALU_DEFAULT_NALU_LENGTH_SIZE - 1;
     info->avcC_param_next.lengthSizeMinusOne = NALU_DEFAULT_NALU_LENGTH_SIZE - 1;
     h264_stream_buffer_t *sb = &info->buffer;
-    sb->bank = lsmash_create_multiple_buffers( parse_only ? 1 : 3, NALU_DEFAULT_BUFFER_SIZE );
+    sb->bank = lsmash_create_multiple_buffers( 1, NALU_DEFAULT_BUFFER_SIZE );
     if( !sb->bank )
         return LSMASH_ERR_MEMORY_ALLOC;
     sb->rbsp = lsmash_withdraw_buffer( sb->bank, 1 );
     if( !parse_only )
     {
-        info->au.data            = lsmash_withdraw_buffer( sb->bank, 2 );
-        info->au.incomplete_data = lsmash_withdraw_buffer( sb->bank, 3 );
+        info->au.incomplete_data = lsmash_malloc( NALU_DEFAULT_BUFFER_SIZE );
+        if( !info->au.incomplete_data )
+        {
+            lsmash_destroy_multiple_buffers( sb->bank );
+            return LSMASH_ERR_MEMORY_ALLOC;
+        }
+        info->au.incomplete_alloc = NALU_DEFAULT_BUFFER_SIZE;
     }
     info->bits = lsmash_bits_adhoc_create();
     if( !info->bits )
     {
+        lsmash_free( info->au.incomplete_data );
         lsmash_destroy_multiple_buffers( sb->bank );
         return LSMASH_ERR_MEMORY_ALLOC;
     }
-    lsmash_init_entry_list( info->sps_list );
-    lsmash_init_entry_list( info->pps_list );
     lsmash_init_entry_list( info->slice_list );
     return 0;
 }
@@ -188,23 +196,7 @@ uint64_t h264_find_next_start_code
         *start_code_length = long_start_code ? NALU_LONG_START_CODE_LENGTH : NALU_SHORT_START_CODE_LENGTH;
         uint64_t distance = *start_code_length + nuh->length;
         /* Find the start code of the next NALU and get the distance from the start code of the latest NALU. */
-        if( !lsmash_bs_is_end( bs, distance + NALU_SHORT_START_CODE_LENGTH ) )
-        {
-            uint32_t sync_bytes = lsmash_bs_show_be24( bs, distance );
-            while( 0x000001 != sync_bytes )
-            {
-                if( lsmash_bs_is_end( bs, ++distance + NALU_SHORT_START_CODE_LENGTH ) )
-                {
-                    distance = lsmash_bs_get_remaining_buffer_size( bs );
-                    break;
-                }
-                sync_bytes <<= 8;
-                sync_bytes  |= lsmash_bs_show_byte( bs, distance + NALU_SHORT_START_CODE_LENGTH - 1 );
-                sync_bytes  &= 0xFFFFFF;
-            }
-        }
-        else
-            distance = lsmash_bs_get_remaining_buffer_size( bs );
+        distance = nalu_get_distance_to_next_start_code( bs, distance );
         /* Any NALU has no consecutive zero bytes at the end. */
         while( 0x00 == lsmash_bs_show_byte( bs, distance - 1 ) )
         {
@@ -234,58 +226,38 @@ uint64_t h264_find_next_start_code
 
 static h264_sps_t *h264_get_sps
 (
-    lsmash_entry_list_t *sps_list,
-    uint8_t              sps_id
+    h264_sps_t **sps_table,
+    uint8_t      sps_id
 )
 {
-    if( !sps_list || sps_id > 31 )
+    if( sps_id > H264_MAX_SPS_ID )
         return NULL;
-    for( lsmash_entry_t *entry = sps_list->head; entry; entry = entry->next )
+    if( !sps_table[sps_id] )
     {
-        h264_sps_t *sps = (h264_sps_t *)entry->data;
+        h264_sps_t *sps = lsmash_malloc_zero( sizeof(h264_sps_t) );
         if( !sps )
             return NULL;
-        if( sps->seq_parameter_set_id == sps_id )
-            return sps;
-    }
-    h264_sps_t *sps = lsmash_malloc_zero( sizeof(h264_sps_t) );
-    if( !sps )
-        return NULL;
-    sps->seq_parameter_set_id = sps_id;
-    if( lsmash_add_entry( sps_list, sps ) < 0 )
-    {
-        lsmash_free( sps );
-        return NULL;
+        sps->seq_parameter_set_id = sps_id;
+        sps_table[sps_id] = sps;
     }
-    return sps;
+    return sps_table[sps_id];
 }
 
 static h264_pps_t *h264_get_pps
 (
-    lsmash_entry_list_t *pps_list,
-    uint8_t              pps_id
+    h264_pps_t **pps_table,
+    uint8_t      pps_id
 )
 {
-    if( !pps_list )
-        return NULL;
-    for( lsmash_entry_t *entry = pps_list->head; entry; entry = entry->next )
+    if( !pps_table[pps_id] )
     {
-        h264_pps_t *pps = (h264_pps_t *)entry->data;
+        h264_pps_t *pps = lsmash_malloc_zero( sizeof(h264_pps_t) );
         if( !pps )
             return NULL;
-        if( pps->pic_parameter_set_id == pps_id )
-            return pps;
-    }
-    h264_pps_t *pps = lsmash_malloc_zero( sizeof(h264_pps_t) );
-    if( !pps )
-        return NULL;
-    pps->pic_parameter_set_id = pps_id;
-    if( lsmash_add_entry( pps_list, pps ) < 0 )
-    {
-        lsmash_free( pps );
-        return NULL;
+        pps->pic_parameter_set_id = pps_id;
+        pps_table[pps_id] = pps;
     }
-    return pps;
+    return pps_table[pps_id];
 }
 
 static h264_slice_info_t *h264_get_slice_info
@@ -326,10 +298,10 @@ int h264_calculate_poc
 #if H264_POC_DEBUG_PRINT
     fprintf( stderr, "PictureOrderCount\n" );
 #endif
-    h264_pps_t *pps = h264_get_pps( info->pps_list, picture->pic_parameter_set_id );
+    h264_pps_t *pps = h264_get_pps( info->pps_table, picture->pic_parameter_set_id );
     if( !pps )
         return LSMASH_ERR_NAMELESS;
-    h264_sps_t *sps = h264_get_sps( info->sps_list, pps->seq_parameter_set_id );
+    h264_sps_t *sps = h264_get_sps( info->sps_table, pps->seq_parameter_set_id );
     if( !sps )
         return LSMASH_ERR_NAMELESS;
     int64_t TopFieldOrderCnt    = 0;
@@ -584,7 +556,7 @@ int h264_parse_sps
     int err = h264_parse_sps_minimally( bits, &temp_sps, rbsp_buffer, ebsp, ebsp_size );
     if( err < 0 )
         return err;
-    h264_sps_t *sps = h264_get_sps( info->sps_list, temp_sps.seq_parameter_set_id );
+    h264_sps_t *sps = h264_get_sps( info->sps_table, temp_sps.seq_parameter_set_id );
     if( !sps )
         return LSMASH_ERR_NAMELESS;
     memset( sps, 0, sizeof(h264_sps_t) );
@@ -760,14 +732,15 @@ int h264_parse_sps
             lsmash_bits_get( bits, 1 );         /* low_delay_hrd_flag */
         }
         sps->vui.pic_struct_present_flag = lsmash_bits_get( bits, 1 );
-        if( lsmash_bits_get( bits, 1 ) )        /* bitstream_restriction_flag */
+        sps->vui.bitstream_restriction_flag = lsmash_bits_get( bits, 1 );
+        if( sps->vui.bitstream_restriction_flag )
         {
             lsmash_bits_get( bits, 1 );         /* motion_vectors_over_pic_boundaries_flag */
             nalu_get_exp_golomb_ue( bits );     /* max_bytes_per_pic_denom */
             nalu_get_exp_golomb_ue( bits );     /* max_bits_per_mb_denom */
             nalu_get_exp_golomb_ue( bits );     /* log2_max_mv_length_horizontal */
             nalu_get_exp_golomb_ue( bits );     /* log2_max_mv_length_vertical */
-            nalu_get_exp_golomb_ue( bits );     /* max_num_reorder_frames */
+            sps->vui.max_num_reorder_frames = nalu_get_exp_golomb_ue( bits );
             nalu_get_exp_golomb_ue( bits );     /* max_dec_frame_buffering */
         }
     }
@@ -823,7 +796,7 @@ int h264_parse_pps
     int err = h264_parse_pps_minimally( bits, &temp_pps, rbsp_buffer, ebsp, ebsp_size );
     if( err < 0 )
         return err;
-    h264_pps_t *pps = h264_get_pps( info->pps_list, temp_pps.pic_parameter_set_id );
+    h264_pps_t *pps = h264_get_pps( info->pps_table, temp_pps.pic_parameter_set_id );
     if( !pps )
         return LSMASH_ERR_NAMELESS;
     memset( pps, 0, sizeof(h264_pps_t) );
@@ -831,7 +804,7 @@ int h264_parse_pps
     uint64_t seq_parameter_set_id = nalu_get_exp_golomb_ue( bits );
     if( seq_parameter_set_id > 31 )
         return LSMASH_ERR_INVALID_DATA;
-    h264_sps_t *sps = h264_get_sps( info->sps_list, seq_parameter_set_id );
+    h264_sps_t *sps = h264_get_sps( info->sps_table, seq_parameter_set_id );
     if( !sps )
         return LSMASH_ERR_NAMELESS;
     pps->seq_parameter_set_id = seq_parameter_set_id;
@@ -1021,10 +994,10 @@ static int h264_parse_slice_header
     if( pic_parameter_set_id > 255 )
         return LSMASH_ERR_INVALID_DATA;
     slice->pic_parameter_set_id = pic_parameter_set_id;
-    h264_pps_t *pps = h264_get_pps( info->pps_list, pic_parameter_set_id );
+    h264_pps_t *pps = h264_get_pps( info->pps_table, pic_parameter_set_id );
     if( !pps )
         return LSMASH_ERR_NAMELESS;
-    h264_sps_t *sps = h264_get_sps( info->sps_list, pps->seq_parameter_set_id );
+    h264_sps_t *sps = h264_get_sps( info->sps_table, pps->seq_parameter_set_id );
     if( !sps )
         return LSMASH_ERR_NAMELESS;
     slice->seq_parameter_set_id = pps->seq_parameter_set_id;
@@ -1292,10 +1265,10 @@ int h264_parse_slice
     h264_slice_info_t *slice = h264_get_slice_info( info->slice_list, slice_id );
     if( !slice )
         return LSMASH_ERR_NAMELESS;
-    h264_pps_t *pps = h264_get_pps( info->pps_list, slice->pic_parameter_set_id );
+    h264_pps_t *pps = h264_get_pps( info->pps_table, slice->pic_parameter_set_id );
     if( !pps )
         return LSMASH_ERR_NAMELESS;
-    h264_sps_t *sps = h264_get_sps( info->sps_list, pps->seq_parameter_set_id );
+    h264_sps_t *sps = h264_get_sps( info->sps_table, pps->seq_parameter_set_id );
     if( !sps )
         return LSMASH_ERR_NAMELESS;
     slice->seq_parameter_set_id = pps->seq_parameter_set_id;
@@ -1628,7 +1601,6 @@ int h264_find_au_delimit_by_nalu_type
 int h264_supplement_buffer
 (
     h264_stream_buffer_t *sb,
-    h264_access_unit_t   *au,
     uint32_t              size
 )
 {
@@ -1637,11 +1609,6 @@ int h264_supplement_buffer
         return LSMASH_ERR_MEMORY_ALLOC;
     sb->bank = bank;
     sb->rbsp = lsmash_withdraw_buffer( bank, 1 );
-    if( au && bank->number_of_buffers == 3 )
-    {
-        au->data            = lsmash_withdraw_buffer( bank, 2 );
-        au->incomplete_data = lsmash_withdraw_buffer( bank, 3 );
-    }
     return 0;
 }
 
@@ -2030,6 +1997,7 @@ int lsmash_append_h264_parameter_set
             ps->nalUnit = ps_data;
         }
         ps->nalUnitLength = ps_length;
+        ps->hash          = isom_get_ps_hash( ps_data, ps_length );
         invoke_reorder = 0;
     }
     else
@@ -2206,6 +2174,7 @@ int h264_move_pending_avcC_param
     /* No pending avcC. */
     lsmash_destroy_h264_parameter_sets( &info->avcC_param_next );
     memset( &info->avcC_param_next, 0, sizeof(lsmash_h264_specific_parameters_t) );
+    info->avcC_param_next.lengthSizeMinusOne = NALU_DEFAULT_NALU_LENGTH_SIZE - 1;
     info->avcC_pending = 0;
     return 0;
 }
@@ -2288,7 +2257,7 @@ int lsmash_setup_h264_specific_parameters_from_access_unit
             /* Increase the buffer if needed. */
             uint64_t possible_au_length = NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
             if( sb->bank->buffer_size < possible_au_length
-             && (err = h264_supplement_buffer( sb, NULL, 2 * possible_au_length )) < 0 )
+             && (err = h264_supplement_buffer( sb, 2 * possible_au_length )) < 0 )
                 return h264_parse_failed( info, err );
             /* Get the EBSP of the current NALU here.
              * AVC elemental stream defined in 14496-15 can recognize from 0 to 13, and 19 of nal_unit_type.
@@ -50,6 +50,9 @@ enum
     H264_NALU_TYPE_UNSPECIFIED31 = 31,  /* Unspecified */
 };
 
+#define H264_MAX_SPS_ID 31
+#define H264_MAX_PPS_ID 255
+
 struct lsmash_h264_parameter_sets_tag
 {
     /* Each list contains entries as isom_dcr_ps_entry_t. */
@@ -86,6 +89,8 @@ typedef struct
     uint32_t time_scale;
     uint8_t  fixed_frame_rate_flag;
     uint8_t  pic_struct_present_flag;
+    uint8_t  bitstream_restriction_flag;
+    uint32_t max_num_reorder_frames;
     h264_hrd_t hrd;
 } h264_vui_t;
 
@@ -226,10 +231,11 @@ typedef struct
 
 typedef struct
 {
-    uint8_t            *data;
-    uint8_t            *incomplete_data;
+    uint8_t            *data;               /* the completed AU, taken over by a sample */
+    uint8_t            *incomplete_data;    /* the AU under assembly */
     uint32_t            length;
     uint32_t            incomplete_length;
+    uint32_t            incomplete_alloc;   /* the allocated size of incomplete_data */
     uint32_t            number;
     h264_picture_info_t picture;
 } h264_access_unit_t;
@@ -246,9 +252,9 @@ struct h264_info_tag
 {
     lsmash_h264_specific_parameters_t avcC_param;
     lsmash_h264_specific_parameters_t avcC_param_next;
-    lsmash_entry_list_t  sps_list  [1]; /* contains entries as h264_sps_t */
-    lsmash_entry_list_t  pps_list  [1]; /* contains entries as h264_pps_t */
-    lsmash_entry_list_t  slice_list[1]; /* for slice data partition */
+    h264_sps_t          *sps_table[H264_MAX_SPS_ID + 1];    /* indexed by seq_parameter_set_id */
+    h264_pps_t          *pps_table[H264_MAX_PPS_ID + 1];    /* indexed by pic_parameter_set_id */
+    lsmash_entry_list_t  slice_list[1];                     /* for slice data partition */
     h264_sps_t           sps;           /* active SPS */
     h264_pps_t           pps;           /* active PPS */
     h264_sei_t           sei;           /* active SEI */
@@ -316,7 +322,6 @@ int h264_find_au_delimit_by_nalu_type
 int h264_supplement_buffer
 (
     h264_stream_buffer_t *buffer,
-    h264_access_unit_t   *au,
     uint32_t              size
 );
 
@@ -39,9 +39,6 @@
 #define HEVC_POC_DEBUG_PRINT 0
 
 #define HEVC_MIN_NALU_HEADER_LENGTH 2
-#define HEVC_MAX_VPS_ID             15
-#define HEVC_MAX_SPS_ID             15
-#define HEVC_MAX_PPS_ID             63
 #define HEVC_MAX_DPB_SIZE           16
 #define HVCC_CONFIGURATION_VERSION  1
 
@@ -95,12 +92,20 @@ void hevc_cleanup_parser
 {
     if( !info )
         return;
-    lsmash_remove_entries( info->vps_list, NULL );
-    lsmash_remove_entries( info->sps_list, NULL );
-    lsmash_remove_entries( info->pps_list, hevc_remove_pps );
+    for( int i = 0; i <= HEVC_MAX_VPS_ID; i++ )
+        lsmash_freep( &info->vps_table[i] );
+    for( int i = 0; i <= HEVC_MAX_SPS_ID; i++ )
+        lsmash_freep( &info->sps_table[i] );
+    for( int i = 0; i <= HEVC_MAX_PPS_ID; i++ )
+    {
+        hevc_remove_pps( info->pps_table[i] );
+        info->pps_table[i] = NULL;
+    }
     lsmash_destroy_hevc_parameter_arrays( &info->hvcC_param );
     lsmash_destroy_hevc_parameter_arrays( &info->hvcC_param_next );
     lsmash_destroy_multiple_buffers( info->buffer.bank );
+    lsmash_freep( &info->au.data );
+    lsmash_freep( &info->au.incomplete_data );
     lsmash_bits_adhoc_cleanup( info->bits );
     info->bits = NULL;
 }
@@ -116,24 +121,27 @@ int hevc_setup_parser
     info->hvcC_param     .lengthSizeMinusOne = NALU_DEFAULT_NALU_LENGTH_SIZE - 1;
     info->hvcC_param_next.lengthSizeMinusOne = NALU_DEFAULT_NALU_LENGTH_SIZE - 1;
     hevc_stream_buffer_t *sb = &info->buffer;
-    sb->bank = lsmash_create_multiple_buffers( parse_only ? 1 : 3, NALU_DEFAULT_BUFFER_SIZE );
+    sb->bank = lsmash_create_multiple_buffers( 1, NALU_DEFAULT_BUFFER_SIZE );
     if( !sb->bank )
         return LSMASH_ERR_MEMORY_ALLOC;
     sb->rbsp = lsmash_withdraw_buffer( sb->bank, 1 );
     if( !parse_only )
     {
-        info->au.data            = lsmash_withdraw_buffer( sb->bank, 2 );
-        info->au.incomplete_data = lsmash_withdraw_buffer( sb->bank, 3 );
+        info->au.incomplete_data = lsmash_malloc( NALU_DEFAULT_BUFFER_SIZE );
+        if( !info->au.incomplete_data )
+        {
+            lsmash_destroy_multiple_buffers( sb->bank );
+            return LSMASH_ERR_MEMORY_ALLOC;
+        }
+        info->au.incomplete_alloc = NALU_DEFAULT_BUFFER_SIZE;
     }
     info->bits = lsmash_bits_adhoc_create();
     if( !info->bits )
     {
+        lsmash_free( info->au.incomplete_data );
         lsmash_destroy_multiple_buffers( sb->bank );
         return LSMASH_ERR_MEMORY_ALLOC;
     }
-    lsmash_init_entry_list( info->vps_list );
-    lsmash_init_entry_list( info->sps_list );
-    lsmash_init_entry_list( info->pps_list );
     info->prev_nalu_type = HEVC_NALU_TYPE_UNKNOWN;
     return 0;
 }
@@ -211,23 +219,7 @@ uint64_t hevc_find_next_start_code
         *start_code_length = long_start_code ? NALU_LONG_START_CODE_LENGTH : NALU_SHORT_START_CODE_LENGTH;
         uint64_t distance = *start_code_length + nuh->length;
         /* Find the start code of the next NALU and get the distance from the start code of the latest NALU. */
-        if( !lsmash_bs_is_end( bs, distance + NALU_SHORT_START_CODE_LENGTH ) )
-        {
-            uint32_t sync_bytes = lsmash_bs_show_be24( bs, distance );
-            while( 0x000001 != sync_bytes )
-            {
-                if( lsmash_bs_is_end( bs, ++distance + NALU_SHORT_START_CODE_LENGTH ) )
-                {
-                    distance = lsmash_bs_get_remaining_buffer_size( bs );
-                    break;
-                }
-                sync_bytes <<= 8;
-                sync_bytes  |= lsmash_bs_show_byte( bs, distance + NALU_SHORT_START_CODE_LENGTH - 1 );
-                sync_bytes  &= 0xFFFFFF;
-            }
-        }
-        else
-            distance = lsmash_bs_get_remaining_buffer_size( bs );
+        distance = nalu_get_distance_to_next_start_code( bs, distance );
         /* Any NALU has no consecutive zero bytes at the end. */
         while( 0x00 == lsmash_bs_show_byte( bs, distance - 1 ) )
         {
@@ -258,86 +250,59 @@ uint64_t hevc_find_next_start_code
 
 static hevc_vps_t *hevc_get_vps
 (
-    lsmash_entry_list_t *vps_list,
-    uint8_t              vps_id
+    hevc_vps_t **vps_table,
+    uint8_t      vps_id
 )
 {
-    if( !vps_list || vps_id > HEVC_MAX_VPS_ID )
+    if( vps_id > HEVC_MAX_VPS_ID )
         return NULL;
-    for( lsmash_entry_t *entry = vps_list->head; entry; entry = entry->next )
+    if( !vps_table[vps_id] )
     {
-        hevc_vps_t *vps = (hevc_vps_t *)entry->data;
+        hevc_vps_t *vps = lsmash_malloc_zero( sizeof(hevc_vps_t) );
         if( !vps )
             return NULL;
-        if( vps->video_parameter_set_id == vps_id )
-            return vps;
+        vps->video_parameter_set_id = vps_id;
+        vps_table[vps_id] = vps;
     }
-    hevc_vps_t *vps = lsmash_malloc_zero( sizeof(hevc_vps_t) );
-    if( !vps )
-        return NULL;
-    vps->video_parameter_set_id = vps_id;
-    if( lsmash_add_entry( vps_list, vps ) < 0 )
-    {
-        lsmash_free( vps );
-        return NULL;
-    }
-    return vps;
+    return vps_table[vps_id];
 }
 
 static hevc_sps_t *hevc_get_sps
 (
-    lsmash_entry_list_t *sps_list,
-    uint8_t              sps_id
+    hevc_sps_t **sps_table,
+    uint8_t      sps_id
 )
 {
-    if( !sps_list || sps_id > HEVC_MAX_SPS_ID )
+    if( sps_id > HEVC_MAX_SPS_ID )
         return NULL;
-    for( lsmash_entry_t *entry = sps_list->head; entry; entry = entry->next )
+    if( !sps_table[sps_id] )
     {
-        hevc_sps_t *sps = (hevc_sps_t *)entry->data;
+        hevc_sps_t *sps = lsmash_malloc_zero( sizeof(hevc_sps_t) );
         if( !sps )
             return NULL;
-        if( sps->seq_parameter_set_id == sps_id )
-            return sps;
-    }
-    hevc_sps_t *sps = lsmash_malloc_zero( sizeof(hevc_sps_t) );
-    if( !sps )
-        return NULL;
-    sps->seq_parameter_set_id = sps_id;
-    if( lsmash_add_entry( sps_list, sps ) < 0 )
-    {
-        lsmash_free( sps );
-        return NULL;
+        sps->seq_parameter_set_id = sps_id;
+        sps_table[sps_id] = sps;
     }
-    return sps;
+    return sps_table[sps_id];
 }
 
 static hevc_pps_t *hevc_get_pps
 (
-    lsmash_entry_list_t *pps_list,
-    uint8_t              pps_id
+    hevc_pps_t **pps_table,
+    uint8_t      pps_id
 )
 {
-    if( !pps_list || pps_id > HEVC_MAX_PPS_ID )
+    if( pps_id > HEVC_MAX_PPS_ID )
         return NULL;
-    for( lsmash_entry_t *entry = pps_list->head; entry; entry = entry->next )
+    if( !pps_table[pps_id] )
     {
-        hevc_pps_t *pps = (hevc_pps_t *)entry->data;
+        hevc_pps_t *pps = lsmash_malloc_zero( sizeof(hevc_pps_t) );
         if( !pps )
             return NULL;
-        if( pps->pic_parameter_set_id == pps_id )
-            return pps;
+        pps->pic_parameter_set_id = pps_id;
+        pps_table[pps_id] = pps;
     }
-    hevc_pps_t *pps = lsmash_malloc_zero( sizeof(hevc_pps_t) );
-    if( !pps )
-        return NULL;
-    pps->pic_parameter_set_id = pps_id;
-    if( lsmash_add_entry( pps_list, pps ) < 0 )
-    {
-        lsmash_free( pps );
-        return NULL;
-    }
-    return pps;
+    return pps_table[pps_id];
 }
 
 int hevc_calculate_poc
@@ -350,10 +315,10 @@ int hevc_calculate_poc
 #if HEVC_POC_DEBUG_PRINT
     fprintf( stderr, "PictureOrderCount\n" );
 #endif
-    hevc_pps_t *pps = hevc_get_pps( info->pps_list, picture->pic_parameter_set_id );
+    hevc_pps_t *pps = hevc_get_pps( info->pps_table, picture->pic_parameter_set_id );
     if( !pps )
         return LSMASH_ERR_NAMELESS;
-    hevc_sps_t *sps = hevc_get_sps( info->sps_list, pps->seq_parameter_set_id );
+    hevc_sps_t *sps = hevc_get_sps( info->sps_table, pps->seq_parameter_set_id );
     if( !sps )
         return LSMASH_ERR_NAMELESS;
     /* 8.3.1 Decoding process for picture order count
@@ -416,7 +381,7 @@ static inline int hevc_activate_vps
     uint8_t      video_parameter_set_id
 )
 {
-    hevc_vps_t *vps = hevc_get_vps( info->vps_list, video_parameter_set_id );
+    hevc_vps_t *vps = hevc_get_vps( info->vps_table, video_parameter_set_id );
     if( !vps )
         return LSMASH_ERR_NAMELESS;
     info->vps = *vps;
@@ -429,7 +394,7 @@ static inline int hevc_activate_sps
     uint8_t      seq_parameter_set_id
 )
 {
-    hevc_sps_t *sps = hevc_get_sps( info->sps_list, seq_parameter_set_id );
+    hevc_sps_t *sps = hevc_get_sps( info->sps_table, seq_parameter_set_id );
     if( !sps )
         return LSMASH_ERR_NAMELESS;
     info->sps = *sps;
@@ -753,7 +718,7 @@ int hevc_parse_vps
         int err = hevc_parse_vps_minimally( bits, &min_vps, rbsp_buffer, ebsp, ebsp_size );
         if( err < 0 )
             return err;
-        vps = hevc_get_vps( info->vps_list, min_vps.video_parameter_set_id );
+        vps = hevc_get_vps( info->vps_table, min_vps.video_parameter_set_id );
         if( !vps )
             return LSMASH_ERR_NAMELESS;
         *vps = min_vps;
@@ -834,7 +799,7 @@ static int hevc_parse_sps_minimally
     for( int i = sub_layer_ordering_info_present_flag ? 0 : sps->max_sub_layers_minus1; i <= sps->max_sub_layers_minus1; i++ )
     {
         nalu_get_exp_golomb_ue( bits );  /* max_dec_pic_buffering_minus1[i] */
-        nalu_get_exp_golomb_ue( bits );  /* max_num_reorder_pics        [i] */
+        sps->max_num_reorder_pics = nalu_get_exp_golomb_ue( bits );
         nalu_get_exp_golomb_ue( bits );  /* max_latency_increase_plus1  [i] */
     }
     uint64_t log2_min_luma_coding_block_size_minus3   = nalu_get_exp_golomb_ue( bits );
@@ -1031,7 +996,7 @@ int hevc_parse_sps
         int err = hevc_parse_sps_minimally( bits, &min_sps, rbsp_buffer, ebsp, ebsp_size );
         if( err < 0 )
             return err;
-        sps = hevc_get_sps( info->sps_list, min_sps.seq_parameter_set_id );
+        sps = hevc_get_sps( info->sps_table, min_sps.seq_parameter_set_id );
         if( !sps )
             return LSMASH_ERR_NAMELESS;
         *sps = min_sps;
@@ -1131,7 +1096,7 @@ int hevc_parse_pps
         hevc_pps_t min_pps;
         if( (err = hevc_parse_pps_minimally( bits, &min_pps, rbsp_buffer, ebsp, ebsp_size )) < 0 )
             return err;
-        pps = hevc_get_pps( info->pps_list, min_pps.pic_parameter_set_id );
+        pps = hevc_get_pps( info->pps_table, min_pps.pic_parameter_set_id );
         if( !pps )
             return LSMASH_ERR_NAMELESS;
         memcpy( pps, &min_pps, SIZEOF_PPS_EXCLUDING_HEAP );
@@ -1353,11 +1318,11 @@ int hevc_parse_slice_segment_header
         lsmash_bits_get( bits, 1 );     /* no_output_of_prior_pics_flag */
     slice->pic_parameter_set_id = nalu_get_exp_golomb_ue( bits );
     /* Get PPS by slice_pic_parameter_set_id. */
-    hevc_pps_t *pps = hevc_get_pps( info->pps_list, slice->pic_parameter_set_id );
+    hevc_pps_t *pps = hevc_get_pps( info->pps_table, slice->pic_parameter_set_id );
     if( !pps )
         return LSMASH_ERR_NAMELESS;
     /* Get SPS by pps_seq_parameter_set_id. */
-    hevc_sps_t *sps = hevc_get_sps( info->sps_list, pps->seq_parameter_set_id );
+    hevc_sps_t *sps = hevc_get_sps( info->sps_table, pps->seq_parameter_set_id );
     if( !sps )
         return LSMASH_ERR_NAMELESS;
     slice->video_parameter_set_id = sps->video_parameter_set_id;
@@ -1739,10 +1704,10 @@ int hevc_find_au_delimit_by_slice_info
      *     ||         CtbAddrRsToTs[ slice->segment_address ]   <=         CtbAddrRsToTs[ prev_slice->segment_address ] )
      *        return 1;
      */
-    hevc_pps_t *prev_pps = hevc_get_pps( info->pps_list, prev_slice->pic_parameter_set_id );
+    hevc_pps_t *prev_pps = hevc_get_pps( info->pps_table, prev_slice->pic_parameter_set_id );
     if( !prev_pps )
         return 0;
-    hevc_sps_t *prev_sps = hevc_get_sps( info->sps_list, prev_pps->seq_parameter_set_id );
+    hevc_sps_t *prev_sps = hevc_get_sps( info->sps_table, prev_pps->seq_parameter_set_id );
     if( !prev_sps )
         return 0;
     uint64_t currTileId;
@@ -1790,7 +1755,6 @@ int hevc_find_au_delimit_by_nalu_type
 int hevc_supplement_buffer
 (
     hevc_stream_buffer_t *sb,
-    hevc_access_unit_t   *au,
     uint32_t              size
 )
 {
@@ -1799,11 +1763,6 @@ int hevc_supplement_buffer
         return LSMASH_ERR_MEMORY_ALLOC;
     sb->bank = bank;
     sb->rbsp = lsmash_withdraw_buffer( bank, 1 );
-    if( au && bank->number_of_buffers == 3 )
-    {
-        au->data            = lsmash_withdraw_buffer( bank, 2 );
-        au->incomplete_data = lsmash_withdraw_buffer( bank, 3 );
-    }
     return 0;
 }
 
@@ -2335,6 +2294,7 @@ int lsmash_append_hevc_dcr_nalu
             ps->nalUnit = ps_data;
         }
         ps->nalUnitLength = ps_length;
+        ps->hash          = isom_get_ps_hash( ps_data, ps_length );
         invoke_reorder = 0;
     }
     else
@@ -2669,6 +2629,7 @@ int hevc_move_pending_hvcC_param
     /* No pending hvcC. */
     lsmash_destroy_hevc_parameter_arrays( &info->hvcC_param_next );
     memset( &info->hvcC_param_next, 0, sizeof(lsmash_hevc_specific_parameters_t) );
+    info->hvcC_param_next.lengthSizeMinusOne = NALU_DEFAULT_NALU_LENGTH_SIZE - 1;
     info->hvcC_pending = 0;
     return 0;
 }
@@ -2785,7 +2746,7 @@ int lsmash_setup_hevc_specific_parameters_from_access_unit
             /* Increase the buffer if needed. */
             uint64_t possible_au_length = NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
             if( sb->bank->buffer_size < possible_au_length
-             && (err = hevc_supplement_buffer( sb, NULL, 2 * possible_au_length )) < 0 )
+             && (err = hevc_supplement_buffer( sb, 2 * possible_au_length )) < 0 )
                 return hevc_parse_failed( info, err );
             /* Get the EBSP of the current NALU here. */
             uint8_t *nalu = lsmash_bs_get_buffer_data( bs ) + start_code_length;
@@ -60,6 +60,10 @@ enum
     HEVC_NALU_TYPE_UNKNOWN        = 64
 };
 
+#define HEVC_MAX_VPS_ID             15
+#define HEVC_MAX_SPS_ID             15
+#define HEVC_MAX_PPS_ID             63
+
 typedef struct
 {
     uint8_t             array_completeness;
@@ -180,6 +184,7 @@ typedef struct
     uint8_t       long_term_ref_pics_present_flag;
     uint8_t       num_long_term_ref_pics_sps;
     uint8_t       temporal_mvp_enabled_flag;
+    uint32_t      max_num_reorder_pics;     /* for HighestTid equal to sps_max_sub_layers_minus1 */
     uint32_t      cropped_width;
     uint32_t      cropped_height;
     uint32_t      PicWidthInCtbsY;
@@ -202,7 +207,7 @@ typedef struct
     uint8_t   entropy_coding_sync_enabled_flag;
     uint32_t  num_tile_columns_minus1;
     uint32_t  num_tile_rows_minus1;
-#define SIZEOF_PPS_EXCLUDING_HEAP (sizeof(hevc_pps_t) - offsetof( hevc_pps_t, col_alloc_size ))
+#define SIZEOF_PPS_EXCLUDING_HEAP offsetof( hevc_pps_t, col_alloc_size )
     size_t    col_alloc_size;
     size_t    row_alloc_size;
     uint32_t *colWidth;
@@ -288,10 +293,11 @@ typedef struct
 /* Access unit */
 typedef struct
 {
-    uint8_t            *data;
-    uint8_t            *incomplete_data;
+    uint8_t            *data;               /* the completed AU, taken over by a sample */
+    uint8_t            *incomplete_data;    /* the AU under assembly */
     uint32_t            length;
     uint32_t            incomplete_length;
+    uint32_t            incomplete_alloc;   /* the allocated size of incomplete_data */
     uint32_t            number;
     uint8_t             TemporalId;
     hevc_picture_info_t picture;
@@ -310,9 +316,9 @@ struct hevc_info_tag
     lsmash_hevc_specific_parameters_t hvcC_param;
     lsmash_hevc_specific_parameters_t hvcC_param_next;
     hevc_nalu_header_t   nuh;
-    lsmash_entry_list_t  vps_list[1];
-    lsmash_entry_list_t  sps_list[1];
-    lsmash_entry_list_t  pps_list[1];
+    hevc_vps_t          *vps_table[HEVC_MAX_VPS_ID + 1];    /* indexed by video_parameter_set_id */
+    hevc_sps_t          *sps_table[HEVC_MAX_SPS_ID + 1];    /* indexed by seq_parameter_set_id */
+    hevc_pps_t          *pps_table[HEVC_MAX_PPS_ID + 1];    /* indexed by pic_parameter_set_id */
     hevc_vps_t           vps;           /* active VPS */
     hevc_sps_t           sps;           /* active SPS */
     hevc_pps_t           pps;           /* active PPS */
@@ -385,7 +391,6 @@ int hevc_find_au_delimit_by_nalu_type
 int hevc_supplement_buffer
 (
     hevc_stream_buffer_t *hb,
-    hevc_access_unit_t   *au,
     uint32_t              size
 );
 
@@ -20,6 +20,10 @@
 
 /* This file is available under an ISC license. */
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #define NALU_DEFAULT_BUFFER_SIZE      (1<<16)
 #define NALU_DEFAULT_NALU_LENGTH_SIZE 4     /* We always use 4 bytes length. */
 #define NALU_SHORT_START_CODE_LENGTH  3
@@ -31,10 +35,11 @@ static inline uint64_t nalu_get_codeNum
     lsmash_bits_t *bits
 )
 {
-    uint32_t leadingZeroBits = 0;
-    for( int b = 0; !b; leadingZeroBits++ )
-        b = lsmash_bits_get( bits, 1 );
-    --leadingZeroBits;
+    uint32_t leadingZeroBits = lsmash_bits_get_leading_zeros( bits );
+    if( leadingZeroBits == 0 )
+        return 0;
+    if( leadingZeroBits > 63 )
+        return UINT64_MAX;  /* broken */
     return ((uint64_t)1 << leadingZeroBits) - 1 + lsmash_bits_get( bits, leadingZeroBits );
 }
 
@@ -74,6 +79,47 @@ static inline uint64_t nalu_get_exp_golomb_se
     return nalu_decode_exp_golomb_se( codeNum );
 }
 
+/* Return the pointer to the first three-byte sequence 0x0000XX lying in [buf, buf_end), where XX is a given non-zero byte.
+ * Return buf_end if no such sequence is found. */
+static inline uint8_t *nalu_search_three_byte_code
+(
+    uint8_t *buf,
+    uint8_t *buf_end,
+    uint8_t  last_byte
+)
+{
+    if( buf_end - buf < NALU_SHORT_START_CODE_LENGTH )
+        return buf_end;
+#ifdef __SSE2__
+    /* Skip 16 bytes at once while any sequence doesn't begin in them. */
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i last = _mm_set1_epi8( last_byte );
+    while( buf_end - buf >= 16 + NALU_SHORT_START_CODE_LENGTH - 1 )
+    {
+        __m128i b0 = _mm_loadu_si128( (const __m128i *)(buf    ) );
+        __m128i b1 = _mm_loadu_si128( (const __m128i *)(buf + 1) );
+        __m128i b2 = _mm_loadu_si128( (const __m128i *)(buf + 2) );
+        __m128i sc = _mm_and_si128( _mm_and_si128( _mm_cmpeq_epi8( b0, zero ),
+                                                   _mm_cmpeq_epi8( b1, zero ) ),
+                                                   _mm_cmpeq_epi8( b2, last ) );
+        if( _mm_movemask_epi8( sc ) )
+            break;
+        buf += 16;
+    }
+#endif
+    /* Check the third byte of a candidate first since it is rarely either 0x00 or the given byte in coded data. */
+    for( uint8_t *p = buf + 2; p < buf_end; )
+        if( p[0] && p[0] != last_byte )
+            p += 3;
+        else if( p[-1] )
+            p += 2;
+        else if( p[-2] || p[0] != last_byte )
+            ++p;
+        else
+            return p - 2;
+    return buf_end;
+}
+
 /* Convert EBSP (Encapsulated Byte Sequence Packets) to RBSP (Raw Byte Sequence Packets). */
 static inline uint8_t *nalu_remove_emulation_prevention
 (
@@ -84,15 +130,19 @@ static inline uint8_t *nalu_remove_emulation_prevention
 {
     uint8_t *src_end = src + src_length;
     while( src < src_end )
-        if( ((src + 2) < src_end) && !src[0] && !src[1] && (src[2] == 0x03) )
+    {
+        /* Copy the bytes preceding the next emulation_prevention_three_byte at once. */
+        uint8_t *epb = nalu_search_three_byte_code( src, src_end, 0x03 );
+        if( epb == src_end )
         {
-            /* 0x000003 -> 0x0000 */
-            *dst++ = *src++;
-            *dst++ = *src++;
-            src++;  /* Skip emulation_prevention_three_byte (0x03). */
+            memcpy( dst, src, src_end - src );
+            return dst + (src_end - src);
         }
-        else
-            *dst++ = *src++;
+        /* 0x000003 -> 0x0000 */
+        memcpy( dst, src, epb + 2 - src );
+        dst += epb + 2 - src;
+        src  = epb + 3; /* Skip emulation_prevention_three_byte (0x03). */
+    }
     return dst;
 }
 
@@ -179,6 +229,7 @@ static inline int nalu_check_same_ps_existence
     uint32_t             ps_length
 )
 {
+    uint32_t hash = isom_get_ps_hash( ps_data, ps_length );
     for( lsmash_entry_t *entry = ps_list->head; entry; entry = entry->next )
     {
         isom_dcr_ps_entry_t *ps = (isom_dcr_ps_entry_t *)entry->data;
@@ -186,7 +237,7 @@ static inline int nalu_check_same_ps_existence
             return LSMASH_ERR_NAMELESS;
         if( ps->unused )
             continue;
-        if( ps->nalUnitLength == ps_length && !memcmp( ps->nalUnit, ps_data, ps_length ) )
+        if( ps->hash == hash && ps->nalUnitLength == ps_length && !memcmp( ps->nalUnit, ps_data, ps_length ) )
             return 1;   /* The same parameter set already exists. */
     }
     return 0;
@@ -216,6 +267,8 @@ static inline int nalu_get_dcr_ps
             lsmash_remove_entries( list, isom_remove_dcr_ps );
             return LSMASH_ERR_NAMELESS;
         }
+        data->unused        = 0;
+        data->hash          = isom_get_ps_hash( data->nalUnit, data->nalUnitLength );
     }
     return 0;
 }
@@ -229,6 +282,29 @@ static inline int nalu_check_next_short_start_code
     return ((buf_pos + 2) < buf_end) && !buf_pos[0] && !buf_pos[1] && (buf_pos[2] == 0x01);
 }
 
+/* Return the distance from the current position of the buffer to the first short start code found at or after
+ * a given offset. The start code must be followed by at least one byte.
+ * Return the remaining size of the stream if no start code is found. */
+static inline uint64_t nalu_get_distance_to_next_start_code
+(
+    lsmash_bs_t *bs,
+    uint64_t     offset
+)
+{
+    /* Search over the data on the buffer at once, and then refill the buffer if no start code is found. */
+    while( !lsmash_bs_is_end( bs, offset + NALU_SHORT_START_CODE_LENGTH ) )
+    {
+        uint8_t *data     = lsmash_bs_get_buffer_data( bs );
+        uint64_t size     = lsmash_bs_get_remaining_buffer_size( bs ) - 1;
+        uint8_t *sc_found = nalu_search_three_byte_code( data + offset, data + size, 0x01 );
+        if( sc_found < data + size )
+            return sc_found - data;
+        /* Any start code may straddle the end of the data on the buffer. */
+        offset = LSMASH_MAX( offset, size - NALU_SHORT_START_CODE_LENGTH + 1 );
+    }
+    return lsmash_bs_get_remaining_buffer_size( bs );
+}
+
 /* Return the offset from the beginning of stream if a start code is found.
  * Return NALU_NO_START_CODE_FOUND otherwise. */
 static inline uint64_t nalu_find_first_start_code
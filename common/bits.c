@@ -118,19 +118,57 @@ void lsmash_bits_put( lsmash_bits_t *bits, uint32_t width, uint64_t value )
     }
 }
 
+/* Load the next 64 bits i.e. the residual bits of the cache followed by the bytes on the buffer.
+ * Return 0 if the buffer doesn't have enough bytes, then the caller shall read bits in the usual way. */
+static inline int lsmash_bits_load_window( lsmash_bits_t *bits, uint64_t *window )
+{
+    lsmash_bs_t *bs = bits->bs;
+    if( bs->error || lsmash_bs_get_remaining_buffer_size( bs ) < sizeof(uint64_t) )
+        return 0;
+    uint64_t bytes = LSMASH_GET_BE64( lsmash_bs_get_buffer_data( bs ) );
+    if( bits->store )
+        *window = ((uint64_t)lsmash_bits_mask_lsb8( bits->cache, bits->store ) << (64 - bits->store))
+                | (bytes >> bits->store);
+    else
+        *window = bytes;
+    return 1;
+}
+
+/* Consume 'width' bits, which shall not exceed the residual bits of the cache plus 56 bits, loaded by lsmash_bits_load_window(). */
+static inline void lsmash_bits_consume_window( lsmash_bits_t *bits, uint32_t width )
+{
+    if( bits->store >= width )
+    {
+        bits->store -= width;
+        return;
+    }
+    lsmash_bs_t *bs = bits->bs;
+    uint32_t consumed = (width - bits->store + BITS_IN_BYTE - 1) / BITS_IN_BYTE;
+    bits->cache = lsmash_bs_get_buffer_data( bs )[consumed - 1];
+    bits->store = bits->store + consumed * BITS_IN_BYTE - width;
+    bs->buffer.pos   += consumed;
+    bs->buffer.count += consumed;
+}
+
 uint64_t lsmash_bits_get( lsmash_bits_t *bits, uint32_t width )
 {
     debug_if( !bits || !width )
         return 0;
+    if( bits->store >= width )
+    {
+        /* cache contains all of bits required. */
+        bits->store -= width;
+        return lsmash_bits_mask_lsb8( bits->cache >> bits->store, width );
+    }
     uint64_t value = 0;
+    if( width <= 56 && lsmash_bits_load_window( bits, &value ) )
+    {
+        /* Take the bits from the 64-bit window at once. */
+        lsmash_bits_consume_window( bits, width );
+        return value >> (64 - width);
+    }
     if( bits->store )
     {
-        if( bits->store >= width )
-        {
-            /* cache contains all of bits required. */
-            bits->store -= width;
-            return lsmash_bits_mask_lsb8( bits->cache >> bits->store, width );
-        }
         /* fill value's leading bits with cache's residual. */
         value = lsmash_bits_mask_lsb8( bits->cache, bits->store );
         width -= bits->store;
@@ -156,6 +194,25 @@ uint64_t lsmash_bits_get( lsmash_bits_t *bits, uint32_t width )
     return value;
 }
 
+/* Skip the leading zero bits and the following bit 1, and return the number of the zero bits.
+ * This is the prefix of Exp-Golomb codes. */
+uint32_t lsmash_bits_get_leading_zeros( lsmash_bits_t *bits )
+{
+    debug_if( !bits )
+        return 0;
+    uint64_t window;
+    if( lsmash_bits_load_window( bits, &window ) && (window >> 8) )
+    {
+        uint32_t leading_zeros = lsmash_count_leading_zeros64( window );
+        lsmash_bits_consume_window( bits, leading_zeros + 1 );
+        return leading_zeros;
+    }
+    uint32_t leading_zeros = 0;
+    while( !lsmash_bits_get( bits, 1 ) && !bits->bs->eob && !bits->bs->error )
+        ++leading_zeros;
+    return leading_zeros;
+}
+
 void *lsmash_bits_export_data( lsmash_bits_t *bits, uint32_t *length )
 {
     lsmash_bits_put_align( bits );
@@ -25,6 +25,10 @@
 #include <string.h>
 #include <limits.h>
 
+#ifdef LSMASH_THREADS_ENABLED
+#include <pthread.h>
+#endif
+
 lsmash_bs_t *lsmash_bs_create( void )
 {
     lsmash_bs_t *bs = lsmash_malloc_zero( sizeof(lsmash_bs_t) );
@@ -40,16 +44,22 @@ static void bs_buffer_free( lsmash_bs_t *bs )
 {
     if( bs->buffer.internal )
         lsmash_free( bs->buffer.data );
+    else if( bs->buffer.mapped )
+        lsmash_unmap_file( bs->buffer.data, bs->buffer.alloc );
+    bs->buffer.mapped = 0;
     bs->buffer.data  = NULL;
     bs->buffer.alloc = 0;
     bs->buffer.store = 0;
     bs->buffer.pos   = 0;
 }
 
+static void bs_async_stop( lsmash_bs_t *bs );
+
 void lsmash_bs_cleanup( lsmash_bs_t *bs )
 {
     if( !bs )
         return;
+    bs_async_stop( bs );
     bs_buffer_free( bs );
     lsmash_free( bs );
 }
@@ -79,10 +89,51 @@ int lsmash_bs_set_empty_stream( lsmash_bs_t *bs, uint8_t *data, size_t size )
     return 0;
 }
 
+/* Replace the buffer with the memory mapping of the whole stream opened by lsmash_open_file().
+ * The stream itself is never read after this, and any seek and read is done on the mapping.
+ * Return 0 if successful.
+ * Return a negative value otherwise, and then the bytestream is left unchanged. */
+int lsmash_bs_map_stream( lsmash_bs_t *bs )
+{
+    if( !bs || !bs->stream || bs->unseekable || bs->read != lsmash_fread_wrapper )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    int64_t pos = bs->seek( bs->stream, 0, SEEK_CUR );
+    if( pos < 0 )
+        return LSMASH_ERR_NAMELESS;
+    uint64_t size;
+    uint8_t *data = lsmash_map_file( (FILE *)bs->stream, &size );
+    if( !data )
+        return LSMASH_ERR_NAMELESS;
+    if( (uint64_t)pos > size )
+    {
+        lsmash_unmap_file( data, size );
+        return LSMASH_ERR_NAMELESS;
+    }
+    bs_buffer_free( bs );
+    bs->eof     = 1;            /* nothing to read from the stream any more */
+    bs->eob     = 0;
+    bs->written = size;
+    bs->offset  = size;         /* behave as if the pointer of the stream is at the end */
+    bs->buffer.unseekable = 0;
+    bs->buffer.internal   = 0;
+    bs->buffer.mapped     = 1;
+    bs->buffer.data       = data;
+    bs->buffer.store      = size;
+    bs->buffer.alloc      = size;
+    bs->buffer.pos        = pos;
+    return 0;
+}
+
 void lsmash_bs_empty( lsmash_bs_t *bs )
 {
     if( !bs )
         return;
+    if( bs->buffer.mapped )
+    {
+        /* The mapping is always valid. Just discard the data before the current position. */
+        bs->buffer.pos = bs->buffer.store;
+        return;
+    }
     if( bs->buffer.data )
         memset( bs->buffer.data, 0, bs->buffer.alloc );
     bs->buffer.store = 0;
@@ -156,6 +207,10 @@ int64_t lsmash_bs_write_seek( lsmash_bs_t *bs, int64_t offset, int whence )
         return LSMASH_ERR_NAMELESS;
     if( whence != SEEK_SET && whence != SEEK_CUR && whence != SEEK_END )
         return LSMASH_ERR_FUNCTION_PARAM;
+    /* Any queued data shall be written before the seek. */
+    int err = lsmash_bs_wait_async_write( bs );
+    if( err < 0 )
+        return err;
     /* Try to seek the stream. */
     int64_t ret = bs->seek( bs->stream, offset, whence );
     if( ret < 0 )
@@ -180,7 +235,7 @@ int64_t lsmash_bs_read_seek( lsmash_bs_t *bs, int64_t offset, int whence )
         uint64_t dst_offset = bs_estimate_seek_offset( bs, offset, whence );
         uint64_t offset_s = bs->offset - bs->buffer.store;
         uint64_t offset_e = bs->offset;
-        if( bs->unseekable || (dst_offset >= offset_s && dst_offset < offset_e) )
+        if( bs->unseekable || bs->buffer.mapped || (dst_offset >= offset_s && dst_offset < offset_e) )
         {
             /* OK, we can. So, seek on the buffer. */
             bs->buffer.pos = dst_offset - offset_s;
@@ -190,6 +245,9 @@ int64_t lsmash_bs_read_seek( lsmash_bs_t *bs, int64_t offset, int whence )
     }
     if( bs->unseekable )
         return LSMASH_ERR_NAMELESS;
+    int err = lsmash_bs_wait_async_write( bs );
+    if( err < 0 )
+        return err;
     /* Try to seek the stream. */
     int64_t ret = bs->seek( bs->stream, offset, whence );
     if( ret < 0 )
@@ -214,6 +272,264 @@ static void bs_dispose_past_data( lsmash_bs_t *bs )
     bs->buffer.pos   = 0;
 }
 
+/*---- asynchronous output ----*/
+#ifdef LSMASH_THREADS_ENABLED
+typedef struct
+{
+    uint8_t *data;                      /* the data to be written */
+    size_t   size;                      /* the number of bytes to be written */
+    uint8_t *buffer;                    /* the buffer owned by this slot, which is exchanged for the buffer of the bytestream */
+    size_t   alloc;
+    void   (*release)( void *opaque );  /* called when written if 'data' is not 'buffer' but refers to the data of the caller */
+    void    *opaque;
+} bs_async_slot_t;
+
+struct lsmash_bs_async_tag
+{
+    pthread_t          thread;
+    pthread_mutex_t    mutex;
+    pthread_cond_t     filled;      /* signaled when a slot is queued or the writer shall quit */
+    pthread_cond_t     drained;     /* signaled when a queued slot has been written */
+    bs_async_slot_t   *slot;        /* the ring of queued buffers */
+    uint32_t           depth;       /* the number of slots */
+    uint32_t           head;        /* the index of the slot to be written next */
+    uint32_t           count;       /* the number of queued slots */
+    int                error;
+    int                quit;
+    void              *stream;
+    int              (*write)( void *opaque, uint8_t *buf, int size );
+    lsmash_bs_async_t *next;        /* the next running writer */
+};
+
+/* The running writers, so that the output to a stream can be completed before it is closed
+ * even if the bytestream writing into it has not been cleaned up yet. */
+static pthread_mutex_t    bs_async_running_mutex = PTHREAD_MUTEX_INITIALIZER;
+static lsmash_bs_async_t *bs_async_running;
+
+static void *bs_async_writer( void *arg )
+{
+    lsmash_bs_async_t *async = (lsmash_bs_async_t *)arg;
+    pthread_mutex_lock( &async->mutex );
+    while( 1 )
+    {
+        while( async->count == 0 && !async->quit )
+            pthread_cond_wait( &async->filled, &async->mutex );
+        if( async->count == 0 )
+            break;
+        /* The caller never touches queued slots, so write without the lock. */
+        bs_async_slot_t *slot = &async->slot[ async->head ];
+        int error = async->error;
+        pthread_mutex_unlock( &async->mutex );
+        if( !error && async->write( async->stream, slot->data, slot->size ) != slot->size )
+            error = 1;
+        if( slot->release )
+        {
+            slot->release( slot->opaque );
+            slot->release = NULL;
+        }
+        slot->data = NULL;
+        pthread_mutex_lock( &async->mutex );
+        async->error |= error;
+        async->head = (async->head + 1) % async->depth;
+        -- async->count;
+        pthread_cond_signal( &async->drained );
+    }
+    pthread_mutex_unlock( &async->mutex );
+    return NULL;
+}
+
+/* Get the slot to be queued next. Block while all the slots are queued.
+ * Return NULL with the lock released if the writer has failed, otherwise return with the lock held. */
+static bs_async_slot_t *bs_async_get_free_slot( lsmash_bs_async_t *async )
+{
+    pthread_mutex_lock( &async->mutex );
+    while( async->count == async->depth && !async->error )
+        pthread_cond_wait( &async->drained, &async->mutex );
+    if( async->error )
+    {
+        pthread_mutex_unlock( &async->mutex );
+        return NULL;
+    }
+    return &async->slot[ (async->head + async->count) % async->depth ];
+}
+
+static void bs_async_queue_slot( lsmash_bs_async_t *async )
+{
+    ++ async->count;
+    pthread_cond_signal( &async->filled );
+    pthread_mutex_unlock( &async->mutex );
+}
+
+/* Hand the buffer over to the writer thread in exchange for a free one. */
+static int bs_async_queue( lsmash_bs_t *bs )
+{
+    lsmash_bs_async_t *async = bs->async;
+    bs_async_slot_t *slot = bs_async_get_free_slot( async );
+    if( !slot )
+        return LSMASH_ERR_NAMELESS;
+    uint8_t *free_data  = slot->buffer;
+    size_t   free_alloc = slot->alloc;
+    slot->buffer = bs->buffer.data;
+    slot->alloc  = bs->buffer.alloc;
+    slot->data   = bs->buffer.data;
+    slot->size   = bs->buffer.store;
+    bs_async_queue_slot( async );
+    bs->buffer.data  = free_data;
+    bs->buffer.alloc = free_alloc;
+    return 0;
+}
+
+/* Hand the data of the caller over to the writer thread without copying it. */
+static int bs_async_queue_data( lsmash_bs_t *bs, uint8_t *buf, size_t size, void (*release)( void *opaque ), void *opaque )
+{
+    lsmash_bs_async_t *async = bs->async;
+    bs_async_slot_t *slot = bs_async_get_free_slot( async );
+    if( !slot )
+        return LSMASH_ERR_NAMELESS;
+    slot->data    = buf;
+    slot->size    = size;
+    slot->release = release;
+    slot->opaque  = opaque;
+    bs_async_queue_slot( async );
+    return 0;
+}
+
+static int bs_async_wait( lsmash_bs_async_t *async )
+{
+    pthread_mutex_lock( &async->mutex );
+    while( async->count )
+        pthread_cond_wait( &async->drained, &async->mutex );
+    int error = async->error;
+    pthread_mutex_unlock( &async->mutex );
+    return error ? LSMASH_ERR_NAMELESS : 0;
+}
+
+int lsmash_bs_wait_async_write( lsmash_bs_t *bs )
+{
+    if( !bs || !bs->async )
+        return 0;
+    int err = bs_async_wait( bs->async );
+    if( err < 0 )
+        bs->error = 1;
+    return err;
+}
+
+int lsmash_bs_wait_async_write_on_stream( void *stream )
+{
+    int err = 0;
+    pthread_mutex_lock( &bs_async_running_mutex );
+    for( lsmash_bs_async_t *async = bs_async_running; async; async = async->next )
+        if( async->stream == stream && bs_async_wait( async ) < 0 )
+            err = LSMASH_ERR_NAMELESS;
+    pthread_mutex_unlock( &bs_async_running_mutex );
+    return err;
+}
+
+static void bs_async_stop( lsmash_bs_t *bs )
+{
+    lsmash_bs_async_t *async = bs->async;
+    if( !async )
+        return;
+    pthread_mutex_lock( &bs_async_running_mutex );
+    for( lsmash_bs_async_t **p = &bs_async_running; *p; p = &(*p)->next )
+        if( *p == async )
+        {
+            *p = async->next;
+            break;
+        }
+    pthread_mutex_unlock( &bs_async_running_mutex );
+    pthread_mutex_lock( &async->mutex );
+    async->quit = 1;
+    pthread_cond_signal( &async->filled );
+    pthread_mutex_unlock( &async->mutex );
+    pthread_join( async->thread, NULL );
+    pthread_cond_destroy( &async->drained );
+    pthread_cond_destroy( &async->filled );
+    pthread_mutex_destroy( &async->mutex );
+    for( uint32_t i = 0; i < async->depth; i++ )
+        lsmash_free( async->slot[i].buffer );
+    lsmash_free( async->slot );
+    lsmash_free( async );
+    bs->async = NULL;
+}
+
+/* Let a background thread write out the buffer on every flush while the caller keeps filling another one.
+ * 'depth' is the maximum number of flushed buffers waiting for the writer. */
+int lsmash_bs_start_async_write( lsmash_bs_t *bs, uint32_t depth )
+{
+    if( !bs || !bs->stream || !bs->write || !bs->buffer.internal || depth == 0 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    if( bs->async )
+        return 0;
+    lsmash_bs_async_t *async = lsmash_malloc_zero( sizeof(lsmash_bs_async_t) );
+    if( !async )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    async->slot = lsmash_malloc_zero( depth * sizeof(bs_async_slot_t) );
+    if( !async->slot )
+    {
+        lsmash_free( async );
+        return LSMASH_ERR_MEMORY_ALLOC;
+    }
+    async->depth  = depth;
+    async->stream = bs->stream;
+    async->write  = bs->write;
+    if( pthread_mutex_init( &async->mutex, NULL ) )
+        goto fail_mutex;
+    if( pthread_cond_init( &async->filled, NULL ) )
+        goto fail_filled;
+    if( pthread_cond_init( &async->drained, NULL ) )
+        goto fail_drained;
+    if( pthread_create( &async->thread, NULL, bs_async_writer, async ) )
+        goto fail_thread;
+    pthread_mutex_lock( &bs_async_running_mutex );
+    async->next      = bs_async_running;
+    bs_async_running = async;
+    pthread_mutex_unlock( &bs_async_running_mutex );
+    bs->async = async;
+    return 0;
+fail_thread:
+    pthread_cond_destroy( &async->drained );
+fail_drained:
+    pthread_cond_destroy( &async->filled );
+fail_filled:
+    pthread_mutex_destroy( &async->mutex );
+fail_mutex:
+    lsmash_free( async->slot );
+    lsmash_free( async );
+    return LSMASH_ERR_NAMELESS;
+}
+#else
+static int bs_async_queue( lsmash_bs_t *bs )
+{
+    return LSMASH_ERR_PATCH_WELCOME;
+}
+
+static int bs_async_queue_data( lsmash_bs_t *bs, uint8_t *buf, size_t size, void (*release)( void *opaque ), void *opaque )
+{
+    return LSMASH_ERR_PATCH_WELCOME;
+}
+
+int lsmash_bs_wait_async_write( lsmash_bs_t *bs )
+{
+    return 0;
+}
+
+int lsmash_bs_wait_async_write_on_stream( void *stream )
+{
+    return 0;
+}
+
+static void bs_async_stop( lsmash_bs_t *bs )
+{
+}
+
+int lsmash_bs_start_async_write( lsmash_bs_t *bs, uint32_t depth )
+{
+    return LSMASH_ERR_PATCH_WELCOME;
+}
+#endif
+/*---- ----*/
+
 /*---- bitstream writer ----*/
 void lsmash_bs_put_byte( lsmash_bs_t *bs, uint8_t value )
 {
@@ -307,7 +623,8 @@ int lsmash_bs_flush_buffer( lsmash_bs_t *bs )
      || (bs->stream && bs->write && !bs->buffer.data) )
         return 0;
     if( bs->error
-     || (bs->stream && bs->write && bs->write( bs->stream, lsmash_bs_get_buffer_data_start( bs ), bs->buffer.store ) != bs->buffer.store) )
+     || (bs->stream && bs->write && bs->async && bs_async_queue( bs ) < 0)
+     || (bs->stream && bs->write && !bs->async && bs->write( bs->stream, lsmash_bs_get_buffer_data_start( bs ), bs->buffer.store ) != bs->buffer.store) )
     {
         bs_buffer_free( bs );
         bs->error = 1;
@@ -334,12 +651,40 @@ int lsmash_bs_write_data( lsmash_bs_t *bs, uint8_t *buf, size_t size )
         bs->error = 1;
         return LSMASH_ERR_NAMELESS;
     }
+    if( bs->async )
+    {
+        /* Keep the order of the output by going through the buffer. */
+        lsmash_bs_put_bytes( bs, size, buf );
+        return lsmash_bs_flush_buffer( bs );
+    }
     int write_size = bs->write( bs->stream, buf, size );
     bs->written += write_size;
     bs->offset  += write_size;
     return write_size != size ? LSMASH_ERR_NAMELESS : 0;
 }
 
+int lsmash_bs_write_data_by_reference( lsmash_bs_t *bs, uint8_t *buf, size_t size, void (*release)( void *opaque ), void *opaque )
+{
+    if( !bs || !bs->async || size == 0 || size > INT_MAX )
+    {
+        int err = lsmash_bs_write_data( bs, buf, size );
+        release( opaque );
+        return err;
+    }
+    /* Keep the order of the output by flushing the buffer first. */
+    int err;
+    if( (err = lsmash_bs_flush_buffer( bs )) < 0
+     || (err = bs_async_queue_data( bs, buf, size, release, opaque )) < 0 )
+    {
+        release( opaque );
+        bs->error = 1;
+        return err;
+    }
+    bs->written += size;
+    bs->offset  += size;
+    return 0;
+}
+
 void *lsmash_bs_export_data( lsmash_bs_t *bs, uint32_t *length )
 {
     if( !bs || !bs->buffer.data || bs->buffer.store == 0 || bs->error )
@@ -363,6 +708,8 @@ static void bs_fill_buffer( lsmash_bs_t *bs )
         bs->eof = 1;
         return;
     }
+    if( lsmash_bs_wait_async_write( bs ) < 0 )
+        return;
     if( !bs->buffer.data )
     {
         bs_alloc( bs, bs->buffer.max_size );
@@ -642,7 +989,7 @@ int lsmash_bs_read( lsmash_bs_t *bs, uint32_t size )
     if( size == 0 )
         return 0;
     bs_alloc( bs, bs->buffer.store + size );
-    if( bs->error || !bs->stream )
+    if( bs->error || !bs->stream || lsmash_bs_wait_async_write( bs ) < 0 )
     {
         bs->error = 1;
         return LSMASH_ERR_NAMELESS;
@@ -670,7 +1017,7 @@ int lsmash_bs_read_data( lsmash_bs_t *bs, uint8_t *buf, size_t *size )
         return LSMASH_ERR_FUNCTION_PARAM;
     if( !buf || *size == 0 )
         return 0;
-    if( bs->error || !bs->stream )
+    if( bs->error || !bs->stream || lsmash_bs_wait_async_write( bs ) < 0 )
     {
         bs->error = 1;
         return LSMASH_ERR_NAMELESS;
@@ -28,6 +28,7 @@ typedef struct
     int      unseekable;    /* If set to 1, the buffer is unseekable. */
     int      internal;      /* If set to 1, the buffer is allocated on heap internally.
                              * The pointer to the buffer shall not be changed by any method other than internal allocation. */
+    int      mapped;        /* If set to 1, the buffer is the memory mapping of the whole stream. */
     uint8_t *data;          /* the pointer to the buffer for reading/writing */
     size_t   store;         /* valid data size on the buffer */
     size_t   alloc;         /* total buffer size including invalid area */
@@ -36,6 +37,8 @@ typedef struct
     uint64_t count;         /* counter for arbitrary usage */
 } lsmash_buffer_t;
 
+typedef struct lsmash_bs_async_tag lsmash_bs_async_t;
+
 typedef struct
 {
     void           *stream;         /* I/O stream */
@@ -47,6 +50,7 @@ typedef struct
     uint64_t        offset;         /* the current position in the 'stream'
                                      * the number of bytes from the beginning */
     lsmash_buffer_t buffer;
+    lsmash_bs_async_t *async;       /* the background writer if the asynchronous output is enabled */
     int     (*read) ( void *opaque, uint8_t *buf, int size );
     int     (*write)( void *opaque, uint8_t *buf, int size );
     int64_t (*seek) ( void *opaque, int64_t offset, int whence );
@@ -99,12 +103,24 @@ static inline size_t lsmash_bs_get_valid_data_size( lsmash_bs_t *bs )
     return bs->buffer.store;
 }
 
+/* Check if the data of 'size' bytes at the absolute position 'pos' of the stream is on the buffer. */
+static inline int lsmash_bs_is_buffered( lsmash_bs_t *bs, uint64_t pos, uint64_t size )
+{
+    return !bs->buffer.unseekable
+        && pos >= bs->offset - bs->buffer.store
+        && pos + size <= bs->offset;
+}
+
 lsmash_bs_t *lsmash_bs_create( void );
 void lsmash_bs_cleanup( lsmash_bs_t *bs );
 int lsmash_bs_set_empty_stream( lsmash_bs_t *bs, uint8_t *data, size_t size );
+int lsmash_bs_map_stream( lsmash_bs_t *bs );
 void lsmash_bs_empty( lsmash_bs_t *bs );
 int64_t lsmash_bs_write_seek( lsmash_bs_t *bs, int64_t offset, int whence );
 int64_t lsmash_bs_read_seek( lsmash_bs_t *bs, int64_t offset, int whence );
+int lsmash_bs_start_async_write( lsmash_bs_t *bs, uint32_t depth );
+int lsmash_bs_wait_async_write( lsmash_bs_t *bs );
+int lsmash_bs_wait_async_write_on_stream( void *stream );
 
 /*---- bytestream writer ----*/
 void lsmash_bs_put_byte( lsmash_bs_t *bs, uint8_t value );
@@ -121,6 +137,9 @@ void lsmash_bs_put_le16( lsmash_bs_t *bs, uint16_t value );
 void lsmash_bs_put_le32( lsmash_bs_t *bs, uint32_t value );
 int lsmash_bs_flush_buffer( lsmash_bs_t *bs );
 int lsmash_bs_write_data( lsmash_bs_t *bs, uint8_t *buf, size_t size );
+/* Same as lsmash_bs_write_data() except that the asynchronous output refers to 'buf' instead of copying it.
+ * 'release' is called with 'opaque' once 'buf' is not needed anymore, even on failure. */
+int lsmash_bs_write_data_by_reference( lsmash_bs_t *bs, uint8_t *buf, size_t size, void (*release)( void *opaque ), void *opaque );
 void *lsmash_bs_export_data( lsmash_bs_t *bs, uint32_t *length );
 
 /*---- bytestream reader ----*/
@@ -106,6 +106,29 @@ int lsmash_remove_entry_direct_orig( lsmash_entry_list_t *list, lsmash_entry_t *
     return 0;
 }
 
+int lsmash_move_entry_to_tail( lsmash_entry_list_t *list, lsmash_entry_t *entry )
+{
+    if( !list || !entry )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    if( entry == list->tail )
+        return 0;
+    lsmash_entry_t *next = entry->next;
+    lsmash_entry_t *prev = entry->prev;
+    if( entry == list->head )
+        list->head = next;
+    else
+        prev->next = next;
+    next->prev = prev;
+    entry->prev = list->tail;
+    entry->next = NULL;
+    list->tail->next = entry;
+    list->tail       = entry;
+    /* The entry numbers after the moved entry change. */
+    list->last_accessed_entry  = NULL;
+    list->last_accessed_number = 0;
+    return 0;
+}
+
 int lsmash_remove_entry_orig( lsmash_entry_list_t *list, uint32_t entry_number, lsmash_entry_data_eliminator eliminator )
 {
     lsmash_entry_t *entry = lsmash_get_entry( list, entry_number );
@@ -189,3 +212,89 @@ void *lsmash_get_entry_data( lsmash_entry_list_t *list, uint32_t entry_number )
     lsmash_entry_t *entry = lsmash_get_entry( list, entry_number );
     return entry ? entry->data : NULL;
 }
+
+void lsmash_init_entry_array( lsmash_entry_array_t *array, uint32_t entry_size )
+{
+    array->data        = NULL;
+    array->entry_size  = entry_size;
+    array->entry_count = 0;
+    array->alloc_count = 0;
+}
+
+lsmash_entry_array_t *lsmash_create_entry_array( uint32_t entry_size )
+{
+    lsmash_entry_array_t *array = lsmash_malloc( sizeof(lsmash_entry_array_t) );
+    if( !array )
+        return NULL;
+    lsmash_init_entry_array( array, entry_size );
+    return array;
+}
+
+/* Make room for at least 'entry_count' entries in total. */
+int lsmash_reserve_array_entries( lsmash_entry_array_t *array, uint32_t entry_count )
+{
+    if( !array || array->entry_size == 0 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    if( entry_count <= array->alloc_count )
+        return 0;
+    if( (uint64_t)entry_count * array->entry_size > SIZE_MAX )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    void *data = lsmash_realloc( array->data, (size_t)entry_count * array->entry_size );
+    if( !data )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    array->data        = data;
+    array->alloc_count = entry_count;
+    return 0;
+}
+
+int lsmash_add_array_entry( lsmash_entry_array_t *array, const void *data )
+{
+    if( !array || !data )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    if( array->entry_count == array->alloc_count )
+    {
+        /* Grow geometrically so that the amortized cost of an addition is constant. */
+        if( array->entry_count == UINT32_MAX )
+            return LSMASH_ERR_MEMORY_ALLOC;
+        uint32_t alloc_count = array->alloc_count == 0              ? 16
+                             : array->alloc_count > UINT32_MAX / 2 ? UINT32_MAX
+                             :                                       2 * array->alloc_count;
+        int err = lsmash_reserve_array_entries( array, alloc_count );
+        if( err < 0 )
+            return err;
+    }
+    memcpy( (uint8_t *)array->data + (size_t)array->entry_count * array->entry_size, data, array->entry_size );
+    array->entry_count += 1;
+    return 0;
+}
+
+int lsmash_remove_array_entry_tail( lsmash_entry_array_t *array )
+{
+    if( !array || array->entry_count == 0 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    array->entry_count -= 1;
+    return 0;
+}
+
+void lsmash_remove_array_entries( lsmash_entry_array_t *array )
+{
+    if( !array )
+        return;
+    lsmash_free( array->data );
+    lsmash_init_entry_array( array, array->entry_size );
+}
+
+void lsmash_remove_array( lsmash_entry_array_t *array )
+{
+    if( !array )
+        return;
+    lsmash_free( array->data );
+    lsmash_free( array );
+}
+
+void *lsmash_get_array_entry_data( lsmash_entry_array_t *array, uint32_t entry_number )
+{
+    if( !array || !entry_number || entry_number > array->entry_count )
+        return NULL;
+    return (uint8_t *)array->data + (size_t)(entry_number - 1) * array->entry_size;
+}
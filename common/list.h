@@ -38,6 +38,17 @@ typedef struct
     uint32_t entry_count;
 } lsmash_entry_list_t;
 
+/* Contiguous array of fixed-size entries
+ * This is suitable for large tables of small entries such as the sample tables
+ * since it requires neither a memory allocation nor link pointers per entry. */
+typedef struct
+{
+    void    *data;              /* the head of entries */
+    uint32_t entry_size;        /* the size of each entry in bytes */
+    uint32_t entry_count;       /* the number of entries in use */
+    uint32_t alloc_count;       /* the number of entries which the allocated memory block can hold */
+} lsmash_entry_array_t;
+
 typedef void (*lsmash_entry_data_eliminator)(void *data); /* very same as free() of standard c lib; void free(void *); */
 
 #define lsmash_remove_entry_direct( list, entry, eliminator ) \
@@ -64,5 +75,17 @@ int lsmash_remove_entry_tail_orig( lsmash_entry_list_t *list, lsmash_entry_data_
 void lsmash_remove_entries_orig( lsmash_entry_list_t *list, lsmash_entry_data_eliminator eliminator );
 void lsmash_remove_list_orig( lsmash_entry_list_t *list, lsmash_entry_data_eliminator eliminator );
 
+int lsmash_move_entry_to_tail( lsmash_entry_list_t *list, lsmash_entry_t *entry );
+
 lsmash_entry_t *lsmash_get_entry( lsmash_entry_list_t *list, uint32_t entry_number );
 void *lsmash_get_entry_data( lsmash_entry_list_t *list, uint32_t entry_number );
+
+void lsmash_init_entry_array( lsmash_entry_array_t *array, uint32_t entry_size );
+lsmash_entry_array_t *lsmash_create_entry_array( uint32_t entry_size );
+int lsmash_reserve_array_entries( lsmash_entry_array_t *array, uint32_t entry_count );
+int lsmash_add_array_entry( lsmash_entry_array_t *array, const void *data );
+int lsmash_remove_array_entry_tail( lsmash_entry_array_t *array );
+void lsmash_remove_array_entries( lsmash_entry_array_t *array );
+void lsmash_remove_array( lsmash_entry_array_t *array );
+
+void *lsmash_get_array_entry_data( lsmash_entry_array_t *array, uint32_t entry_number );
@@ -20,12 +20,28 @@
 
 /* This file is available under an ISC license. */
 
+#if defined( __linux__ )
+#define _GNU_SOURCE             /* for fileno() and syscall() */
+#elif !defined( _WIN32 )
+#define _POSIX_C_SOURCE 200112L /* for fileno() */
+#endif
+
 #include "internal.h" /* must be placed first */
 
 #include <stdlib.h>
 
 #ifdef _WIN32
 #include <windows.h>
+#include <io.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#ifdef __linux__
+#include <errno.h>
+#include <unistd.h>
+#include <sys/syscall.h>
 #endif
 
 #ifdef _WIN32
@@ -65,3 +81,90 @@ FILE *lsmash_win32_fopen( const char *name, const char *mode )
 
 #endif
 
+/* Map the whole of a regular file opened for reading into memory.
+ * Return the address of the mapping if successful.
+ * Return NULL otherwise. */
+#ifdef _WIN32
+void *lsmash_map_file( FILE *fp, uint64_t *size )
+{
+    HANDLE file = (HANDLE)_get_osfhandle( _fileno( fp ) );
+    LARGE_INTEGER file_size;
+    if( file == INVALID_HANDLE_VALUE
+     || GetFileType( file ) != FILE_TYPE_DISK
+     || !GetFileSizeEx( file, &file_size )
+     || file_size.QuadPart <= 0
+     || (uint64_t)file_size.QuadPart > SIZE_MAX )
+        return NULL;
+    HANDLE mapping = CreateFileMappingW( file, NULL, PAGE_READONLY, 0, 0, NULL );
+    if( !mapping )
+        return NULL;
+    void *data = MapViewOfFile( mapping, FILE_MAP_READ, 0, 0, 0 );
+    CloseHandle( mapping );     /* The view keeps the mapping object alive. */
+    if( !data )
+        return NULL;
+    *size = file_size.QuadPart;
+    return data;
+}
+
+void lsmash_unmap_file( void *data, uint64_t size )
+{
+    UnmapViewOfFile( data );
+}
+#else
+void *lsmash_map_file( FILE *fp, uint64_t *size )
+{
+    struct stat st;
+    int fd = fileno( fp );
+    if( fd < 0
+     || fstat( fd, &st ) < 0
+     || !S_ISREG( st.st_mode )
+     || st.st_size <= 0
+     || (uint64_t)st.st_size > SIZE_MAX )
+        return NULL;
+    void *data = mmap( NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0 );
+    if( data == MAP_FAILED )
+        return NULL;
+    *size = st.st_size;
+    return data;
+}
+
+void lsmash_unmap_file( void *data, uint64_t size )
+{
+    munmap( data, (size_t)size );
+}
+#endif
+
+/* Copy 'size' bytes at 'src' to 'dst' within a file opened for both reading and writing
+ * without passing the data through user space. The two ranges shall not overlap.
+ * Return 0 if successful.
+ * Return LSMASH_ERR_PATCH_WELCOME if the system or the file doesn't support it. Nothing is copied then.
+ * Return other negative value otherwise. */
+int lsmash_copy_file_range( FILE *fp, uint64_t src, uint64_t dst, uint64_t size )
+{
+#if defined( __linux__ ) && defined( __NR_copy_file_range )
+    if( fflush( fp ) )
+        return LSMASH_ERR_NAMELESS;
+    int     fd     = fileno( fp );
+    int64_t in     = src;
+    int64_t out    = dst;
+    int     copied = 0;
+    while( size )
+    {
+        size_t  length = size > (1 << 30) ? (1 << 30) : size;
+        ssize_t ret    = syscall( __NR_copy_file_range, fd, &in, fd, &out, length, 0 );
+        if( ret <= 0 )
+        {
+            if( ret < 0 && !copied
+             && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP || errno == EBADF) )
+                return LSMASH_ERR_PATCH_WELCOME;
+            return LSMASH_ERR_NAMELESS;
+        }
+        size  -= ret;
+        copied = 1;
+    }
+    /* Discard the data read ahead by the stdio buffer since it may be stale now. */
+    return fflush( fp ) ? LSMASH_ERR_NAMELESS : 0;
+#else
+    return LSMASH_ERR_PATCH_WELCOME;
+#endif
+}
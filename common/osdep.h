@@ -57,4 +57,10 @@
    int lsmash_string_from_wchar( int cp, const wchar_t *from, char **to );
 #endif
 
+#include <stdio.h>
+#include <stdint.h>
+void *lsmash_map_file( FILE *fp, uint64_t *size );
+void lsmash_unmap_file( void *data, uint64_t size );
+int lsmash_copy_file_range( FILE *fp, uint64_t src, uint64_t dst, uint64_t size );
+
 #endif
@@ -23,6 +23,8 @@
 #ifndef LSMASH_UTIL_H
 #define LSMASH_UTIL_H
 
+#include <assert.h>
+
 #define debug_if(x) if(x)
 
 #define LSMASH_MAX( a, b ) ((a) > (b) ? (a) : (b))
@@ -181,6 +183,27 @@ static inline void lsmash_reduce_fraction
     }
 }
 
+/* Count the number of the leading zero bits of a non-zero value. */
+static inline uint32_t lsmash_count_leading_zeros64
+(
+    uint64_t value
+)
+{
+    assert( value );
+#if defined( __GNUC__ )
+    return __builtin_clzll( value );
+#else
+    uint32_t count = 0;
+    for( uint32_t width = 32; width; width >>= 1 )
+        if( !(value >> (64 - width)) )
+        {
+            count  += width;
+            value <<= width;
+        }
+    return count;
+#endif
+}
+
 static inline void lsmash_reduce_fraction_su
 (
     int64_t  *a,
@@ -155,12 +155,51 @@ void isom_bs_put_box_common( lsmash_bs_t *bs, void *box )
         isom_bs_put_basebox_common( bs, (isom_box_t *)box );
 }
 
+static int isom_compare_fourcc_index( const isom_fourcc_index_t *a, const isom_fourcc_index_t *b )
+{
+    if( a->fourcc != b->fourcc )
+        return a->fourcc > b->fourcc ? 1 : -1;
+    /* Keep the order in the table among the entries of the same four character codes. */
+    return a->number > b->number ? 1 : (a->number == b->number ? 0 : -1);
+}
+
+void isom_create_fourcc_index( isom_fourcc_index_t *index, const void *table, size_t entry_size, uint32_t entry_count )
+{
+    const uint8_t *entry = (const uint8_t *)table;
+    for( uint32_t i = 0; i < entry_count; i++ )
+    {
+        memcpy( &index[i].fourcc, entry, sizeof(lsmash_compact_box_type_t) );
+        index[i].number = i;
+        entry += entry_size;
+    }
+    qsort( index, entry_count, sizeof(isom_fourcc_index_t), (int(*)( const void *, const void * ))isom_compare_fourcc_index );
+}
+
+/* Return the position in the index of the first entry having given four character codes.
+ * Return 'entry_count' if no entry has them. */
+uint32_t isom_search_fourcc_index( const isom_fourcc_index_t *index, uint32_t entry_count, lsmash_compact_box_type_t fourcc )
+{
+    uint32_t low  = 0;
+    uint32_t high = entry_count;
+    while( low < high )
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if( index[mid].fourcc < fourcc )
+            low = mid + 1;
+        else
+            high = mid;
+    }
+    return low < entry_count && index[low].fourcc == fourcc ? low : entry_count;
+}
+
 /* Return 1 if the box is fullbox, Otherwise return 0. */
 int isom_is_fullbox( void *box )
 {
     isom_box_t *current = (isom_box_t *)box;
     lsmash_box_type_t type = current->type;
-    static lsmash_box_type_t fullbox_type_table[50] = { LSMASH_BOX_TYPE_INITIALIZER };
+    static lsmash_box_type_t   fullbox_type_table[50] = { LSMASH_BOX_TYPE_INITIALIZER };
+    static isom_fourcc_index_t fullbox_type_index[50];
+    static uint32_t            fullbox_type_count;
     if( !lsmash_check_box_type_specified( &fullbox_type_table[0] ) )
     {
         /* Initialize the table. */
@@ -195,6 +234,7 @@ int isom_is_fullbox( void *box )
         fullbox_type_table[i++] = ISOM_BOX_TYPE_SDTP;
         fullbox_type_table[i++] = ISOM_BOX_TYPE_STSC;
         fullbox_type_table[i++] = ISOM_BOX_TYPE_STSZ;
+        fullbox_type_table[i++] = ISOM_BOX_TYPE_STZ2;
         fullbox_type_table[i++] = ISOM_BOX_TYPE_STCO;
         fullbox_type_table[i++] = ISOM_BOX_TYPE_CO64;
         fullbox_type_table[i++] = ISOM_BOX_TYPE_SGPD;
@@ -213,9 +253,13 @@ int isom_is_fullbox( void *box )
         fullbox_type_table[i++] = ISOM_BOX_TYPE_TFRA;
         fullbox_type_table[i++] = ISOM_BOX_TYPE_MFRO;
         fullbox_type_table[i]   = LSMASH_BOX_TYPE_UNSPECIFIED;
+        isom_create_fourcc_index( fullbox_type_index, fullbox_type_table, sizeof(lsmash_box_type_t), i );
+        fullbox_type_count = i;
     }
-    for( int i = 0; lsmash_check_box_type_specified( &fullbox_type_table[i] ); i++ )
-        if( lsmash_check_box_type_identical( type, fullbox_type_table[i] ) )
+    for( uint32_t i = isom_search_fourcc_index( fullbox_type_index, fullbox_type_count, type.fourcc );
+         i < fullbox_type_count && fullbox_type_index[i].fourcc == type.fourcc;
+         i++ )
+        if( lsmash_check_box_type_identical( type, fullbox_type_table[ fullbox_type_index[i].number ] ) )
             return 1;
     if( current->parent )
     {
@@ -464,6 +508,13 @@ lsmash_entry_t *isom_get_entry_of_box
 #define REMOVE_LIST_BOX_IN_LIST( box_name, parent_type ) \
         REMOVE_LIST_BOX_TEMPLATE( REMOVE_BOX_IN_LIST, box_name, parent_type, NULL )
 
+#define REMOVE_ARRAY_BOX( box_name, parent_type )   \
+    do                                              \
+    {                                               \
+        lsmash_remove_array( box_name->list );      \
+        REMOVE_BOX( box_name, parent_type );        \
+    } while( 0 )
+
 #define DEFINE_SIMPLE_BOX_REMOVER_TEMPLATE( REMOVER, box_name, ... )    \
     static void isom_remove_##box_name( isom_##box_name##_t *box_name ) \
     {                                                                   \
@@ -478,6 +529,9 @@ lsmash_entry_t *isom_get_entry_of_box
 #define DEFINE_SIMPLE_LIST_BOX_REMOVER( func_name, box_name, ... ) \
         DEFINE_SIMPLE_BOX_REMOVER_TEMPLATE( REMOVE_LIST_BOX, box_name, __VA_ARGS__ )
 
+#define DEFINE_SIMPLE_ARRAY_BOX_REMOVER( func_name, box_name, ... ) \
+        DEFINE_SIMPLE_BOX_REMOVER_TEMPLATE( REMOVE_ARRAY_BOX, box_name, __VA_ARGS__ )
+
 #define DEFINE_SIMPLE_BOX_IN_LIST_REMOVER( func_name, box_name, ... ) \
         DEFINE_SIMPLE_BOX_REMOVER_TEMPLATE( REMOVE_BOX_IN_LIST, box_name, __VA_ARGS__ )
 
@@ -559,6 +613,7 @@ static void isom_remove_file( lsmash_file_t *file )
     isom_remove_timelines( file );
 #endif
     lsmash_free( file->compatible_brands );
+    lsmash_free( file->compressed_movie );
     lsmash_bs_cleanup( file->bs );
     lsmash_importer_destroy( file->importer );
     if( file->fragment )
@@ -566,6 +621,11 @@ static void isom_remove_file( lsmash_file_t *file )
         lsmash_remove_list( file->fragment->pool, isom_remove_sample_pool );
         lsmash_free( file->fragment );
     }
+    if( file->fragment_index )
+    {
+        lsmash_remove_array_entries( file->fragment_index->pos_list );
+        lsmash_free( file->fragment_index );
+    }
     REMOVE_BOX_IN_LIST( file, lsmash_root_t );
 }
 
@@ -593,6 +653,7 @@ static void isom_remove_trak( isom_trak_t *trak )
     {
         isom_remove_sample_pool( trak->cache->chunk.pool );
         lsmash_remove_list( trak->cache->roll.pool, NULL );
+        lsmash_remove_array_entries( trak->cache->bitrate.list );
         lsmash_free( trak->cache->rap );
         lsmash_free( trak->cache->fragment );
         lsmash_free( trak->cache );
@@ -892,14 +953,14 @@ void isom_remove_sample_description( isom_sample_entry_t *sample )
         }
 }
 
-DEFINE_SIMPLE_LIST_BOX_REMOVER( isom_remove_stts, stts, isom_stbl_t )
-DEFINE_SIMPLE_LIST_BOX_REMOVER( isom_remove_ctts, ctts, isom_stbl_t )
+DEFINE_SIMPLE_ARRAY_BOX_REMOVER( isom_remove_stts, stts, isom_stbl_t )
+DEFINE_SIMPLE_ARRAY_BOX_REMOVER( isom_remove_ctts, ctts, isom_stbl_t )
 DEFINE_SIMPLE_BOX_REMOVER( isom_remove_cslg, cslg, isom_stbl_t )
-DEFINE_SIMPLE_LIST_BOX_REMOVER( isom_remove_stsc, stsc, isom_stbl_t )
-DEFINE_SIMPLE_LIST_BOX_REMOVER( isom_remove_stsz, stsz, isom_stbl_t )
-DEFINE_SIMPLE_LIST_BOX_REMOVER( isom_remove_stss, stss, isom_stbl_t )
-DEFINE_SIMPLE_LIST_BOX_REMOVER( isom_remove_stps, stps, isom_stbl_t )
-DEFINE_SIMPLE_LIST_BOX_REMOVER( isom_remove_stco, stco, isom_stbl_t )
+DEFINE_SIMPLE_ARRAY_BOX_REMOVER( isom_remove_stsc, stsc, isom_stbl_t )
+DEFINE_SIMPLE_ARRAY_BOX_REMOVER( isom_remove_stsz, stsz, isom_stbl_t )
+DEFINE_SIMPLE_ARRAY_BOX_REMOVER( isom_remove_stss, stss, isom_stbl_t )
+DEFINE_SIMPLE_ARRAY_BOX_REMOVER( isom_remove_stps, stps, isom_stbl_t )
+DEFINE_SIMPLE_ARRAY_BOX_REMOVER( isom_remove_stco, stco, isom_stbl_t )
 
 static void isom_remove_sdtp( isom_sdtp_t *sdtp )
 {
@@ -1186,6 +1247,15 @@ uint64_t isom_update_box_size( void *opaque_box )
         return NULL;                                                               \
     }
 
+#define CREATE_ARRAY_BOX( box_name, parent, box_type, precedence, entry_type )     \
+    CREATE_BOX( box_name, parent, box_type, precedence, 1 );                       \
+    box_name->list = lsmash_create_entry_array( sizeof(entry_type) );              \
+    if( !box_name->list )                                                          \
+    {                                                                              \
+        lsmash_remove_entry_tail( &(parent)->extensions, isom_remove_##box_name ); \
+        return NULL;                                                               \
+    }
+
 #define ADD_BOX_TEMPLATE( box_name, parent, box_type, precedence, BOX_CREATOR ) \
     BOX_CREATOR( box_name, parent, box_type, precedence, 1 );                   \
     if( !(parent)->box_name )                                                   \
@@ -1207,6 +1277,11 @@ uint64_t isom_update_box_size( void *opaque_box )
 #define ADD_LIST_BOX_IN_LIST( box_name, parent, box_type, precedence ) \
         ADD_BOX_IN_LIST_TEMPLATE( box_name, parent, box_type, precedence, CREATE_LIST_BOX )
 
+#define ADD_ARRAY_BOX( box_name, parent, box_type, precedence, entry_type ) \
+    CREATE_ARRAY_BOX( box_name, parent, box_type, precedence, entry_type );   \
+    if( !(parent)->box_name )                                                 \
+        (parent)->box_name = box_name
+
 #define DEFINE_SIMPLE_BOX_ADDER_TEMPLATE( ... ) CALL_FUNC_DEFAULT_ARGS( DEFINE_SIMPLE_BOX_ADDER_TEMPLATE, __VA_ARGS__ )
 #define DEFINE_SIMPLE_BOX_ADDER_TEMPLATE_6( ADDER, box_name, parent_name, box_type, precedence, parent_type ) \
     isom_##box_name##_t *isom_add_##box_name( parent_type *parent_name )                                      \
@@ -1224,6 +1299,13 @@ uint64_t isom_update_box_size( void *opaque_box )
 #define DEFINE_SIMPLE_LIST_BOX_ADDER( func_name, ... ) \
         DEFINE_SIMPLE_BOX_ADDER_TEMPLATE( ADD_LIST_BOX, __VA_ARGS__ )
 
+#define DEFINE_SIMPLE_ARRAY_BOX_ADDER( func_name, box_name, parent_name, box_type, precedence )    \
+    isom_##box_name##_t *isom_add_##box_name( isom_##parent_name##_t *parent_name )              \
+    {                                                                                            \
+        ADD_ARRAY_BOX( box_name, parent_name, box_type, precedence, isom_##box_name##_entry_t ); \
+        return box_name;                                                                         \
+    }
+
 #define DEFINE_SIMPLE_SAMPLE_EXTENSION_ADDER( func_name, box_name, parent_name, box_type, precedence, has_destructor, parent_type ) \
     isom_##box_name##_t *isom_add_##box_name( parent_type *parent_name )                                                            \
     {                                                                                                                               \
@@ -1317,6 +1399,7 @@ isom_trak_t *isom_add_trak( isom_moov_t *moov )
     isom_cache_t    *cache    = lsmash_malloc_zero( sizeof(isom_cache_t) );
     if( !cache )
         goto fail;
+    lsmash_init_entry_array( cache->bitrate.list, sizeof(isom_bitrate_entry_t) );
     if( moov->file->fragment )
     {
         fragment = lsmash_malloc_zero( sizeof(isom_fragment_t) );
@@ -1500,24 +1583,30 @@ DEFINE_SIMPLE_SAMPLE_EXTENSION_ADDER( isom_add_wave, wave, audio,    QT_BOX_TYPE
 DEFINE_SIMPLE_SAMPLE_EXTENSION_ADDER( isom_add_chan, chan, audio,    QT_BOX_TYPE_CHAN, LSMASH_BOX_PRECEDENCE_QTFF_CHAN, 1, isom_audio_entry_t )
 DEFINE_SIMPLE_SAMPLE_EXTENSION_ADDER( isom_add_srat, srat, audio,  ISOM_BOX_TYPE_SRAT, LSMASH_BOX_PRECEDENCE_ISOM_SRAT, 0, isom_audio_entry_t )
 
-DEFINE_SIMPLE_LIST_BOX_ADDER( isom_add_stts, stts, stbl, ISOM_BOX_TYPE_STTS, LSMASH_BOX_PRECEDENCE_ISOM_STTS )
-DEFINE_SIMPLE_LIST_BOX_ADDER( isom_add_ctts, ctts, stbl, ISOM_BOX_TYPE_CTTS, LSMASH_BOX_PRECEDENCE_ISOM_CTTS )
-DEFINE_SIMPLE_BOX_ADDER     ( isom_add_cslg, cslg, stbl, ISOM_BOX_TYPE_CSLG, LSMASH_BOX_PRECEDENCE_ISOM_CSLG )
-DEFINE_SIMPLE_LIST_BOX_ADDER( isom_add_stsc, stsc, stbl, ISOM_BOX_TYPE_STSC, LSMASH_BOX_PRECEDENCE_ISOM_STSC )
-DEFINE_SIMPLE_BOX_ADDER     ( isom_add_stsz, stsz, stbl, ISOM_BOX_TYPE_STSZ, LSMASH_BOX_PRECEDENCE_ISOM_STSZ )  /* We don't create a list here. */
-DEFINE_SIMPLE_LIST_BOX_ADDER( isom_add_stss, stss, stbl, ISOM_BOX_TYPE_STSS, LSMASH_BOX_PRECEDENCE_ISOM_STSS )
-DEFINE_SIMPLE_LIST_BOX_ADDER( isom_add_stps, stps, stbl,   QT_BOX_TYPE_STPS, LSMASH_BOX_PRECEDENCE_QTFF_STPS )
+DEFINE_SIMPLE_ARRAY_BOX_ADDER( isom_add_stts, stts, stbl, ISOM_BOX_TYPE_STTS, LSMASH_BOX_PRECEDENCE_ISOM_STTS )
+DEFINE_SIMPLE_ARRAY_BOX_ADDER( isom_add_ctts, ctts, stbl, ISOM_BOX_TYPE_CTTS, LSMASH_BOX_PRECEDENCE_ISOM_CTTS )
+DEFINE_SIMPLE_BOX_ADDER      ( isom_add_cslg, cslg, stbl, ISOM_BOX_TYPE_CSLG, LSMASH_BOX_PRECEDENCE_ISOM_CSLG )
+DEFINE_SIMPLE_ARRAY_BOX_ADDER( isom_add_stsc, stsc, stbl, ISOM_BOX_TYPE_STSC, LSMASH_BOX_PRECEDENCE_ISOM_STSC )
+DEFINE_SIMPLE_BOX_ADDER      ( isom_add_stsz, stsz, stbl, ISOM_BOX_TYPE_STSZ, LSMASH_BOX_PRECEDENCE_ISOM_STSZ )  /* We don't create a list here. */
+DEFINE_SIMPLE_ARRAY_BOX_ADDER( isom_add_stss, stss, stbl, ISOM_BOX_TYPE_STSS, LSMASH_BOX_PRECEDENCE_ISOM_STSS )
+DEFINE_SIMPLE_ARRAY_BOX_ADDER( isom_add_stps, stps, stbl,   QT_BOX_TYPE_STPS, LSMASH_BOX_PRECEDENCE_QTFF_STPS )
+
+isom_stsz_t *isom_add_stz2( isom_stbl_t *stbl )
+{
+    ADD_ARRAY_BOX( stsz, stbl, ISOM_BOX_TYPE_STZ2, LSMASH_BOX_PRECEDENCE_ISOM_STZ2, isom_stsz_entry_t );
+    return stsz;
+}
 
 isom_stco_t *isom_add_stco( isom_stbl_t *stbl )
 {
-    ADD_LIST_BOX( stco, stbl, ISOM_BOX_TYPE_STCO, LSMASH_BOX_PRECEDENCE_ISOM_STCO );
+    ADD_ARRAY_BOX( stco, stbl, ISOM_BOX_TYPE_STCO, LSMASH_BOX_PRECEDENCE_ISOM_STCO, isom_stco_entry_t );
     stco->large_presentation = 0;
     return stco;
 }
 
 isom_stco_t *isom_add_co64( isom_stbl_t *stbl )
 {
-    ADD_LIST_BOX( stco, stbl, ISOM_BOX_TYPE_CO64, LSMASH_BOX_PRECEDENCE_ISOM_CO64 );
+    ADD_ARRAY_BOX( stco, stbl, ISOM_BOX_TYPE_CO64, LSMASH_BOX_PRECEDENCE_ISOM_CO64, isom_co64_entry_t );
     stco->large_presentation = 1;
     return stco;
 }
@@ -2038,7 +2127,7 @@ int lsmash_write_top_level_box
     if( ret < 0 )
         return ret;
     box->file->size += box->size;
-    return 0;
+    return lsmash_bs_wait_async_write( box->file->bs );
 }
 
 uint8_t *lsmash_export_box
@@ -445,6 +445,7 @@ typedef struct
     uint8_t *nalUnit;
     /* */
     int      unused;
+    uint32_t hash;      /* hash of nalUnit for cheap rejection of different parameter sets */
 } isom_dcr_ps_entry_t;
 
 /* MPEG-4 Bit Rate Box
@@ -885,7 +886,7 @@ typedef struct
 typedef struct
 {
     ISOM_FULLBOX_COMMON;
-    lsmash_entry_list_t *list;
+    lsmash_entry_array_t *list;
 } isom_stts_t;
 
 /* Composition Time to Sample Box
@@ -903,7 +904,7 @@ typedef struct
 typedef struct
 {
     ISOM_FULLBOX_COMMON;
-    lsmash_entry_list_t *list;
+    lsmash_entry_array_t *list;
 } isom_ctts_t;
 
 /* Composition to Decode Box (Composition Shift Least Greatest Box)
@@ -928,6 +929,12 @@ typedef struct
  * The total number of samples in the media is always indicated in the sample_count.
  * Note: a sample size of zero is not prohibited in general, but it must be valid and defined for the coding system,
  *       as defined by the sample entry, that the sample belongs to. */
+
+/* Compact Sample Size Box
+ * This box is an alternative to the Sample Size Box, and stores each sample size in 4, 8 or 16 bits.
+ * There is no constant sample size, and the table is always present.
+ * This box is not defined in QuickTime file format.
+ * L-SMASH holds this box in the same structure as the Sample Size Box, whose field_size is set to non-zero. */
 typedef struct
 {
     uint32_t entry_size;        /* the size of a sample */
@@ -938,7 +945,9 @@ typedef struct
     ISOM_FULLBOX_COMMON;
     uint32_t sample_size;           /* If this field is set to 0, then the samples have different sizes. */
     uint32_t sample_count;          /* the number of samples in the track */
-    lsmash_entry_list_t *list;      /* available if sample_size == 0 */
+    lsmash_entry_array_t *list;     /* available if sample_size == 0 */
+    uint8_t  field_size;            /* the size in bits of each entry in the Compact Sample Size Box
+                                     * If this field is set to 0, then this box is the Sample Size Box. */
 } isom_stsz_t;
 
 /* Sync Sample Box
@@ -953,7 +962,7 @@ typedef struct
 typedef struct
 {
     ISOM_FULLBOX_COMMON;
-    lsmash_entry_list_t *list;
+    lsmash_entry_array_t *list;
 } isom_stss_t;
 
 /* Partial Sync Sample Box
@@ -969,7 +978,7 @@ typedef struct
 typedef struct
 {
     ISOM_FULLBOX_COMMON;
-    lsmash_entry_list_t *list;
+    lsmash_entry_array_t *list;
 } isom_stps_t;
 
 /* Independent and Disposable Samples Box */
@@ -1004,7 +1013,7 @@ typedef struct
 typedef struct
 {
     ISOM_FULLBOX_COMMON;
-    lsmash_entry_list_t *list;
+    lsmash_entry_array_t *list;
 } isom_stsc_t;
 
 /* Chunk Offset Box
@@ -1024,7 +1033,7 @@ typedef struct
 typedef struct
 {
     ISOM_FULLBOX_COMMON;        /* type = 'stco': 32-bit chunk offsets / type = 'co64': 64-bit chunk offsets */
-    lsmash_entry_list_t *list;
+    lsmash_entry_array_t *list;
 
         uint8_t large_presentation;     /* Set 1 to this if 64-bit chunk-offset are needed. */
 } isom_stco_t;      /* share with co64 box */
@@ -1190,6 +1199,21 @@ typedef struct
     uint8_t *data;
 } isom_free_t;
 
+/* Data Compression Box and Compressed Movie Data Box
+ * These boxes are in the Compressed Movie Box and carry the Movie Box compressed by the indicated algorithm.
+ * The Movie Box is decompressed and read when reading, so the instances of them are created only for dump. */
+typedef struct
+{
+    ISOM_BASEBOX_COMMON;
+    uint32_t compression_type;
+} isom_dcom_t;
+
+typedef struct
+{
+    ISOM_BASEBOX_COMMON;
+    uint32_t uncompressed_size;
+} isom_cmvd_t;
+
 typedef isom_free_t isom_skip_t;
 
 /* Chapter List Box
@@ -1358,12 +1382,16 @@ typedef struct
 } isom_udta_t;
 
 /** Caches for handling tracks **/
+#define ISOM_SAMPLE_POOL_GATHER_THRESHOLD 4096      /* Samples smaller than this are copied into a gathering buffer. */
+#define ISOM_SAMPLE_POOL_GATHER_SIZE      (1<<16)   /* size of a gathering buffer */
+
 typedef struct
 {
-    uint64_t alloc;             /* total buffer size for the pool */
-    uint64_t size;              /* total size of samples in the pool */
-    uint32_t sample_count;      /* number of samples in the pool */
-    uint8_t *data;              /* actual data of samples in the pool */
+    uint64_t size;                  /* total size of samples in the pool */
+    uint32_t sample_count;          /* number of samples in the pool */
+    lsmash_entry_list_t samples;    /* samples in the pool
+                                     * The data of them is written into the stream directly without any copy. */
+    lsmash_sample_t    *gather;     /* the last sample in the pool, which gathers the data of small samples */
 } isom_sample_pool_t;
 
 typedef struct
@@ -1381,6 +1409,23 @@ typedef struct
     int32_t  ctd_shift;
 } isom_timestamp_t;
 
+typedef struct
+{
+    uint64_t dts;               /* the sum of the durations of the preceding samples in this sample description */
+    uint64_t time_wnd;          /* the DTS at the start of the current one second window */
+    uint64_t total_size;        /* the total size of the samples */
+    uint32_t rate;              /* the total size of the samples in the current window */
+    uint32_t max_rate;          /* the largest total size of the samples in a closed window */
+    uint32_t buffer_size;       /* the largest sample size */
+    uint32_t sample_count;      /* the number of the samples */
+} isom_bitrate_entry_t;
+
+typedef struct
+{
+    uint32_t             last_index;    /* the sample description index of the last sample */
+    lsmash_entry_array_t list[1];       /* isom_bitrate_entry_t for each sample description */
+} isom_bitrate_t;
+
 typedef struct
 {
     isom_group_assignment_entry_t *assignment;          /* the address corresponding to the entry in Sample to Group Box */
@@ -1446,6 +1491,7 @@ typedef struct
     uint8_t           is_audio;
     isom_chunk_t      chunk;
     isom_timestamp_t  timestamp;
+    isom_bitrate_t    bitrate;
     isom_grouping_t   roll;
     isom_rap_group_t *rap;
     isom_fragment_t  *fragment;
@@ -1710,6 +1756,24 @@ typedef struct
     lsmash_entry_list_t *pool;              /* samples pooled to interleave for the current movie fragment */
 } isom_fragment_manager_t;
 
+/* Movie fragment index
+ * The presence of this means Movie Fragment Boxes are read on demand instead of at once when reading a file. */
+typedef struct
+{
+    uint32_t             max_resident;      /* the maximum number of Movie Fragment Boxes kept in the file */
+    uint32_t             found_count;       /* the number of the leading positions in 'pos_list' confirmed as Movie Fragment Boxes */
+    uint32_t             sequence_number;   /* the sequence number of the last found Movie Fragment Box
+                                             * The positions from the Track Fragment Random Access Boxes are confirmed with this. */
+    uint64_t             next_pos;          /* the position of the top level box following the last found Movie Fragment Box
+                                             * 0 if no more Movie Fragment Boxes */
+    uint64_t             end_pos;           /* the position where lsmash_read_file() resumed reading after the first Movie Fragment Box */
+    lsmash_entry_array_t pos_list[1];       /* the positions of the Movie Fragment Boxes in uint64_t
+                                             * The ones following the found ones are taken from the Track Fragment Random Access Boxes. */
+} isom_fragment_index_t;
+
+/* Destination to print boxes progressively while reading */
+typedef struct isom_print_stream_tag isom_print_stream_t;
+
 /** **/
 
 /* Track Box */
@@ -1742,6 +1806,14 @@ typedef struct
     isom_mvex_t         *mvex;          /* Movie Extends Box */
 } isom_moov_t;
 
+/* Compressed Movie Box
+ * This box is defined in QuickTime file format, and replaces all the other boxes in the Movie Box.
+ * It contains a Data Compression Box 'dcom', which indicates the compression algorithm by a four character code,
+ * and a Compressed Movie Data Box 'cmvd', which contains the uncompressed size and the compressed Movie Box.
+ * L-SMASH has no structure for these boxes. The compressed data is expanded while reading, and its boxes are
+ * read into the Movie Box containing the Compressed Movie Box. */
+#define QT_COMPRESSION_TYPE_ZLIB LSMASH_4CC( 'z', 'l', 'i', 'b' )
+
 /** Segments
  * segment
  *   portion of an ISO base media file format file, consisting of either (a) a movie box, with its associated media data
@@ -1875,7 +1947,9 @@ struct lsmash_file_tag
 
         lsmash_bs_t             *bs;        /* bytestream manager */
         isom_fragment_manager_t *fragment;  /* movie fragment manager */
+        isom_fragment_index_t   *fragment_index;    /* movie fragment index for reading on demand */
         lsmash_entry_list_t     *print;
+        isom_print_stream_t     *print_stream;      /* destination to print boxes while reading */
         lsmash_entry_list_t     *timeline;
         lsmash_file_t           *initializer;
         struct importer_tag     *importer;
@@ -1883,9 +1957,14 @@ struct lsmash_file_tag
         double    max_chunk_duration;       /* max duration per chunk in seconds */
         double    max_async_tolerance;      /* max tolerance, in seconds, for amount of interleaving asynchronization between tracks */
         uint64_t  max_chunk_size;           /* max size per chunk in bytes. */
+        uint64_t  moov_reserve_size;        /* the size of the space reserved for the Movie Box ahead of the Media Data Box */
         uint32_t  brand_count;
         uint32_t *compatible_brands;        /* the backup of the compatible brands in the File Type Box or the valid Segment Type Box */
         uint8_t   fake_file_mode;           /* If set to 1, the bytestream manager handles fake-file stream. */
+        uint8_t   compact_sample_size;      /* If set to 1, the Compact Sample Size Box is used instead of the Sample Size Box if smaller. */
+        uint8_t   compress_movie;           /* If set to 1, the Movie Box is compressed into a Compressed Movie Box. */
+        uint8_t  *compressed_movie;         /* the compressed Movie Box to be written instead of the Movie Box */
+        uint64_t  compressed_movie_size;
         /* flags for compatibility */
 #define COMPAT_FLAGS_OFFSET offsetof( lsmash_file_t, qt_compatible )
         uint8_t qt_compatible;              /* compatibility with QuickTime file format */
@@ -2117,8 +2196,11 @@ struct lsmash_root_tag
 #define QT_BOX_TYPE_ALLF lsmash_form_qtff_box_type( LSMASH_4CC( 'A', 'l', 'l', 'F' ) )
 #define QT_BOX_TYPE_CLEF lsmash_form_qtff_box_type( LSMASH_4CC( 'c', 'l', 'e', 'f' ) )
 #define QT_BOX_TYPE_CLIP lsmash_form_qtff_box_type( LSMASH_4CC( 'c', 'l', 'i', 'p' ) )
+#define QT_BOX_TYPE_CMOV lsmash_form_qtff_box_type( LSMASH_4CC( 'c', 'm', 'o', 'v' ) )
+#define QT_BOX_TYPE_CMVD lsmash_form_qtff_box_type( LSMASH_4CC( 'c', 'm', 'v', 'd' ) )
 #define QT_BOX_TYPE_CRGN lsmash_form_qtff_box_type( LSMASH_4CC( 'c', 'r', 'g', 'n' ) )
 #define QT_BOX_TYPE_CTAB lsmash_form_qtff_box_type( LSMASH_4CC( 'c', 't', 'a', 'b' ) )
+#define QT_BOX_TYPE_DCOM lsmash_form_qtff_box_type( LSMASH_4CC( 'd', 'c', 'o', 'm' ) )
 #define QT_BOX_TYPE_ENOF lsmash_form_qtff_box_type( LSMASH_4CC( 'e', 'n', 'o', 'f' ) )
 #define QT_BOX_TYPE_GMHD lsmash_form_qtff_box_type( LSMASH_4CC( 'g', 'm', 'h', 'd' ) )
 #define QT_BOX_TYPE_GMIN lsmash_form_qtff_box_type( LSMASH_4CC( 'g', 'm', 'i', 'n' ) )
@@ -2221,6 +2303,7 @@ struct lsmash_root_tag
 #define LSMASH_BOX_PRECEDENCE_ISOM_SDTP (LSMASH_BOX_PRECEDENCE_N  - 12 * LSMASH_BOX_PRECEDENCE_S)
 #define LSMASH_BOX_PRECEDENCE_ISOM_STSC (LSMASH_BOX_PRECEDENCE_N  - 14 * LSMASH_BOX_PRECEDENCE_S)
 #define LSMASH_BOX_PRECEDENCE_ISOM_STSZ (LSMASH_BOX_PRECEDENCE_N  - 16 * LSMASH_BOX_PRECEDENCE_S)
+#define LSMASH_BOX_PRECEDENCE_ISOM_STZ2 (LSMASH_BOX_PRECEDENCE_N  - 16 * LSMASH_BOX_PRECEDENCE_S)
 #define LSMASH_BOX_PRECEDENCE_ISOM_STCO (LSMASH_BOX_PRECEDENCE_N  - 18 * LSMASH_BOX_PRECEDENCE_S)
 #define LSMASH_BOX_PRECEDENCE_ISOM_CO64 (LSMASH_BOX_PRECEDENCE_N  - 18 * LSMASH_BOX_PRECEDENCE_S)
 #define LSMASH_BOX_PRECEDENCE_ISOM_SGPD (LSMASH_BOX_PRECEDENCE_N  - 20 * LSMASH_BOX_PRECEDENCE_S)
@@ -2460,6 +2543,18 @@ void isom_init_box_common_orig
     isom_extension_destructor_t destructor
 );
 
+/* Index to dispatch tables sorted by four character codes
+ * The first member of each entry of an indexed table shall be lsmash_compact_box_type_t or lsmash_box_type_t
+ * so that the four character codes can be looked up by binary search instead of scanning the table. */
+typedef struct
+{
+    lsmash_compact_box_type_t fourcc;
+    uint32_t                  number;   /* the position of the entry in the indexed table */
+} isom_fourcc_index_t;
+
+void isom_create_fourcc_index( isom_fourcc_index_t *index, const void *table, size_t entry_size, uint32_t entry_count );
+uint32_t isom_search_fourcc_index( const isom_fourcc_index_t *index, uint32_t entry_count, lsmash_compact_box_type_t fourcc );
+
 int isom_is_fullbox( void *box );
 int isom_is_lpcm_audio( void *box );
 int isom_is_qt_audio( lsmash_codec_type_t type );
@@ -2497,6 +2592,7 @@ isom_sbgp_t *isom_get_fragment_sample_to_group( isom_traf_t *traf, uint32_t grou
 isom_trak_t *isom_track_create( lsmash_file_t *file, lsmash_media_type media_type );
 isom_moov_t *isom_movie_create( lsmash_file_t *file );
 
+uint32_t isom_get_ps_hash( uint8_t *ps, uint32_t ps_size );
 isom_dcr_ps_entry_t *isom_create_ps_entry( uint8_t *ps, uint32_t ps_size );
 void isom_remove_dcr_ps( isom_dcr_ps_entry_t *ps );
 
@@ -2508,9 +2604,12 @@ uint32_t isom_get_sample_count
     isom_trak_t *trak
 );
 
-isom_sample_pool_t *isom_create_sample_pool
+isom_sample_pool_t *isom_create_sample_pool( void );
+
+int isom_write_sample_pool
 (
-    uint64_t size
+    lsmash_bs_t        *bs,
+    isom_sample_pool_t *pool
 );
 
 int isom_update_sample_tables
@@ -2609,6 +2708,7 @@ isom_ctts_t *isom_add_ctts( isom_stbl_t *stbl );
 isom_cslg_t *isom_add_cslg( isom_stbl_t *stbl );
 isom_stsc_t *isom_add_stsc( isom_stbl_t *stbl );
 isom_stsz_t *isom_add_stsz( isom_stbl_t *stbl );
+isom_stsz_t *isom_add_stz2( isom_stbl_t *stbl );
 isom_stss_t *isom_add_stss( isom_stbl_t *stbl );
 isom_stps_t *isom_add_stps( isom_stbl_t *stbl );
 isom_sdtp_t *isom_add_sdtp( isom_box_t *parent );
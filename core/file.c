@@ -33,6 +33,9 @@
 #include "box.h"
 #include "read.h"
 #include "fragment.h"
+#ifdef LSMASH_DEMUXER_ENABLED
+#include "timeline.h"
+#endif
 
 #include "importer/importer.h"
 
@@ -205,6 +208,43 @@ int isom_check_compatibility
     return 0;
 }
 
+void isom_check_brand_compatibility
+(
+    lsmash_file_t *file,
+    uint8_t       *qt_compatible,
+    uint8_t       *avc_extensions
+)
+{
+    *qt_compatible  = 0;
+    *avc_extensions = 0;
+    isom_ftyp_t *ftyp = file->ftyp ? file->ftyp : (isom_ftyp_t *)lsmash_get_entry_data( &file->styp_list, 1 );
+    if( !ftyp )
+    {
+        *qt_compatible = !file->moov || !file->moov->iods;
+        return;
+    }
+    for( uint32_t i = 0; i <= ftyp->brand_count; i++ )
+    {
+        uint32_t brand = (i == ftyp->brand_count ? ftyp->major_brand : ftyp->compatible_brands[i]);
+        switch( brand )
+        {
+            case ISOM_BRAND_TYPE_QT :
+                *qt_compatible = 1;
+                break;
+            case ISOM_BRAND_TYPE_AVC1 :
+            case ISOM_BRAND_TYPE_ISO2 :
+            case ISOM_BRAND_TYPE_ISO3 :
+            case ISOM_BRAND_TYPE_ISO4 :
+            case ISOM_BRAND_TYPE_ISO5 :
+            case ISOM_BRAND_TYPE_ISO6 :
+                *avc_extensions = 1;
+                break;
+            default :
+                break;
+        }
+    }
+}
+
 int isom_check_mandatory_boxes
 (
     lsmash_file_t *file
@@ -242,9 +282,9 @@ int isom_check_mandatory_boxes
             return LSMASH_ERR_INVALID_DATA;
         if( !file->fragment
          && (!stbl->stsd->list.head
-          || !stbl->stts->list || !stbl->stts->list->head
-          || !stbl->stsc->list || !stbl->stsc->list->head
-          || !stbl->stco->list || !stbl->stco->list->head) )
+          || !stbl->stts->list || !stbl->stts->list->entry_count
+          || !stbl->stsc->list || !stbl->stsc->list->entry_count
+          || !stbl->stco->list || !stbl->stco->list->entry_count) )
             return LSMASH_ERR_INVALID_DATA;
     }
     if( !file->fragment )
@@ -257,50 +297,90 @@ int isom_check_mandatory_boxes
     return 0;
 }
 
+#define ISOM_REARRANGE_MIN_BUFFER_SIZE      (1 << 20)
+#define ISOM_REARRANGE_KERNEL_COPY_MIN_SIZE (1 << 20)   /* Moving by a smaller shift in the kernel needs too many system calls. */
+
+/* Move all the data from 'pos' to the end of the stream backward by 'shift' bytes so that the caller can write
+ * something into the space made at 'pos'. The data is moved from the tail so that any block overwrites only the
+ * data moved already, thus a single buffer of any size is enough. If possible, the kernel copies the data within
+ * the file without passing it through the buffer. The stream position is the new end of the stream on success. */
 int isom_rearrange_data
 (
     lsmash_file_t        *file,
     lsmash_adhoc_remux_t *remux,
-    uint8_t              *buf[2],
-    size_t                read_num,
-    size_t                size,
-    uint64_t              read_pos,
-    uint64_t              write_pos,
+    uint64_t              pos,
+    uint64_t              shift,
     uint64_t              file_size
 )
 {
     assert( remux );
-    /* Copy-pastan */
-    int buf_switch = 1;
     lsmash_bs_t *bs = file->bs;
-    int     ret;
-    int64_t ret64;
-    while( read_num == size )
+    int ret = lsmash_bs_flush_buffer( bs );
+    if( ret < 0 )
+        return ret;
+    int64_t end = lsmash_bs_write_seek( bs, 0, SEEK_END );
+    if( end < 0 )
+        return end;
+    if( pos > (uint64_t)end )
+        return LSMASH_ERR_INVALID_DATA;
+    /* Any block moved in the kernel shall not overlap its destination. */
+    int kernel_copy = shift >= ISOM_REARRANGE_KERNEL_COPY_MIN_SIZE
+                   && bs->write == lsmash_fwrite_wrapper;
+    size_t   size = LSMASH_MAX( remux->buffer_size, ISOM_REARRANGE_MIN_BUFFER_SIZE );
+    uint8_t *buf  = NULL;
+    uint64_t remain = end - pos;
+    while( remain )
     {
-        ret64 = lsmash_bs_write_seek( bs, read_pos, SEEK_SET );
-        if( ret64 < 0 )
-            return ret64;
-        ret = lsmash_bs_read_data( bs, buf[buf_switch], &read_num );
-        if( ret < 0 )
-            return ret;
-        read_pos    = bs->offset;
-        buf_switch ^= 0x1;
-        ret64 = lsmash_bs_write_seek( bs, write_pos, SEEK_SET );
-        if( ret64 < 0 )
-            return ret64;
-        ret = lsmash_bs_write_data( bs, buf[buf_switch], size );
-        if( ret < 0 )
-            return ret;
-        write_pos = bs->offset;
+        uint64_t block_size = LSMASH_MIN( remain, kernel_copy ? shift : size );
+        uint64_t src_pos    = pos + remain - block_size;
+        if( kernel_copy )
+        {
+            ret = lsmash_copy_file_range( (FILE *)bs->stream, src_pos, src_pos + shift, block_size );
+            if( ret == LSMASH_ERR_PATCH_WELCOME )
+            {
+                /* Not supported. Move via the buffer instead. */
+                kernel_copy = 0;
+                continue;
+            }
+            if( ret < 0 )
+                goto fail;
+        }
+        else
+        {
+            if( !buf && (buf = lsmash_malloc( size )) == NULL )
+                return LSMASH_ERR_MEMORY_ALLOC;
+            size_t read_num = block_size;
+            int64_t ret64 = lsmash_bs_write_seek( bs, src_pos, SEEK_SET );
+            if( ret64 < 0 )
+            {
+                ret = ret64;
+                goto fail;
+            }
+            if( (ret = lsmash_bs_read_data( bs, buf, &read_num )) < 0 )
+                goto fail;
+            if( read_num != block_size )
+            {
+                ret = LSMASH_ERR_NAMELESS;
+                goto fail;
+            }
+            if( (ret64 = lsmash_bs_write_seek( bs, src_pos + shift, SEEK_SET )) < 0 )
+            {
+                ret = ret64;
+                goto fail;
+            }
+            if( (ret = lsmash_bs_write_data( bs, buf, block_size )) < 0 )
+                goto fail;
+        }
+        remain -= block_size;
         if( remux->func )
-            remux->func( remux->param, write_pos, file_size ); // FIXME:
+            remux->func( remux->param, file_size - remain, file_size ); // FIXME:
     }
-    ret = lsmash_bs_write_data( bs, buf[buf_switch ^ 0x1], read_num );
-    if( ret < 0 )
-        return ret;
-    if( remux->func )
-        remux->func( remux->param, file_size, file_size ); // FIXME:
-    return 0;
+    lsmash_free( buf );
+    int64_t ret64 = lsmash_bs_write_seek( bs, end + shift, SEEK_SET );
+    return ret64 < 0 ? ret64 : 0;
+fail:
+    lsmash_free( buf );
+    return ret;
 }
 
 static int isom_set_brands
@@ -419,6 +499,10 @@ void lsmash_discard_boxes
 {
     if( !root || !root->file )
         return;
+#ifdef LSMASH_DEMUXER_ENABLED
+    /* Lazily constructed timelines refer to the sample tables. */
+    isom_complete_timelines( root->file );
+#endif
     isom_remove_all_extension_boxes( &root->file->extensions );
 }
 
@@ -476,19 +560,25 @@ int lsmash_open_file
     if( !stream )
         return LSMASH_ERR_NAMELESS;
     memset( param, 0, sizeof(lsmash_file_parameters_t) );
-    param->mode                = file_mode;
-    param->opaque              = (void *)stream;
-    param->read                = lsmash_fread_wrapper;
-    param->write               = lsmash_fwrite_wrapper;
-    param->seek                = seekable ? lsmash_fseek_wrapper : NULL;
-    param->major_brand         = 0;
-    param->brands              = NULL;
-    param->brand_count         = 0;
-    param->minor_version       = 0;
-    param->max_chunk_duration  = 0.5;
-    param->max_async_tolerance = 2.0;
-    param->max_chunk_size      = 4 * 1024 * 1024;
-    param->max_read_size       = 4 * 1024 * 1024;
+    param->mode                   = file_mode;
+    param->opaque                 = (void *)stream;
+    param->read                   = lsmash_fread_wrapper;
+    param->write                  = lsmash_fwrite_wrapper;
+    param->seek                   = seekable ? lsmash_fseek_wrapper : NULL;
+    param->major_brand            = 0;
+    param->brands                 = NULL;
+    param->brand_count            = 0;
+    param->minor_version          = 0;
+    param->max_chunk_duration     = 0.5;
+    param->max_async_tolerance    = 2.0;
+    param->max_chunk_size         = 4 * 1024 * 1024;
+    param->async_write_depth      = 0;
+    param->moov_reserve_size      = 0;
+    param->compact_sample_size    = 0;
+    param->compress_movie         = 0;
+    param->max_read_size          = 4 * 1024 * 1024;
+    param->memory_map             = 0;
+    param->max_resident_fragments = 0;
     return 0;
 }
 
@@ -501,9 +591,28 @@ int lsmash_close_file
         return LSMASH_ERR_NAMELESS;
     if( !param->opaque )
         return 0;
+    /* Complete the output queued for the background writer, if any, before closing the stream. */
+    int err = lsmash_bs_wait_async_write_on_stream( param->opaque );
     int ret = fclose( (FILE *)param->opaque );
     param->opaque = NULL;
-    return ret == 0 ? 0 : LSMASH_ERR_UNKNOWN;
+    return ret != 0 ? LSMASH_ERR_UNKNOWN : err;
+}
+
+uint64_t lsmash_estimate_movie_size
+(
+    lsmash_file_parameters_t *param,
+    uint32_t                  track_count,
+    uint64_t                  sample_count,
+    double                    duration
+)
+{
+    /* Assume the worst case of the sample tables i.e. each sample has its own entry in stsz, stts, ctts, stss and sdtp,
+     * and each chunk has its own entry in stsc and co64. Any other box is covered by the fixed size per track or movie. */
+    double   chunk_duration = param && param->max_chunk_duration > 0 ? param->max_chunk_duration : 0.5;
+    uint64_t chunk_count    = track_count * (uint64_t)(duration / chunk_duration + 1);
+    return 4096 + track_count * 4096ULL
+         + sample_count * (4 + 8 + 8 + 4 + 1)
+         + chunk_count  * (12 + 8);
 }
 
 lsmash_file_t *lsmash_set_file
@@ -531,6 +640,26 @@ lsmash_file_t *lsmash_set_file
     file->max_chunk_duration  = param->max_chunk_duration;
     file->max_async_tolerance = LSMASH_MAX( param->max_async_tolerance, 2 * param->max_chunk_duration );
     file->max_chunk_size      = param->max_chunk_size;
+    file->moov_reserve_size   = param->moov_reserve_size;
+    file->compact_sample_size = !!param->compact_sample_size;
+    file->compress_movie      = !!param->compress_movie;
+    if( (file->flags & LSMASH_FILE_MODE_READ)
+     && !(file->flags & LSMASH_FILE_MODE_WRITE)
+     && param->memory_map )
+        /* On failure, just read through the stream as usual. */
+        (void)lsmash_bs_map_stream( file->bs );
+    if( (file->flags & LSMASH_FILE_MODE_READ)
+     && !(file->flags & (LSMASH_FILE_MODE_WRITE | LSMASH_FILE_MODE_DUMP))
+     && !file->bs->unseekable
+     && param->max_resident_fragments )
+    {
+        /* Movie fragments are read on demand, which requires seekability. */
+        file->fragment_index = lsmash_malloc_zero( sizeof(isom_fragment_index_t) );
+        if( !file->fragment_index )
+            goto fail;
+        file->fragment_index->max_resident = param->max_resident_fragments;
+        lsmash_init_entry_array( file->fragment_index->pos_list, sizeof(uint64_t) );
+    }
     if( (file->flags & LSMASH_FILE_MODE_WRITE)
      && (file->flags & LSMASH_FILE_MODE_BOX) )
     {
@@ -554,6 +683,9 @@ lsmash_file_t *lsmash_set_file
         else if( file->bs->unseekable )
             /* For unseekable output operations, LSMASH_FILE_MODE_FRAGMENTED shall be set. */
             goto fail;
+        /* On failure, just write into the stream synchronously. */
+        if( param->async_write_depth )
+            (void)lsmash_bs_start_async_write( file->bs, param->async_write_depth );
         /* Establish file types. */
         if( isom_set_brands( file, param->major_brand,
                                    param->minor_version,
@@ -664,7 +796,8 @@ int lsmash_switch_media_segment
      || (!(predecessor->flags & LSMASH_FILE_MODE_MEDIA) && !(predecessor->flags & LSMASH_FILE_MODE_INITIALIZATION)) )
         return LSMASH_ERR_FUNCTION_PARAM;
     int ret = isom_finish_final_fragment_movie( predecessor, remux );
-    if( ret < 0 )
+    int err = lsmash_bs_wait_async_write( predecessor->bs );
+    if( ret < 0 || (ret = err) < 0 )
         return ret;
     if( predecessor->flags & LSMASH_FILE_MODE_INITIALIZATION )
     {
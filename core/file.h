@@ -25,6 +25,14 @@ int isom_check_compatibility
     lsmash_file_t *file
 );
 
+/* Get the compatibility with QuickTime file format and AVC extensions from the brands, if any, without changing the file. */
+void isom_check_brand_compatibility
+(
+    lsmash_file_t *file,
+    uint8_t       *qt_compatible,
+    uint8_t       *avc_extensions
+);
+
 int isom_check_mandatory_boxes
 (
     lsmash_file_t *file
@@ -34,10 +42,7 @@ int isom_rearrange_data
 (
     lsmash_file_t        *file,
     lsmash_adhoc_remux_t *remux,
-    uint8_t              *buf[2],
-    size_t                read_num,
-    size_t                size,
-    uint64_t              read_pos,
-    uint64_t              write_pos,
+    uint64_t              pos,
+    uint64_t              shift,
     uint64_t              file_size
 );
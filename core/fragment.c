@@ -290,48 +290,28 @@ static int isom_write_segment_indexes
             continue;
         total_sidx_size += sidx->size;
     }
-    /* The buffer size must be at least total_sidx_size * 2. */
-    size_t buffer_size = total_sidx_size * 2;
-    if( remux->buffer_size > buffer_size )
-        buffer_size = remux->buffer_size;
-    /* Split to 2 buffers. */
-    uint8_t *buf[2] = { NULL, NULL };
-    if( (buf[0] = (uint8_t *)lsmash_malloc( buffer_size )) == NULL )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    size_t size = buffer_size / 2;
-    buf[1] = buf[0] + size;
-    /* Seek to the beginning of the first Movie Fragment Box i.e. the first subsegment within this media segment. */
+    /* Make room for the Segment Index Boxes at the beginning of the first Movie Fragment Box
+     * i.e. the first subsegment within this media segment. */
+    uint64_t total = file->size + total_sidx_size;
+    if( (ret = isom_rearrange_data( file, remux, file->fragment->first_moof_pos, total_sidx_size, total )) < 0 )
+        return ret;
+    /* Write the Segment Index Boxes actually here. */
     lsmash_bs_t *bs = file->bs;
     int64_t ret64;
     if( (ret64 = lsmash_bs_write_seek( bs, file->fragment->first_moof_pos, SEEK_SET )) < 0 )
-    {
-        ret = ret64;
-        goto fail;
-    }
-    size_t read_num = size;
-    lsmash_bs_read_data( bs, buf[0], &read_num );
-    uint64_t read_pos = bs->offset;
-    /* Write the Segment Index Boxes actually here. */
-    if( (ret64 = lsmash_bs_write_seek( bs, file->fragment->first_moof_pos, SEEK_SET )) < 0 )
-    {
-        ret = ret64;
-        goto fail;
-    }
+        return ret64;
     for( lsmash_entry_t *entry = file->sidx_list.head; entry; entry = entry->next )
     {
         isom_sidx_t *sidx = (isom_sidx_t *)entry->data;
         if( !sidx )
             continue;
         if( (ret = isom_write_box( file->bs, (isom_box_t *)sidx )) < 0 )
-            goto fail;
+            return ret;
     }
-    /* Rearrange subsequent data. */
-    uint64_t write_pos = bs->offset;
-    uint64_t total     = file->size + total_sidx_size;
-    if( (ret = isom_rearrange_data( file, remux, buf, read_num, size, read_pos, write_pos, total )) < 0 )
-        goto fail;
     file->size += total_sidx_size;
-    lsmash_freep( &buf[0] );
+    /* Get back to the end of the file. */
+    if( (ret64 = lsmash_bs_write_seek( bs, total, SEEK_SET )) < 0 )
+        return ret64;
     /* Update 'moof_offset' of each entry within the Track Fragment Random Access Boxes. */
     if( file->mfra )
         for( lsmash_entry_t *entry = file->mfra->tfra_list.head; entry; entry = entry->next )
@@ -348,9 +328,6 @@ static int isom_write_segment_indexes
             }
         }
     return 0;
-fail:
-    lsmash_free( buf[0] );
-    return ret;
 }
 
 int isom_finish_final_fragment_movie
@@ -417,9 +394,7 @@ static int isom_create_fragment_overall_default_settings( lsmash_file_t *file )
             return LSMASH_ERR_NAMELESS;
         isom_stbl_t *stbl = trak->mdia->minf->stbl;
         if( !stbl->stts || !stbl->stts->list
-         || !stbl->stsz
-         || (stbl->stts->list->tail && !stbl->stts->list->tail->data)
-         || (stbl->stsz->list && stbl->stsz->list->head && !stbl->stsz->list->head->data) )
+         || !stbl->stsz )
             return LSMASH_ERR_NAMELESS;
         isom_trex_t *trex = isom_add_trex( file->moov->mvex );
         if( !trex )
@@ -429,12 +404,12 @@ static int isom_create_fragment_overall_default_settings( lsmash_file_t *file )
         trex->default_sample_description_index = trak->cache->chunk.sample_description_index
                                                ? trak->cache->chunk.sample_description_index
                                                : 1;
-        trex->default_sample_duration          = stbl->stts->list->tail
-                                               ? ((isom_stts_entry_t *)stbl->stts->list->tail->data)->sample_delta
+        trex->default_sample_duration          = stbl->stts->list->entry_count
+                                               ? ((isom_stts_entry_t *)stbl->stts->list->data)[stbl->stts->list->entry_count - 1].sample_delta
                                                : 1;
         trex->default_sample_size              = !stbl->stsz->list
-                                               ? stbl->stsz->sample_size : stbl->stsz->list->head
-                                               ? ((isom_stsz_entry_t *)stbl->stsz->list->head->data)->entry_size : 0;
+                                               ? stbl->stsz->sample_size : stbl->stsz->list->entry_count
+                                               ? ((isom_stsz_entry_t *)stbl->stsz->list->data)->entry_size : 0;
         if( stbl->sdtp
          && stbl->sdtp->list )
         {
@@ -1253,7 +1228,7 @@ int isom_append_fragment_track_run
         return LSMASH_ERR_MEMORY_ALLOC;
     fragment->sample_count += chunk->pool->sample_count;
     fragment->pool_size    += chunk->pool->size;
-    chunk->pool = isom_create_sample_pool( chunk->pool->size );
+    chunk->pool = isom_create_sample_pool();
     return chunk->pool ? 0 : LSMASH_ERR_MEMORY_ALLOC;
 }
 
@@ -1407,7 +1382,7 @@ static int isom_update_fragment_sample_tables( isom_traf_t *traf, lsmash_sample_
     if( !current->pool )
     {
         /* Very initial settings, just once per track */
-        current->pool = isom_create_sample_pool( 0 );
+        current->pool = isom_create_sample_pool();
         if( !current->pool )
             return LSMASH_ERR_MEMORY_ALLOC;
     }
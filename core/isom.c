@@ -134,6 +134,15 @@ static int isom_add_elst_entry( isom_elst_t *elst, uint64_t segment_duration, in
     return 0;
 }
 
+/* 32-bit FNV-1a */
+uint32_t isom_get_ps_hash( uint8_t *ps, uint32_t ps_size )
+{
+    uint32_t hash = 0x811c9dc5;
+    for( uint32_t i = 0; i < ps_size; i++ )
+        hash = (hash ^ ps[i]) * 0x01000193;
+    return hash;
+}
+
 isom_dcr_ps_entry_t *isom_create_ps_entry( uint8_t *ps, uint32_t ps_size )
 {
     isom_dcr_ps_entry_t *entry = lsmash_malloc( sizeof(isom_dcr_ps_entry_t) );
@@ -147,6 +156,7 @@ isom_dcr_ps_entry_t *isom_create_ps_entry( uint8_t *ps, uint32_t ps_size )
     }
     entry->nalUnitLength = ps_size;
     entry->unused        = 0;
+    entry->hash          = isom_get_ps_hash( ps, ps_size );
     return entry;
 }
 
@@ -322,17 +332,10 @@ static int isom_add_stts_entry( isom_stbl_t *stbl, uint32_t sample_delta )
      || !stbl->stts
      || !stbl->stts->list )
         return LSMASH_ERR_NAMELESS;
-    isom_stts_entry_t *data = lsmash_malloc( sizeof(isom_stts_entry_t) );
-    if( !data )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    data->sample_count = 1;
-    data->sample_delta = sample_delta;
-    if( lsmash_add_entry( stbl->stts->list, data ) < 0 )
-    {
-        lsmash_free( data );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    return 0;
+    isom_stts_entry_t data;
+    data.sample_count = 1;
+    data.sample_delta = sample_delta;
+    return lsmash_add_array_entry( stbl->stts->list, &data );
 }
 
 static int isom_add_ctts_entry( isom_stbl_t *stbl, uint32_t sample_offset )
@@ -341,17 +344,10 @@ static int isom_add_ctts_entry( isom_stbl_t *stbl, uint32_t sample_offset )
      || !stbl->ctts
      || !stbl->ctts->list )
         return LSMASH_ERR_NAMELESS;
-    isom_ctts_entry_t *data = lsmash_malloc( sizeof(isom_ctts_entry_t) );
-    if( !data )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    data->sample_count  = 1;
-    data->sample_offset = sample_offset;
-    if( lsmash_add_entry( stbl->ctts->list, data ) < 0 )
-    {
-        lsmash_free( data );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    return 0;
+    isom_ctts_entry_t data;
+    data.sample_count  = 1;
+    data.sample_offset = sample_offset;
+    return lsmash_add_array_entry( stbl->ctts->list, &data );
 }
 
 static int isom_add_stsc_entry( isom_stbl_t *stbl, uint32_t first_chunk, uint32_t samples_per_chunk, uint32_t sample_description_index )
@@ -360,18 +356,11 @@ static int isom_add_stsc_entry( isom_stbl_t *stbl, uint32_t first_chunk, uint32_
      || !stbl->stsc
      || !stbl->stsc->list )
         return LSMASH_ERR_NAMELESS;
-    isom_stsc_entry_t *data = lsmash_malloc( sizeof(isom_stsc_entry_t) );
-    if( !data )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    data->first_chunk              = first_chunk;
-    data->samples_per_chunk        = samples_per_chunk;
-    data->sample_description_index = sample_description_index;
-    if( lsmash_add_entry( stbl->stsc->list, data ) < 0 )
-    {
-        lsmash_free( data );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    return 0;
+    isom_stsc_entry_t data;
+    data.first_chunk              = first_chunk;
+    data.samples_per_chunk        = samples_per_chunk;
+    data.sample_description_index = sample_description_index;
+    return lsmash_add_array_entry( stbl->stsc->list, &data );
 }
 
 static int isom_add_stsz_entry( isom_stbl_t *stbl, uint32_t entry_size )
@@ -392,32 +381,24 @@ static int isom_add_stsz_entry( isom_stbl_t *stbl, uint32_t entry_size )
     /* found sample_size varies, create sample_size list */
     if( !stsz->list )
     {
-        stsz->list = lsmash_create_entry_list();
+        stsz->list = lsmash_create_entry_array( sizeof(isom_stsz_entry_t) );
         if( !stsz->list )
             return LSMASH_ERR_MEMORY_ALLOC;
+        int err = lsmash_reserve_array_entries( stsz->list, stsz->sample_count + 1 );
+        if( err < 0 )
+            return err;
+        isom_stsz_entry_t data;
+        data.entry_size = stsz->sample_size;
         for( uint32_t i = 0; i < stsz->sample_count; i++ )
-        {
-            isom_stsz_entry_t *data = lsmash_malloc( sizeof(isom_stsz_entry_t) );
-            if( !data )
-                return LSMASH_ERR_MEMORY_ALLOC;
-            data->entry_size = stsz->sample_size;
-            if( lsmash_add_entry( stsz->list, data ) < 0 )
-            {
-                lsmash_free( data );
-                return LSMASH_ERR_MEMORY_ALLOC;
-            }
-        }
+            if( (err = lsmash_add_array_entry( stsz->list, &data )) < 0 )
+                return err;
         stsz->sample_size = 0;
     }
-    isom_stsz_entry_t *data = lsmash_malloc( sizeof(isom_stsz_entry_t) );
-    if( !data )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    data->entry_size = entry_size;
-    if( lsmash_add_entry( stsz->list, data ) < 0 )
-    {
-        lsmash_free( data );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
+    isom_stsz_entry_t data;
+    data.entry_size = entry_size;
+    int err = lsmash_add_array_entry( stsz->list, &data );
+    if( err < 0 )
+        return err;
     ++ stsz->sample_count;
     return 0;
 }
@@ -428,16 +409,9 @@ static int isom_add_stss_entry( isom_stbl_t *stbl, uint32_t sample_number )
      || !stbl->stss
      || !stbl->stss->list )
         return LSMASH_ERR_NAMELESS;
-    isom_stss_entry_t *data = lsmash_malloc( sizeof(isom_stss_entry_t) );
-    if( !data )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    data->sample_number = sample_number;
-    if( lsmash_add_entry( stbl->stss->list, data ) < 0 )
-    {
-        lsmash_free( data );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    return 0;
+    isom_stss_entry_t data;
+    data.sample_number = sample_number;
+    return lsmash_add_array_entry( stbl->stss->list, &data );
 }
 
 static int isom_add_stps_entry( isom_stbl_t *stbl, uint32_t sample_number )
@@ -446,16 +420,9 @@ static int isom_add_stps_entry( isom_stbl_t *stbl, uint32_t sample_number )
      || !stbl->stps
      || !stbl->stps->list )
         return LSMASH_ERR_NAMELESS;
-    isom_stps_entry_t *data = lsmash_malloc( sizeof(isom_stps_entry_t) );
-    if( !data )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    data->sample_number = sample_number;
-    if( lsmash_add_entry( stbl->stps->list, data ) < 0 )
-    {
-        lsmash_free( data );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    return 0;
+    isom_stps_entry_t data;
+    data.sample_number = sample_number;
+    return lsmash_add_array_entry( stbl->stps->list, &data );
 }
 
 /* Between ISOBMFF and QTFF, the most significant 2-bit has different meaning.
@@ -508,16 +475,9 @@ static int isom_add_co64_entry( isom_stbl_t *stbl, uint64_t chunk_offset )
      || !stbl->stco
      || !stbl->stco->list )
         return LSMASH_ERR_NAMELESS;
-    isom_co64_entry_t *data = lsmash_malloc( sizeof(isom_co64_entry_t) );
-    if( !data )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    data->chunk_offset = chunk_offset;
-    if( lsmash_add_entry( stbl->stco->list, data ) < 0 )
-    {
-        lsmash_free( data );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    return 0;
+    isom_co64_entry_t data;
+    data.chunk_offset = chunk_offset;
+    return lsmash_add_array_entry( stbl->stco->list, &data );
 }
 
 static int isom_convert_stco_to_co64( isom_stbl_t *stbl )
@@ -532,17 +492,39 @@ static int isom_convert_stco_to_co64( isom_stbl_t *stbl )
         goto fail;
     }
     /* move chunk_offset to co64 from stco */
-    for( lsmash_entry_t *entry = stco->list->head; entry; entry = entry->next )
-    {
-        isom_stco_entry_t *data = (isom_stco_entry_t*)entry->data;
-        if( (err = isom_add_co64_entry( stbl, data->chunk_offset )) < 0 )
+    if( (err = lsmash_reserve_array_entries( stbl->stco->list, stco->list->entry_count + 1 )) < 0 )
+        goto fail;
+    isom_stco_entry_t *data = (isom_stco_entry_t *)stco->list->data;
+    for( uint32_t i = 0; i < stco->list->entry_count; i++ )
+        if( (err = isom_add_co64_entry( stbl, data[i].chunk_offset )) < 0 )
             goto fail;
-    }
 fail:
     isom_remove_box_by_itself( stco );
     return err;
 }
 
+static void isom_compact_sample_size_table( isom_stbl_t *stbl )
+{
+    isom_stsz_t *stsz = stbl->stsz;
+    if( stsz->sample_size != 0
+     || stsz->field_size   != 0
+     || !stsz->list
+     || !stsz->list->entry_count )
+        return;     /* The table is absent or already compact. */
+    uint32_t max_entry_size = 0;
+    isom_stsz_entry_t *data = (isom_stsz_entry_t *)stsz->list->data;
+    for( uint32_t i = 0; i < stsz->list->entry_count; i++ )
+        max_entry_size = LSMASH_MAX( max_entry_size, data[i].entry_size );
+    if( max_entry_size > UINT16_MAX )
+        return;     /* The Compact Sample Size Box cannot store this table. */
+    /* Any field size of the Compact Sample Size Box is smaller than that of the Sample Size Box. */
+    stsz->field_size = max_entry_size <= 0x0f ? 4
+                     : max_entry_size <= 0xff ? 8
+                     :                          16;
+    stsz->type       = ISOM_BOX_TYPE_STZ2;
+    isom_set_box_writer( (isom_box_t *)stsz );
+}
+
 static int isom_add_stco_entry( isom_stbl_t *stbl, uint64_t chunk_offset )
 {
     if( !stbl
@@ -558,16 +540,9 @@ static int isom_add_stco_entry( isom_stbl_t *stbl, uint64_t chunk_offset )
             return err;
         return isom_add_co64_entry( stbl, chunk_offset );
     }
-    isom_stco_entry_t *data = lsmash_malloc( sizeof(isom_stco_entry_t) );
-    if( !data )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    data->chunk_offset = (uint32_t)chunk_offset;
-    if( lsmash_add_entry( stbl->stco->list, data ) < 0 )
-    {
-        lsmash_free( data );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    return 0;
+    isom_stco_entry_t data;
+    data.chunk_offset = (uint32_t)chunk_offset;
+    return lsmash_add_array_entry( stbl->stco->list, &data );
 }
 
 static isom_sgpd_t *isom_get_sample_group_description_common( lsmash_entry_list_t *list, uint32_t grouping_type )
@@ -706,21 +681,18 @@ static uint64_t isom_get_dts( isom_stts_t *stts, uint32_t sample_number )
         return 0;
     uint64_t dts = 0;
     uint32_t i   = 1;
-    lsmash_entry_t    *entry;
-    isom_stts_entry_t *data = NULL;
-    for( entry = stts->list->head; entry; entry = entry->next )
+    uint32_t n;
+    isom_stts_entry_t *data = (isom_stts_entry_t *)stts->list->data;
+    for( n = 0; n < stts->list->entry_count; n++ )
     {
-        data = (isom_stts_entry_t *)entry->data;
-        if( !data )
-            return 0;
-        if( i + data->sample_count > sample_number )
+        if( i + data[n].sample_count > sample_number )
             break;
-        dts += (uint64_t)data->sample_delta * data->sample_count;
-        i   += data->sample_count;
+        dts += (uint64_t)data[n].sample_delta * data[n].sample_count;
+        i   += data[n].sample_count;
     }
-    if( !entry )
+    if( n == stts->list->entry_count )
         return 0;
-    dts += (uint64_t)data->sample_delta * (sample_number - i);
+    dts += (uint64_t)data[n].sample_delta * (sample_number - i);
     return dts;
 }
 
@@ -733,22 +705,19 @@ static uint64_t isom_get_cts( isom_stts_t *stts, isom_ctts_t *ctts, uint32_t sam
     if( !ctts )
         return isom_get_dts( stts, sample_number );
     uint32_t i = 1;     /* This can be 0 (and then condition below shall be changed) but I dare use same algorithm with isom_get_dts. */
-    lsmash_entry_t    *entry;
-    isom_ctts_entry_t *data = NULL;
+    uint32_t n;
+    isom_ctts_entry_t *data = (isom_ctts_entry_t *)ctts->list->data;
     if( sample_number == 0 )
         return 0;
-    for( entry = ctts->list->head; entry; entry = entry->next )
+    for( n = 0; n < ctts->list->entry_count; n++ )
     {
-        data = (isom_ctts_entry_t *)entry->data;
-        if( !data )
-            return 0;
-        if( i + data->sample_count > sample_number )
+        if( i + data[n].sample_count > sample_number )
             break;
-        i += data->sample_count;
+        i += data[n].sample_count;
     }
-    if( !entry )
+    if( n == ctts->list->entry_count )
         return 0;
-    return isom_get_dts( stts, sample_number ) + data->sample_offset;
+    return isom_get_dts( stts, sample_number ) + data[n].sample_offset;
 }
 #endif
 
@@ -757,10 +726,9 @@ static int isom_replace_last_sample_delta( isom_stbl_t *stbl, uint32_t sample_de
     if( !stbl
      || !stbl->stts
      || !stbl->stts->list
-     || !stbl->stts->list->tail
-     || !stbl->stts->list->tail->data )
+     || !stbl->stts->list->entry_count )
         return LSMASH_ERR_NAMELESS;
-    isom_stts_entry_t *last_stts_data = (isom_stts_entry_t *)stbl->stts->list->tail->data;
+    isom_stts_entry_t *last_stts_data = (isom_stts_entry_t *)lsmash_get_array_entry_data( stbl->stts->list, stbl->stts->list->entry_count );
     if( sample_delta != last_stts_data->sample_delta )
     {
         if( last_stts_data->sample_count > 1 )
@@ -804,8 +772,9 @@ static int isom_update_mdhd_duration( isom_trak_t *trak, uint32_t last_sample_de
         return 0;
     }
     /* Now we have at least 1 sample, so do stts_entry. */
-    lsmash_entry_t    *last_stts      = stts->list->tail;
-    isom_stts_entry_t *last_stts_data = (isom_stts_entry_t *)last_stts->data;
+    isom_stts_entry_t *last_stts_data = (isom_stts_entry_t *)lsmash_get_array_entry_data( stts->list, stts->list->entry_count );
+    if( !last_stts_data )
+        return LSMASH_ERR_INVALID_DATA;
     if( sample_count == 1 )
         mdhd->duration = last_stts_data->sample_delta;
     /* Now we have at least 2 samples,
@@ -826,11 +795,14 @@ static int isom_update_mdhd_duration( isom_trak_t *trak, uint32_t last_sample_de
         else
         {
             /* Remove the last entry. */
-            if( (err = lsmash_remove_entry_tail( stts->list, NULL )) < 0 )
+            if( (err = lsmash_remove_array_entry_tail( stts->list )) < 0 )
                 return err;
             /* copy the previous sample_delta. */
-            ++ ((isom_stts_entry_t *)stts->list->tail->data)->sample_count;
-            mdhd->duration += ((isom_stts_entry_t *)stts->list->tail->data)->sample_delta;
+            last_stts_data = (isom_stts_entry_t *)lsmash_get_array_entry_data( stts->list, stts->list->entry_count );
+            if( !last_stts_data )
+                return LSMASH_ERR_INVALID_DATA;
+            ++ last_stts_data->sample_count;
+            mdhd->duration += last_stts_data->sample_delta;
         }
     }
     else
@@ -847,15 +819,13 @@ static int isom_update_mdhd_duration( isom_trak_t *trak, uint32_t last_sample_de
         int32_t  ctd_shift  = trak->cache->timestamp.ctd_shift;
         uint32_t j = 0;
         uint32_t k = 0;
-        lsmash_entry_t *stts_entry = stts->list->head;
-        lsmash_entry_t *ctts_entry = ctts->list->head;
+        isom_stts_entry_t *stts_data = (isom_stts_entry_t *)stts->list->data;
+        isom_ctts_entry_t *ctts_data = (isom_ctts_entry_t *)ctts->list->data;
+        isom_stts_entry_t *stts_end  = stts_data + stts->list->entry_count;
+        isom_ctts_entry_t *ctts_end  = ctts_data + ctts->list->entry_count;
         for( uint32_t i = 0; i < sample_count; i++ )
         {
-            if( !ctts_entry || !stts_entry )
-                return LSMASH_ERR_INVALID_DATA;
-            isom_stts_entry_t *stts_data = (isom_stts_entry_t *)stts_entry->data;
-            isom_ctts_entry_t *ctts_data = (isom_ctts_entry_t *)ctts_entry->data;
-            if( !stts_data || !ctts_data )
+            if( ctts_data == ctts_end || stts_data == stts_end )
                 return LSMASH_ERR_INVALID_DATA;
             uint64_t cts;
             if( ctd_shift )
@@ -884,12 +854,12 @@ static int isom_update_mdhd_duration( isom_trak_t *trak, uint32_t last_sample_de
             /* If finished sample_count of current entry, move to next. */
             if( ++j == ctts_data->sample_count )
             {
-                ctts_entry = ctts_entry->next;
+                ++ctts_data;
                 j = 0;
             }
             if( ++k == stts_data->sample_count )
             {
-                stts_entry = stts_entry->next;
+                ++stts_data;
                 k = 0;
             }
         }
@@ -1044,69 +1014,71 @@ int lsmash_update_track_duration( lsmash_root_t *root, uint32_t track_ID, uint32
     return err;
 }
 
-static inline int isom_increment_sample_number_in_entry( uint32_t *sample_number_in_entry, uint32_t sample_count_in_entry, lsmash_entry_t **entry )
+static inline void isom_increment_sample_number_in_entry( uint32_t *sample_number_in_entry, uint32_t sample_count_in_entry, uint32_t *entry_index )
 {
     if( *sample_number_in_entry != sample_count_in_entry )
     {
         *sample_number_in_entry += 1;
-        return 0;
+        return;
     }
     /* Precede the next entry. */
     *sample_number_in_entry = 1;
-    if( *entry )
+    *entry_index += 1;
+}
+
+/* Account a sample into the bitrate description.
+ * The maximum bitrate is the largest total size of the samples within a one second window. */
+static void isom_account_bitrate( isom_bitrate_entry_t *bitrate, uint32_t size, uint32_t timescale )
+{
+    if( bitrate->buffer_size < size )
+        bitrate->buffer_size = size;
+    bitrate->total_size += size;
+    bitrate->rate       += size;
+    if( bitrate->dts > bitrate->time_wnd + timescale )
+    {
+        if( bitrate->rate > bitrate->max_rate )
+            bitrate->max_rate = bitrate->rate;
+        bitrate->time_wnd = bitrate->dts;
+        bitrate->rate     = 0;
+    }
+    ++ bitrate->sample_count;
+}
+
+/* Fill the bitrate accounts of given sample description by walking the sample tables.
+ * This is used only when the samples were not accounted while appended. */
+static void isom_scan_bitrate_description( isom_mdia_t *mdia, isom_bitrate_entry_t *bitrate, uint32_t sample_description_index )
+{
+    isom_stsz_t *stsz                = mdia->minf->stbl->stsz;
+    lsmash_entry_array_t *stts_list  = mdia->minf->stbl->stts->list;
+    lsmash_entry_array_t *stsc_list  = mdia->minf->stbl->stsc->list;
+    isom_stsz_entry_t *stsz_entries  = stsz->list ? (isom_stsz_entry_t *)stsz->list->data : NULL;
+    isom_stts_entry_t *stts_entries  = (isom_stts_entry_t *)stts_list->data;
+    isom_stsc_entry_t *stsc_entries  = (isom_stsc_entry_t *)stsc_list->data;
+    isom_stts_entry_t *stts_data     = NULL;
+    isom_stsc_entry_t *stsc_data     = NULL;
+    uint32_t stsz_index              = 0;
+    uint32_t stts_index              = 0;
+    uint32_t next_stsc_index         = 0;
+    uint32_t timescale               = mdia->mdhd->timescale;
+    uint32_t chunk_number            = 0;
+    uint32_t sample_number_in_stts   = 1;
+    uint32_t sample_number_in_chunk  = 1;
+    memset( bitrate, 0, sizeof(isom_bitrate_entry_t) );
+    while( stts_index < stts_list->entry_count )
     {
-        *entry = (*entry)->next;
-        if( *entry && !(*entry)->data )
-            return LSMASH_ERR_INVALID_DATA;
-    }
-    return 0;
-}
-
-static int isom_calculate_bitrate_description( isom_mdia_t *mdia, uint32_t *bufferSizeDB, uint32_t *maxBitrate, uint32_t *avgBitrate, uint32_t sample_description_index )
-{
-    isom_stsz_t *stsz               = mdia->minf->stbl->stsz;
-    lsmash_entry_t *stsz_entry      = stsz->list ? stsz->list->head : NULL;
-    lsmash_entry_t *stts_entry      = mdia->minf->stbl->stts->list->head;
-    lsmash_entry_t *stsc_entry      = NULL;
-    lsmash_entry_t *next_stsc_entry = mdia->minf->stbl->stsc->list->head;
-    isom_stts_entry_t *stts_data    = NULL;
-    isom_stsc_entry_t *stsc_data    = NULL;
-    if( next_stsc_entry && !next_stsc_entry->data )
-        return LSMASH_ERR_INVALID_DATA;
-    uint32_t rate                   = 0;
-    uint64_t dts                    = 0;
-    uint32_t time_wnd               = 0;
-    uint32_t timescale              = mdia->mdhd->timescale;
-    uint32_t chunk_number           = 0;
-    uint32_t sample_number_in_stts  = 1;
-    uint32_t sample_number_in_chunk = 1;
-    *bufferSizeDB = 0;
-    *maxBitrate   = 0;
-    *avgBitrate   = 0;
-    while( stts_entry )
-    {
-        int err;
         if( !stsc_data || sample_number_in_chunk == stsc_data->samples_per_chunk )
         {
             /* Move the next chunk. */
             sample_number_in_chunk = 1;
             ++chunk_number;
             /* Check if the next entry is broken. */
-            while( next_stsc_entry && ((isom_stsc_entry_t *)next_stsc_entry->data)->first_chunk < chunk_number )
-            {
+            while( next_stsc_index < stsc_list->entry_count && stsc_entries[next_stsc_index].first_chunk < chunk_number )
                 /* Just skip broken next entry. */
-                next_stsc_entry = next_stsc_entry->next;
-                if( next_stsc_entry && !next_stsc_entry->data )
-                    return LSMASH_ERR_INVALID_DATA;
-            }
+                ++next_stsc_index;
             /* Check if the next chunk belongs to the next sequence of chunks. */
-            if( next_stsc_entry && ((isom_stsc_entry_t *)next_stsc_entry->data)->first_chunk == chunk_number )
+            if( next_stsc_index < stsc_list->entry_count && stsc_entries[next_stsc_index].first_chunk == chunk_number )
             {
-                stsc_entry = next_stsc_entry;
-                next_stsc_entry = next_stsc_entry->next;
-                if( next_stsc_entry && !next_stsc_entry->data )
-                    return LSMASH_ERR_INVALID_DATA;
-                stsc_data = (isom_stsc_entry_t *)stsc_entry->data;
+                stsc_data = &stsc_entries[next_stsc_index++];
                 /* Check if the next contiguous chunks belong to given sample description. */
                 if( stsc_data->sample_description_index != sample_description_index )
                 {
@@ -1114,43 +1086,41 @@ static int isom_calculate_bitrate_description( isom_mdia_t *mdia, uint32_t *buff
                     uint32_t number_of_skips   = 0;
                     uint32_t first_chunk       = stsc_data->first_chunk;
                     uint32_t samples_per_chunk = stsc_data->samples_per_chunk;
-                    while( next_stsc_entry )
+                    while( next_stsc_index < stsc_list->entry_count )
                     {
-                        if( ((isom_stsc_entry_t *)next_stsc_entry->data)->sample_description_index != sample_description_index )
+                        if( stsc_entries[next_stsc_index].sample_description_index != sample_description_index )
                         {
-                            stsc_data = (isom_stsc_entry_t *)next_stsc_entry->data;
+                            stsc_data = &stsc_entries[next_stsc_index];
                             number_of_skips  += (stsc_data->first_chunk - first_chunk) * samples_per_chunk;
                             first_chunk       = stsc_data->first_chunk;
                             samples_per_chunk = stsc_data->samples_per_chunk;
                         }
-                        else if( ((isom_stsc_entry_t *)next_stsc_entry->data)->first_chunk <= first_chunk )
+                        else if( stsc_entries[next_stsc_index].first_chunk <= first_chunk )
                             ;   /* broken entry */
                         else
                             break;
                         /* Just skip the next entry. */
-                        next_stsc_entry = next_stsc_entry->next;
-                        if( next_stsc_entry && !next_stsc_entry->data )
-                            return LSMASH_ERR_INVALID_DATA;
+                        ++next_stsc_index;
                     }
-                    if( !next_stsc_entry )
+                    if( next_stsc_index == stsc_list->entry_count )
                         break;      /* There is no more chunks which don't belong to given sample description. */
-                    number_of_skips += (((isom_stsc_entry_t *)next_stsc_entry->data)->first_chunk - first_chunk) * samples_per_chunk;
+                    number_of_skips += (stsc_entries[next_stsc_index].first_chunk - first_chunk) * samples_per_chunk;
                     for( uint32_t i = 0; i < number_of_skips; i++ )
                     {
                         if( stsz->list )
                         {
-                            if( !stsz_entry )
+                            if( stsz_index == stsz->list->entry_count )
                                 break;
-                            stsz_entry = stsz_entry->next;
+                            ++stsz_index;
                         }
-                        if( !stts_entry )
+                        if( stts_index == stts_list->entry_count )
                             break;
-                        if( (err = isom_increment_sample_number_in_entry( &sample_number_in_stts,
-                                                                          ((isom_stts_entry_t *)stts_entry->data)->sample_count,
-                                                                          &stts_entry )) < 0 )
-                            return err;
+                        isom_increment_sample_number_in_entry( &sample_number_in_stts,
+                                                               stts_entries[stts_index].sample_count,
+                                                               &stts_index );
                     }
-                    if( (stsz->list && !stsz_entry) || !stts_entry )
+                    if( (stsz->list && stsz_index == stsz->list->entry_count)
+                     || stts_index == stts_list->entry_count )
                         break;
                     chunk_number = stsc_data->first_chunk;
                 }
@@ -1162,41 +1132,39 @@ static int isom_calculate_bitrate_description( isom_mdia_t *mdia, uint32_t *buff
         uint32_t size;
         if( stsz->list )
         {
-            if( !stsz_entry )
+            if( stsz_index == stsz->list->entry_count )
                 break;
-            isom_stsz_entry_t *stsz_data = (isom_stsz_entry_t *)stsz_entry->data;
-            if( !stsz_data )
-                return LSMASH_ERR_INVALID_DATA;
-            size = stsz_data->entry_size;
-            stsz_entry = stsz_entry->next;
+            size = stsz_entries[stsz_index++].entry_size;
         }
         else
             size = stsz->sample_size;
         /* Get current sample's DTS. */
         if( stts_data )
-            dts += stts_data->sample_delta;
-        stts_data = (isom_stts_entry_t *)stts_entry->data;
-        if( !stts_data )
-            return LSMASH_ERR_INVALID_DATA;
-        if( (err = isom_increment_sample_number_in_entry( &sample_number_in_stts, stts_data->sample_count, &stts_entry )) < 0 )
-            return err;
+            bitrate->dts += stts_data->sample_delta;
+        stts_data = &stts_entries[stts_index];
+        isom_increment_sample_number_in_entry( &sample_number_in_stts, stts_data->sample_count, &stts_index );
         /* Calculate bitrate description. */
-        if( *bufferSizeDB < size )
-            *bufferSizeDB = size;
-        *avgBitrate += size;
-        rate += size;
-        if( dts > time_wnd + timescale )
-        {
-            if( rate > *maxBitrate )
-                *maxBitrate = rate;
-            time_wnd = dts;
-            rate = 0;
-        }
+        isom_account_bitrate( bitrate, size, timescale );
     }
-    double duration = (double)mdia->mdhd->duration / timescale;
-    *avgBitrate = (uint32_t)(*avgBitrate / duration);
-    if( *maxBitrate == 0 )
-        *maxBitrate = *avgBitrate;
+}
+
+static int isom_calculate_bitrate_description( isom_mdia_t *mdia, uint32_t *bufferSizeDB, uint32_t *maxBitrate, uint32_t *avgBitrate, uint32_t sample_description_index )
+{
+    /* Use the accounts made while the samples were appended if any. */
+    isom_trak_t          *trak    = (isom_trak_t *)mdia->parent;
+    isom_bitrate_entry_t *bitrate = trak && trak->cache
+                                  ? (isom_bitrate_entry_t *)lsmash_get_array_entry_data( trak->cache->bitrate.list, sample_description_index )
+                                  : NULL;
+    isom_bitrate_entry_t scanned;
+    if( !bitrate || bitrate->sample_count == 0 )
+    {
+        isom_scan_bitrate_description( mdia, &scanned, sample_description_index );
+        bitrate = &scanned;
+    }
+    double duration = (double)mdia->mdhd->duration / mdia->mdhd->timescale;
+    *bufferSizeDB = bitrate->buffer_size;
+    *avgBitrate   = (uint32_t)(bitrate->total_size / duration);
+    *maxBitrate   = bitrate->max_rate ? bitrate->max_rate : *avgBitrate;
     /* Convert to bits per second. */
     *maxBitrate *= 8;
     *avgBitrate *= 8;
@@ -2038,10 +2006,10 @@ uint32_t lsmash_get_last_sample_delta( lsmash_root_t *root, uint32_t track_ID )
      || !trak->mdia->minf->stbl
      || !trak->mdia->minf->stbl->stts
      || !trak->mdia->minf->stbl->stts->list
-     || !trak->mdia->minf->stbl->stts->list->tail
-     || !trak->mdia->minf->stbl->stts->list->tail->data )
+     || !trak->mdia->minf->stbl->stts->list->entry_count )
         return 0;
-    return ((isom_stts_entry_t *)trak->mdia->minf->stbl->stts->list->tail->data)->sample_delta;
+    lsmash_entry_array_t *stts_list = trak->mdia->minf->stbl->stts->list;
+    return ((isom_stts_entry_t *)lsmash_get_array_entry_data( stts_list, stts_list->entry_count ))->sample_delta;
 }
 
 uint32_t lsmash_get_start_time_offset( lsmash_root_t *root, uint32_t track_ID )
@@ -2055,10 +2023,9 @@ uint32_t lsmash_get_start_time_offset( lsmash_root_t *root, uint32_t track_ID )
      || !trak->mdia->minf->stbl
      || !trak->mdia->minf->stbl->ctts
      || !trak->mdia->minf->stbl->ctts->list
-     || !trak->mdia->minf->stbl->ctts->list->head
-     || !trak->mdia->minf->stbl->ctts->list->head->data )
+     || !trak->mdia->minf->stbl->ctts->list->entry_count )
         return 0;
-    return ((isom_ctts_entry_t *)trak->mdia->minf->stbl->ctts->list->head->data)->sample_offset;
+    return ((isom_ctts_entry_t *)trak->mdia->minf->stbl->ctts->list->data)->sample_offset;
 }
 
 uint32_t lsmash_get_composition_to_decode_shift( lsmash_root_t *root, uint32_t track_ID )
@@ -2081,10 +2048,12 @@ uint32_t lsmash_get_composition_to_decode_shift( lsmash_root_t *root, uint32_t t
         return 0;
     if( !(file->max_isom_version >= 4 && stbl->ctts->version == 1) && !file->qt_compatible )
         return 0;   /* This movie shall not have composition to decode timeline shift. */
-    lsmash_entry_t *stts_entry = stbl->stts->list->head;
-    lsmash_entry_t *ctts_entry = stbl->ctts->list->head;
-    if( !stts_entry || !ctts_entry )
+    if( !stbl->stts->list->entry_count || !stbl->ctts->list->entry_count )
         return 0;
+    isom_stts_entry_t *stts_data = (isom_stts_entry_t *)stbl->stts->list->data;
+    isom_ctts_entry_t *ctts_data = (isom_ctts_entry_t *)stbl->ctts->list->data;
+    isom_stts_entry_t *stts_last = stts_data + stbl->stts->list->entry_count - 1;
+    isom_ctts_entry_t *ctts_last = ctts_data + stbl->ctts->list->entry_count - 1;
     uint64_t dts       = 0;
     uint64_t cts       = 0;
     uint32_t ctd_shift = 0;
@@ -2092,26 +2061,22 @@ uint32_t lsmash_get_composition_to_decode_shift( lsmash_root_t *root, uint32_t t
     uint32_t j         = 0;
     for( uint32_t k = 0; k < sample_count; k++ )
     {
-        isom_stts_entry_t *stts_data = (isom_stts_entry_t *)stts_entry->data;
-        isom_ctts_entry_t *ctts_data = (isom_ctts_entry_t *)ctts_entry->data;
-        if( !stts_data || !ctts_data )
-            return 0;
         cts = dts + (int32_t)ctts_data->sample_offset;
         if( dts > cts + ctd_shift )
             ctd_shift = dts - cts;
         dts += stts_data->sample_delta;
         if( ++i == stts_data->sample_count )
         {
-            stts_entry = stts_entry->next;
-            if( !stts_entry )
+            if( stts_data == stts_last )
                 return 0;
+            ++stts_data;
             i = 0;
         }
         if( ++j == ctts_data->sample_count )
         {
-            ctts_entry = ctts_entry->next;
-            if( !ctts_entry )
+            if( ctts_data == ctts_last )
                 return 0;
+            ++ctts_data;
             j = 0;
         }
     }
@@ -2590,9 +2555,9 @@ int isom_check_large_offset_requirement
     {
         isom_trak_t *trak = (isom_trak_t *)entry->data;
         isom_stco_t *stco = trak->mdia->minf->stbl->stco;
-        if( !stco->list->tail   /* no samples */
+        if( !stco->list->entry_count    /* no samples */
          || stco->large_presentation
-         || (((isom_stco_entry_t *)stco->list->tail->data)->chunk_offset + moov->size + meta_size) <= UINT32_MAX )
+         || (((isom_stco_entry_t *)stco->list->data)[stco->list->entry_count - 1].chunk_offset + moov->size + meta_size) <= UINT32_MAX )
         {
             entry = entry->next;
             continue;   /* no need to convert stco into co64 */
@@ -2620,36 +2585,37 @@ void isom_add_preceding_box_size
         isom_trak_t *trak = (isom_trak_t *)entry->data;
         isom_stsc_t *stsc = trak->mdia->minf->stbl->stsc;
         isom_stco_t *stco = trak->mdia->minf->stbl->stco;
-        lsmash_entry_t    *stsc_entry = stsc->list->head;
-        isom_stsc_entry_t *stsc_data  = stsc_entry ? (isom_stsc_entry_t *)stsc_entry->data : NULL;
+        isom_stsc_entry_t *stsc_data  = (isom_stsc_entry_t *)lsmash_get_array_entry_data( stsc->list, 1 );
+        isom_stsc_entry_t *stsc_end   = (isom_stsc_entry_t *)stsc->list->data + stsc->list->entry_count;
         uint32_t chunk_number = 1;
-        for( lsmash_entry_t *stco_entry = stco->list->head; stco_entry; )
+        for( uint32_t i = 0; i < stco->list->entry_count; )
         {
             if( stsc_data
              && stsc_data->first_chunk == chunk_number )
             {
                 lsmash_file_t *ref_file = isom_get_written_media_file( trak, stsc_data->sample_description_index );
-                stsc_entry = stsc_entry->next;
-                stsc_data  = stsc_entry ? (isom_stsc_entry_t *)stsc_entry->data : NULL;
+                ++stsc_data;
+                if( stsc_data == stsc_end )
+                    stsc_data = NULL;
                 if( ref_file != trak->file )
                 {
                     /* The chunks are not contained in the same file. Skip applying the offset.
                      * If no more stsc entries, the rest of the chunks is not contained in the same file. */
-                    if( !stsc_entry || !stsc_data )
+                    if( !stsc_data )
                         break;
-                    while( stco_entry && chunk_number < stsc_data->first_chunk )
+                    while( i < stco->list->entry_count && chunk_number < stsc_data->first_chunk )
                     {
-                        stco_entry = stco_entry->next;
+                        ++i;
                         ++chunk_number;
                     }
                     continue;
                 }
             }
             if( stco->large_presentation )
-                ((isom_co64_entry_t *)stco_entry->data)->chunk_offset += preceding_size;
+                ((isom_co64_entry_t *)stco->list->data)[i].chunk_offset += preceding_size;
             else
-                ((isom_stco_entry_t *)stco_entry->data)->chunk_offset += preceding_size;
-            stco_entry = stco_entry->next;
+                ((isom_stco_entry_t *)stco->list->data)[i].chunk_offset += preceding_size;
+            ++i;
             ++chunk_number;
         }
     }
@@ -2667,19 +2633,23 @@ int isom_establish_movie( lsmash_file_t *file )
     return 0;
 }
 
-int lsmash_finish_movie
+/* Get the amount of the shift of the media data to move boxes of 'mtf_size' bytes in total to the front.
+ * The reserved space, which is not enough, is overwritten together with the starting area of mdat.
+ * If the rest of it is too small to be a Free Space Box, extend it to the minimum size. */
+static uint64_t isom_get_front_shift( uint64_t mtf_size, uint64_t reserved_size )
+{
+    return mtf_size > reserved_size
+         ? mtf_size - reserved_size
+         : mtf_size + ISOM_BASEBOX_COMMON_SIZE - reserved_size;
+}
+
+static int isom_finish_movie
 (
     lsmash_root_t        *root,
+    lsmash_file_t        *file,
     lsmash_adhoc_remux_t *remux
 )
 {
-    if( isom_check_initializer_present( root ) < 0 )
-        return LSMASH_ERR_FUNCTION_PARAM;
-    lsmash_file_t *file = root->file;
-    if( !file
-     || !file->bs
-     || !file->initializer->moov )
-        return LSMASH_ERR_INVALID_DATA;
     if( file->fragment )
         return isom_finish_final_fragment_movie( file, remux );
     if( file != file->initializer )
@@ -2697,7 +2667,7 @@ int lsmash_finish_movie
          || !trak->mdia->minf->stbl
          || !trak->mdia->minf->stbl->stco
          || !trak->mdia->minf->stbl->stco->list
-         || !trak->mdia->minf->stbl->stco->list->tail )
+         || !trak->mdia->minf->stbl->stco->list->entry_count )
             return LSMASH_ERR_INVALID_DATA;
         if( (err = isom_complement_data_reference( trak->mdia->minf )) < 0 )
             return err;
@@ -2720,6 +2690,9 @@ int lsmash_finish_movie
         isom_stbl_t *stbl = trak->mdia->minf->stbl;
         if( !trak->cache->all_sync && !stbl->stss && !isom_add_stss( stbl ) )
             return LSMASH_ERR_NAMELESS;
+        /* Replace stsz with stz2 if the latter is smaller. QuickTime file format doesn't define stz2. */
+        if( file->compact_sample_size && !file->qt_compatible )
+            isom_compact_sample_size_table( stbl );
         if( (err = isom_update_tkhd_duration( trak ))             < 0
          || (err = isom_update_bitrate_description( trak->mdia )) < 0 )
             return err;
@@ -2733,59 +2706,129 @@ int lsmash_finish_movie
     file->mdat->manager &= ~LSMASH_INCOMPLETE_BOX;
     if( (err = isom_write_box( bs, (isom_box_t *)file->mdat )) < 0 )
         return err;
-    /* Write the Movie Box and a Meta Box if no optimization for progressive download. */
     uint64_t meta_size = file->meta ? file->meta->size : 0;
+    /* Compress the Movie Box if required and effective. Only QuickTime file format defines the Compressed Movie Box.
+     * Without any support of the compression, the Movie Box is written as it is. */
+    uint64_t moov_size = moov->size;
+    if( file->compress_movie && file->qt_compatible )
+    {
+        int64_t compressed_size = isom_compress_movie( file, 0 );
+        if( compressed_size < 0 && compressed_size != LSMASH_ERR_PATCH_WELCOME )
+            return compressed_size;
+        if( compressed_size > 0 && compressed_size < moov->size )
+            moov_size = compressed_size;
+        else
+            lsmash_freep( &file->compressed_movie );
+    }
+    /* Get the size of the space reserved for the Movie Box and a Meta Box ahead of the Media Data Box. */
+    isom_free_t *skip          = file->free;
+    uint64_t     reserved_size = skip && skip->size > ISOM_BASEBOX_COMMON_SIZE ? skip->size : 0;
+    int64_t      ret64;
+    if( reserved_size
+     && (moov_size + meta_size == reserved_size
+      || moov_size + meta_size + ISOM_BASEBOX_COMMON_SIZE <= reserved_size) )
+    {
+        /* Write the Movie Box and a Meta Box into the reserved space, and the rest of it remains as a Free Space Box.
+         * No media data moves, so any chunk offset is kept as it is. */
+        uint64_t current_pos = bs->offset;
+        if( (ret64 = lsmash_bs_write_seek( bs, skip->pos, SEEK_SET )) < 0 )
+            return ret64;
+        if( (err = isom_write_movie( bs, file )) < 0
+         || (err = isom_write_box( bs, (isom_box_t *)file->meta )) < 0 )
+            return err;
+        skip->pos  += moov_size + meta_size;
+        skip->size -= moov_size + meta_size;
+        if( skip->size )
+        {
+            isom_bs_put_box_common( bs, skip );
+            if( (err = lsmash_bs_flush_buffer( bs )) < 0 )
+                return err;
+        }
+        else
+            isom_remove_box_by_itself( skip );
+        return (ret64 = lsmash_bs_write_seek( bs, current_pos, SEEK_SET )) < 0 ? ret64 : 0;
+    }
+    /* Write the Movie Box and a Meta Box if no optimization for progressive download. */
     if( !remux )
     {
-        if( (err = isom_write_box( bs, (isom_box_t *)file->moov )) < 0
+        if( (err = isom_write_movie( bs, file )) < 0
          || (err = isom_write_box( bs, (isom_box_t *)file->meta )) < 0 )
             return err;
-        file->size += moov->size + meta_size;
+        file->size += moov_size + meta_size;
         return 0;
     }
     /* stco->co64 conversion, depending on last chunk's offset */
     if( (err = isom_check_large_offset_requirement( moov, meta_size )) < 0 )
         return err;
     /* now the amount of offset is fixed. */
-    uint64_t mtf_size = moov->size + meta_size;     /* sum of size of boxes moved to front */
-    /* buffer size must be at least mtf_size * 2 */
-    remux->buffer_size = LSMASH_MAX( remux->buffer_size, mtf_size * 2 );
-    /* Split to 2 buffers. */
-    uint8_t *buf[2] = { NULL, NULL };
-    if( (buf[0] = (uint8_t*)lsmash_malloc( remux->buffer_size )) == NULL )
-        return LSMASH_ERR_MEMORY_ALLOC; /* NOTE: I think we still can fallback to "return isom_write_moov();" here. */
-    size_t size = remux->buffer_size / 2;
-    buf[1] = buf[0] + size;
+    uint64_t mtf_size = moov_size + meta_size;      /* sum of size of boxes moved to front */
+    uint64_t shift    = isom_get_front_shift( mtf_size, reserved_size );
     /* Now, the amount of the offset is fixed. apply it to stco/co64 */
-    isom_add_preceding_box_size( moov, mtf_size );
-    /* Backup starting area of mdat and write moov + meta there instead. */
+    isom_add_preceding_box_size( moov, shift );
+    /* The size of the compressed Movie Box depends on the chunk offsets, which are shifted by the size in turn.
+     * Enlarge the space for it until the compressed one fits, and then the rest is filled with a Free Space Box in it.
+     * Enlarging by two box headers at least keeps the shift increasing. */
+    while( file->compressed_movie )
+    {
+        int64_t compressed_size = isom_compress_movie( file, moov_size );
+        if( compressed_size < 0 )
+            return compressed_size;
+        if( compressed_size == moov_size )
+            break;
+        moov_size = LSMASH_MAX( compressed_size, moov_size ) + 2 * ISOM_BASEBOX_COMMON_SIZE;
+        mtf_size  = moov_size + meta_size;
+        uint64_t new_shift = isom_get_front_shift( mtf_size, reserved_size );
+        isom_add_preceding_box_size( moov, new_shift - shift );
+        shift = new_shift;
+    }
+    /* Make room for moov + meta at the starting area of mdat. */
     isom_mdat_t *mdat            = file->mdat;
-    uint64_t     total           = file->size + mtf_size;
-    uint64_t     placeholder_pos = file->free ? file->free->pos : mdat->pos;
-    if( (err = lsmash_bs_write_seek( bs, placeholder_pos, SEEK_SET )) < 0 )
-        goto fail;
-    size_t read_num = size;
-    lsmash_bs_read_data( bs, buf[0], &read_num );
-    uint64_t read_pos = bs->offset;
-    /* Write moov + meta there instead. */
-    if( (err = lsmash_bs_write_seek( bs, placeholder_pos, SEEK_SET )) < 0
-     || (err = isom_write_box( bs, (isom_box_t *)file->moov ))        < 0
-     || (err = isom_write_box( bs, (isom_box_t *)file->meta ))        < 0 )
-        goto fail;
-    uint64_t write_pos = bs->offset;
+    uint64_t     total           = file->size + shift;
+    uint64_t     placeholder_pos = skip ? skip->pos : mdat->pos;
+    if( (err = isom_rearrange_data( file, remux, placeholder_pos + reserved_size, shift, total )) < 0 )
+        return err;
+    /* Write moov + meta there. */
+    if( (ret64 = lsmash_bs_write_seek( bs, placeholder_pos, SEEK_SET )) < 0 )
+        return ret64;
+    if( (err = isom_write_movie( bs, file )) < 0
+     || (err = isom_write_box( bs, (isom_box_t *)file->meta )) < 0 )
+        return err;
     /* Update the positions */
-    mdat->pos += mtf_size;
-    if( file->free )
-        file->free->pos += mtf_size;
-    /* Move Media Data Box. */
-    if( (err = isom_rearrange_data( file, remux, buf, read_num, size, read_pos, write_pos, total )) < 0 )
-        goto fail;
-    file->size += mtf_size;
-    lsmash_free( buf[0] );
-    return 0;
-fail:
-    lsmash_free( buf[0] );
-    return err;
+    mdat->pos += shift;
+    if( reserved_size && mtf_size > reserved_size )
+        isom_remove_box_by_itself( skip );
+    else if( reserved_size )
+    {
+        skip->pos  = placeholder_pos + mtf_size;
+        skip->size = ISOM_BASEBOX_COMMON_SIZE;
+        isom_bs_put_box_common( bs, skip );
+        if( (err = lsmash_bs_flush_buffer( bs )) < 0 )
+            return err;
+    }
+    else if( skip )
+        skip->pos += mtf_size;
+    file->size += shift;
+    /* Get back to the end of the file. */
+    return (ret64 = lsmash_bs_write_seek( bs, total, SEEK_SET )) < 0 ? ret64 : 0;
+}
+
+int lsmash_finish_movie
+(
+    lsmash_root_t        *root,
+    lsmash_adhoc_remux_t *remux
+)
+{
+    if( isom_check_initializer_present( root ) < 0 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    lsmash_file_t *file = root->file;
+    if( !file
+     || !file->bs
+     || !file->initializer->moov )
+        return LSMASH_ERR_INVALID_DATA;
+    int ret = isom_finish_movie( root, file, remux );
+    /* Complete the asynchronous output so that the stream can be closed just after this. */
+    int err = lsmash_bs_wait_async_write( file->bs );
+    return ret < 0 ? ret : err;
 }
 
 int lsmash_set_last_sample_delta( lsmash_root_t *root, uint32_t track_ID, uint32_t sample_delta )
@@ -2821,7 +2864,7 @@ int lsmash_set_last_sample_delta( lsmash_root_t *root, uint32_t track_ID, uint32
     isom_stts_t *stts = stbl->stts;
     uint32_t sample_count = isom_get_sample_count( trak );
     int err;
-    if( !stts->list->tail )
+    if( !stts->list->entry_count )
     {
         if( !sample_count )
             return 0;       /* no samples */
@@ -2833,15 +2876,14 @@ int lsmash_set_last_sample_delta( lsmash_root_t *root, uint32_t track_ID, uint32
             return err;
         return lsmash_update_track_duration( root, track_ID, 0 );
     }
+    isom_stts_entry_t *stts_entries = (isom_stts_entry_t *)stts->list->data;
     uint32_t i = 0;
-    for( lsmash_entry_t *entry = stts->list->head; entry; entry = entry->next )
-        i += ((isom_stts_entry_t *)entry->data)->sample_count;
+    for( uint32_t n = 0; n < stts->list->entry_count; n++ )
+        i += stts_entries[n].sample_count;
     if( sample_count < i )
         return LSMASH_ERR_INVALID_DATA;
     int no_last = (sample_count > i);
-    isom_stts_entry_t *last_stts_data = (isom_stts_entry_t *)stts->list->tail->data;
-    if( !last_stts_data )
-        return LSMASH_ERR_INVALID_DATA;
+    isom_stts_entry_t *last_stts_data = &stts_entries[stts->list->entry_count - 1];
     /* Consider QuikcTime fixed compression audio. */
     isom_audio_entry_t *audio = (isom_audio_entry_t *)lsmash_get_entry_data( &trak->mdia->minf->stbl->stsd->list,
                                                                               trak->cache->chunk.sample_description_index );
@@ -2856,11 +2898,8 @@ int lsmash_set_last_sample_delta( lsmash_root_t *root, uint32_t track_ID, uint32
             return LSMASH_ERR_INVALID_DATA;
         int exclude_last_sample = no_last ? 0 : 1;
         uint32_t j = audio->samplesPerPacket;
-        for( lsmash_entry_t *entry = stts->list->tail; entry && j > 1; entry = entry->prev )
+        for( isom_stts_entry_t *stts_data = last_stts_data; stts_data >= stts_entries && j > 1; stts_data-- )
         {
-            isom_stts_entry_t *stts_data = (isom_stts_entry_t *)entry->data;
-            if( !stts_data )
-                return LSMASH_ERR_INVALID_DATA;
             for( uint32_t k = exclude_last_sample; k < stts_data->sample_count && j > 1; k++ )
             {
                 sample_delta -= stts_data->sample_delta;
@@ -3093,20 +3132,12 @@ void lsmash_delete_sample( lsmash_sample_t *sample )
     lsmash_free( sample );
 }
 
-isom_sample_pool_t *isom_create_sample_pool( uint64_t size )
+isom_sample_pool_t *isom_create_sample_pool( void )
 {
     isom_sample_pool_t *pool = lsmash_malloc_zero( sizeof(isom_sample_pool_t) );
     if( !pool )
         return NULL;
-    if( size == 0 )
-        return pool;
-    pool->data = lsmash_malloc( size );
-    if( !pool->data )
-    {
-        lsmash_free( pool );
-        return NULL;
-    }
-    pool->alloc = size;
+    lsmash_init_entry_list( &pool->samples );
     return pool;
 }
 
@@ -3114,10 +3145,47 @@ void isom_remove_sample_pool( isom_sample_pool_t *pool )
 {
     if( !pool )
         return;
-    lsmash_free( pool->data );
+    lsmash_remove_entries( &pool->samples, lsmash_delete_sample );
     lsmash_free( pool );
 }
 
+/* Write the data of the pooled samples and then empty the pool. */
+int isom_write_sample_pool( lsmash_bs_t *bs, isom_sample_pool_t *pool )
+{
+    int err = 0;
+    if( bs->stream )
+    {
+        /* Flush the buffered data first to keep the order of output,
+         * and then write the data of each sample from its own buffer.
+         * Each sample is handed over to the output and deleted when its data has been written. */
+        if( (err = lsmash_bs_flush_buffer( bs )) < 0 )
+            return err;
+        for( lsmash_entry_t *entry = pool->samples.head; entry; entry = entry->next )
+        {
+            lsmash_sample_t *sample = (lsmash_sample_t *)entry->data;
+            if( !sample )
+                return LSMASH_ERR_NAMELESS;
+            entry->data = NULL;
+            if( (err = lsmash_bs_write_data_by_reference( bs, sample->data, sample->length,
+                                                          (void (*)( void * ))lsmash_delete_sample, sample )) < 0 )
+                return err;
+        }
+    }
+    else
+        for( lsmash_entry_t *entry = pool->samples.head; entry; entry = entry->next )
+        {
+            lsmash_sample_t *sample = (lsmash_sample_t *)entry->data;
+            if( !sample )
+                return LSMASH_ERR_NAMELESS;
+            lsmash_bs_put_bytes( bs, sample->length, sample->data );
+        }
+    lsmash_remove_entries( &pool->samples, lsmash_delete_sample );
+    pool->gather       = NULL;
+    pool->sample_count = 0;
+    pool->size         = 0;
+    return err;
+}
+
 static uint32_t isom_add_size( isom_trak_t *trak, uint32_t sample_size )
 {
     if( isom_add_stsz_entry( trak->mdia->minf->stbl, sample_size ) < 0 )
@@ -3138,7 +3206,7 @@ static uint32_t isom_add_dts( isom_stbl_t *stbl, isom_timestamp_t *cache, uint64
     if( dts <= cache->dts )
         return 0;
     uint32_t sample_delta = dts - cache->dts;
-    isom_stts_entry_t *data = (isom_stts_entry_t *)stts->list->tail->data;
+    isom_stts_entry_t *data = (isom_stts_entry_t *)lsmash_get_array_entry_data( stts->list, stts->list->entry_count );
     if( data->sample_delta == sample_delta )
         ++ data->sample_count;
     else if( isom_add_stts_entry( stbl, sample_delta ) < 0 )
@@ -3164,7 +3232,7 @@ static int isom_add_cts( isom_stbl_t *stbl, isom_timestamp_t *cache, uint64_t ct
         if( (err = isom_add_ctts_entry( stbl, 0 )) < 0 )
             return err;
         ctts = stbl->ctts;
-        isom_ctts_entry_t *data = (isom_ctts_entry_t *)ctts->list->head->data;
+        isom_ctts_entry_t *data = (isom_ctts_entry_t *)ctts->list->data;
         uint32_t sample_count = stbl->stsz->sample_count;
         if( sample_count != 1 )
         {
@@ -3177,9 +3245,10 @@ static int isom_add_cts( isom_stbl_t *stbl, isom_timestamp_t *cache, uint64_t ct
         cache->cts = cts;
         return 0;
     }
-    if( !ctts->list )
+    if( !ctts->list
+     || !ctts->list->entry_count )
         return LSMASH_ERR_INVALID_DATA;
-    isom_ctts_entry_t *data = (isom_ctts_entry_t *)ctts->list->tail->data;
+    isom_ctts_entry_t *data = (isom_ctts_entry_t *)lsmash_get_array_entry_data( ctts->list, ctts->list->entry_count );
     uint32_t sample_offset = cts - cache->dts;
     if( data->sample_offset == sample_offset )
         ++ data->sample_count;
@@ -3226,6 +3295,28 @@ static int isom_add_timestamp( isom_trak_t *trak, uint64_t dts, uint64_t cts )
     return 0;
 }
 
+static int isom_add_bitrate( isom_trak_t *trak, uint32_t sample_description_index, uint32_t sample_size, uint32_t prev_sample_delta )
+{
+    isom_bitrate_t *bitrate = &trak->cache->bitrate;
+    /* The duration of the previous sample has been settled by the current one. */
+    isom_bitrate_entry_t *prev = (isom_bitrate_entry_t *)lsmash_get_array_entry_data( bitrate->list, bitrate->last_index );
+    if( prev )
+        prev->dts += prev_sample_delta;
+    while( bitrate->list->entry_count < sample_description_index )
+    {
+        isom_bitrate_entry_t entry = { 0 };
+        int err = lsmash_add_array_entry( bitrate->list, &entry );
+        if( err < 0 )
+            return err;
+    }
+    isom_bitrate_entry_t *data = (isom_bitrate_entry_t *)lsmash_get_array_entry_data( bitrate->list, sample_description_index );
+    if( !data )
+        return LSMASH_ERR_INVALID_DATA;
+    isom_account_bitrate( data, sample_size, trak->mdia->mdhd->timescale );
+    bitrate->last_index = sample_description_index;
+    return 0;
+}
+
 static int isom_add_sync_point( isom_trak_t *trak, uint32_t sample_number, lsmash_sample_property_t *prop )
 {
     isom_stbl_t  *stbl  = trak->mdia->minf->stbl;
@@ -3840,7 +3931,7 @@ static int isom_add_chunk( isom_trak_t *trak, lsmash_sample_t *sample )
     if( !current->pool )
     {
         /* Very initial settings, just once per track */
-        current->pool = isom_create_sample_pool( 0 );
+        current->pool = isom_create_sample_pool();
         if( !current->pool )
             return LSMASH_ERR_MEMORY_ALLOC;
     }
@@ -3862,7 +3953,7 @@ static int isom_add_chunk( isom_trak_t *trak, lsmash_sample_t *sample )
         return 0;   /* No need to flush current cached chunk, the current sample must be put into that. */
     /* NOTE: chunk relative stuff must be pushed into file after a chunk is fully determined with its contents. */
     /* Now the current cached chunk is fixed, actually add the chunk relative properties to its file accordingly. */
-    isom_stsc_entry_t *last_stsc_data = stbl->stsc->list->tail ? (isom_stsc_entry_t *)stbl->stsc->list->tail->data : NULL;
+    isom_stsc_entry_t *last_stsc_data = (isom_stsc_entry_t *)lsmash_get_array_entry_data( stbl->stsc->list, stbl->stsc->list->entry_count );
     /* Create a new chunk sequence in this track if needed. */
     int err;
     if( (!last_stsc_data
@@ -3895,15 +3986,13 @@ static int isom_write_pooled_samples( lsmash_file_t *file, isom_sample_pool_t *p
      || !(file->flags & LSMASH_FILE_MODE_MEDIA)
      || ((file->flags & LSMASH_FILE_MODE_BOX) && !file->mdat) )
         return LSMASH_ERR_INVALID_DATA;
-    lsmash_bs_put_bytes( file->bs, pool->size, pool->data );
-    int err = lsmash_bs_flush_buffer( file->bs );
+    uint64_t size = pool->size;
+    int err = isom_write_sample_pool( file->bs, pool );
     if( err < 0 )
         return err;
     if( file->mdat )
-        file->mdat->media_size += pool->size;
-    file->size += pool->size;
-    pool->sample_count = 0;
-    pool->size         = 0;
+        file->mdat->media_size += size;
+    file->size += size;
     return 0;
 }
 
@@ -3936,8 +4025,12 @@ int isom_update_sample_tables
             if( sample_count == 0 )
                 return LSMASH_ERR_NAMELESS;
             /* Add a decoding timestamp and a composition timestamp. */
+            uint64_t prev_dts = trak->cache->timestamp.dts;
             if( (err = isom_add_timestamp( trak, sample_dts, sample_cts )) < 0 )
                 return err;
+            /* Account the bitrate of this sample. */
+            if( (err = isom_add_bitrate( trak, sample->index, 1, trak->cache->timestamp.dts - prev_dts )) < 0 )
+                return err;
             sample_dts += sample_duration;
             sample_cts += sample_duration;
         }
@@ -3950,8 +4043,12 @@ int isom_update_sample_tables
         if( sample_count == 0 )
             return LSMASH_ERR_NAMELESS;
         /* Add a decoding timestamp and a composition timestamp. */
+        uint64_t prev_dts = trak->cache->timestamp.dts;
         if( (err = isom_add_timestamp( trak, sample->dts, sample->cts )) < 0 )
             return err;
+        /* Account the bitrate of this sample. */
+        if( (err = isom_add_bitrate( trak, sample->index, sample->length, trak->cache->timestamp.dts - prev_dts )) < 0 )
+            return err;
         /* Add a sync point if needed. */
         if( (err = isom_add_sync_point( trak, sample_count, &sample->prop )) < 0 )
             return err;
@@ -3977,7 +4074,7 @@ static int isom_output_cached_chunk( isom_trak_t *trak )
 {
     isom_chunk_t      *chunk          = &trak->cache->chunk;
     isom_stbl_t       *stbl           = trak->mdia->minf->stbl;
-    isom_stsc_entry_t *last_stsc_data = stbl->stsc->list->tail ? (isom_stsc_entry_t *)stbl->stsc->list->tail->data : NULL;
+    isom_stsc_entry_t *last_stsc_data = (isom_stsc_entry_t *)lsmash_get_array_entry_data( stbl->stsc->list, stbl->stsc->list->entry_count );
     /* Create a new chunk sequence in this track if needed. */
     int err;
     if( (!last_stsc_data
@@ -4002,57 +4099,72 @@ static int isom_output_cached_chunk( isom_trak_t *trak )
     return isom_write_pooled_samples( file, chunk->pool );
 }
 
-int isom_pool_sample( isom_sample_pool_t *pool, lsmash_sample_t *sample, uint32_t samples_per_packet )
+/* Move the data of a sample into the pool without accounting it.
+ * The sample is taken over. */
+static int isom_store_sample_data( isom_sample_pool_t *pool, lsmash_sample_t *sample )
 {
-    uint64_t pool_size = pool->size + sample->length;
-    if( pool->alloc < pool_size )
+    uint32_t length = sample->length;
+    if( length >= ISOM_SAMPLE_POOL_GATHER_THRESHOLD )
     {
-        uint8_t *data;
-        uint64_t alloc = pool_size + (1<<16);
-        if( !pool->data )
-            data = lsmash_malloc( alloc );
-        else
-            data = lsmash_realloc( pool->data, alloc );
-        if( !data )
+        /* Take over the sample itself instead of copying its data.
+         * The sample is deleted after its data is written. */
+        if( lsmash_add_entry( &pool->samples, sample ) < 0 )
             return LSMASH_ERR_MEMORY_ALLOC;
-        pool->data  = data;
-        pool->alloc = alloc;
+        pool->gather = NULL;
+    }
+    else
+    {
+        /* Small samples are gathered into a buffer to avoid writing them one by one. */
+        lsmash_sample_t *gather = pool->gather;
+        if( !gather || gather->length + length > ISOM_SAMPLE_POOL_GATHER_SIZE )
+        {
+            gather = lsmash_create_sample( ISOM_SAMPLE_POOL_GATHER_SIZE );
+            if( !gather )
+                return LSMASH_ERR_MEMORY_ALLOC;
+            if( lsmash_add_entry( &pool->samples, gather ) < 0 )
+            {
+                lsmash_delete_sample( gather );
+                return LSMASH_ERR_MEMORY_ALLOC;
+            }
+            gather->length = 0;
+            pool->gather   = gather;
+        }
+        memcpy( gather->data + gather->length, sample->data, length );
+        gather->length += length;
+        lsmash_delete_sample( sample );
     }
-    memcpy( pool->data + pool->size, sample->data, sample->length );
-    pool->size          = pool_size;
+    return 0;
+}
+
+int isom_pool_sample( isom_sample_pool_t *pool, lsmash_sample_t *sample, uint32_t samples_per_packet )
+{
+    uint32_t length = sample->length;
+    int err = isom_store_sample_data( pool, sample );
+    if( err < 0 )
+        return err;
+    pool->size         += length;
     pool->sample_count += samples_per_packet;
-    lsmash_delete_sample( sample );
     return 0;
 }
 
-static int isom_append_sample_internal
-(
-    isom_trak_t         *trak,
-    lsmash_sample_t     *sample,
-    isom_sample_entry_t *sample_entry
-)
+/* Write the pooled samples of the chunk fixed by isom_add_chunk(). */
+static int isom_write_fixed_chunk( isom_trak_t *trak )
+{
+    /* The sample_description_index in the cache is one of the next written chunk.
+     * Therefore, it cannot be referenced here. */
+    lsmash_entry_array_t *stsc_list      = trak->mdia->minf->stbl->stsc->list;
+    isom_stsc_entry_t    *last_stsc_data = (isom_stsc_entry_t *)lsmash_get_array_entry_data( stsc_list, stsc_list->entry_count );
+    lsmash_file_t        *file           = isom_get_written_media_file( trak, last_stsc_data->sample_description_index );
+    return isom_write_pooled_samples( file, trak->cache->chunk.pool );
+}
+
+/* Arbitration system between tracks with extremely scattering dts.
+ * Here, we check whether asynchronization between the tracks exceeds the tolerance.
+ * If a track has too old "first DTS" in its cached chunk than current sample's DTS, then its pooled samples must be flushed.
+ * We don't consider presentation of media since any edit can pick an arbitrary portion of media in track.
+ * Note: you needn't read this function until you grasp the basic handling of chunks. */
+static int isom_flush_async_chunks( isom_trak_t *trak, uint64_t dts )
 {
-    uint32_t samples_per_packet;
-    int ret = isom_update_sample_tables( trak, sample, &samples_per_packet, sample_entry );
-    if( ret < 0 )
-        return ret;
-    /* ret == 1 means pooled samples must be flushed. */
-    isom_sample_pool_t *current_pool = trak->cache->chunk.pool;
-    if( ret == 1 )
-    {
-        /* The sample_description_index in the cache is one of the next written chunk.
-         * Therefore, it cannot be referenced here. */
-        lsmash_entry_list_t *stsc_list      = trak->mdia->minf->stbl->stsc->list;
-        isom_stsc_entry_t   *last_stsc_data = (isom_stsc_entry_t *)stsc_list->tail->data;
-        lsmash_file_t       *file           = isom_get_written_media_file( trak, last_stsc_data->sample_description_index );
-        if( (ret = isom_write_pooled_samples( file, current_pool )) < 0 )
-            return ret;
-    }
-    /* Arbitration system between tracks with extremely scattering dts.
-     * Here, we check whether asynchronization between the tracks exceeds the tolerance.
-     * If a track has too old "first DTS" in its cached chunk than current sample's DTS, then its pooled samples must be flushed.
-     * We don't consider presentation of media since any edit can pick an arbitrary portion of media in track.
-     * Note: you needn't read this loop until you grasp the basic handling of chunks. */
     lsmash_file_t *file = trak->file;
     double tolerance = file->max_async_tolerance;
     for( lsmash_entry_t *entry = file->moov->trak_list.head; entry; entry = entry->next )
@@ -4073,10 +4185,11 @@ static int isom_append_sample_internal
         isom_chunk_t *chunk = &other->cache->chunk;
         if( !chunk->pool || chunk->pool->sample_count == 0 )
             continue;
-        double diff = ((double)sample->dts      /  trak->mdia->mdhd->timescale)
+        double diff = ((double)dts              /  trak->mdia->mdhd->timescale)
                     - ((double)chunk->first_dts / other->mdia->mdhd->timescale);
-        if( diff > tolerance && (ret = isom_output_cached_chunk( other )) < 0 )
-            return ret;
+        int err;
+        if( diff > tolerance && (err = isom_output_cached_chunk( other )) < 0 )
+            return err;
         /* Note: we don't flush the cached chunk in the current track and the current sample here
          * even if the conditional expression of '-diff > tolerance' meets.
          * That's useless because appending a sample to another track would be a good equivalent.
@@ -4086,8 +4199,90 @@ static int isom_append_sample_internal
          * To completely avoid this, we need to observe at least whether the current sample will be placed
          * right next to the previous chunk of the same track or not. */
     }
+    return 0;
+}
+
+static int isom_append_sample_internal
+(
+    isom_trak_t         *trak,
+    lsmash_sample_t     *sample,
+    isom_sample_entry_t *sample_entry
+)
+{
+    uint32_t samples_per_packet;
+    int ret = isom_update_sample_tables( trak, sample, &samples_per_packet, sample_entry );
+    if( ret < 0 )
+        return ret;
+    /* ret == 1 means pooled samples must be flushed. */
+    if( ret == 1 && (ret = isom_write_fixed_chunk( trak )) < 0 )
+        return ret;
+    if( (ret = isom_flush_async_chunks( trak, sample->dts )) < 0 )
+        return ret;
     /* anyway the current sample must be pooled. */
-    return isom_pool_sample( current_pool, sample, samples_per_packet );
+    return isom_pool_sample( trak->cache->chunk.pool, sample, samples_per_packet );
+}
+
+/* Move the LPCM frames of 'length' bytes from 'offset' in a sample into the pool without accounting them. */
+static int isom_store_lpcm_frames( isom_sample_pool_t *pool, lsmash_sample_t *sample, uint32_t offset, uint32_t length )
+{
+    if( length == 0 )
+        return 0;
+    lsmash_sample_t *frames = lsmash_create_sample( length );
+    if( !frames )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    memcpy( frames->data, sample->data + offset, length );
+    int err = isom_store_sample_data( pool, frames );
+    if( err < 0 )
+        lsmash_delete_sample( frames );
+    return err;
+}
+
+/* Append a buffer of LPCM frames as the individual samples.
+ * The sample tables are advanced per frame, which just counts up their runs since all the frames have the same size
+ * and duration, while the data of the frames are moved into the pool per chunk instead of per frame.
+ * If all the frames fall into the cached chunk, the sample itself is taken over without copying. */
+static int isom_append_lpcm_samples
+(
+    isom_trak_t         *trak,
+    lsmash_sample_t     *sample,
+    isom_sample_entry_t *sample_entry,
+    uint32_t             frame_size
+)
+{
+    lsmash_sample_t frame = *sample;
+    frame.data   = NULL;
+    frame.length = frame_size;
+    uint32_t frame_count = sample->length / frame_size;
+    uint32_t first_frame = 0;   /* the first frame whose data is not in the pool yet */
+    int ret;
+    for( uint32_t i = 0; i < frame_count; i++ )
+    {
+        frame.dts = sample->dts + i;
+        frame.cts = sample->cts + i;
+        uint32_t samples_per_packet;
+        if( (ret = isom_update_sample_tables( trak, &frame, &samples_per_packet, sample_entry )) < 0 )
+            return ret;
+        isom_sample_pool_t *pool = trak->cache->chunk.pool;
+        if( ret == 1 )
+        {
+            /* The frames preceding the current one complete the cached chunk. */
+            if( (ret = isom_store_lpcm_frames( pool, sample, first_frame * frame_size, (i - first_frame) * frame_size )) < 0
+             || (ret = isom_write_fixed_chunk( trak )) < 0 )
+                return ret;
+            first_frame = i;
+        }
+        if( (ret = isom_flush_async_chunks( trak, frame.dts )) < 0 )
+            return ret;
+        pool->size         += frame_size;
+        pool->sample_count += samples_per_packet;
+    }
+    isom_sample_pool_t *pool = trak->cache->chunk.pool;
+    if( first_frame == 0 )
+        return isom_store_sample_data( pool, sample );
+    if( (ret = isom_store_lpcm_frames( pool, sample, first_frame * frame_size, (frame_count - first_frame) * frame_size )) < 0 )
+        return ret;
+    lsmash_delete_sample( sample );
+    return 0;
 }
 
 int isom_append_sample_by_type
@@ -4152,6 +4347,12 @@ static int isom_append_sample
         assert( file->free );
         file->size += file->free->size + file->mdat->size;
     }
+    if( isom_is_lpcm_audio( sample_entry ) )
+    {
+        uint32_t frame_size = ((isom_audio_entry_t *)sample_entry)->constBytesPerAudioPacket;
+        if( frame_size && sample->length > frame_size && sample->length % frame_size == 0 )
+            return isom_append_lpcm_samples( trak, sample, sample_entry, frame_size );
+    }
     return isom_append_sample_by_type( trak, sample, sample_entry, (int (*)( void *, lsmash_sample_t *, isom_sample_entry_t * ))isom_append_sample_internal );
 }
 
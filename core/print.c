@@ -30,6 +30,7 @@
 #include <stdarg.h> /* for isom_iprintf */
 
 #include "box.h"
+#include "file.h"
 
 
 typedef int (*isom_print_box_t)( FILE *, lsmash_file_t *, isom_box_t *, int );
@@ -41,6 +42,16 @@ typedef struct
     isom_print_box_t func;
 } isom_print_entry_t;
 
+struct isom_print_stream_tag
+{
+    FILE                      *fp;
+    lsmash_print_format        format;
+    int                        max_level;
+    uint32_t                   type_count;
+    lsmash_compact_box_type_t *types;
+    int                        file_printed;    /* whether the file itself has been printed or not */
+};
+
 static void isom_ifprintf_duration( FILE *fp, int indent, char *field_name, uint64_t duration, uint32_t timescale )
 {
     if( !timescale )
@@ -383,9 +394,11 @@ static int isom_print_styp( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
 {
     /* Print 'valid' if this box is the first box in a file. */
     int valid;
-    if( file->print
-     && file->print->head
-     && file->print->head->data )
+    if( file->print_stream )
+        valid = (box->pos == 0);
+    else if( file->print
+          && file->print->head
+          && file->print->head->data )
         valid = (box == ((isom_print_entry_t *)file->print->head->data)->box);
     else
         valid = 0;
@@ -430,6 +443,36 @@ static int isom_print_moov( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
     return isom_print_simple( fp, box, level, "Movie Box" );
 }
 
+static int isom_print_cmov( FILE *fp, lsmash_file_t *file, isom_box_t *box, int level )
+{
+    return isom_print_simple( fp, box, level, "Compressed Movie Box" );
+}
+
+static int isom_print_dcom( FILE *fp, lsmash_file_t *file, isom_box_t *box, int level )
+{
+    isom_dcom_t *dcom = (isom_dcom_t *)box;
+    int indent = level;
+    isom_print_box_common( fp, indent++, box, "Data Compression Box" );
+    lsmash_ifprintf( fp, indent, "compression_type = %s\n", isom_4cc2str( dcom->compression_type ) );
+    return 0;
+}
+
+static int isom_print_cmvd( FILE *fp, lsmash_file_t *file, isom_box_t *box, int level )
+{
+    isom_cmvd_t *cmvd = (isom_cmvd_t *)box;
+    int indent = level;
+    isom_print_box_common( fp, indent++, box, "Compressed Movie Data Box" );
+    lsmash_ifprintf( fp, indent, "uncompressed_size = %"PRIu32"\n", cmvd->uncompressed_size );
+    return 0;
+}
+
+/* The Movie Box decompressed from the Compressed Movie Data Box.
+ * The positions of it and its descendants are offsets in the decompressed data, not in the file. */
+static int isom_print_decompressed_moov( FILE *fp, lsmash_file_t *file, isom_box_t *box, int level )
+{
+    return isom_print_simple( fp, box, level, "Movie Box (decompressed; positions are in the decompressed data)" );
+}
+
 static int isom_print_mvhd( FILE *fp, lsmash_file_t *file, isom_box_t *box, int level )
 {
     isom_mvhd_t *mvhd = (isom_mvhd_t *)box;
@@ -1354,13 +1397,12 @@ static int isom_print_stts( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
         return LSMASH_ERR_INVALID_DATA;
     isom_stts_t *stts = (isom_stts_t *)box;
     int indent = level;
-    uint32_t i = 0;
     isom_print_box_common( fp, indent++, box, "Decoding Time to Sample Box" );
     lsmash_ifprintf( fp, indent, "entry_count = %"PRIu32"\n", stts->list->entry_count );
-    for( lsmash_entry_t *entry = stts->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < stts->list->entry_count; i++ )
     {
-        isom_stts_entry_t *data = (isom_stts_entry_t *)entry->data;
-        lsmash_ifprintf( fp, indent++, "entry[%"PRIu32"]\n", i++ );
+        isom_stts_entry_t *data = (isom_stts_entry_t *)stts->list->data + i;
+        lsmash_ifprintf( fp, indent++, "entry[%"PRIu32"]\n", i );
         lsmash_ifprintf( fp, indent, "sample_count = %"PRIu32"\n", data->sample_count );
         lsmash_ifprintf( fp, indent--, "sample_delta = %"PRIu32"\n", data->sample_delta );
     }
@@ -1373,22 +1415,21 @@ static int isom_print_ctts( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
         return LSMASH_ERR_INVALID_DATA;
     isom_ctts_t *ctts = (isom_ctts_t *)box;
     int indent = level;
-    uint32_t i = 0;
     isom_print_box_common( fp, indent++, box, "Composition Time to Sample Box" );
     lsmash_ifprintf( fp, indent, "entry_count = %"PRIu32"\n", ctts->list->entry_count );
     if( file->qt_compatible || ctts->version == 1 )
-        for( lsmash_entry_t *entry = ctts->list->head; entry; entry = entry->next )
+        for( uint32_t i = 0; i < ctts->list->entry_count; i++ )
         {
-            isom_ctts_entry_t *data = (isom_ctts_entry_t *)entry->data;
-            lsmash_ifprintf( fp, indent++, "entry[%"PRIu32"]\n", i++ );
+            isom_ctts_entry_t *data = (isom_ctts_entry_t *)ctts->list->data + i;
+            lsmash_ifprintf( fp, indent++, "entry[%"PRIu32"]\n", i );
             lsmash_ifprintf( fp, indent, "sample_count = %"PRIu32"\n", data->sample_count );
             lsmash_ifprintf( fp, indent--, "sample_offset = %"PRId32"\n", (union {uint32_t ui; int32_t si;}){ data->sample_offset }.si );
         }
     else
-        for( lsmash_entry_t *entry = ctts->list->head; entry; entry = entry->next )
+        for( uint32_t i = 0; i < ctts->list->entry_count; i++ )
         {
-            isom_ctts_entry_t *data = (isom_ctts_entry_t *)entry->data;
-            lsmash_ifprintf( fp, indent++, "entry[%"PRIu32"]\n", i++ );
+            isom_ctts_entry_t *data = (isom_ctts_entry_t *)ctts->list->data + i;
+            lsmash_ifprintf( fp, indent++, "entry[%"PRIu32"]\n", i );
             lsmash_ifprintf( fp, indent, "sample_count = %"PRIu32"\n", data->sample_count );
             lsmash_ifprintf( fp, indent--, "sample_offset = %"PRIu32"\n", data->sample_offset );
         }
@@ -1426,11 +1467,10 @@ static int isom_print_stss( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
         return LSMASH_ERR_INVALID_DATA;
     isom_stss_t *stss = (isom_stss_t *)box;
     int indent = level;
-    uint32_t i = 0;
     isom_print_box_common( fp, indent++, box, "Sync Sample Box" );
     lsmash_ifprintf( fp, indent, "entry_count = %"PRIu32"\n", stss->list->entry_count );
-    for( lsmash_entry_t *entry = stss->list->head; entry; entry = entry->next )
-        lsmash_ifprintf( fp, indent, "sample_number[%"PRIu32"] = %"PRIu32"\n", i++, ((isom_stss_entry_t *)entry->data)->sample_number );
+    for( uint32_t i = 0; i < stss->list->entry_count; i++ )
+        lsmash_ifprintf( fp, indent, "sample_number[%"PRIu32"] = %"PRIu32"\n", i, ((isom_stss_entry_t *)stss->list->data)[i].sample_number );
     return 0;
 }
 
@@ -1440,11 +1480,10 @@ static int isom_print_stps( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
         return LSMASH_ERR_INVALID_DATA;
     isom_stps_t *stps = (isom_stps_t *)box;
     int indent = level;
-    uint32_t i = 0;
     isom_print_box_common( fp, indent++, box, "Partial Sync Sample Box" );
     lsmash_ifprintf( fp, indent, "entry_count = %"PRIu32"\n", stps->list->entry_count );
-    for( lsmash_entry_t *entry = stps->list->head; entry; entry = entry->next )
-        lsmash_ifprintf( fp, indent, "sample_number[%"PRIu32"] = %"PRIu32"\n", i++, ((isom_stps_entry_t *)entry->data)->sample_number );
+    for( uint32_t i = 0; i < stps->list->entry_count; i++ )
+        lsmash_ifprintf( fp, indent, "sample_number[%"PRIu32"] = %"PRIu32"\n", i, ((isom_stps_entry_t *)stps->list->data)[i].sample_number );
     return 0;
 }
 
@@ -1499,13 +1538,12 @@ static int isom_print_stsc( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
         return LSMASH_ERR_INVALID_DATA;
     isom_stsc_t *stsc = (isom_stsc_t *)box;
     int indent = level;
-    uint32_t i = 0;
     isom_print_box_common( fp, indent++, box, "Sample To Chunk Box" );
     lsmash_ifprintf( fp, indent, "entry_count = %"PRIu32"\n", stsc->list->entry_count );
-    for( lsmash_entry_t *entry = stsc->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < stsc->list->entry_count; i++ )
     {
-        isom_stsc_entry_t *data = (isom_stsc_entry_t *)entry->data;
-        lsmash_ifprintf( fp, indent++, "entry[%"PRIu32"]\n", i++ );
+        isom_stsc_entry_t *data = (isom_stsc_entry_t *)stsc->list->data + i;
+        lsmash_ifprintf( fp, indent++, "entry[%"PRIu32"]\n", i );
         lsmash_ifprintf( fp, indent, "first_chunk = %"PRIu32"\n", data->first_chunk );
         lsmash_ifprintf( fp, indent, "samples_per_chunk = %"PRIu32"\n", data->samples_per_chunk );
         lsmash_ifprintf( fp, indent--, "sample_description_index = %"PRIu32"\n", data->sample_description_index );
@@ -1517,7 +1555,6 @@ static int isom_print_stsz( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
 {
     isom_stsz_t *stsz = (isom_stsz_t *)box;
     int indent = level;
-    uint32_t i = 0;
     isom_print_box_common( fp, indent++, box, "Sample Size Box" );
     if( !stsz->sample_size )
         lsmash_ifprintf( fp, indent, "sample_size = 0 (variable)\n" );
@@ -1525,11 +1562,23 @@ static int isom_print_stsz( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
         lsmash_ifprintf( fp, indent, "sample_size = %"PRIu32" (constant)\n", stsz->sample_size );
     lsmash_ifprintf( fp, indent, "sample_count = %"PRIu32"\n", stsz->sample_count );
     if( !stsz->sample_size && stsz->list )
-        for( lsmash_entry_t *entry = stsz->list->head; entry; entry = entry->next )
-        {
-            isom_stsz_entry_t *data = (isom_stsz_entry_t *)entry->data;
-            lsmash_ifprintf( fp, indent, "entry_size[%"PRIu32"] = %"PRIu32"\n", i++, data->entry_size );
-        }
+        for( uint32_t i = 0; i < stsz->list->entry_count; i++ )
+            lsmash_ifprintf( fp, indent, "entry_size[%"PRIu32"] = %"PRIu32"\n", i, ((isom_stsz_entry_t *)stsz->list->data)[i].entry_size );
+    return 0;
+}
+
+static int isom_print_stz2( FILE *fp, lsmash_file_t *file, isom_box_t *box, int level )
+{
+    if( !((isom_stsz_t *)box)->list )
+        return LSMASH_ERR_INVALID_DATA;
+    isom_stsz_t *stz2 = (isom_stsz_t *)box;
+    int indent = level;
+    isom_print_box_common( fp, indent++, box, "Compact Sample Size Box" );
+    lsmash_ifprintf( fp, indent, "reserved = 0x000000\n" );
+    lsmash_ifprintf( fp, indent, "field_size = %"PRIu8"\n", stz2->field_size );
+    lsmash_ifprintf( fp, indent, "sample_count = %"PRIu32"\n", stz2->sample_count );
+    for( uint32_t i = 0; i < stz2->list->entry_count; i++ )
+        lsmash_ifprintf( fp, indent, "entry_size[%"PRIu32"] = %"PRIu32"\n", i, ((isom_stsz_entry_t *)stz2->list->data)[i].entry_size );
     return 0;
 }
 
@@ -1539,18 +1588,17 @@ static int isom_print_stco( FILE *fp, lsmash_file_t *file, isom_box_t *box, int
         return LSMASH_ERR_INVALID_DATA;
     isom_stco_t *stco = (isom_stco_t *)box;
     int indent = level;
-    uint32_t i = 0;
     isom_print_box_common( fp, indent++, box, "Chunk Offset Box" );
     lsmash_ifprintf( fp, indent, "entry_count = %"PRIu32"\n", stco->list->entry_count );
     if( lsmash_check_box_type_identical( stco->type, ISOM_BOX_TYPE_STCO ) )
     {
-        for( lsmash_entry_t *entry = stco->list->head; entry; entry = entry->next )
-            lsmash_ifprintf( fp, indent, "chunk_offset[%"PRIu32"] = %"PRIu32"\n", i++, ((isom_stco_entry_t *)entry->data)->chunk_offset );
+        for( uint32_t i = 0; i < stco->list->entry_count; i++ )
+            lsmash_ifprintf( fp, indent, "chunk_offset[%"PRIu32"] = %"PRIu32"\n", i, ((isom_stco_entry_t *)stco->list->data)[i].chunk_offset );
     }
     else
     {
-        for( lsmash_entry_t *entry = stco->list->head; entry; entry = entry->next )
-            lsmash_ifprintf( fp, indent, "chunk_offset[%"PRIu32"] = %"PRIu64"\n", i++, ((isom_co64_entry_t *)entry->data)->chunk_offset );
+        for( uint32_t i = 0; i < stco->list->entry_count; i++ )
+            lsmash_ifprintf( fp, indent, "chunk_offset[%"PRIu32"] = %"PRIu64"\n", i, ((isom_co64_entry_t *)stco->list->data)[i].chunk_offset );
     }
     return 0;
 }
@@ -2324,6 +2372,7 @@ int lsmash_print_movie( lsmash_root_t *root, const char *filename )
     lsmash_file_t *file = root->file;
     if( !file
      || !file->print
+     || file->print_stream
      || !(file->flags & LSMASH_FILE_MODE_DUMP) )
         return LSMASH_ERR_FUNCTION_PARAM;
     FILE *destination;
@@ -2360,6 +2409,9 @@ static isom_print_box_t isom_select_print_func( isom_box_t *box )
 {
     if( box->manager & LSMASH_UNKNOWN_BOX )
         return isom_print_unknown;
+    if( (box->manager & LSMASH_ABSENT_IN_FILE) && lsmash_check_box_type_identical( box->type, ISOM_BOX_TYPE_MOOV ) )
+        /* Any Movie Box read from the file itself is present in it. */
+        return isom_print_decompressed_moov;
     if( box->parent )
     {
         isom_box_t *parent = box->parent;
@@ -2378,6 +2430,8 @@ static isom_print_box_t isom_select_print_func( isom_box_t *box )
                 lsmash_codec_type_t type;
                 isom_print_box_t    func;
             } print_description_table[160] = { { LSMASH_CODEC_TYPE_INITIALIZER, NULL } };
+            static isom_fourcc_index_t print_description_index[160];
+            static uint32_t            print_description_count;
             if( !print_description_table[0].func )
             {
                 /* Initialize the table. */
@@ -2516,10 +2570,14 @@ static isom_print_box_t isom_select_print_func( isom_box_t *box )
                 ADD_PRINT_DESCRIPTION_TABLE_ELEMENT( ISOM_CODEC_TYPE_MP4S_SYSTEM, isom_print_mp4s_description );
                 ADD_PRINT_DESCRIPTION_TABLE_ELEMENT( LSMASH_CODEC_TYPE_UNSPECIFIED, NULL );
 #undef ADD_PRINT_DESCRIPTION_TABLE_ELEMENT
+                print_description_count = i - 1;
+                isom_create_fourcc_index( print_description_index, print_description_table, sizeof(struct print_description_table_tag), print_description_count );
             }
-            for( int i = 0; print_description_table[i].func; i++ )
-                if( lsmash_check_codec_type_identical( sample_type, print_description_table[i].type ) )
-                    return print_description_table[i].func;
+            for( uint32_t i = isom_search_fourcc_index( print_description_index, print_description_count, sample_type.fourcc );
+                 i < print_description_count && print_description_index[i].fourcc == sample_type.fourcc;
+                 i++ )
+                if( lsmash_check_codec_type_identical( sample_type, print_description_table[ print_description_index[i].number ].type ) )
+                    return print_description_table[ print_description_index[i].number ].func;
             return isom_print_unknown;
         }
         if( lsmash_check_box_type_identical( parent->type, QT_BOX_TYPE_WAVE ) )
@@ -2562,6 +2620,8 @@ static isom_print_box_t isom_select_print_func( isom_box_t *box )
         lsmash_box_type_t type;
         isom_print_box_t  func;
     } print_box_table[128] = { { LSMASH_BOX_TYPE_INITIALIZER, NULL } };
+    static isom_fourcc_index_t print_box_index[128];
+    static uint32_t            print_box_count;
     if( !print_box_table[0].func )
     {
         /* Initialize the table. */
@@ -2571,6 +2631,9 @@ static isom_print_box_t isom_select_print_func( isom_box_t *box )
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_STYP, isom_print_styp );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_SIDX, isom_print_sidx );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_MOOV, isom_print_moov );
+        ADD_PRINT_BOX_TABLE_ELEMENT(   QT_BOX_TYPE_CMOV, isom_print_cmov );
+        ADD_PRINT_BOX_TABLE_ELEMENT(   QT_BOX_TYPE_DCOM, isom_print_dcom );
+        ADD_PRINT_BOX_TABLE_ELEMENT(   QT_BOX_TYPE_CMVD, isom_print_cmvd );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_MVHD, isom_print_mvhd );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_IODS, isom_print_iods );
         ADD_PRINT_BOX_TABLE_ELEMENT(   QT_BOX_TYPE_CTAB, isom_print_ctab );
@@ -2621,6 +2684,7 @@ static isom_print_box_t isom_select_print_func( isom_box_t *box )
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_SDTP, isom_print_sdtp );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_STSC, isom_print_stsc );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_STSZ, isom_print_stsz );
+        ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_STZ2, isom_print_stz2 );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_STCO, isom_print_stco );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_CO64, isom_print_stco );
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_SGPD, isom_print_sgpd );
@@ -2653,10 +2717,14 @@ static isom_print_box_t isom_select_print_func( isom_box_t *box )
         ADD_PRINT_BOX_TABLE_ELEMENT( ISOM_BOX_TYPE_MFRO, isom_print_mfro );
         ADD_PRINT_BOX_TABLE_ELEMENT( LSMASH_BOX_TYPE_UNSPECIFIED, NULL );
 #undef ADD_PRINT_BOX_TABLE_ELEMENT
+        print_box_count = i - 1;
+        isom_create_fourcc_index( print_box_index, print_box_table, sizeof(struct print_box_table_tag), print_box_count );
     }
-    for( int i = 0; print_box_table[i].func; i++ )
-        if( lsmash_check_box_type_identical( box->type, print_box_table[i].type ) )
-            return print_box_table[i].func;
+    for( uint32_t i = isom_search_fourcc_index( print_box_index, print_box_count, box->type.fourcc );
+         i < print_box_count && print_box_index[i].fourcc == box->type.fourcc;
+         i++ )
+        if( lsmash_check_box_type_identical( box->type, print_box_table[ print_box_index[i].number ].type ) )
+            return print_box_table[ print_box_index[i].number ].func;
     return isom_print_unknown;
 }
 
@@ -2667,6 +2735,180 @@ static inline void isom_print_remove_plastic_box( isom_box_t *box )
         isom_remove_box_by_itself( box );
 }
 
+int lsmash_set_print_stream( lsmash_file_t *file, const char *filename, const lsmash_print_parameters_t *param )
+{
+    if( !file
+     || !filename
+     || !(file->flags & LSMASH_FILE_MODE_DUMP)
+     || file->print_stream
+     || file->print )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    if( param
+     && ((param->format != LSMASH_PRINT_FORMAT_TEXT && param->format != LSMASH_PRINT_FORMAT_JSON_LINES)
+      || (param->type_count && !param->types)) )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    isom_print_stream_t *stream = lsmash_malloc_zero( sizeof(isom_print_stream_t) );
+    if( !stream )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    if( param )
+    {
+        stream->format     = param->format;
+        stream->max_level  = param->max_level;
+        stream->type_count = param->type_count;
+        if( param->type_count )
+        {
+            stream->types = lsmash_memdup( param->types, param->type_count * sizeof(lsmash_compact_box_type_t) );
+            if( !stream->types )
+            {
+                lsmash_free( stream );
+                return LSMASH_ERR_MEMORY_ALLOC;
+            }
+        }
+    }
+    if( !strcmp( filename, "-" ) )
+        stream->fp = stdout;
+    else
+    {
+        stream->fp = lsmash_fopen( filename, "wb" );
+        if( !stream->fp )
+        {
+            lsmash_free( stream->types );
+            lsmash_free( stream );
+            return LSMASH_ERR_NAMELESS;
+        }
+    }
+    file->print_stream = stream;
+    return 0;
+}
+
+static void isom_print_file_progressively( isom_print_stream_t *stream, uint64_t size )
+{
+    if( stream->file_printed )
+        return;
+    if( stream->format == LSMASH_PRINT_FORMAT_JSON_LINES )
+        fprintf( stream->fp, "{\"level\":0,\"type\":\"file\",\"size\":%"PRIu64"}\n", size );
+    else
+    {
+        fprintf( stream->fp, "[File]\n" );
+        fprintf( stream->fp, "    size = %"PRIu64"\n", size );
+    }
+    stream->file_printed = 1;
+}
+
+/* The file itself is printed first if its size is known before reading, otherwise after all boxes. */
+void isom_start_print_stream( lsmash_file_t *file )
+{
+    if( file->print_stream && !file->bs->unseekable )
+        isom_print_file_progressively( file->print_stream, file->bs->written );
+}
+
+int isom_finish_print_stream( lsmash_file_t *file )
+{
+    isom_print_stream_t *stream = file->print_stream;
+    if( !stream )
+        return 0;
+    isom_print_file_progressively( stream, file->size );
+    return fflush( stream->fp ) ? LSMASH_ERR_NAMELESS : 0;
+}
+
+static void isom_remove_print_stream( isom_print_stream_t *stream )
+{
+    if( !stream )
+        return;
+    if( stream->fp == stdout )
+        fflush( stream->fp );
+    else
+        fclose( stream->fp );
+    lsmash_free( stream->types );
+    lsmash_free( stream );
+}
+
+static void isom_print_json_4cc( FILE *fp, lsmash_compact_box_type_t fourcc )
+{
+    for( int i = 24; i >= 0; i -= 8 )
+    {
+        int c = (fourcc >> i) & 0xff;
+        if( isom_is_printable_char( c ) && c != '"' && c != '\\' && c != 127 )
+            fputc( c, fp );
+        else
+            fprintf( fp, "\\u%04x", c );
+    }
+}
+
+static int isom_print_box_json( FILE *fp, isom_box_t *box, int level )
+{
+    fprintf( fp, "{\"level\":%d,\"type\":\"", level );
+    isom_print_json_4cc( fp, box->type.fourcc );
+    fprintf( fp, "\",\"position\":%"PRIu64",\"size\":%"PRIu64, box->pos, box->size );
+    if( box->type.fourcc == ISOM_BOX_TYPE_UUID.fourcc )
+        fprintf( fp, ",\"usertype\":\"%08"PRIx32"-%02x%02x-%02x%02x-%02x%02x-%02x%02x%02x%02x%02x%02x\"",
+                 box->type.user.fourcc,
+                 box->type.user.id[0], box->type.user.id[1], box->type.user.id[2],  box->type.user.id[3],
+                 box->type.user.id[4], box->type.user.id[5], box->type.user.id[6],  box->type.user.id[7],
+                 box->type.user.id[8], box->type.user.id[9], box->type.user.id[10], box->type.user.id[11] );
+    if( box->manager & LSMASH_FULLBOX )
+        fprintf( fp, ",\"version\":%"PRIu8",\"flags\":%"PRIu32, box->version, box->flags & 0x00ffffff );
+    if( box->manager & LSMASH_INCOMPLETE_BOX )
+        fprintf( fp, ",\"incomplete\":true" );
+    fprintf( fp, "}\n" );
+    return 0;
+}
+
+/* Return the level at which the box is printed, or 0 if the box is not printed.
+ * If any type is specified, the outermost box of the types among the box and its ancestors is printed as a top level box
+ * since the ancestors of it are not printed. */
+static int isom_check_print_filter( isom_print_stream_t *stream, isom_box_t *box, int level )
+{
+    if( stream->max_level > 0 && level > stream->max_level )
+        return 0;
+    if( stream->type_count == 0 )
+        return level;
+    /* Print the box if the box itself or any of its ancestors is of the specified types. */
+    int print_level = 0;
+    for( int ancestor_level = level; box && lsmash_check_box_type_specified( &box->type ); box = box->parent, ancestor_level-- )
+        for( uint32_t i = 0; i < stream->type_count; i++ )
+            if( box->type.fourcc == stream->types[i] )
+            {
+                print_level = level - ancestor_level + 1;
+                break;
+            }
+    return print_level;
+}
+
+static void isom_remove_print_func( isom_print_entry_t *data );
+
+/* Print the boxes pooled since the last call, i.e. the last top level box and its descendants, and then release them. */
+int isom_flush_print_stream( lsmash_file_t *file )
+{
+    isom_print_stream_t *stream = file->print_stream;
+    if( !stream || !file->print )
+        return 0;
+    /* Some boxes are printed differently depending on the compatibility which is settled after reading the whole file.
+     * Decide it tentatively from the boxes read so far and restore it after printing not to affect reading. */
+    uint8_t qt_compatible  = file->qt_compatible;
+    uint8_t avc_extensions = file->avc_extensions;
+    isom_check_brand_compatibility( file, &file->qt_compatible, &file->avc_extensions );
+    int ret = 0;
+    for( lsmash_entry_t *entry = file->print->head; entry && ret >= 0; entry = entry->next )
+    {
+        isom_print_entry_t *data = (isom_print_entry_t *)entry->data;
+        if( !data || !data->box )
+        {
+            ret = LSMASH_ERR_NAMELESS;
+            break;
+        }
+        int print_level = isom_check_print_filter( stream, data->box, data->level );
+        if( print_level )
+            ret = stream->format == LSMASH_PRINT_FORMAT_JSON_LINES
+                ? isom_print_box_json( stream->fp, data->box, data->level )
+                : data->func( stream->fp, file, data->box, print_level );
+    }
+    file->qt_compatible  = qt_compatible;
+    file->avc_extensions = avc_extensions;
+    lsmash_remove_entries( file->print, isom_remove_print_func );
+    return ret;
+}
+
 int isom_add_print_func( lsmash_file_t *file, void *box, int level )
 {
     if( !(file->flags & LSMASH_FILE_MODE_DUMP) )
@@ -2705,6 +2947,8 @@ void isom_remove_print_funcs( lsmash_file_t *file )
 {
     lsmash_remove_list( file->print, isom_remove_print_func );
     file->print = NULL;
+    isom_remove_print_stream( file->print_stream );
+    file->print_stream = NULL;
 }
 
 #endif /* LSMASH_DEMUXER_ENABLED */
@@ -25,5 +25,8 @@
 
 int isom_add_print_func( lsmash_file_t *file, void *box, int level );
 void isom_remove_print_funcs( lsmash_file_t *file );
+void isom_start_print_stream( lsmash_file_t *file );
+int isom_flush_print_stream( lsmash_file_t *file );
+int isom_finish_print_stream( lsmash_file_t *file );
 
 #endif /* LSMASH_PRINT_H */
@@ -25,6 +25,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <limits.h>
+
+#ifdef LSMASH_ZLIB_ENABLED
+#include <zlib.h>
+#endif
 
 #include "box.h"
 #include "file.h"
@@ -188,14 +193,37 @@ static void isom_check_box_size( lsmash_bs_t *bs, isom_box_t *box )
     }
 }
 
+/* Release a top level box just printed progressively if the box is not needed to read the rest of the file. */
+static void isom_release_printed_box( lsmash_file_t *file, isom_box_t *box )
+{
+    if( (box->manager & LSMASH_UNKNOWN_BOX)
+     || lsmash_check_box_type_identical( box->type, ISOM_BOX_TYPE_MOOF )
+     || lsmash_check_box_type_identical( box->type, ISOM_BOX_TYPE_SIDX )
+     || (lsmash_check_box_type_identical( box->type, ISOM_BOX_TYPE_STYP ) && file->styp_list.entry_count > 1) )
+        isom_remove_box_by_itself( box );
+}
+
 static int isom_read_children( lsmash_file_t *file, isom_box_t *box, void *parent, int level )
 {
     int ret;
     lsmash_bs_t *bs         = file->bs;
     isom_box_t  *parent_box = (isom_box_t *)parent;
     uint64_t parent_pos = lsmash_bs_count( bs );
+    lsmash_entry_t *last_entry = parent_box->extensions.tail;
     while( !(ret = isom_read_box( file, box, parent_box, parent_pos, level )) )
     {
+        if( level == 0 && file->print_stream )
+        {
+            /* Print the top level box and its descendants, and then release them if not needed anymore.
+             * The box just read, if any, is the last one in the extension list of the file. */
+            if( (ret = isom_flush_print_stream( file )) < 0 )
+                return ret;
+            if( parent_box->extensions.tail != last_entry && parent_box->extensions.tail->data )
+                isom_release_printed_box( file, (isom_box_t *)parent_box->extensions.tail->data );
+            last_entry = parent_box->extensions.tail;
+            /* No movie fragment piles up, so the memory doesn't grow with the number of them. */
+            assert( file->moof_list.entry_count == 0 );
+        }
         parent_pos += box->size;
         if( parent_box->size <= parent_pos || bs->eob || bs->error )
             break;
@@ -372,6 +400,160 @@ static int isom_read_moov( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
     return isom_read_children( file, box, moov, level );
 }
 
+#ifdef LSMASH_ZLIB_ENABLED
+/* Create an instance of a box only for dump. It is removed after printing. */
+static isom_box_t *isom_add_box_for_dump( lsmash_file_t *file, isom_box_t *box, size_t struct_size, int level )
+{
+    isom_box_t *dummy = lsmash_malloc_zero( struct_size );
+    if( !dummy )
+        return NULL;
+    isom_box_common_copy( dummy, box );
+    dummy->manager |= LSMASH_ABSENT_IN_FILE;
+    return isom_add_print_func( file, dummy, level ) < 0 ? NULL : dummy;
+}
+
+static int isom_add_cmov_for_dump( lsmash_file_t *file, isom_box_t *box, uint32_t cmvd_size, uint32_t moov_size, int level )
+{
+    /* The Data Compression Box and the Compressed Movie Data Box follow the header of the Compressed Movie Box. */
+    isom_box_t *cmov = isom_add_box_for_dump( file, box, sizeof(isom_box_t), level );
+    if( !cmov )
+        return LSMASH_ERR_NAMELESS;
+    isom_box_t child = { .root = box->root, .file = box->file, .parent = box->parent };
+    child.type = QT_BOX_TYPE_DCOM;
+    child.pos  = box->pos + lsmash_bs_count( file->bs );
+    child.size = ISOM_BASEBOX_COMMON_SIZE + 4;
+    isom_dcom_t *dcom = (isom_dcom_t *)isom_add_box_for_dump( file, &child, sizeof(isom_dcom_t), level + 1 );
+    if( !dcom )
+        return LSMASH_ERR_NAMELESS;
+    dcom->compression_type = QT_COMPRESSION_TYPE_ZLIB;
+    child.type = QT_BOX_TYPE_CMVD;
+    child.pos += child.size;
+    child.size = cmvd_size;
+    isom_cmvd_t *cmvd = (isom_cmvd_t *)isom_add_box_for_dump( file, &child, sizeof(isom_cmvd_t), level + 1 );
+    if( !cmvd )
+        return LSMASH_ERR_NAMELESS;
+    cmvd->uncompressed_size = moov_size;
+    return 0;
+}
+#endif
+
+#ifdef LSMASH_ZLIB_ENABLED
+/* Decompress the Movie Box in zlib format.
+ * The declared size of the decompressed data isn't trusted, so the buffer grows only as the data is inflated
+ * and decompression stops at the declared size. */
+static int isom_uncompress_moov( uint8_t *src, uint32_t src_size, uint32_t *moov_size, uint8_t **moov_data )
+{
+    z_stream stream = { .next_in = src, .avail_in = src_size };
+    if( inflateInit( &stream ) != Z_OK )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    uint8_t *data  = NULL;
+    uint32_t alloc = 0;
+    int      ret   = LSMASH_ERR_INVALID_DATA;
+    int      zret  = Z_OK;
+    while( zret == Z_OK )
+    {
+        if( stream.total_out == alloc )
+        {
+            if( alloc == *moov_size )
+                /* The decompressed data exceeds the declared size. */
+                goto fail;
+            alloc = LSMASH_MIN( *moov_size, LSMASH_MAX( 2 * (uint64_t)alloc, 4 * (uint64_t)src_size ) );
+            uint8_t *temp = lsmash_realloc( data, alloc );
+            if( !temp )
+            {
+                ret = LSMASH_ERR_MEMORY_ALLOC;
+                goto fail;
+            }
+            data = temp;
+            stream.next_out  = data  + stream.total_out;
+            stream.avail_out = alloc - stream.total_out;
+        }
+        zret = inflate( &stream, Z_NO_FLUSH );
+    }
+    if( zret != Z_STREAM_END )
+        goto fail;
+    inflateEnd( &stream );
+    *moov_size = stream.total_out;
+    *moov_data = data;
+    return 0;
+fail:
+    inflateEnd( &stream );
+    lsmash_free( data );
+    return ret;
+}
+#endif
+
+static int isom_read_cmov( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, int level )
+{
+#ifdef LSMASH_ZLIB_ENABLED
+    /* Only the Data Compression Box indicating zlib followed by the Compressed Movie Data Box is supported. */
+    lsmash_bs_t *bs = file->bs;
+    uint64_t payload_size = box->size - lsmash_bs_count( bs );
+    if( !lsmash_check_box_type_identical( parent->type, ISOM_BOX_TYPE_MOOV )
+     || (box->manager & LSMASH_LAST_BOX)
+     || payload_size < 2 * ISOM_BASEBOX_COMMON_SIZE + 8
+     || payload_size > INT_MAX
+     || lsmash_bs_is_end( bs, 2 * ISOM_BASEBOX_COMMON_SIZE + 7 )
+     || lsmash_bs_show_be32( bs,  0 ) != ISOM_BASEBOX_COMMON_SIZE + 4
+     || lsmash_bs_show_be32( bs,  4 ) != QT_BOX_TYPE_DCOM.fourcc
+     || lsmash_bs_show_be32( bs,  8 ) != QT_COMPRESSION_TYPE_ZLIB
+     || lsmash_bs_show_be32( bs, 16 ) != QT_BOX_TYPE_CMVD.fourcc )
+        return isom_read_unknown_box( file, box, parent, level );
+    uint32_t cmvd_size = lsmash_bs_show_be32( bs, 12 );
+    uint32_t moov_size = lsmash_bs_show_be32( bs, 20 );
+    if( cmvd_size < ISOM_BASEBOX_COMMON_SIZE + 4
+     || cmvd_size > payload_size - ISOM_BASEBOX_COMMON_SIZE - 4
+     || moov_size < ISOM_BASEBOX_COMMON_SIZE )
+        return LSMASH_ERR_INVALID_DATA;
+    int ret;
+    if( (file->flags & LSMASH_FILE_MODE_DUMP)
+     && (ret = isom_add_cmov_for_dump( file, box, cmvd_size, moov_size, level )) < 0 )
+        return ret;
+    uint8_t *payload = lsmash_bs_get_bytes( bs, payload_size );
+    if( !payload )
+        return LSMASH_ERR_NAMELESS;
+    uint8_t *moov_data = NULL;
+    if( (ret = isom_uncompress_moov( &payload[24], cmvd_size - ISOM_BASEBOX_COMMON_SIZE - 4, &moov_size, &moov_data )) < 0 )
+        goto fail;
+    ret = LSMASH_ERR_INVALID_DATA;
+    /* Read the boxes in the decompressed Movie Box as if they were in the Movie Box containing this box.
+     * For dump, they are nested in the Compressed Movie Data Box under the decompressed Movie Box. */
+    lsmash_bs_t *moov_bs = lsmash_bs_create();
+    if( !moov_bs )
+    {
+        ret = LSMASH_ERR_MEMORY_ALLOC;
+        goto fail;
+    }
+    lsmash_bs_set_empty_stream( moov_bs, moov_data, moov_size );
+    isom_box_t moov_box = { .root = parent->root, .file = parent->file, .parent = parent->parent };
+    file->bs = moov_bs;
+    if( isom_bs_read_box_common( moov_bs, &moov_box ) == 0
+     && moov_box.type.fourcc == ISOM_BOX_TYPE_MOOV.fourcc
+     && moov_box.size <= moov_size )
+    {
+        moov_box.type = ISOM_BOX_TYPE_MOOV;
+        if( (file->flags & LSMASH_FILE_MODE_DUMP)
+         && !isom_add_box_for_dump( file, &moov_box, sizeof(isom_box_t), level + 2 ) )
+            ret = LSMASH_ERR_NAMELESS;
+        else
+        {
+            uint64_t size = parent->size;
+            parent->size = moov_box.size;
+            ret = isom_read_children( file, &moov_box, parent, level + 2 );
+            parent->size = size;
+        }
+    }
+    file->bs = bs;
+    lsmash_bs_cleanup( moov_bs );
+fail:
+    lsmash_free( moov_data );
+    lsmash_free( payload );
+    return ret;
+#else
+    return isom_read_unknown_box( file, box, parent, level );
+#endif
+}
+
 static int isom_read_mvhd( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, int level )
 {
     if( !lsmash_check_box_type_identical( parent->type, ISOM_BOX_TYPE_MOOV ) || ((isom_moov_t *)parent)->mvhd )
@@ -1577,6 +1759,16 @@ static int isom_read_mp4s_description( lsmash_file_t *file, isom_box_t *box, iso
     return isom_read_children( file, box, mp4s, level );
 }
 
+/* Allocate the table at once as far as the box can actually hold the declared entries. */
+static int isom_reserve_table_entries( lsmash_bs_t *bs, isom_box_t *box, lsmash_entry_array_t *list, uint32_t entry_count, uint32_t entry_size )
+{
+    uint64_t pos = lsmash_bs_count( bs );
+    if( pos >= box->size )
+        return 0;
+    uint64_t max_entry_count = (box->size - pos) / entry_size;
+    return lsmash_reserve_array_entries( list, (uint32_t)LSMASH_MIN( entry_count, max_entry_count ) );
+}
+
 static int isom_read_stts( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, int level )
 {
     if( !lsmash_check_box_type_identical( parent->type, ISOM_BOX_TYPE_STBL ) || ((isom_stbl_t *)parent)->stts )
@@ -1584,18 +1776,16 @@ static int isom_read_stts( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
     ADD_BOX( stts, isom_stbl_t );
     lsmash_bs_t *bs = file->bs;
     uint32_t entry_count = lsmash_bs_get_be32( bs );
+    int err = isom_reserve_table_entries( bs, box, stts->list, entry_count, 8 );
+    if( err < 0 )
+        return err;
     for( uint64_t pos = lsmash_bs_count( bs ); pos < box->size && stts->list->entry_count < entry_count; pos = lsmash_bs_count( bs ) )
     {
-        isom_stts_entry_t *data = lsmash_malloc( sizeof(isom_stts_entry_t) );
-        if( !data )
-            return LSMASH_ERR_MEMORY_ALLOC;
-        if( lsmash_add_entry( stts->list, data ) < 0 )
-        {
-            lsmash_free( data );
+        isom_stts_entry_t data;
+        data.sample_count = lsmash_bs_get_be32( bs );
+        data.sample_delta = lsmash_bs_get_be32( bs );
+        if( lsmash_add_array_entry( stts->list, &data ) < 0 )
             return LSMASH_ERR_MEMORY_ALLOC;
-        }
-        data->sample_count = lsmash_bs_get_be32( bs );
-        data->sample_delta = lsmash_bs_get_be32( bs );
     }
     return isom_read_leaf_box_common_last_process( file, box, level, stts );
 }
@@ -1607,18 +1797,16 @@ static int isom_read_ctts( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
     ADD_BOX( ctts, isom_stbl_t );
     lsmash_bs_t *bs = file->bs;
     uint32_t entry_count = lsmash_bs_get_be32( bs );
+    int err = isom_reserve_table_entries( bs, box, ctts->list, entry_count, 8 );
+    if( err < 0 )
+        return err;
     for( uint64_t pos = lsmash_bs_count( bs ); pos < box->size && ctts->list->entry_count < entry_count; pos = lsmash_bs_count( bs ) )
     {
-        isom_ctts_entry_t *data = lsmash_malloc( sizeof(isom_ctts_entry_t) );
-        if( !data )
+        isom_ctts_entry_t data;
+        data.sample_count  = lsmash_bs_get_be32( bs );
+        data.sample_offset = lsmash_bs_get_be32( bs );
+        if( lsmash_add_array_entry( ctts->list, &data ) < 0 )
             return LSMASH_ERR_MEMORY_ALLOC;
-        if( lsmash_add_entry( ctts->list, data ) < 0 )
-        {
-            lsmash_free( data );
-            return LSMASH_ERR_MEMORY_ALLOC;
-        }
-        data->sample_count  = lsmash_bs_get_be32( bs );
-        data->sample_offset = lsmash_bs_get_be32( bs );
     }
     return isom_read_leaf_box_common_last_process( file, box, level, ctts );
 }
@@ -1644,17 +1832,15 @@ static int isom_read_stss( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
     ADD_BOX( stss, isom_stbl_t );
     lsmash_bs_t *bs = file->bs;
     uint32_t entry_count = lsmash_bs_get_be32( bs );
+    int err = isom_reserve_table_entries( bs, box, stss->list, entry_count, 4 );
+    if( err < 0 )
+        return err;
     for( uint64_t pos = lsmash_bs_count( bs ); pos < box->size && stss->list->entry_count < entry_count; pos = lsmash_bs_count( bs ) )
     {
-        isom_stss_entry_t *data = lsmash_malloc( sizeof(isom_stss_entry_t) );
-        if( !data )
+        isom_stss_entry_t data;
+        data.sample_number = lsmash_bs_get_be32( bs );
+        if( lsmash_add_array_entry( stss->list, &data ) < 0 )
             return LSMASH_ERR_MEMORY_ALLOC;
-        if( lsmash_add_entry( stss->list, data ) < 0 )
-        {
-            lsmash_free( data );
-            return LSMASH_ERR_MEMORY_ALLOC;
-        }
-        data->sample_number = lsmash_bs_get_be32( bs );
     }
     return isom_read_leaf_box_common_last_process( file, box, level, stss );
 }
@@ -1666,17 +1852,15 @@ static int isom_read_stps( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
     ADD_BOX( stps, isom_stbl_t );
     lsmash_bs_t *bs = file->bs;
     uint32_t entry_count = lsmash_bs_get_be32( bs );
+    int err = isom_reserve_table_entries( bs, box, stps->list, entry_count, 4 );
+    if( err < 0 )
+        return err;
     for( uint64_t pos = lsmash_bs_count( bs ); pos < box->size && stps->list->entry_count < entry_count; pos = lsmash_bs_count( bs ) )
     {
-        isom_stps_entry_t *data = lsmash_malloc( sizeof(isom_stps_entry_t) );
-        if( !data )
-            return LSMASH_ERR_MEMORY_ALLOC;
-        if( lsmash_add_entry( stps->list, data ) < 0 )
-        {
-            lsmash_free( data );
+        isom_stps_entry_t data;
+        data.sample_number = lsmash_bs_get_be32( bs );
+        if( lsmash_add_array_entry( stps->list, &data ) < 0 )
             return LSMASH_ERR_MEMORY_ALLOC;
-        }
-        data->sample_number = lsmash_bs_get_be32( bs );
     }
     return isom_read_leaf_box_common_last_process( file, box, level, stps );
 }
@@ -1716,19 +1900,17 @@ static int isom_read_stsc( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
     ADD_BOX( stsc, isom_stbl_t );
     lsmash_bs_t *bs = file->bs;
     uint32_t entry_count = lsmash_bs_get_be32( bs );
+    int err = isom_reserve_table_entries( bs, box, stsc->list, entry_count, 12 );
+    if( err < 0 )
+        return err;
     for( uint64_t pos = lsmash_bs_count( bs ); pos < box->size && stsc->list->entry_count < entry_count; pos = lsmash_bs_count( bs ) )
     {
-        isom_stsc_entry_t *data = lsmash_malloc( sizeof(isom_stsc_entry_t) );
-        if( !data )
-            return LSMASH_ERR_MEMORY_ALLOC;
-        if( lsmash_add_entry( stsc->list, data ) < 0 )
-        {
-            lsmash_free( data );
+        isom_stsc_entry_t data;
+        data.first_chunk              = lsmash_bs_get_be32( bs );
+        data.samples_per_chunk        = lsmash_bs_get_be32( bs );
+        data.sample_description_index = lsmash_bs_get_be32( bs );
+        if( lsmash_add_array_entry( stsc->list, &data ) < 0 )
             return LSMASH_ERR_MEMORY_ALLOC;
-        }
-        data->first_chunk              = lsmash_bs_get_be32( bs );
-        data->samples_per_chunk        = lsmash_bs_get_be32( bs );
-        data->sample_description_index = lsmash_bs_get_be32( bs );
     }
     return isom_read_leaf_box_common_last_process( file, box, level, stsc );
 }
@@ -1744,25 +1926,67 @@ static int isom_read_stsz( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
     uint64_t pos = lsmash_bs_count( bs );
     if( pos < box->size )
     {
-        stsz->list = lsmash_create_entry_list();
+        stsz->list = lsmash_create_entry_array( sizeof(isom_stsz_entry_t) );
         if( !stsz->list )
             return LSMASH_ERR_MEMORY_ALLOC;
+        int err = isom_reserve_table_entries( bs, box, stsz->list, stsz->sample_count, 4 );
+        if( err < 0 )
+            return err;
         for( ; pos < box->size && stsz->list->entry_count < stsz->sample_count; pos = lsmash_bs_count( bs ) )
         {
-            isom_stsz_entry_t *data = lsmash_malloc( sizeof(isom_stsz_entry_t) );
-            if( !data )
-                return LSMASH_ERR_MEMORY_ALLOC;
-            if( lsmash_add_entry( stsz->list, data ) < 0 )
-            {
-                lsmash_free( data );
+            isom_stsz_entry_t data;
+            data.entry_size = lsmash_bs_get_be32( bs );
+            if( lsmash_add_array_entry( stsz->list, &data ) < 0 )
                 return LSMASH_ERR_MEMORY_ALLOC;
-            }
-            data->entry_size = lsmash_bs_get_be32( bs );
         }
     }
     return isom_read_leaf_box_common_last_process( file, box, level, stsz );
 }
 
+static int isom_read_stz2( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, int level )
+{
+    if( !lsmash_check_box_type_identical( parent->type, ISOM_BOX_TYPE_STBL ) || ((isom_stbl_t *)parent)->stsz )
+        return isom_read_unknown_box( file, box, parent, level );
+    isom_stsz_t *stz2 = isom_add_stz2( (isom_stbl_t *)parent );
+    if( !stz2 )
+        return LSMASH_ERR_NAMELESS;
+    lsmash_bs_t *bs = file->bs;
+    lsmash_bs_skip_bytes( bs, 3 );  /* reserved */
+    stz2->field_size   = lsmash_bs_get_byte( bs );
+    stz2->sample_count = lsmash_bs_get_be32( bs );
+    if( stz2->field_size != 4 && stz2->field_size != 8 && stz2->field_size != 16 )
+        return LSMASH_ERR_INVALID_DATA;
+    uint64_t pos = lsmash_bs_count( bs );
+    if( pos < box->size )
+    {
+        uint64_t max_entry_count = (box->size - pos) * 8 / stz2->field_size;
+        int err = lsmash_reserve_array_entries( stz2->list, (uint32_t)LSMASH_MIN( stz2->sample_count, max_entry_count ) );
+        if( err < 0 )
+            return err;
+    }
+    for( ; pos < box->size && stz2->list->entry_count < stz2->sample_count; pos = lsmash_bs_count( bs ) )
+    {
+        isom_stsz_entry_t data;
+        if( stz2->field_size == 4 )
+        {
+            uint8_t packed = lsmash_bs_get_byte( bs );
+            data.entry_size = packed >> 4;
+            if( lsmash_add_array_entry( stz2->list, &data ) < 0 )
+                return LSMASH_ERR_MEMORY_ALLOC;
+            if( stz2->list->entry_count == stz2->sample_count )
+                break;
+            data.entry_size = packed & 0x0f;
+        }
+        else if( stz2->field_size == 8 )
+            data.entry_size = lsmash_bs_get_byte( bs );
+        else
+            data.entry_size = lsmash_bs_get_be16( bs );
+        if( lsmash_add_array_entry( stz2->list, &data ) < 0 )
+            return LSMASH_ERR_MEMORY_ALLOC;
+    }
+    return isom_read_leaf_box_common_last_process( file, box, level, stz2 );
+}
+
 static int isom_read_stco( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, int level )
 {
     if( !lsmash_check_box_type_identical( parent->type, ISOM_BOX_TYPE_STBL ) || ((isom_stbl_t *)parent)->stco )
@@ -1776,32 +2000,25 @@ static int isom_read_stco( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
         return LSMASH_ERR_NAMELESS;
     lsmash_bs_t *bs = file->bs;
     uint32_t entry_count = lsmash_bs_get_be32( bs );
+    int err = isom_reserve_table_entries( bs, box, stco->list, entry_count, is_stco ? 4 : 8 );
+    if( err < 0 )
+        return err;
     if( is_stco )
         for( uint64_t pos = lsmash_bs_count( bs ); pos < box->size && stco->list->entry_count < entry_count; pos = lsmash_bs_count( bs ) )
         {
-            isom_stco_entry_t *data = lsmash_malloc( sizeof(isom_stco_entry_t) );
-            if( !data )
+            isom_stco_entry_t data;
+            data.chunk_offset = lsmash_bs_get_be32( bs );
+            if( lsmash_add_array_entry( stco->list, &data ) < 0 )
                 return LSMASH_ERR_MEMORY_ALLOC;
-            if( lsmash_add_entry( stco->list, data ) < 0 )
-            {
-                lsmash_free( data );
-                return LSMASH_ERR_MEMORY_ALLOC;
-            }
-            data->chunk_offset = lsmash_bs_get_be32( bs );
         }
     else
     {
         for( uint64_t pos = lsmash_bs_count( bs ); pos < box->size && stco->list->entry_count < entry_count; pos = lsmash_bs_count( bs ) )
         {
-            isom_co64_entry_t *data = lsmash_malloc( sizeof(isom_co64_entry_t) );
-            if( !data )
+            isom_co64_entry_t data;
+            data.chunk_offset = lsmash_bs_get_be64( bs );
+            if( lsmash_add_array_entry( stco->list, &data ) < 0 )
                 return LSMASH_ERR_MEMORY_ALLOC;
-            if( lsmash_add_entry( stco->list, data ) < 0 )
-            {
-                lsmash_free( data );
-                return LSMASH_ERR_MEMORY_ALLOC;
-            }
-            data->chunk_offset = lsmash_bs_get_be64( bs );
         }
     }
     return isom_read_leaf_box_common_last_process( file, box, level, stco );
@@ -2010,10 +2227,66 @@ static int isom_read_trex( lsmash_file_t *file, isom_box_t *box, isom_box_t *par
     return isom_read_leaf_box_common_last_process( file, box, level, trex );
 }
 
+/* Get the position of the Movie Fragment Random Access Box from the Movie Fragment Random Access Offset Box
+ * at the end of the file. If not found, return the file size. */
+static uint64_t isom_locate_mfra( lsmash_bs_t *bs )
+{
+    uint64_t file_size = bs->written;
+    if( file_size < ISOM_FULLBOX_COMMON_SIZE + 4
+     || lsmash_bs_read_seek( bs, file_size - (ISOM_FULLBOX_COMMON_SIZE + 4), SEEK_SET ) < 0 )
+        return file_size;
+    uint32_t size   = lsmash_bs_get_be32( bs );
+    uint32_t type   = lsmash_bs_get_be32( bs );
+    (void)lsmash_bs_get_be32( bs );     /* version and flags */
+    uint32_t length = lsmash_bs_get_be32( bs );
+    if( bs->eob
+     || size != ISOM_FULLBOX_COMMON_SIZE + 4
+     || type != ISOM_BOX_TYPE_MFRO.fourcc
+     || length < ISOM_BASEBOX_COMMON_SIZE + size
+     || length > file_size
+     || lsmash_bs_read_seek( bs, file_size - length, SEEK_SET ) < 0 )
+        return file_size;
+    size = lsmash_bs_get_be32( bs );
+    type = lsmash_bs_get_be32( bs );
+    if( bs->eob
+     || size != length
+     || type != ISOM_BOX_TYPE_MFRA.fourcc )
+        return file_size;
+    return file_size - length;
+}
+
+/* Record the first Movie Fragment Box and skip the rest of movie fragments.
+ * The following Movie Fragment Boxes are found and read by isom_get_movie_fragment(). */
+static int isom_defer_movie_fragments( lsmash_file_t *file, isom_box_t *box )
+{
+    isom_fragment_index_t *index = file->fragment_index;
+    lsmash_bs_t *bs = file->bs;
+    int err = lsmash_add_array_entry( index->pos_list, &box->pos );
+    if( err < 0 )
+        return err;
+    index->found_count = 1;
+    index->next_pos    = box->pos + box->size;
+    file->flags |= LSMASH_FILE_MODE_MEDIA;
+    uint64_t next_pos = isom_locate_mfra( bs );
+    if( next_pos < index->next_pos )
+        next_pos = bs->written;
+    if( next_pos <= index->next_pos )
+        index->next_pos = 0;
+    index->end_pos = next_pos;
+    if( lsmash_bs_read_seek( bs, next_pos, SEEK_SET ) < 0 )
+        return LSMASH_ERR_NAMELESS;
+    box->size = next_pos - box->pos;    /* for file size */
+    return 0;
+}
+
 static int isom_read_moof( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, int level )
 {
     if( !lsmash_check_box_type_identical( parent->type, LSMASH_BOX_TYPE_UNSPECIFIED ) )
         return isom_read_unknown_box( file, box, parent, level );
+    if( file->fragment_index
+     && file->fragment_index->pos_list->entry_count == 0
+     && !(box->manager & LSMASH_LAST_BOX) )
+        return isom_defer_movie_fragments( file, box );
     ADD_BOX( moof, lsmash_file_t );
     box->parent = parent;
     isom_box_common_copy( moof, box );
@@ -2527,6 +2800,8 @@ int isom_read_box( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, uin
             lsmash_box_type_t (*form_box_type_func)( lsmash_compact_box_type_t );
             int (*reader_func)( lsmash_file_t *, isom_box_t *, isom_box_t *, int );
         } description_reader_table[160] = { { 0, NULL, NULL } };
+        static isom_fourcc_index_t description_reader_index[160];
+        static uint32_t            description_reader_count;
         if( !description_reader_table[0].reader_func )
         {
             /* Initialize the table. */
@@ -2665,14 +2940,15 @@ int isom_read_box( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, uin
             ADD_DESCRIPTION_READER_TABLE_ELEMENT( ISOM_CODEC_TYPE_MP4S_SYSTEM, lsmash_form_iso_box_type, isom_read_mp4s_description );
             ADD_DESCRIPTION_READER_TABLE_ELEMENT( LSMASH_CODEC_TYPE_UNSPECIFIED, NULL, NULL );
 #undef ADD_DESCRIPTION_READER_TABLE_ELEMENT
+            description_reader_count = i - 1;
+            isom_create_fourcc_index( description_reader_index, description_reader_table, sizeof(struct description_reader_table_tag), description_reader_count );
+        }
+        uint32_t pos = isom_search_fourcc_index( description_reader_index, description_reader_count, box->type.fourcc );
+        if( pos < description_reader_count )
+        {
+            form_box_type_func = description_reader_table[ description_reader_index[pos].number ].form_box_type_func;
+            reader_func        = description_reader_table[ description_reader_index[pos].number ].reader_func;
         }
-        for( int i = 0; description_reader_table[i].reader_func; i++ )
-            if( box->type.fourcc == description_reader_table[i].fourcc )
-            {
-                form_box_type_func = description_reader_table[i].form_box_type_func;
-                reader_func        = description_reader_table[i].reader_func;
-                goto read_box;
-            }
         goto read_box;
     }
     if( lsmash_check_box_type_identical( parent->type, QT_BOX_TYPE_WAVE ) )
@@ -2709,6 +2985,8 @@ int isom_read_box( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, uin
         lsmash_box_type_t (*form_box_type_func)( lsmash_compact_box_type_t );
         int (*reader_func)( lsmash_file_t *, isom_box_t *, isom_box_t *, int );
     } box_reader_table[128] = { { 0, NULL, NULL } };
+    static isom_fourcc_index_t box_reader_index[128];
+    static uint32_t            box_reader_count;
     if( !box_reader_table[0].reader_func )
     {
         /* Initialize the table. */
@@ -2720,6 +2998,7 @@ int isom_read_box( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, uin
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_SIDX, lsmash_form_iso_box_type,  isom_read_sidx );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_MOOV, lsmash_form_iso_box_type,  isom_read_moov );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_MVHD, lsmash_form_iso_box_type,  isom_read_mvhd );
+        ADD_BOX_READER_TABLE_ELEMENT(   QT_BOX_TYPE_CMOV, lsmash_form_qtff_box_type, isom_read_cmov );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_IODS, lsmash_form_iso_box_type,  isom_read_iods );
         ADD_BOX_READER_TABLE_ELEMENT(   QT_BOX_TYPE_CTAB, lsmash_form_qtff_box_type, isom_read_ctab );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_ESDS, lsmash_form_iso_box_type,  isom_read_esds );
@@ -2769,6 +3048,7 @@ int isom_read_box( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, uin
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_SDTP, lsmash_form_iso_box_type,  isom_read_sdtp );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_STSC, lsmash_form_iso_box_type,  isom_read_stsc );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_STSZ, lsmash_form_iso_box_type,  isom_read_stsz );
+        ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_STZ2, lsmash_form_iso_box_type,  isom_read_stz2 );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_STCO, lsmash_form_iso_box_type,  isom_read_stco );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_CO64, lsmash_form_iso_box_type,  isom_read_stco );
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_SGPD, lsmash_form_iso_box_type,  isom_read_sgpd );
@@ -2797,14 +3077,16 @@ int isom_read_box( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, uin
         ADD_BOX_READER_TABLE_ELEMENT( ISOM_BOX_TYPE_MFRO, lsmash_form_iso_box_type,  isom_read_mfro );
         ADD_BOX_READER_TABLE_ELEMENT( LSMASH_BOX_TYPE_UNSPECIFIED, NULL,  NULL );
 #undef ADD_BOX_READER_TABLE_ELEMENT
+        box_reader_count = i - 1;
+        isom_create_fourcc_index( box_reader_index, box_reader_table, sizeof(struct box_reader_table_tag), box_reader_count );
+    }
+    uint32_t pos = isom_search_fourcc_index( box_reader_index, box_reader_count, box->type.fourcc );
+    if( pos < box_reader_count )
+    {
+        form_box_type_func = box_reader_table[ box_reader_index[pos].number ].form_box_type_func;
+        reader_func        = box_reader_table[ box_reader_index[pos].number ].reader_func;
+        goto read_box;
     }
-    for( int i = 0; box_reader_table[i].reader_func; i++ )
-        if( box->type.fourcc == box_reader_table[i].fourcc )
-        {
-            form_box_type_func = box_reader_table[i].form_box_type_func;
-            reader_func        = box_reader_table[i].reader_func;
-            goto read_box;
-        }
     if( box->type.fourcc == ISOM_BOX_TYPE_META.fourcc )
     {
        if( lsmash_bs_is_end   ( bs, 3 ) == 0
@@ -2901,6 +3183,202 @@ read_box:
          : isom_read_unknown_box( file, box, parent, level );
 }
 
+/* Get the size and the sequence number of the Movie Fragment Box at a given position without reading it.
+ * Return 0 if it is a Movie Fragment Box beginning with the Movie Fragment Header Box. */
+static int isom_peek_movie_fragment( lsmash_bs_t *bs, uint64_t pos, uint64_t *size, uint32_t *sequence_number )
+{
+    if( lsmash_bs_read_seek( bs, pos, SEEK_SET ) < 0 )
+        return LSMASH_ERR_NAMELESS;
+    uint64_t moof_size = lsmash_bs_get_be32( bs );
+    uint32_t moof_type = lsmash_bs_get_be32( bs );
+    if( moof_size == 1 )
+        moof_size = lsmash_bs_get_be64( bs );
+    uint32_t mfhd_size = lsmash_bs_get_be32( bs );
+    uint32_t mfhd_type = lsmash_bs_get_be32( bs );
+    (void)lsmash_bs_get_be32( bs );     /* version and flags */
+    *sequence_number = lsmash_bs_get_be32( bs );
+    if( bs->eob
+     || moof_type != ISOM_BOX_TYPE_MOOF.fourcc
+     || mfhd_type != ISOM_BOX_TYPE_MFHD.fourcc
+     || mfhd_size != ISOM_FULLBOX_COMMON_SIZE + 4
+     || moof_size <  ISOM_BASEBOX_COMMON_SIZE + mfhd_size )
+        return LSMASH_ERR_INVALID_DATA;
+    *size = moof_size;
+    return 0;
+}
+
+static int isom_compare_positions( const void *a, const void *b )
+{
+    uint64_t pos_a = *(const uint64_t *)a;
+    uint64_t pos_b = *(const uint64_t *)b;
+    return pos_a < pos_b ? -1 : pos_a > pos_b;
+}
+
+/* Append the positions of Movie Fragment Boxes listed in the Track Fragment Random Access Boxes to the index
+ * if every track has its own one. They are confirmed by isom_find_movie_fragments() when requested. */
+static int isom_seed_movie_fragments( lsmash_file_t *file )
+{
+    isom_fragment_index_t *index = file->fragment_index;
+    if( !file->mfra
+     || !file->moov
+     || !file->moov->mvex
+     ||  index->found_count != 1
+     ||  index->pos_list->entry_count != 1 )
+        return 0;
+    uint32_t count = 0;
+    for( lsmash_entry_t *entry = file->moov->mvex->trex_list.head; entry; entry = entry->next )
+    {
+        isom_trex_t *trex = (isom_trex_t *)entry->data;
+        if( !trex )
+            continue;
+        isom_tfra_t *tfra = NULL;
+        for( lsmash_entry_t *tfra_entry = file->mfra->tfra_list.head; tfra_entry; tfra_entry = tfra_entry->next )
+        {
+            tfra = (isom_tfra_t *)tfra_entry->data;
+            if( tfra && tfra->track_ID == trex->track_ID )
+                break;
+            tfra = NULL;
+        }
+        if( !tfra || !tfra->list )
+            return 0;   /* The track is not covered. */
+        count += tfra->list->entry_count;
+    }
+    if( count == 0 )
+        return 0;
+    uint64_t *pos_array = lsmash_malloc( count * sizeof(uint64_t) );
+    if( !pos_array )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    uint64_t first_pos = *(uint64_t *)lsmash_get_array_entry_data( index->pos_list, 1 );
+    uint32_t n = 0;
+    for( lsmash_entry_t *entry = file->mfra->tfra_list.head; entry; entry = entry->next )
+    {
+        isom_tfra_t *tfra = (isom_tfra_t *)entry->data;
+        if( !tfra || !tfra->list )
+            continue;
+        for( lsmash_entry_t *tfra_entry = tfra->list->head; tfra_entry && n < count; tfra_entry = tfra_entry->next )
+        {
+            isom_tfra_location_time_entry_t *data = (isom_tfra_location_time_entry_t *)tfra_entry->data;
+            if( data && data->moof_offset > first_pos && data->moof_offset < index->end_pos )
+                pos_array[n++] = data->moof_offset;
+        }
+    }
+    qsort( pos_array, n, sizeof(uint64_t), isom_compare_positions );
+    /* The sequence number of the first Movie Fragment Box is the base to confirm the following ones. */
+    uint64_t first_size;
+    int err = 0;
+    if( n && isom_peek_movie_fragment( file->bs, first_pos, &first_size, &index->sequence_number ) == 0 )
+        for( uint32_t i = 0; i < n; i++ )
+            if( (i == 0 || pos_array[i] != pos_array[i - 1])
+             && (err = lsmash_add_array_entry( index->pos_list, &pos_array[i] )) < 0 )
+                break;
+    lsmash_free( pos_array );
+    file->bs->error = 0;
+    return err;
+}
+
+/* Find the top level boxes following the last found Movie Fragment Box
+ * until the position of a given Movie Fragment Box is known or no more boxes are found.
+ * The positions taken from the Track Fragment Random Access Boxes are used if the Movie Fragment Boxes there
+ * follow the last found one in sequence number. Otherwise, the top level boxes are walked one by one,
+ * and the ones other than Movie Fragment Boxes are read as lsmash_read_file() does. */
+static int isom_find_movie_fragments( lsmash_file_t *file, uint32_t fragment_number )
+{
+    isom_fragment_index_t *index = file->fragment_index;
+    lsmash_bs_t *bs = file->bs;
+    while( index->found_count < fragment_number )
+    {
+        if( index->pos_list->entry_count > index->found_count )
+        {
+            uint64_t pos = *(uint64_t *)lsmash_get_array_entry_data( index->pos_list, index->found_count + 1 );
+            uint64_t size;
+            uint32_t sequence_number;
+            if( isom_peek_movie_fragment( bs, pos, &size, &sequence_number ) == 0
+             && sequence_number == index->sequence_number + 1
+             && (index->next_pos == 0 || pos >= index->next_pos) )
+            {
+                ++ index->found_count;
+                index->sequence_number = sequence_number;
+                index->next_pos        = pos + size < index->end_pos ? pos + size : 0;
+                continue;
+            }
+            /* Some Movie Fragment Boxes are not listed. Find them by walking from the last found one. */
+            while( index->pos_list->entry_count > index->found_count )
+                lsmash_remove_array_entry_tail( index->pos_list );
+            bs->error = 0;
+        }
+        if( index->next_pos == 0 )
+            break;
+        uint64_t pos = index->next_pos;
+        index->next_pos = 0;
+        if( lsmash_bs_read_seek( bs, pos, SEEK_SET ) < 0 )
+            break;
+        uint64_t size = lsmash_bs_get_be32( bs );
+        uint32_t type = lsmash_bs_get_be32( bs );
+        if( size == 1 )
+            size = lsmash_bs_get_be64( bs );
+        else if( size == 0 )
+            size = index->end_pos - pos;    /* This box is the last box in the stream. */
+        if( bs->eob || size < ISOM_BASEBOX_COMMON_SIZE )
+            break;
+        if( type == ISOM_BOX_TYPE_MOOF.fourcc )
+        {
+            int err = lsmash_add_array_entry( index->pos_list, &pos );
+            if( err < 0 )
+                return err;
+            ++ index->found_count;
+        }
+        else
+        {
+            /* Hand any other top level box to the reader. */
+            isom_box_t box;
+            int err = lsmash_bs_read_seek( bs, pos, SEEK_SET ) < 0 ? LSMASH_ERR_NAMELESS
+                    : isom_read_box( file, &box, (isom_box_t *)file, pos, 0 );
+            bs->error = 0;  /* Clear error flag. */
+            if( err < 0 )
+                return err;
+        }
+        if( size < index->end_pos - pos )
+            index->next_pos = pos + size;
+    }
+    return 0;
+}
+
+isom_moof_t *isom_get_movie_fragment( lsmash_file_t *file, uint32_t fragment_number )
+{
+    isom_fragment_index_t *index = file->fragment_index;
+    if( !index )
+        return (isom_moof_t *)lsmash_get_entry_data( &file->moof_list, fragment_number );
+    if( isom_find_movie_fragments( file, fragment_number ) < 0 )
+        return NULL;
+    uint64_t *pos = (uint64_t *)lsmash_get_array_entry_data( index->pos_list, fragment_number );
+    if( !pos )
+        return NULL;
+    /* Check whether the Movie Fragment Box is kept or not. */
+    for( lsmash_entry_t *entry = file->moof_list.head; entry; entry = entry->next )
+    {
+        isom_moof_t *moof = (isom_moof_t *)entry->data;
+        if( moof && moof->pos == *pos )
+        {
+            /* Keep the list in order of use so that the least recently used one is discarded first. */
+            lsmash_move_entry_to_tail( &file->moof_list, entry );
+            return moof;
+        }
+    }
+    /* Read the Movie Fragment Box. It is appended to the tail of the list.
+     * Discard the least recently used ones if more than the maximum number of them are kept. */
+    lsmash_bs_t *bs = file->bs;
+    isom_box_t box;
+    int ret = lsmash_bs_read_seek( bs, *pos, SEEK_SET ) < 0 ? LSMASH_ERR_NAMELESS
+            : isom_read_box( file, &box, (isom_box_t *)file, *pos, 0 );
+    bs->error = 0;  /* Clear error flag. */
+    isom_moof_t *moof = file->moof_list.tail ? (isom_moof_t *)file->moof_list.tail->data : NULL;
+    if( ret < 0 || !moof || moof->pos != *pos )
+        return NULL;
+    while( file->moof_list.entry_count > index->max_resident )
+        isom_remove_box_by_itself( file->moof_list.head->data );
+    return moof;
+}
+
 int isom_read_file( lsmash_file_t *file )
 {
     lsmash_bs_t *bs = file->bs;
@@ -2913,6 +3391,7 @@ int isom_read_file( lsmash_file_t *file )
         file->print = lsmash_create_entry_list();
         if( !file->print )
             return LSMASH_ERR_MEMORY_ALLOC;
+        isom_start_print_stream( file );
     }
     file->size = UINT64_MAX;
     isom_box_t box;
@@ -2922,5 +3401,9 @@ int isom_read_file( lsmash_file_t *file )
     bs->error = 0;  /* Clear error flag. */
     if( ret < 0 )
         return ret;
+    if( (ret = isom_finish_print_stream( file )) < 0 )
+        return ret;
+    if( file->fragment_index && (ret = isom_seed_movie_fragments( file )) < 0 )
+        return ret;
     return isom_check_compatibility( file );
 }
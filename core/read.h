@@ -25,5 +25,6 @@
 
 int isom_read_file( lsmash_file_t *file );
 int isom_read_box( lsmash_file_t *file, isom_box_t *box, isom_box_t *parent, uint64_t parent_pos, int level );
+isom_moof_t *isom_get_movie_fragment( lsmash_file_t *file, uint32_t fragment_number );
 
 #endif /* LSMASH_READ_H */
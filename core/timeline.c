@@ -26,10 +26,12 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <limits.h>
 #include <inttypes.h>
 
 #include "box.h"
 #include "timeline.h"
+#include "read.h"
 
 #include "codecs/mp4a.h"
 #include "codecs/mp4sys.h"
@@ -38,10 +40,13 @@
 #include "importer/importer.h"
 
 #define NO_RANDOM_ACCESS_POINT 0xffffffff
+#define ISOM_TIMELINE_EXPANSION_WINDOW 4096
+#define ISOM_TIMELINE_STREAM_CHUNK_SIZE (1 << 20)   /* max length of a chunk made of contiguous samples in a stream */
 
 typedef struct
 {
     uint64_t pos;
+    uint64_t dts;           /* the sum of the durations of all preceding samples */
     uint32_t duration;
     uint32_t offset;
     uint32_t length;
@@ -50,6 +55,75 @@ typedef struct
     lsmash_sample_property_t prop;
 } isom_sample_info_t;
 
+/* states of expansion of the sample tables into the sample info */
+typedef struct
+{
+    isom_dref_t *dref;
+    isom_stsd_t *stsd;
+    isom_stts_t *stts;
+    isom_ctts_t *ctts;
+    isom_stss_t *stss;
+    isom_stps_t *stps;
+    isom_stsc_t *stsc;
+    isom_stsz_t *stsz;
+    isom_stco_t *stco;
+    isom_sgpd_t *sgpd_rap;
+    isom_sgpd_t *sgpd_roll;
+    lsmash_entry_t *sdtp_entry;
+    lsmash_entry_t *sbgp_roll_entry;
+    lsmash_entry_t *sbgp_rap_entry;
+    isom_stts_entry_t *stts_data;
+    isom_ctts_entry_t *ctts_data;
+    isom_stss_entry_t *stss_data;
+    isom_stps_entry_t *stps_data;
+    isom_stsz_entry_t *stsz_data;
+    isom_stsc_entry_t *stsc_data;
+    isom_stsc_entry_t *next_stsc_data;
+    void              *stco_data;   /* isom_stco_entry_t or isom_co64_entry_t */
+    isom_sample_entry_t *description;
+    isom_dref_entry_t   *dref_entry;
+    isom_portable_chunk_t chunk;
+    isom_lpcm_bunch_t     bunch;
+    uint64_t dts;
+    uint64_t data_offset;
+    uint64_t offset_from_chunk;
+    uint32_t chunk_number;
+    uint32_t sample_number;
+    uint32_t sample_number_in_chunk;
+    uint32_t sample_number_in_stts_entry;
+    uint32_t sample_number_in_ctts_entry;
+    uint32_t sample_number_in_sbgp_roll_entry;
+    uint32_t sample_number_in_sbgp_rap_entry;
+    uint32_t samples_per_packet;
+    uint32_t constant_sample_size;
+    uint32_t distance;              /* distance from the last random accessible point */
+    uint32_t last_duration;
+    uint32_t packet_number;
+    int all_sync;
+    int large_presentation;
+    int is_lpcm_audio;
+    int is_qt_fixed_comp_audio;
+    int iso_sdtp;
+    int allow_negative_sample_offset;
+    /* movie fragments */
+    lsmash_file_t                   *file;
+    isom_tfra_t                     *tfra;
+    lsmash_entry_t                  *tfra_entry;
+    isom_tfra_location_time_entry_t *rap;
+    uint32_t fragment_number;       /* the number of the next movie fragment to be expanded */
+    uint32_t sample_count;          /* the number of samples expanded so far */
+    int fragmented;                 /* If set to 1, movie fragments are expanded instead of the sample tables. */
+} isom_sample_table_cursor_t;
+
+typedef struct
+{
+    lsmash_file_t *file;    /* the file where the chunk is stored */
+    uint64_t       pos;     /* absolute file offset of the chunk */
+    uint64_t       size;    /* size of the chunk */
+    uint64_t       alloc;   /* allocated size of the data */
+    uint8_t       *data;
+} isom_chunk_buffer_t;
+
 static const lsmash_class_t lsmash_timeline_class =
 {
     "timeline"
@@ -66,24 +140,29 @@ struct isom_timeline_tag
     uint32_t ctd_shift;     /* shift from composition to decode timeline */
     uint64_t media_duration;
     uint64_t track_duration;
-    uint32_t last_accessed_sample_number;
-    uint64_t last_accessed_sample_dts;
     uint32_t last_accessed_lpcm_bunch_number;
     uint32_t last_accessed_lpcm_bunch_duration;
     uint32_t last_accessed_lpcm_bunch_sample_count;
     uint32_t last_accessed_lpcm_bunch_first_sample_number;
     uint64_t last_accessed_lpcm_bunch_dts;
+    uint32_t last_read_sample_number;
+    lsmash_entry_t     *last_read_chunk_entry;  /* entry of the chunk read last in sequential reading */
+    isom_chunk_buffer_t chunk_buffer[2];        /* the chunk being read and the next one prefetched */
     lsmash_entry_list_t edit_list [1];  /* list of edits */
     lsmash_entry_list_t chunk_list[1];  /* list of chunks */
-    lsmash_entry_list_t info_list [1];  /* list of sample info */
+    lsmash_entry_array_t info_list[1];  /* array of sample info */
     lsmash_entry_list_t bunch_list[1];  /* list of LPCM bunch */
+    isom_sample_table_cursor_t *cursor; /* available only while the timeline is constructed lazily */
     int (*get_dts)( isom_timeline_t *timeline, uint32_t sample_number, uint64_t *dts );
     int (*get_cts)( isom_timeline_t *timeline, uint32_t sample_number, uint64_t *cts );
+    int (*get_sample_number)( isom_timeline_t *timeline, uint64_t dts, uint32_t *sample_number );
     int (*get_sample_duration)( isom_timeline_t *timeline, uint32_t sample_number, uint32_t *sample_duration );
     lsmash_sample_t *(*get_sample)( isom_timeline_t *timeline, uint32_t sample_number );
     int (*get_sample_info)( isom_timeline_t *timeline, uint32_t sample_number, lsmash_sample_t *sample );
     int (*get_sample_property)( isom_timeline_t *timeline, uint32_t sample_number, lsmash_sample_property_t *prop );
+    int (*get_sample_location)( isom_timeline_t *timeline, uint32_t sample_number, lsmash_sample_t *sample, lsmash_file_t **file );
     int (*check_sample_existence)( isom_timeline_t *timeline, uint32_t sample_number );
+    int (*convert_sample)( lsmash_sample_t *sample );   /* converts the data of a sample read from the stream if any */
 };
 
 isom_timeline_t *isom_get_timeline( lsmash_root_t *root, uint32_t track_ID )
@@ -111,7 +190,7 @@ isom_timeline_t *isom_timeline_create( void )
     timeline->class = &lsmash_timeline_class;
     lsmash_init_entry_list( timeline->edit_list );
     lsmash_init_entry_list( timeline->chunk_list );
-    lsmash_init_entry_list( timeline->info_list );
+    lsmash_init_entry_array( timeline->info_list, sizeof(isom_sample_info_t) );
     lsmash_init_entry_list( timeline->bunch_list );
     return timeline;
 }
@@ -122,8 +201,11 @@ void isom_timeline_destroy( isom_timeline_t *timeline )
         return;
     lsmash_remove_entries( timeline->edit_list,  NULL );
     lsmash_remove_entries( timeline->chunk_list, NULL );    /* chunk data must be already freed. */
-    lsmash_remove_entries( timeline->info_list,  NULL );
+    lsmash_remove_array_entries( timeline->info_list );
     lsmash_remove_entries( timeline->bunch_list, NULL );
+    lsmash_free( timeline->cursor );
+    lsmash_free( timeline->chunk_buffer[0].data );
+    lsmash_free( timeline->chunk_buffer[1].data );
     lsmash_free( timeline );
 }
 
@@ -239,6 +321,15 @@ int isom_timeline_set_track_duration
     return 0;
 }
 
+void isom_timeline_set_sample_converter
+(
+    isom_timeline_t *timeline,
+    int (*convert_sample)( lsmash_sample_t *sample )
+)
+{
+    timeline->convert_sample = convert_sample;
+}
+
 static void isom_get_qt_fixed_comp_audio_sample_quants
 (
     isom_timeline_t     *timeline,
@@ -283,18 +374,20 @@ static int isom_is_qt_fixed_compressed_audio
     return (((isom_audio_entry_t *)description)->compression_ID != QT_AUDIO_COMPRESSION_ID_VARIABLE_COMPRESSION);
 }
 
+static int isom_expand_timeline( isom_timeline_t *timeline, uint32_t sample_number );
+
+static inline isom_sample_info_t *isom_get_sample_info( isom_timeline_t *timeline, uint32_t sample_number )
+{
+    if( sample_number > timeline->info_list->entry_count && timeline->cursor )
+        (void)isom_expand_timeline( timeline, sample_number );
+    return (isom_sample_info_t *)lsmash_get_array_entry_data( timeline->info_list, sample_number );
+}
+
 static int isom_add_sample_info_entry( isom_timeline_t *timeline, isom_sample_info_t *src_info )
 {
-    isom_sample_info_t *dst_info = lsmash_malloc( sizeof(isom_sample_info_t) );
-    if( !dst_info )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    if( lsmash_add_entry( timeline->info_list, dst_info ) < 0 )
-    {
-        lsmash_free( dst_info );
-        return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    *dst_info = *src_info;
-    return 0;
+    isom_sample_info_t *prev_info = (isom_sample_info_t *)lsmash_get_array_entry_data( timeline->info_list, timeline->info_list->entry_count );
+    src_info->dts = prev_info ? prev_info->dts + prev_info->duration : 0;
+    return lsmash_add_array_entry( timeline->info_list, src_info );
 }
 
 int isom_add_lpcm_bunch_entry( isom_timeline_t *timeline, isom_lpcm_bunch_t *src_bunch )
@@ -325,6 +418,42 @@ static int isom_add_portable_chunk_entry( isom_timeline_t *timeline, isom_portab
     return 0;
 }
 
+int isom_add_stream_sample_entry( isom_timeline_t *timeline, lsmash_file_t *file, lsmash_sample_t *sample, uint32_t sample_duration )
+{
+    /* Group contiguous samples into a chunk so that sequential reading can read them at a time. */
+    isom_portable_chunk_t *chunk = timeline->chunk_list->tail ? (isom_portable_chunk_t *)timeline->chunk_list->tail->data : NULL;
+    if( !chunk
+     ||  chunk->file != file
+     ||  chunk->data_offset + chunk->length != sample->pos
+     ||  chunk->length + sample->length > ISOM_TIMELINE_STREAM_CHUNK_SIZE )
+    {
+        isom_portable_chunk_t new_chunk =
+        {
+            .data_offset = sample->pos,
+            .length      = 0,
+            .number      = timeline->chunk_list->entry_count + 1,
+            .file        = file
+        };
+        int err = isom_add_portable_chunk_entry( timeline, &new_chunk );
+        if( err < 0 )
+            return err;
+        chunk = (isom_portable_chunk_t *)timeline->chunk_list->tail->data;
+    }
+    chunk->length += sample->length;
+    isom_sample_info_t info =
+    {
+        .pos      = sample->pos,
+        .duration = sample_duration,
+        .offset   = sample->cts - sample->dts,
+        .length   = sample->length,
+        .index    = sample->index,
+        .chunk    = chunk,
+        .prop     = sample->prop
+    };
+    timeline->max_sample_size = LSMASH_MAX( timeline->max_sample_size, sample->length );
+    return isom_add_sample_info_entry( timeline, &info );
+}
+
 static int isom_compare_lpcm_sample_info( isom_lpcm_bunch_t *bunch, isom_sample_info_t *info )
 {
     return info->duration != bunch->duration
@@ -391,56 +520,19 @@ static isom_lpcm_bunch_t *isom_get_bunch( isom_timeline_t *timeline, uint32_t sa
 
 static int isom_get_dts_from_info_list( isom_timeline_t *timeline, uint32_t sample_number, uint64_t *dts )
 {
-    if( sample_number == timeline->last_accessed_sample_number )
-        *dts = timeline->last_accessed_sample_dts;
-    else if( sample_number == 1 )
-        *dts = 0;
-    else if( sample_number == timeline->last_accessed_sample_number + 1 )
-    {
-        isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, timeline->last_accessed_sample_number );
-        if( !info )
-            return LSMASH_ERR_NAMELESS;
-        *dts = timeline->last_accessed_sample_dts + info->duration;
-    }
-    else if( sample_number == timeline->last_accessed_sample_number - 1 )
-    {
-        isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, timeline->last_accessed_sample_number - 1 );
-        if( !info )
-            return LSMASH_ERR_NAMELESS;
-        *dts = timeline->last_accessed_sample_dts - info->duration;
-    }
-    else
-    {
-        *dts = 0;
-        uint32_t distance = sample_number - 1;
-        lsmash_entry_t *entry;
-        for( entry = timeline->info_list->head; entry; entry = entry->next )
-        {
-            isom_sample_info_t *info = (isom_sample_info_t *)entry->data;
-            if( !info )
-                return LSMASH_ERR_NAMELESS;
-            if( distance-- == 0 )
-                break;
-            *dts += info->duration;
-        }
-        if( !entry )
-            return LSMASH_ERR_NAMELESS;
-    }
-    /* Note: last_accessed_sample_number is always updated together with last_accessed_sample_dts, and vice versa. */
-    timeline->last_accessed_sample_dts    = *dts;
-    timeline->last_accessed_sample_number = sample_number;
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
+    if( !info )
+        return LSMASH_ERR_NAMELESS;
+    *dts = info->dts;
     return 0;
 }
 
 static int isom_get_cts_from_info_list( isom_timeline_t *timeline, uint32_t sample_number, uint64_t *cts )
 {
-    int ret = isom_get_dts_from_info_list( timeline, sample_number, cts );
-    if( ret < 0 )
-        return ret;
-    isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, sample_number );
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
     if( !info )
         return LSMASH_ERR_NAMELESS;
-    *cts = timeline->ctd_shift ? (*cts + (int32_t)info->offset) : (*cts + info->offset);
+    *cts = timeline->ctd_shift ? (info->dts + (int32_t)info->offset) : (info->dts + info->offset);
     return 0;
 }
 
@@ -462,9 +554,63 @@ static int isom_get_cts_from_bunch_list( isom_timeline_t *timeline, uint32_t sam
     return 0;
 }
 
+/* Find the last sample whose DTS is not greater than a given DTS by binary search. */
+static int isom_get_sample_number_from_info_list( isom_timeline_t *timeline, uint64_t dts, uint32_t *sample_number )
+{
+    /* Expand the timeline until a sample whose DTS is greater than a given DTS appears. */
+    while( timeline->cursor )
+    {
+        isom_sample_info_t *last_info = (isom_sample_info_t *)lsmash_get_array_entry_data( timeline->info_list, timeline->info_list->entry_count );
+        if( last_info && last_info->dts > dts )
+            break;
+        int err = isom_expand_timeline( timeline, timeline->info_list->entry_count + 1 );
+        if( err < 0 )
+            return err;
+    }
+    isom_sample_info_t *info = (isom_sample_info_t *)timeline->info_list->data;
+    uint32_t low  = 0;
+    uint32_t high = timeline->info_list->entry_count;
+    if( high == 0 )
+        return LSMASH_ERR_NAMELESS;
+    while( high - low > 1 )
+    {
+        uint32_t mid = low + (high - low) / 2;
+        if( info[mid].dts <= dts )
+            low = mid;
+        else
+            high = mid;
+    }
+    *sample_number = low + 1;
+    return 0;
+}
+
+static int isom_get_sample_number_from_bunch_list( isom_timeline_t *timeline, uint64_t dts, uint32_t *sample_number )
+{
+    uint64_t bunch_dts = 0;
+    uint32_t first_sample_number = 1;
+    for( lsmash_entry_t *entry = timeline->bunch_list->head; entry; entry = entry->next )
+    {
+        isom_lpcm_bunch_t *bunch = (isom_lpcm_bunch_t *)entry->data;
+        if( !bunch )
+            return LSMASH_ERR_NAMELESS;
+        uint64_t bunch_duration = (uint64_t)bunch->duration * bunch->sample_count;
+        if( dts < bunch_dts + bunch_duration || !entry->next )
+        {
+            uint64_t sample_number_offset = bunch->duration ? (dts - bunch_dts) / bunch->duration : 0;
+            if( sample_number_offset >= bunch->sample_count )
+                sample_number_offset = bunch->sample_count ? bunch->sample_count - 1 : 0;
+            *sample_number = first_sample_number + sample_number_offset;
+            return 0;
+        }
+        bunch_dts           += bunch_duration;
+        first_sample_number += bunch->sample_count;
+    }
+    return LSMASH_ERR_NAMELESS;
+}
+
 static int isom_get_sample_duration_from_info_list( isom_timeline_t *timeline, uint32_t sample_number, uint32_t *sample_duration )
 {
-    isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, sample_number );
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
     if( !info )
         return LSMASH_ERR_NAMELESS;
     *sample_duration = info->duration;
@@ -482,7 +628,7 @@ static int isom_get_sample_duration_from_bunch_list( isom_timeline_t *timeline,
 
 static int isom_check_sample_existence_in_info_list( isom_timeline_t *timeline, uint32_t sample_number )
 {
-    isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, sample_number );
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
     if( !info || !info->chunk )
         return 0;
     return !!info->chunk->file;
@@ -496,18 +642,130 @@ static int isom_check_sample_existence_in_bunch_list( isom_timeline_t *timeline,
     return !!bunch->chunk->file;
 }
 
+static int isom_load_chunk_buffer( isom_chunk_buffer_t *buffer, isom_portable_chunk_t *chunk )
+{
+    lsmash_bs_t *bs = chunk->file->bs;
+    buffer->size = 0;
+    if( chunk->length > buffer->alloc )
+    {
+        uint8_t *data = lsmash_realloc( buffer->data, chunk->length );
+        if( !data )
+            return LSMASH_ERR_MEMORY_ALLOC;
+        buffer->data  = data;
+        buffer->alloc = chunk->length;
+    }
+    if( lsmash_bs_read_seek( bs, chunk->data_offset, SEEK_SET ) < 0
+     || lsmash_bs_get_bytes_ex( bs, chunk->length, buffer->data ) != chunk->length )
+        return LSMASH_ERR_NAMELESS;
+    buffer->file = chunk->file;
+    buffer->pos  = chunk->data_offset;
+    buffer->size = chunk->length;
+    return 0;
+}
+
+static inline int isom_check_chunk_buffer( isom_chunk_buffer_t *buffer, lsmash_file_t *file, uint64_t pos, uint64_t size )
+{
+    return buffer->size
+        && buffer->file == file
+        && pos >= buffer->pos
+        && pos + size <= buffer->pos + buffer->size;
+}
+
+static inline int isom_check_chunk_bufferable( lsmash_bs_t *bs, isom_portable_chunk_t *chunk )
+{
+    /* Reading a whole chunk is meaningless for a mapped file and not worth for a huge chunk.
+     * Note that the length of a chunk is unknown until all samples in it are constructed. */
+    return !bs->buffer.mapped
+        && chunk->length
+        && chunk->length <= bs->buffer.max_size;
+}
+
+static lsmash_entry_t *isom_find_chunk_entry( isom_timeline_t *timeline, isom_portable_chunk_t *chunk )
+{
+    lsmash_entry_t *entry = timeline->last_read_chunk_entry;
+    if( entry && entry->data == chunk )
+        return entry;
+    if( entry && entry->next && entry->next->data == chunk )
+        return entry->next;
+    for( entry = timeline->chunk_list->head; entry; entry = entry->next )
+        if( entry->data == chunk )
+            return entry;
+    return NULL;
+}
+
+/* Copy the next chunk of every track read sequentially from the file into its own buffer
+ * if the chunk is on the bytestream buffer just filled, i.e. follows the chunk read last in interleave order.
+ * Then each track can get the chunk without moving the bytestream buffer back there. */
+static void isom_prefetch_chunks( lsmash_file_t *file )
+{
+    if( !file->timeline )
+        return;
+    lsmash_bs_t *bs = file->bs;
+    for( lsmash_entry_t *entry = file->timeline->head; entry; entry = entry->next )
+    {
+        isom_timeline_t *timeline = (isom_timeline_t *)entry->data;
+        if( !timeline
+         || !timeline->last_read_chunk_entry
+         || !timeline->last_read_chunk_entry->next )
+            continue;
+        isom_portable_chunk_t *chunk  = (isom_portable_chunk_t *)timeline->last_read_chunk_entry->next->data;
+        isom_chunk_buffer_t   *buffer = &timeline->chunk_buffer[1];
+        if( !chunk
+         ||  chunk->file != file
+         || !isom_check_chunk_bufferable( bs, chunk )
+         ||  isom_check_chunk_buffer( buffer, file, chunk->data_offset, chunk->length )
+         || !lsmash_bs_is_buffered( bs, chunk->data_offset, chunk->length ) )
+            continue;
+        (void)isom_load_chunk_buffer( buffer, chunk );
+    }
+}
+
 static lsmash_sample_t *isom_read_sample_data_from_stream
 (
-    lsmash_file_t   *file,
-    isom_timeline_t *timeline,
-    uint32_t         sample_length,
-    uint64_t         sample_pos
+    isom_timeline_t       *timeline,
+    isom_portable_chunk_t *chunk,
+    uint32_t               sample_number,
+    uint32_t               sample_length,
+    uint64_t               sample_pos
 )
 {
+    lsmash_bs_t *bs = chunk->file->bs;
+    /* In sequential reading, read the whole chunk at a time into the buffer of the track and then cut out each sample from it
+     * instead of seeking and reading the stream sample by sample. The chunk may be prefetched already. */
+    int sequential = (sample_number == timeline->last_read_sample_number + 1);
+    timeline->last_read_sample_number = sample_number;
+    isom_chunk_buffer_t *buffer = &timeline->chunk_buffer[0];
+    if( !sequential )
+        timeline->last_read_chunk_entry = NULL;
+    else if( sample_length
+          && !isom_check_chunk_buffer( buffer, chunk->file, sample_pos, sample_length )
+          && isom_check_chunk_bufferable( bs, chunk ) )
+    {
+        if( isom_check_chunk_buffer( &timeline->chunk_buffer[1], chunk->file, chunk->data_offset, chunk->length ) )
+        {
+            isom_chunk_buffer_t prefetched = timeline->chunk_buffer[1];
+            timeline->chunk_buffer[1] = *buffer;
+            *buffer = prefetched;
+            timeline->last_read_chunk_entry = isom_find_chunk_entry( timeline, chunk );
+        }
+        else if( isom_load_chunk_buffer( buffer, chunk ) == 0 )
+        {
+            timeline->last_read_chunk_entry = isom_find_chunk_entry( timeline, chunk );
+            isom_prefetch_chunks( chunk->file );
+        }
+    }
+    if( sample_length
+     && isom_check_chunk_buffer( buffer, chunk->file, sample_pos, sample_length ) )
+    {
+        lsmash_sample_t *sample = lsmash_create_sample( sample_length );
+        if( !sample )
+            return NULL;
+        memcpy( sample->data, buffer->data + (sample_pos - buffer->pos), sample_length );
+        return sample;
+    }
     lsmash_sample_t *sample = lsmash_create_sample( 0 );
     if( !sample )
         return NULL;
-    lsmash_bs_t *bs = file->bs;
     lsmash_bs_read_seek( bs, sample_pos, SEEK_SET );
     sample->data = lsmash_bs_get_bytes( bs, sample_length );
     if( !sample->data )
@@ -527,7 +785,7 @@ static lsmash_sample_t *isom_get_lpcm_sample_from_media_timeline( isom_timeline_
     /* Get data of a sample from the stream. */
     uint64_t sample_number_offset = sample_number - timeline->last_accessed_lpcm_bunch_first_sample_number;
     uint64_t sample_pos           = bunch->pos + sample_number_offset * bunch->length;
-    lsmash_sample_t *sample = isom_read_sample_data_from_stream( bunch->chunk->file, timeline, bunch->length, sample_pos );
+    lsmash_sample_t *sample = isom_read_sample_data_from_stream( timeline, bunch->chunk, sample_number, bunch->length, sample_pos );
     if( !sample )
         return NULL;
     /* Get sample info. */
@@ -542,24 +800,26 @@ static lsmash_sample_t *isom_get_lpcm_sample_from_media_timeline( isom_timeline_
 
 static lsmash_sample_t *isom_get_sample_from_media_timeline( isom_timeline_t *timeline, uint32_t sample_number )
 {
-    uint64_t dts;
-    if( isom_get_dts_from_info_list( timeline, sample_number, &dts ) < 0 )
-        return NULL;
-    isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, sample_number );
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
     if( !info
      || !info->chunk )
         return NULL;
     /* Get data of a sample from the stream. */
-    lsmash_sample_t *sample = isom_read_sample_data_from_stream( info->chunk->file, timeline, info->length, info->pos );
+    lsmash_sample_t *sample = isom_read_sample_data_from_stream( timeline, info->chunk, sample_number, info->length, info->pos );
     if( !sample )
         return NULL;
     /* Get sample info. */
-    sample->dts    = dts;
-    sample->cts    = timeline->ctd_shift ? (dts + (int32_t)info->offset) : (dts + info->offset);
+    sample->dts    = info->dts;
+    sample->cts    = timeline->ctd_shift ? (info->dts + (int32_t)info->offset) : (info->dts + info->offset);
     sample->pos    = info->pos;
     sample->length = info->length;
     sample->index  = info->index;
     sample->prop   = info->prop;
+    if( timeline->convert_sample && timeline->convert_sample( sample ) < 0 )
+    {
+        lsmash_delete_sample( sample );
+        return NULL;
+    }
     return sample;
 }
 
@@ -580,19 +840,50 @@ static int isom_get_lpcm_sample_info_from_media_timeline( isom_timeline_t *timel
 
 static int isom_get_sample_info_from_media_timeline( isom_timeline_t *timeline, uint32_t sample_number, lsmash_sample_t *sample )
 {
-    uint64_t dts;
-    int ret = isom_get_dts_from_info_list( timeline, sample_number, &dts );
-    if( ret < 0 )
-        return ret;
-    isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, sample_number );
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
     if( !info )
         return LSMASH_ERR_NAMELESS;
-    sample->dts    = dts;
-    sample->cts    = timeline->ctd_shift ? (dts + (int32_t)info->offset) : (dts + info->offset);
+    sample->dts    = info->dts;
+    sample->cts    = timeline->ctd_shift ? (info->dts + (int32_t)info->offset) : (info->dts + info->offset);
+    sample->pos    = info->pos;
+    sample->length = info->length;
+    sample->index  = info->index;
+    sample->prop   = info->prop;
+    return 0;
+}
+
+static int isom_get_lpcm_sample_location_from_media_timeline( isom_timeline_t *timeline, uint32_t sample_number, lsmash_sample_t *sample, lsmash_file_t **file )
+{
+    isom_lpcm_bunch_t *bunch = isom_get_bunch( timeline, sample_number );
+    if( !bunch
+     || !bunch->chunk
+     || !bunch->chunk->file )
+        return LSMASH_ERR_NAMELESS;
+    uint64_t sample_number_offset = sample_number - timeline->last_accessed_lpcm_bunch_first_sample_number;
+    sample->dts    = timeline->last_accessed_lpcm_bunch_dts + sample_number_offset * bunch->duration;
+    sample->cts    = timeline->ctd_shift ? (sample->dts + (int32_t)bunch->offset) : (sample->dts + bunch->offset);
+    sample->pos    = bunch->pos + sample_number_offset * bunch->length;
+    sample->length = bunch->length;
+    sample->index  = bunch->index;
+    sample->prop   = bunch->prop;
+    *file = bunch->chunk->file;
+    return 0;
+}
+
+static int isom_get_sample_location_from_media_timeline( isom_timeline_t *timeline, uint32_t sample_number, lsmash_sample_t *sample, lsmash_file_t **file )
+{
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
+    if( !info
+     || !info->chunk
+     || !info->chunk->file )
+        return LSMASH_ERR_NAMELESS;
+    sample->dts    = info->dts;
+    sample->cts    = timeline->ctd_shift ? (info->dts + (int32_t)info->offset) : (info->dts + info->offset);
     sample->pos    = info->pos;
     sample->length = info->length;
     sample->index  = info->index;
     sample->prop   = info->prop;
+    *file = info->chunk->file;
     return 0;
 }
 
@@ -605,25 +896,27 @@ static int isom_get_lpcm_sample_property_from_media_timeline( isom_timeline_t *t
 
 static int isom_get_sample_property_from_media_timeline( isom_timeline_t *timeline, uint32_t sample_number, lsmash_sample_property_t *prop )
 {
-    isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, sample_number );
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
     if( !info )
         return LSMASH_ERR_NAMELESS;
     *prop = info->prop;
     return 0;
 }
 
-static void isom_timeline_set_sample_getter_funcs
+void isom_timeline_set_sample_getter_funcs
 (
     isom_timeline_t *timeline
 )
 {
     timeline->get_dts                = isom_get_dts_from_info_list;
     timeline->get_cts                = isom_get_cts_from_info_list;
+    timeline->get_sample_number      = isom_get_sample_number_from_info_list;
     timeline->get_sample_duration    = isom_get_sample_duration_from_info_list;
     timeline->check_sample_existence = isom_check_sample_existence_in_info_list;
     timeline->get_sample             = isom_get_sample_from_media_timeline;
     timeline->get_sample_info        = isom_get_sample_info_from_media_timeline;
     timeline->get_sample_property    = isom_get_sample_property_from_media_timeline;
+    timeline->get_sample_location    = isom_get_sample_location_from_media_timeline;
 }
 
 void isom_timeline_set_lpcm_sample_getter_funcs
@@ -633,11 +926,13 @@ void isom_timeline_set_lpcm_sample_getter_funcs
 {
     timeline->get_dts                = isom_get_dts_from_bunch_list;
     timeline->get_cts                = isom_get_cts_from_bunch_list;
+    timeline->get_sample_number      = isom_get_sample_number_from_bunch_list;
     timeline->get_sample_duration    = isom_get_sample_duration_from_bunch_list;
     timeline->check_sample_existence = isom_check_sample_existence_in_bunch_list;
     timeline->get_sample             = isom_get_lpcm_sample_from_media_timeline;
     timeline->get_sample_info        = isom_get_lpcm_sample_info_from_media_timeline;
     timeline->get_sample_property    = isom_get_lpcm_sample_property_from_media_timeline;
+    timeline->get_sample_location    = isom_get_lpcm_sample_location_from_media_timeline;
 }
 
 static inline void isom_increment_sample_number_in_entry
@@ -656,6 +951,42 @@ static inline void isom_increment_sample_number_in_entry
         *sample_number_in_entry += 1;
 }
 
+static inline void *isom_get_first_array_entry
+(
+    lsmash_entry_array_t *array
+)
+{
+    return array && array->entry_count ? array->data : NULL;
+}
+
+/* Return NULL if 'data' is the last entry of the array. */
+static inline void *isom_get_next_array_entry
+(
+    lsmash_entry_array_t *array,
+    void                 *data
+)
+{
+    uint8_t *next = (uint8_t *)data + array->entry_size;
+    return next < (uint8_t *)array->data + (size_t)array->entry_count * array->entry_size ? next : NULL;
+}
+
+static inline void *isom_increment_sample_number_in_array_entry
+(
+    uint32_t             *sample_number_in_entry,
+    lsmash_entry_array_t *array,
+    void                 *data,
+    uint32_t              sample_count
+)
+{
+    if( *sample_number_in_entry == sample_count )
+    {
+        *sample_number_in_entry = 1;
+        return isom_get_next_array_entry( array, data );
+    }
+    *sample_number_in_entry += 1;
+    return data;
+}
+
 static inline isom_sgpd_t *isom_select_appropriate_sgpd
 (
     isom_sgpd_t *sgpd,
@@ -752,184 +1083,150 @@ static int isom_get_random_access_point_grouping_info
     return 0;
 }
 
-int isom_timeline_construct( lsmash_root_t *root, uint32_t track_ID )
+static int isom_check_movie_fragments_present( lsmash_file_t *file )
+{
+    return file->moov->mvex
+        && (file->moof_list.head || (file->fragment_index && file->fragment_index->pos_list->entry_count));
+}
+
+static int isom_setup_sample_table_cursor
+(
+    isom_timeline_t            *timeline,
+    lsmash_file_t              *file,
+    isom_trak_t                *trak,
+    isom_sample_table_cursor_t *cursor
+)
 {
-    if( isom_check_initializer_present( root ) < 0 )
-        return LSMASH_ERR_FUNCTION_PARAM;
-    lsmash_file_t *file = root->file;
-    if( !file->moov
-     || !file->moov->mvhd
-     ||  file->moov->mvhd->timescale == 0 )
-        return LSMASH_ERR_INVALID_DATA;
-    /* Get track by track_ID. */
-    isom_trak_t *trak = isom_get_trak( file, track_ID );
-    if( !trak
-     || !trak->tkhd
-     || !trak->mdia
-     || !trak->mdia->mdhd
-     ||  trak->mdia->mdhd->timescale == 0
-     || !trak->mdia->minf
-     || !trak->mdia->minf->stbl )
-        return LSMASH_ERR_INVALID_DATA;
-    /* Create a timeline list if it doesn't exist. */
-    if( !file->timeline )
-    {
-        file->timeline = lsmash_create_entry_list();
-        if( !file->timeline )
-            return LSMASH_ERR_MEMORY_ALLOC;
-    }
-    /* Create a timeline. */
-    isom_timeline_t *timeline = isom_timeline_create();
-    if( !timeline )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    timeline->track_ID        = track_ID;
-    timeline->movie_timescale = file->moov->mvhd->timescale;
-    timeline->media_timescale = trak->mdia->mdhd->timescale;
-    timeline->track_duration  = trak->tkhd->duration;
-    /* Preparation for construction. */
-    isom_elst_t *elst = trak->edts ? trak->edts->elst : NULL;
     isom_minf_t *minf = trak->mdia->minf;
-    isom_dref_t *dref = minf->dinf->dref;
     isom_stbl_t *stbl = minf->stbl;
-    isom_stsd_t *stsd = stbl->stsd;
-    isom_stts_t *stts = stbl->stts;
-    isom_ctts_t *ctts = stbl->ctts;
-    isom_stss_t *stss = stbl->stss;
-    isom_stps_t *stps = stbl->stps;
     isom_sdtp_t *sdtp = stbl->sdtp;
-    isom_stsc_t *stsc = stbl->stsc;
-    isom_stsz_t *stsz = stbl->stsz;
-    isom_stco_t *stco = stbl->stco;
-    isom_sgpd_t *sgpd_rap  = isom_get_sample_group_description( stbl, ISOM_GROUP_TYPE_RAP );
-    isom_sbgp_t *sbgp_rap  = isom_get_sample_to_group         ( stbl, ISOM_GROUP_TYPE_RAP );
-    isom_sgpd_t *sgpd_roll = isom_get_roll_recovery_sample_group_description( &stbl->sgpd_list );
-    isom_sbgp_t *sbgp_roll = isom_get_roll_recovery_sample_to_group         ( &stbl->sbgp_list );
-    lsmash_entry_t *elst_entry = elst && elst->list ? elst->list->head : NULL;
-    lsmash_entry_t *stts_entry = stts && stts->list ? stts->list->head : NULL;
-    lsmash_entry_t *ctts_entry = ctts && ctts->list ? ctts->list->head : NULL;
-    lsmash_entry_t *stss_entry = stss && stss->list ? stss->list->head : NULL;
-    lsmash_entry_t *stps_entry = stps && stps->list ? stps->list->head : NULL;
-    lsmash_entry_t *sdtp_entry = sdtp && sdtp->list ? sdtp->list->head : NULL;
-    lsmash_entry_t *stsz_entry = stsz && stsz->list ? stsz->list->head : NULL;
-    lsmash_entry_t *stsc_entry = stsc && stsc->list ? stsc->list->head : NULL;
-    lsmash_entry_t *stco_entry = stco && stco->list ? stco->list->head : NULL;
-    lsmash_entry_t *sbgp_roll_entry = sbgp_roll && sbgp_roll->list ? sbgp_roll->list->head : NULL;
-    lsmash_entry_t *sbgp_rap_entry  = sbgp_rap  && sbgp_rap->list  ? sbgp_rap->list->head  : NULL;
-    lsmash_entry_t *next_stsc_entry = stsc_entry ? stsc_entry->next : NULL;
-    isom_stsc_entry_t *stsc_data = stsc_entry ? (isom_stsc_entry_t *)stsc_entry->data : NULL;
-    int err = LSMASH_ERR_INVALID_DATA;
-    int movie_fragments_present = (file->moov->mvex && file->moof_list.head);
-    if( !movie_fragments_present && (!stts_entry || !stsc_entry || !stco_entry || !stco_entry->data || (next_stsc_entry && !next_stsc_entry->data)) )
-        goto fail;
-    isom_sample_entry_t *description = (isom_sample_entry_t *)lsmash_get_entry_data( &stsd->list, stsc_data ? stsc_data->sample_description_index : 1 );
-    if( !description )
-        goto fail;
-    isom_dref_entry_t *dref_entry = (isom_dref_entry_t *)lsmash_get_entry_data( &dref->list, description->data_reference_index );
-    int all_sync = !stss;
-    int large_presentation = stco->large_presentation || lsmash_check_box_type_identical( stco->type, ISOM_BOX_TYPE_CO64 );
-    int is_lpcm_audio          = isom_is_lpcm_audio( description );
-    int is_qt_fixed_comp_audio = isom_is_qt_fixed_compressed_audio( description );
-    int iso_sdtp = file->max_isom_version >= 2 || file->avc_extensions;
-    int allow_negative_sample_offset = ctts && ((file->max_isom_version >= 4 && ctts->version == 1) || file->qt_compatible);
-    uint32_t sample_number_in_stts_entry      = 1;
-    uint32_t sample_number_in_ctts_entry      = 1;
-    uint32_t sample_number_in_sbgp_roll_entry = 1;
-    uint32_t sample_number_in_sbgp_rap_entry  = 1;
-    uint64_t dts               = 0;
-    uint32_t chunk_number      = 1;
-    uint64_t offset_from_chunk = 0;
-    uint64_t data_offset = stco_entry && stco_entry->data
-                         ? large_presentation
-                             ? ((isom_co64_entry_t *)stco_entry->data)->chunk_offset
-                             : ((isom_stco_entry_t *)stco_entry->data)->chunk_offset
-                         : 0;
-    uint32_t samples_per_packet;
-    uint32_t constant_sample_size;
-    if( is_qt_fixed_comp_audio )
-        isom_get_qt_fixed_comp_audio_sample_quants( timeline, description, &samples_per_packet, &constant_sample_size );
+    isom_sbgp_t *sbgp_rap  = isom_get_sample_to_group              ( stbl, ISOM_GROUP_TYPE_RAP );
+    isom_sbgp_t *sbgp_roll = isom_get_roll_recovery_sample_to_group( &stbl->sbgp_list );
+    cursor->dref      = minf->dinf->dref;
+    cursor->stsd      = stbl->stsd;
+    cursor->stts      = stbl->stts;
+    cursor->ctts      = stbl->ctts;
+    cursor->stss      = stbl->stss;
+    cursor->stps      = stbl->stps;
+    cursor->stsc      = stbl->stsc;
+    cursor->stsz      = stbl->stsz;
+    cursor->stco      = stbl->stco;
+    cursor->sgpd_rap  = isom_get_sample_group_description( stbl, ISOM_GROUP_TYPE_RAP );
+    cursor->sgpd_roll = isom_get_roll_recovery_sample_group_description( &stbl->sgpd_list );
+    cursor->sdtp_entry      = sdtp && sdtp->list ? sdtp->list->head : NULL;
+    cursor->sbgp_roll_entry = sbgp_roll && sbgp_roll->list ? sbgp_roll->list->head : NULL;
+    cursor->sbgp_rap_entry  = sbgp_rap  && sbgp_rap->list  ? sbgp_rap->list->head  : NULL;
+    cursor->stts_data      = isom_get_first_array_entry( cursor->stts ? cursor->stts->list : NULL );
+    cursor->ctts_data      = isom_get_first_array_entry( cursor->ctts ? cursor->ctts->list : NULL );
+    cursor->stss_data      = isom_get_first_array_entry( cursor->stss ? cursor->stss->list : NULL );
+    cursor->stps_data      = isom_get_first_array_entry( cursor->stps ? cursor->stps->list : NULL );
+    cursor->stsz_data      = isom_get_first_array_entry( cursor->stsz ? cursor->stsz->list : NULL );
+    cursor->stsc_data      = isom_get_first_array_entry( cursor->stsc ? cursor->stsc->list : NULL );
+    cursor->stco_data      = isom_get_first_array_entry( cursor->stco ? cursor->stco->list : NULL );
+    cursor->next_stsc_data = cursor->stsc_data ? isom_get_next_array_entry( cursor->stsc->list, cursor->stsc_data ) : NULL;
+    int movie_fragments_present = isom_check_movie_fragments_present( file );
+    if( !movie_fragments_present && (!cursor->stts_data || !cursor->stsc_data || !cursor->stco_data) )
+        return LSMASH_ERR_INVALID_DATA;
+    cursor->description = (isom_sample_entry_t *)lsmash_get_entry_data( &cursor->stsd->list, cursor->stsc_data ? cursor->stsc_data->sample_description_index : 1 );
+    if( !cursor->description )
+        return LSMASH_ERR_INVALID_DATA;
+    cursor->dref_entry = (isom_dref_entry_t *)lsmash_get_entry_data( &cursor->dref->list, cursor->description->data_reference_index );
+    cursor->all_sync               = !cursor->stss;
+    cursor->large_presentation     = cursor->stco->large_presentation || lsmash_check_box_type_identical( cursor->stco->type, ISOM_BOX_TYPE_CO64 );
+    cursor->is_lpcm_audio          = isom_is_lpcm_audio( cursor->description );
+    cursor->is_qt_fixed_comp_audio = isom_is_qt_fixed_compressed_audio( cursor->description );
+    cursor->iso_sdtp               = file->max_isom_version >= 2 || file->avc_extensions;
+    cursor->allow_negative_sample_offset = cursor->ctts && ((file->max_isom_version >= 4 && cursor->ctts->version == 1) || file->qt_compatible);
+    cursor->sample_number_in_stts_entry      = 1;
+    cursor->sample_number_in_ctts_entry      = 1;
+    cursor->sample_number_in_sbgp_roll_entry = 1;
+    cursor->sample_number_in_sbgp_rap_entry  = 1;
+    cursor->dts               = 0;
+    cursor->chunk_number      = 1;
+    cursor->offset_from_chunk = 0;
+    cursor->data_offset = cursor->stco_data
+                        ? cursor->large_presentation
+                            ? ((isom_co64_entry_t *)cursor->stco_data)->chunk_offset
+                            : ((isom_stco_entry_t *)cursor->stco_data)->chunk_offset
+                        : 0;
+    if( cursor->is_qt_fixed_comp_audio )
+        isom_get_qt_fixed_comp_audio_sample_quants( timeline, cursor->description, &cursor->samples_per_packet, &cursor->constant_sample_size );
     else
     {
-        samples_per_packet   = 1;
-        constant_sample_size = stsz->sample_size;
-    }
-    uint32_t sample_number          = samples_per_packet;
-    uint32_t sample_number_in_chunk = samples_per_packet;
-    /* Copy edits. */
-    while( elst_entry )
-    {
-        isom_elst_entry_t *edit = (isom_elst_entry_t *)lsmash_memdup( elst_entry->data, sizeof(isom_elst_entry_t) );
-        if( !edit
-         || lsmash_add_entry( timeline->edit_list, edit ) < 0 )
-        {
-            err = LSMASH_ERR_MEMORY_ALLOC;
-            goto fail;
-        }
-        elst_entry = elst_entry->next;
+        cursor->samples_per_packet   = 1;
+        cursor->constant_sample_size = cursor->stsz->sample_size;
     }
+    cursor->sample_number          = cursor->samples_per_packet;
+    cursor->sample_number_in_chunk = cursor->samples_per_packet;
     /* Check what the first 2-bits of sample dependency means.
      * This check is for chimera of ISO Base Media and QTFF. */
-    if( iso_sdtp && sdtp_entry )
+    if( cursor->iso_sdtp && cursor->sdtp_entry )
     {
-        while( sdtp_entry )
+        for( lsmash_entry_t *entry = cursor->sdtp_entry; entry; entry = entry->next )
         {
-            isom_sdtp_entry_t *sdtp_data = (isom_sdtp_entry_t *)sdtp_entry->data;
+            isom_sdtp_entry_t *sdtp_data = (isom_sdtp_entry_t *)entry->data;
             if( !sdtp_data )
-                goto fail;
+                return LSMASH_ERR_INVALID_DATA;
             if( sdtp_data->is_leading > 1 )
                 break;      /* Apparently, it's defined under ISO Base Media. */
             if( (sdtp_data->is_leading == 1) && (sdtp_data->sample_depends_on == ISOM_SAMPLE_IS_INDEPENDENT) )
             {
                 /* Obviously, it's not defined under ISO Base Media. */
-                iso_sdtp = 0;
+                cursor->iso_sdtp = 0;
                 break;
             }
-            sdtp_entry = sdtp_entry->next;
         }
-        sdtp_entry = sdtp->list->head;
     }
-    /**--- Construct media timeline. ---**/
-    isom_portable_chunk_t chunk;
-    chunk.data_offset = data_offset;
-    chunk.length      = 0;
-    chunk.number      = chunk_number;
-    chunk.file        = (!dref_entry || !dref_entry->ref_file) ? NULL : dref_entry->ref_file;
-    if( (err = isom_add_portable_chunk_entry( timeline, &chunk )) < 0 )
-        goto fail;
-    uint32_t distance      = NO_RANDOM_ACCESS_POINT;
-    uint32_t last_duration = UINT32_MAX;
-    uint32_t packet_number = 1;
-    isom_lpcm_bunch_t bunch = { 0 };
-    while( sample_number <= stsz->sample_count )
+    /* Add the first chunk. */
+    cursor->chunk.data_offset = cursor->data_offset;
+    cursor->chunk.length      = 0;
+    cursor->chunk.number      = cursor->chunk_number;
+    cursor->chunk.file        = (!cursor->dref_entry || !cursor->dref_entry->ref_file) ? NULL : cursor->dref_entry->ref_file;
+    cursor->distance          = NO_RANDOM_ACCESS_POINT;
+    cursor->last_duration     = UINT32_MAX;
+    cursor->packet_number     = 1;
+    cursor->sample_count      = 0;
+    cursor->fragmented        = 0;
+    memset( &cursor->bunch, 0, sizeof(isom_lpcm_bunch_t) );
+    return isom_add_portable_chunk_entry( timeline, &cursor->chunk );
+}
+
+/* Expand the sample tables into the sample info until the timeline has at least a given number of sample info
+ * or reaches the end of the sample tables. */
+static int isom_expand_sample_tables
+(
+    isom_timeline_t            *timeline,
+    isom_sample_table_cursor_t *cursor,
+    uint32_t                    sample_number_limit
+)
+{
+    int err;
+    while( cursor->sample_number <= cursor->stsz->sample_count
+        && timeline->info_list->entry_count < sample_number_limit )
     {
         isom_sample_info_t info = { 0 };
         /* Get sample duration and sample offset. */
-        for( uint32_t i = 0; i < samples_per_packet; i++ )
+        for( uint32_t i = 0; i < cursor->samples_per_packet; i++ )
         {
             /* sample duration */
-            if( stts_entry )
+            if( cursor->stts_data )
             {
-                isom_stts_entry_t *stts_data = (isom_stts_entry_t *)stts_entry->data;
-                if( !stts_data )
-                    goto fail;
-                isom_increment_sample_number_in_entry( &sample_number_in_stts_entry, &stts_entry, stts_data->sample_count );
-                last_duration = stts_data->sample_delta;
+                cursor->last_duration = cursor->stts_data->sample_delta;
+                cursor->stts_data = isom_increment_sample_number_in_array_entry( &cursor->sample_number_in_stts_entry, cursor->stts->list, cursor->stts_data, cursor->stts_data->sample_count );
             }
-            info.duration += last_duration;
-            dts           += last_duration;
+            info.duration += cursor->last_duration;
+            cursor->dts   += cursor->last_duration;
             /* sample offset */
             uint32_t sample_offset;
-            if( ctts_entry )
+            if( cursor->ctts_data )
             {
-                isom_ctts_entry_t *ctts_data = (isom_ctts_entry_t *)ctts_entry->data;
-                if( !ctts_data )
-                    goto fail;
-                isom_increment_sample_number_in_entry( &sample_number_in_ctts_entry, &ctts_entry, ctts_data->sample_count );
-                sample_offset = ctts_data->sample_offset;
-                if( allow_negative_sample_offset )
+                sample_offset = cursor->ctts_data->sample_offset;
+                cursor->ctts_data = isom_increment_sample_number_in_array_entry( &cursor->sample_number_in_ctts_entry, cursor->ctts->list, cursor->ctts_data, cursor->ctts_data->sample_count );
+                if( cursor->allow_negative_sample_offset )
                 {
-                    uint64_t cts = dts + (int32_t)sample_offset;
-                    if( (cts + timeline->ctd_shift) < dts )
-                        timeline->ctd_shift = dts - cts;
+                    uint64_t cts = cursor->dts + (int32_t)sample_offset;
+                    if( (cts + timeline->ctd_shift) < cursor->dts )
+                        timeline->ctd_shift = cursor->dts - cts;
                 }
             }
             else
@@ -938,473 +1235,722 @@ int isom_timeline_construct( lsmash_root_t *root, uint32_t track_ID )
                 info.offset = sample_offset;
         }
         timeline->media_duration += info.duration;
-        if( !is_qt_fixed_comp_audio )
+        if( !cursor->is_qt_fixed_comp_audio )
         {
             /* Check whether sync sample or not. */
-            if( stss_entry )
+            if( cursor->stss_data )
             {
-                isom_stss_entry_t *stss_data = (isom_stss_entry_t *)stss_entry->data;
-                if( !stss_data )
-                    goto fail;
-                if( sample_number == stss_data->sample_number )
+                if( cursor->sample_number == cursor->stss_data->sample_number )
                 {
                     info.prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
-                    stss_entry = stss_entry->next;
-                    distance = 0;
+                    cursor->stss_data = isom_get_next_array_entry( cursor->stss->list, cursor->stss_data );
+                    cursor->distance = 0;
                 }
             }
-            else if( all_sync )
+            else if( cursor->all_sync )
                 /* Don't reset distance as 0 since MDCT-based audio frames need pre-roll for correct presentation
                  * though all of them could be marked as a sync sample. */
                 info.prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
             /* Check whether partial sync sample or not. */
-            if( stps_entry )
+            if( cursor->stps_data )
             {
-                isom_stps_entry_t *stps_data = (isom_stps_entry_t *)stps_entry->data;
-                if( !stps_data )
-                    goto fail;
-                if( sample_number == stps_data->sample_number )
+                if( cursor->sample_number == cursor->stps_data->sample_number )
                 {
                     info.prop.ra_flags |= QT_SAMPLE_RANDOM_ACCESS_FLAG_PARTIAL_SYNC | QT_SAMPLE_RANDOM_ACCESS_FLAG_RAP;
-                    stps_entry = stps_entry->next;
-                    distance = 0;
+                    cursor->stps_data = isom_get_next_array_entry( cursor->stps->list, cursor->stps_data );
+                    cursor->distance = 0;
                 }
             }
             /* Get sample dependency info. */
-            if( sdtp_entry )
+            if( cursor->sdtp_entry )
             {
-                isom_sdtp_entry_t *sdtp_data = (isom_sdtp_entry_t *)sdtp_entry->data;
+                isom_sdtp_entry_t *sdtp_data = (isom_sdtp_entry_t *)cursor->sdtp_entry->data;
                 if( !sdtp_data )
-                    goto fail;
-                if( iso_sdtp )
+                    return LSMASH_ERR_INVALID_DATA;
+                if( cursor->iso_sdtp )
                     info.prop.leading       = sdtp_data->is_leading;
                 else
                     info.prop.allow_earlier = sdtp_data->is_leading;
                 info.prop.independent = sdtp_data->sample_depends_on;
                 info.prop.disposable  = sdtp_data->sample_is_depended_on;
                 info.prop.redundant   = sdtp_data->sample_has_redundancy;
-                sdtp_entry = sdtp_entry->next;
+                cursor->sdtp_entry = cursor->sdtp_entry->next;
             }
             /* Get roll recovery grouping info. */
-            if( sbgp_roll_entry
+            if( cursor->sbgp_roll_entry
              && isom_get_roll_recovery_grouping_info( timeline,
-                                                      &sbgp_roll_entry, sgpd_roll, NULL,
-                                                      &sample_number_in_sbgp_roll_entry,
-                                                      &info, sample_number ) < 0 )
-                goto fail;
-            info.prop.post_roll.identifier = sample_number;
+                                                      &cursor->sbgp_roll_entry, cursor->sgpd_roll, NULL,
+                                                      &cursor->sample_number_in_sbgp_roll_entry,
+                                                      &info, cursor->sample_number ) < 0 )
+                return LSMASH_ERR_INVALID_DATA;
+            info.prop.post_roll.identifier = cursor->sample_number;
             /* Get random access point grouping info. */
-            if( sbgp_rap_entry
+            if( cursor->sbgp_rap_entry
              && isom_get_random_access_point_grouping_info( timeline,
-                                                            &sbgp_rap_entry, sgpd_rap, NULL,
-                                                            &sample_number_in_sbgp_rap_entry,
-                                                            &info, &distance ) < 0 )
-                goto fail;
+                                                            &cursor->sbgp_rap_entry, cursor->sgpd_rap, NULL,
+                                                            &cursor->sample_number_in_sbgp_rap_entry,
+                                                            &info, &cursor->distance ) < 0 )
+                return LSMASH_ERR_INVALID_DATA;
             /* Set up distance from the previous random access point. */
-            if( distance != NO_RANDOM_ACCESS_POINT )
+            if( cursor->distance != NO_RANDOM_ACCESS_POINT )
             {
                 if( info.prop.pre_roll.distance == 0 )
-                    info.prop.pre_roll.distance = distance;
-                ++distance;
+                    info.prop.pre_roll.distance = cursor->distance;
+                ++cursor->distance;
             }
         }
         else
             /* All uncompressed and non-variable compressed audio frame is a sync sample. */
             info.prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
         /* Get size of sample in the stream. */
-        if( is_qt_fixed_comp_audio || !stsz_entry )
-            info.length = constant_sample_size;
+        if( cursor->is_qt_fixed_comp_audio || !cursor->stsz_data )
+            info.length = cursor->constant_sample_size;
         else
         {
-            if( !stsz_entry->data )
-                goto fail;
-            info.length = ((isom_stsz_entry_t *)stsz_entry->data)->entry_size;
-            stsz_entry = stsz_entry->next;
+            info.length = cursor->stsz_data->entry_size;
+            cursor->stsz_data = isom_get_next_array_entry( cursor->stsz->list, cursor->stsz_data );
         }
         timeline->max_sample_size = LSMASH_MAX( timeline->max_sample_size, info.length );
         /* Get chunk info. */
-        info.pos   = data_offset;
-        info.index = stsc_data->sample_description_index;
+        info.pos   = cursor->data_offset;
+        info.index = cursor->stsc_data->sample_description_index;
         info.chunk = (isom_portable_chunk_t *)timeline->chunk_list->tail->data;
-        offset_from_chunk += info.length;
-        if( sample_number_in_chunk == stsc_data->samples_per_chunk )
+        cursor->offset_from_chunk += info.length;
+        if( cursor->sample_number_in_chunk == cursor->stsc_data->samples_per_chunk )
         {
             /* Set the length of the last chunk. */
             if( info.chunk )
-                info.chunk->length = offset_from_chunk;
+                info.chunk->length = cursor->offset_from_chunk;
             /* Move the next chunk. */
-            if( stco_entry )
-                stco_entry = stco_entry->next;
-            if( stco_entry
-             && stco_entry->data )
-                data_offset = large_presentation
-                            ? ((isom_co64_entry_t *)stco_entry->data)->chunk_offset
-                            : ((isom_stco_entry_t *)stco_entry->data)->chunk_offset;
-            chunk.data_offset = data_offset;
-            chunk.length      = 0;
-            chunk.number      = ++chunk_number;
-            offset_from_chunk = 0;
+            if( cursor->stco_data )
+                cursor->stco_data = isom_get_next_array_entry( cursor->stco->list, cursor->stco_data );
+            if( cursor->stco_data )
+                cursor->data_offset = cursor->large_presentation
+                                    ? ((isom_co64_entry_t *)cursor->stco_data)->chunk_offset
+                                    : ((isom_stco_entry_t *)cursor->stco_data)->chunk_offset;
+            cursor->chunk.data_offset = cursor->data_offset;
+            cursor->chunk.length      = 0;
+            cursor->chunk.number      = ++cursor->chunk_number;
+            cursor->offset_from_chunk = 0;
             /* Check if the next entry is broken. */
-            while( next_stsc_entry && chunk_number > ((isom_stsc_entry_t *)next_stsc_entry->data)->first_chunk )
+            while( cursor->next_stsc_data && cursor->chunk_number > cursor->next_stsc_data->first_chunk )
             {
                 /* Just skip broken next entry. */
                 lsmash_log( timeline, LSMASH_LOG_WARNING, "ignore broken entry in Sample To Chunk Box.\n" );
                 lsmash_log( timeline, LSMASH_LOG_WARNING, "timeline might be corrupted.\n" );
-                next_stsc_entry = next_stsc_entry->next;
-                if(  next_stsc_entry
-                 && !next_stsc_entry->data )
-                    goto fail;
+                cursor->next_stsc_data = isom_get_next_array_entry( cursor->stsc->list, cursor->next_stsc_data );
             }
             /* Check if the next chunk belongs to the next sequence of chunks. */
-            if( next_stsc_entry && chunk_number == ((isom_stsc_entry_t *)next_stsc_entry->data)->first_chunk )
+            if( cursor->next_stsc_data && cursor->chunk_number == cursor->next_stsc_data->first_chunk )
             {
-                stsc_entry      = next_stsc_entry;
-                next_stsc_entry = next_stsc_entry->next;
-                if(  next_stsc_entry
-                 && !next_stsc_entry->data )
-                    goto fail;
-                stsc_data = (isom_stsc_entry_t *)stsc_entry->data;
+                cursor->stsc_data      = cursor->next_stsc_data;
+                cursor->next_stsc_data = isom_get_next_array_entry( cursor->stsc->list, cursor->next_stsc_data );
                 /* Update sample description. */
-                description = (isom_sample_entry_t *)lsmash_get_entry_data( &stsd->list, stsc_data->sample_description_index );
-                is_lpcm_audio          = description ? isom_is_lpcm_audio( description )                : 0;
-                is_qt_fixed_comp_audio = description ? isom_is_qt_fixed_compressed_audio( description ) : 0;
-                if( is_qt_fixed_comp_audio )
-                    isom_get_qt_fixed_comp_audio_sample_quants( timeline, description, &samples_per_packet, &constant_sample_size );
+                cursor->description = (isom_sample_entry_t *)lsmash_get_entry_data( &cursor->stsd->list, cursor->stsc_data->sample_description_index );
+                cursor->is_lpcm_audio          = cursor->description ? isom_is_lpcm_audio( cursor->description )                : 0;
+                cursor->is_qt_fixed_comp_audio = cursor->description ? isom_is_qt_fixed_compressed_audio( cursor->description ) : 0;
+                if( cursor->is_qt_fixed_comp_audio )
+                    isom_get_qt_fixed_comp_audio_sample_quants( timeline, cursor->description, &cursor->samples_per_packet, &cursor->constant_sample_size );
                 else
                 {
-                    samples_per_packet   = 1;
-                    constant_sample_size = stsz->sample_size;
+                    cursor->samples_per_packet   = 1;
+                    cursor->constant_sample_size = cursor->stsz->sample_size;
                 }
                 /* Reference media data. */
-                dref_entry = (isom_dref_entry_t *)lsmash_get_entry_data( &dref->list, description ? description->data_reference_index : 0 );
-                chunk.file = (!dref_entry || !dref_entry->ref_file) ? NULL : dref_entry->ref_file;
+                cursor->dref_entry = (isom_dref_entry_t *)lsmash_get_entry_data( &cursor->dref->list, cursor->description ? cursor->description->data_reference_index : 0 );
+                cursor->chunk.file = (!cursor->dref_entry || !cursor->dref_entry->ref_file) ? NULL : cursor->dref_entry->ref_file;
             }
-            sample_number_in_chunk = samples_per_packet;
-            if( (err = isom_add_portable_chunk_entry( timeline, &chunk )) < 0 )
-                goto fail;
+            cursor->sample_number_in_chunk = cursor->samples_per_packet;
+            if( (err = isom_add_portable_chunk_entry( timeline, &cursor->chunk )) < 0 )
+                return err;
         }
         else
         {
-            data_offset            += info.length;
-            sample_number_in_chunk += samples_per_packet;
+            cursor->data_offset            += info.length;
+            cursor->sample_number_in_chunk += cursor->samples_per_packet;
         }
         /* OK. Let's add its info. */
-        if( is_lpcm_audio )
+        if( cursor->is_lpcm_audio )
         {
-            if( sample_number == samples_per_packet )
-                isom_update_bunch( &bunch, &info );
-            else if( isom_compare_lpcm_sample_info( &bunch, &info ) )
+            if( cursor->sample_number == cursor->samples_per_packet )
+                isom_update_bunch( &cursor->bunch, &info );
+            else if( isom_compare_lpcm_sample_info( &cursor->bunch, &info ) )
             {
-                if( (err = isom_add_lpcm_bunch_entry( timeline, &bunch )) < 0 )
-                    goto fail;
-                isom_update_bunch( &bunch, &info );
+                if( (err = isom_add_lpcm_bunch_entry( timeline, &cursor->bunch )) < 0 )
+                    return err;
+                isom_update_bunch( &cursor->bunch, &info );
             }
             else
-                ++ bunch.sample_count;
+                ++ cursor->bunch.sample_count;
         }
         else if( (err = isom_add_sample_info_entry( timeline, &info )) < 0 )
-            goto fail;
+            return err;
         if( timeline->info_list->entry_count && timeline->bunch_list->entry_count )
         {
             lsmash_log( timeline, LSMASH_LOG_ERROR, "LPCM + non-LPCM track is not supported.\n" );
-            err = LSMASH_ERR_PATCH_WELCOME;
-            goto fail;
+            return LSMASH_ERR_PATCH_WELCOME;
         }
-        sample_number += samples_per_packet;
-        packet_number += 1;
+        cursor->sample_number += cursor->samples_per_packet;
+        cursor->packet_number += 1;
     }
+    if( cursor->sample_number <= cursor->stsz->sample_count )
+        return 0;
     isom_portable_chunk_t *last_chunk = lsmash_get_entry_data( timeline->chunk_list, timeline->chunk_list->entry_count );
     if( last_chunk )
     {
-        if( offset_from_chunk )
-            last_chunk->length = offset_from_chunk;
+        if( cursor->offset_from_chunk )
+            last_chunk->length = cursor->offset_from_chunk;
         else
         {
             /* Remove the last invalid chunk. */
             lsmash_remove_entry( timeline->chunk_list, timeline->chunk_list->entry_count, NULL );
-            --chunk_number;
+            --cursor->chunk_number;
         }
     }
-    uint32_t sample_count = packet_number - 1;
-    if( movie_fragments_present )
+    return 0;
+}
+
+static void isom_setup_movie_fragment_cursor
+(
+    isom_timeline_t            *timeline,
+    lsmash_file_t              *file,
+    isom_sample_table_cursor_t *cursor
+)
+{
+    cursor->file              = file;
+    cursor->tfra              = isom_get_tfra( file->mfra, timeline->track_ID );
+    cursor->tfra_entry        = cursor->tfra && cursor->tfra->list ? cursor->tfra->list->head : NULL;
+    cursor->rap               = cursor->tfra_entry ? (isom_tfra_location_time_entry_t *)cursor->tfra_entry->data : NULL;
+    cursor->fragment_number   = 1;
+    cursor->fragmented        = 1;
+    cursor->chunk.data_offset = 0;
+    cursor->chunk.length      = 0;
+}
+
+/* Expand the track fragments of a movie fragment into the sample info. */
+static int isom_expand_movie_fragment
+(
+    isom_timeline_t            *timeline,
+    isom_sample_table_cursor_t *cursor,
+    isom_moof_t                *moof
+)
+{
+    int err;
+    lsmash_file_t *file = cursor->file;
+    uint64_t last_sample_end_pos = 0;
+    /* Track fragments */
+    uint32_t traf_number = 1;
+    for( lsmash_entry_t *traf_entry = moof->traf_list.head; traf_entry; traf_entry = traf_entry->next )
     {
-        isom_tfra_t                     *tfra       = isom_get_tfra( file->mfra, track_ID );
-        lsmash_entry_t                  *tfra_entry = tfra && tfra->list ? tfra->list->head : NULL;
-        isom_tfra_location_time_entry_t *rap        = tfra_entry ? (isom_tfra_location_time_entry_t *)tfra_entry->data : NULL;
-        chunk.data_offset = 0;
-        chunk.length      = 0;
-        /* Movie fragments */
-        for( lsmash_entry_t *moof_entry = file->moof_list.head; moof_entry; moof_entry = moof_entry->next )
+        isom_traf_t *traf = (isom_traf_t *)traf_entry->data;
+        if( !traf )
+            return LSMASH_ERR_INVALID_DATA;
+        isom_tfhd_t *tfhd = traf->tfhd;
+        if( !tfhd )
+            return LSMASH_ERR_INVALID_DATA;
+        isom_trex_t *trex = isom_get_trex( file->moov->mvex, tfhd->track_ID );
+        if( !trex )
+            return LSMASH_ERR_INVALID_DATA;
+        /* Ignore ISOM_TF_FLAGS_DURATION_IS_EMPTY flag even if set. */
+        if( !traf->trun_list.head )
         {
-            isom_moof_t *moof = (isom_moof_t *)moof_entry->data;
-            if( !moof )
-                goto fail;
-            uint64_t last_sample_end_pos = 0;
-            /* Track fragments */
-            uint32_t traf_number = 1;
-            for( lsmash_entry_t *traf_entry = moof->traf_list.head; traf_entry; traf_entry = traf_entry->next )
+            ++traf_number;
+            continue;
+        }
+        /* Get base_data_offset. */
+        uint64_t base_data_offset;
+        if( tfhd->flags & ISOM_TF_FLAGS_BASE_DATA_OFFSET_PRESENT )
+            base_data_offset = tfhd->base_data_offset;
+        else if( (tfhd->flags & ISOM_TF_FLAGS_DEFAULT_BASE_IS_MOOF) || traf_entry == moof->traf_list.head )
+            base_data_offset = moof->pos;
+        else
+            base_data_offset = last_sample_end_pos;
+        /* sample grouping */
+        isom_sgpd_t *sgpd_frag_rap  = isom_get_fragment_sample_group_description( traf, ISOM_GROUP_TYPE_RAP );
+        isom_sbgp_t *sbgp_rap       = isom_get_fragment_sample_to_group         ( traf, ISOM_GROUP_TYPE_RAP );
+        isom_sgpd_t *sgpd_frag_roll = isom_get_roll_recovery_sample_group_description( &traf->sgpd_list );
+        isom_sbgp_t *sbgp_roll      = isom_get_roll_recovery_sample_to_group         ( &traf->sbgp_list );
+        cursor->sbgp_rap_entry  = sbgp_rap  && sbgp_rap->list  ? sbgp_rap->list->head  : NULL;
+        cursor->sbgp_roll_entry = sbgp_roll && sbgp_roll->list ? sbgp_roll->list->head : NULL;
+        int need_data_offset_only = (tfhd->track_ID != timeline->track_ID);
+        /* Track runs */
+        uint32_t trun_number = 1;
+        for( lsmash_entry_t *trun_entry = traf->trun_list.head; trun_entry; trun_entry = trun_entry->next )
+        {
+            isom_trun_t *trun = (isom_trun_t *)trun_entry->data;
+            if( !trun )
+                return LSMASH_ERR_INVALID_DATA;
+            if( trun->sample_count == 0 )
             {
-                isom_traf_t *traf = (isom_traf_t *)traf_entry->data;
-                if( !traf )
-                    goto fail;
-                isom_tfhd_t *tfhd = traf->tfhd;
-                if( !tfhd )
-                    goto fail;
-                isom_trex_t *trex = isom_get_trex( file->moov->mvex, tfhd->track_ID );
-                if( !trex )
-                    goto fail;
-                /* Ignore ISOM_TF_FLAGS_DURATION_IS_EMPTY flag even if set. */
-                if( !traf->trun_list.head )
+                ++trun_number;
+                continue;
+            }
+            /* Get data_offset. */
+            if( trun->flags & ISOM_TR_FLAGS_DATA_OFFSET_PRESENT )
+                cursor->data_offset = trun->data_offset + base_data_offset;
+            else if( trun_entry == traf->trun_list.head )
+                cursor->data_offset = base_data_offset;
+            else
+                cursor->data_offset = last_sample_end_pos;
+            /* */
+            uint32_t sample_description_index = 0;
+            isom_sdtp_entry_t *sdtp_data = NULL;
+            if( !need_data_offset_only )
+            {
+                /* Get sample_description_index of this track fragment. */
+                if( tfhd->flags & ISOM_TF_FLAGS_SAMPLE_DESCRIPTION_INDEX_PRESENT )
+                    sample_description_index = tfhd->sample_description_index;
+                else
+                    sample_description_index = trex->default_sample_description_index;
+                cursor->description   = (isom_sample_entry_t *)lsmash_get_entry_data( &cursor->stsd->list, sample_description_index );
+                cursor->is_lpcm_audio = cursor->description ? isom_is_lpcm_audio( cursor->description ) : 0;
+                /* Reference media data. */
+                cursor->dref_entry = (isom_dref_entry_t *)lsmash_get_entry_data( &cursor->dref->list, cursor->description ? cursor->description->data_reference_index : 0 );
+                lsmash_file_t *ref_file = (!cursor->dref_entry || !cursor->dref_entry->ref_file) ? NULL : cursor->dref_entry->ref_file;
+                /* Each track run can be considered as a chunk.
+                 * Here, we consider physically consecutive track runs as one chunk. */
+                if( cursor->chunk.data_offset + cursor->chunk.length != cursor->data_offset || cursor->chunk.file != ref_file )
                 {
-                    ++traf_number;
-                    continue;
+                    cursor->chunk.data_offset = cursor->data_offset;
+                    cursor->chunk.length      = 0;
+                    cursor->chunk.number      = ++cursor->chunk_number;
+                    cursor->chunk.file        = ref_file;
+                    if( (err = isom_add_portable_chunk_entry( timeline, &cursor->chunk )) < 0 )
+                        return err;
                 }
-                /* Get base_data_offset. */
-                uint64_t base_data_offset;
-                if( tfhd->flags & ISOM_TF_FLAGS_BASE_DATA_OFFSET_PRESENT )
-                    base_data_offset = tfhd->base_data_offset;
-                else if( (tfhd->flags & ISOM_TF_FLAGS_DEFAULT_BASE_IS_MOOF) || traf_entry == moof->traf_list.head )
-                    base_data_offset = moof->pos;
+                /* Get dependency info for this track fragment. */
+                cursor->sdtp_entry = traf->sdtp && traf->sdtp->list ? traf->sdtp->list->head : NULL;
+                sdtp_data  = cursor->sdtp_entry && cursor->sdtp_entry->data ? (isom_sdtp_entry_t *)cursor->sdtp_entry->data : NULL;
+            }
+            /* Get info of each sample. */
+            lsmash_entry_t *row_entry = trun->optional && trun->optional->head ? trun->optional->head : NULL;
+            cursor->sample_number = 1;
+            while( cursor->sample_number <= trun->sample_count )
+            {
+                isom_sample_info_t info = { 0 };
+                isom_trun_optional_row_t *row = row_entry && row_entry->data ? (isom_trun_optional_row_t *)row_entry->data : NULL;
+                /* Get sample_size */
+                if( row && (trun->flags & ISOM_TR_FLAGS_SAMPLE_SIZE_PRESENT) )
+                    info.length = row->sample_size;
+                else if( tfhd->flags & ISOM_TF_FLAGS_DEFAULT_SAMPLE_SIZE_PRESENT )
+                    info.length = tfhd->default_sample_size;
                 else
-                    base_data_offset = last_sample_end_pos;
-                /* sample grouping */
-                isom_sgpd_t *sgpd_frag_rap;
-                isom_sgpd_t *sgpd_frag_roll;
-                sgpd_frag_rap   = isom_get_fragment_sample_group_description( traf, ISOM_GROUP_TYPE_RAP );
-                sbgp_rap        = isom_get_fragment_sample_to_group         ( traf, ISOM_GROUP_TYPE_RAP );
-                sbgp_rap_entry  = sbgp_rap && sbgp_rap->list ? sbgp_rap->list->head : NULL;
-                sgpd_frag_roll  = isom_get_roll_recovery_sample_group_description( &traf->sgpd_list );
-                sbgp_roll       = isom_get_roll_recovery_sample_to_group         ( &traf->sbgp_list );
-                sbgp_roll_entry = sbgp_roll && sbgp_roll->list ? sbgp_roll->list->head : NULL;
-                int need_data_offset_only = (tfhd->track_ID != track_ID);
-                /* Track runs */
-                uint32_t trun_number = 1;
-                for( lsmash_entry_t *trun_entry = traf->trun_list.head; trun_entry; trun_entry = trun_entry->next )
+                    info.length = trex->default_sample_size;
+                if( !need_data_offset_only )
                 {
-                    isom_trun_t *trun = (isom_trun_t *)trun_entry->data;
-                    if( !trun )
-                        goto fail;
-                    if( trun->sample_count == 0 )
+                    info.pos   = cursor->data_offset;
+                    info.index = sample_description_index;
+                    info.chunk = (isom_portable_chunk_t *)timeline->chunk_list->tail->data;
+                    info.chunk->length += info.length;
+                    /* Get sample_duration. */
+                    if( row && (trun->flags & ISOM_TR_FLAGS_SAMPLE_DURATION_PRESENT) )
+                        info.duration = row->sample_duration;
+                    else if( tfhd->flags & ISOM_TF_FLAGS_DEFAULT_SAMPLE_DURATION_PRESENT )
+                        info.duration = tfhd->default_sample_duration;
+                    else
+                        info.duration = trex->default_sample_duration;
+                    /* Get composition time offset. */
+                    if( row && (trun->flags & ISOM_TR_FLAGS_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT) )
                     {
-                        ++trun_number;
-                        continue;
+                        info.offset = row->sample_composition_time_offset;
+                        /* Check composition to decode timeline shift. */
+                        if( file->max_isom_version >= 6 && trun->version != 0 )
+                        {
+                            uint64_t cts = cursor->dts + (int32_t)info.offset;
+                            if( (cts + timeline->ctd_shift) < cursor->dts )
+                                timeline->ctd_shift = cursor->dts - cts;
+                        }
                     }
-                    /* Get data_offset. */
-                    if( trun->flags & ISOM_TR_FLAGS_DATA_OFFSET_PRESENT )
-                        data_offset = trun->data_offset + base_data_offset;
-                    else if( trun_entry == traf->trun_list.head )
-                        data_offset = base_data_offset;
                     else
-                        data_offset = last_sample_end_pos;
-                    /* */
-                    uint32_t sample_description_index = 0;
-                    isom_sdtp_entry_t *sdtp_data = NULL;
-                    if( !need_data_offset_only )
+                        info.offset = 0;
+                    cursor->dts += info.duration;
+                    /* Update media duration and maximun sample size. */
+                    timeline->media_duration += info.duration;
+                    timeline->max_sample_size = LSMASH_MAX( timeline->max_sample_size, info.length );
+                    if( !cursor->is_lpcm_audio )
                     {
-                        /* Get sample_description_index of this track fragment. */
-                        if( tfhd->flags & ISOM_TF_FLAGS_SAMPLE_DESCRIPTION_INDEX_PRESENT )
-                            sample_description_index = tfhd->sample_description_index;
+                        /* Get sample_flags. */
+                        isom_sample_flags_t sample_flags;
+                        if( cursor->sample_number == 1 && (trun->flags & ISOM_TR_FLAGS_FIRST_SAMPLE_FLAGS_PRESENT) )
+                            sample_flags = trun->first_sample_flags;
+                        else if( row && (trun->flags & ISOM_TR_FLAGS_SAMPLE_FLAGS_PRESENT) )
+                            sample_flags = row->sample_flags;
+                        else if( tfhd->flags & ISOM_TF_FLAGS_DEFAULT_SAMPLE_FLAGS_PRESENT )
+                            sample_flags = tfhd->default_sample_flags;
                         else
-                            sample_description_index = trex->default_sample_description_index;
-                        description   = (isom_sample_entry_t *)lsmash_get_entry_data( &stsd->list, sample_description_index );
-                        is_lpcm_audio = description ? isom_is_lpcm_audio( description ) : 0;
-                        /* Reference media data. */
-                        dref_entry = (isom_dref_entry_t *)lsmash_get_entry_data( &dref->list, description ? description->data_reference_index : 0 );
-                        lsmash_file_t *ref_file = (!dref_entry || !dref_entry->ref_file) ? NULL : dref_entry->ref_file;
-                        /* Each track run can be considered as a chunk.
-                         * Here, we consider physically consecutive track runs as one chunk. */
-                        if( chunk.data_offset + chunk.length != data_offset || chunk.file != ref_file )
+                            sample_flags = trex->default_sample_flags;
+                        if( sdtp_data )
                         {
-                            chunk.data_offset = data_offset;
-                            chunk.length      = 0;
-                            chunk.number      = ++chunk_number;
-                            chunk.file        = ref_file;
-                            if( (err = isom_add_portable_chunk_entry( timeline, &chunk )) < 0 )
-                                goto fail;
+                            /* Independent and Disposable Samples Box overrides the information from sample_flags.
+                             * There is no description in the specification about this, but the intention should be such a thing.
+                             * The ground is that sample_flags is placed in media layer
+                             * while Independent and Disposable Samples Box is placed in track or presentation layer. */
+                            info.prop.leading     = sdtp_data->is_leading;
+                            info.prop.independent = sdtp_data->sample_depends_on;
+                            info.prop.disposable  = sdtp_data->sample_is_depended_on;
+                            info.prop.redundant   = sdtp_data->sample_has_redundancy;
+                            if( cursor->sdtp_entry )
+                                cursor->sdtp_entry = cursor->sdtp_entry->next;
+                            sdtp_data = cursor->sdtp_entry ? (isom_sdtp_entry_t *)cursor->sdtp_entry->data : NULL;
                         }
-                        /* Get dependency info for this track fragment. */
-                        sdtp_entry = traf->sdtp && traf->sdtp->list ? traf->sdtp->list->head : NULL;
-                        sdtp_data  = sdtp_entry && sdtp_entry->data ? (isom_sdtp_entry_t *)sdtp_entry->data : NULL;
-                    }
-                    /* Get info of each sample. */
-                    lsmash_entry_t *row_entry = trun->optional && trun->optional->head ? trun->optional->head : NULL;
-                    sample_number = 1;
-                    while( sample_number <= trun->sample_count )
-                    {
-                        isom_sample_info_t info = { 0 };
-                        isom_trun_optional_row_t *row = row_entry && row_entry->data ? (isom_trun_optional_row_t *)row_entry->data : NULL;
-                        /* Get sample_size */
-                        if( row && (trun->flags & ISOM_TR_FLAGS_SAMPLE_SIZE_PRESENT) )
-                            info.length = row->sample_size;
-                        else if( tfhd->flags & ISOM_TF_FLAGS_DEFAULT_SAMPLE_SIZE_PRESENT )
-                            info.length = tfhd->default_sample_size;
                         else
-                            info.length = trex->default_sample_size;
-                        if( !need_data_offset_only )
                         {
-                            info.pos   = data_offset;
-                            info.index = sample_description_index;
-                            info.chunk = (isom_portable_chunk_t *)timeline->chunk_list->tail->data;
-                            info.chunk->length += info.length;
-                            /* Get sample_duration. */
-                            if( row && (trun->flags & ISOM_TR_FLAGS_SAMPLE_DURATION_PRESENT) )
-                                info.duration = row->sample_duration;
-                            else if( tfhd->flags & ISOM_TF_FLAGS_DEFAULT_SAMPLE_DURATION_PRESENT )
-                                info.duration = tfhd->default_sample_duration;
-                            else
-                                info.duration = trex->default_sample_duration;
-                            /* Get composition time offset. */
-                            if( row && (trun->flags & ISOM_TR_FLAGS_SAMPLE_COMPOSITION_TIME_OFFSET_PRESENT) )
-                            {
-                                info.offset = row->sample_composition_time_offset;
-                                /* Check composition to decode timeline shift. */
-                                if( file->max_isom_version >= 6 && trun->version != 0 )
-                                {
-                                    uint64_t cts = dts + (int32_t)info.offset;
-                                    if( (cts + timeline->ctd_shift) < dts )
-                                        timeline->ctd_shift = dts - cts;
-                                }
-                            }
-                            else
-                                info.offset = 0;
-                            dts += info.duration;
-                            /* Update media duration and maximun sample size. */
-                            timeline->media_duration += info.duration;
-                            timeline->max_sample_size = LSMASH_MAX( timeline->max_sample_size, info.length );
-                            if( !is_lpcm_audio )
+                            info.prop.leading     = sample_flags.is_leading;
+                            info.prop.independent = sample_flags.sample_depends_on;
+                            info.prop.disposable  = sample_flags.sample_is_depended_on;
+                            info.prop.redundant   = sample_flags.sample_has_redundancy;
+                        }
+                        /* Check this sample is a sync sample or not.
+                         * Note: all sync sample shall be independent. */
+                        if( !sample_flags.sample_is_non_sync_sample
+                         && info.prop.independent != ISOM_SAMPLE_IS_NOT_INDEPENDENT )
+                        {
+                            info.prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
+                            cursor->distance = 0;
+                        }
+                        /* Get roll recovery grouping info. */
+                        uint32_t roll_id = cursor->sample_count + cursor->sample_number;
+                        if( cursor->sbgp_roll_entry
+                         && isom_get_roll_recovery_grouping_info( timeline,
+                                                                  &cursor->sbgp_roll_entry, cursor->sgpd_roll, sgpd_frag_roll,
+                                                                  &cursor->sample_number_in_sbgp_roll_entry,
+                                                                  &info, roll_id ) < 0 )
+                            return LSMASH_ERR_INVALID_DATA;
+                        info.prop.post_roll.identifier = roll_id;
+                        /* Get random access point grouping info. */
+                        if( cursor->sbgp_rap_entry
+                         && isom_get_random_access_point_grouping_info( timeline,
+                                                                        &cursor->sbgp_rap_entry, cursor->sgpd_rap, sgpd_frag_rap,
+                                                                        &cursor->sample_number_in_sbgp_rap_entry,
+                                                                        &info, &cursor->distance ) < 0 )
+                            return LSMASH_ERR_INVALID_DATA;
+                        /* Get the location of the sync sample from 'tfra' if it is not set up yet.
+                         * Note: there is no guarantee that its entries are placed in a specific order. */
+                        if( cursor->tfra )
+                        {
+                            if( cursor->tfra->number_of_entry == 0
+                             && info.prop.ra_flags == ISOM_SAMPLE_RANDOM_ACCESS_FLAG_NONE )
+                                info.prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
+                            if( cursor->rap
+                             && cursor->rap->moof_offset   == moof->pos
+                             && cursor->rap->traf_number   == traf_number
+                             && cursor->rap->trun_number   == trun_number
+                             && cursor->rap->sample_number == cursor->sample_number )
                             {
-                                /* Get sample_flags. */
-                                isom_sample_flags_t sample_flags;
-                                if( sample_number == 1 && (trun->flags & ISOM_TR_FLAGS_FIRST_SAMPLE_FLAGS_PRESENT) )
-                                    sample_flags = trun->first_sample_flags;
-                                else if( row && (trun->flags & ISOM_TR_FLAGS_SAMPLE_FLAGS_PRESENT) )
-                                    sample_flags = row->sample_flags;
-                                else if( tfhd->flags & ISOM_TF_FLAGS_DEFAULT_SAMPLE_FLAGS_PRESENT )
-                                    sample_flags = tfhd->default_sample_flags;
-                                else
-                                    sample_flags = trex->default_sample_flags;
-                                if( sdtp_data )
-                                {
-                                    /* Independent and Disposable Samples Box overrides the information from sample_flags.
-                                     * There is no description in the specification about this, but the intention should be such a thing.
-                                     * The ground is that sample_flags is placed in media layer
-                                     * while Independent and Disposable Samples Box is placed in track or presentation layer. */
-                                    info.prop.leading     = sdtp_data->is_leading;
-                                    info.prop.independent = sdtp_data->sample_depends_on;
-                                    info.prop.disposable  = sdtp_data->sample_is_depended_on;
-                                    info.prop.redundant   = sdtp_data->sample_has_redundancy;
-                                    if( sdtp_entry )
-                                        sdtp_entry = sdtp_entry->next;
-                                    sdtp_data = sdtp_entry ? (isom_sdtp_entry_t *)sdtp_entry->data : NULL;
-                                }
-                                else
-                                {
-                                    info.prop.leading     = sample_flags.is_leading;
-                                    info.prop.independent = sample_flags.sample_depends_on;
-                                    info.prop.disposable  = sample_flags.sample_is_depended_on;
-                                    info.prop.redundant   = sample_flags.sample_has_redundancy;
-                                }
-                                /* Check this sample is a sync sample or not.
-                                 * Note: all sync sample shall be independent. */
-                                if( !sample_flags.sample_is_non_sync_sample
-                                 && info.prop.independent != ISOM_SAMPLE_IS_NOT_INDEPENDENT )
-                                {
+                                if( info.prop.ra_flags == ISOM_SAMPLE_RANDOM_ACCESS_FLAG_NONE )
                                     info.prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
-                                    distance = 0;
-                                }
-                                /* Get roll recovery grouping info. */
-                                uint32_t roll_id = sample_count + sample_number;
-                                if( sbgp_roll_entry
-                                 && isom_get_roll_recovery_grouping_info( timeline,
-                                                                          &sbgp_roll_entry, sgpd_roll, sgpd_frag_roll,
-                                                                          &sample_number_in_sbgp_roll_entry,
-                                                                          &info, roll_id ) < 0 )
-                                    goto fail;
-                                info.prop.post_roll.identifier = roll_id;
-                                /* Get random access point grouping info. */
-                                if( sbgp_rap_entry
-                                 && isom_get_random_access_point_grouping_info( timeline,
-                                                                                &sbgp_rap_entry, sgpd_rap, sgpd_frag_rap,
-                                                                                &sample_number_in_sbgp_rap_entry,
-                                                                                &info, &distance ) < 0 )
-                                    goto fail;
-                                /* Get the location of the sync sample from 'tfra' if it is not set up yet.
-                                 * Note: there is no guarantee that its entries are placed in a specific order. */
-                                if( tfra )
-                                {
-                                    if( tfra->number_of_entry == 0
-                                     && info.prop.ra_flags == ISOM_SAMPLE_RANDOM_ACCESS_FLAG_NONE )
-                                        info.prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
-                                    if( rap
-                                     && rap->moof_offset   == moof->pos
-                                     && rap->traf_number   == traf_number
-                                     && rap->trun_number   == trun_number
-                                     && rap->sample_number == sample_number )
-                                    {
-                                        if( info.prop.ra_flags == ISOM_SAMPLE_RANDOM_ACCESS_FLAG_NONE )
-                                            info.prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
-                                        if( tfra_entry )
-                                            tfra_entry = tfra_entry->next;
-                                        rap = tfra_entry ? (isom_tfra_location_time_entry_t *)tfra_entry->data : NULL;
-                                    }
-                                }
-                                /* Set up distance from the previous random access point. */
-                                if( distance != NO_RANDOM_ACCESS_POINT )
-                                {
-                                    if( info.prop.pre_roll.distance == 0 )
-                                        info.prop.pre_roll.distance = distance;
-                                    ++distance;
-                                }
-                                /* OK. Let's add its info. */
-                                if( (err = isom_add_sample_info_entry( timeline, &info )) < 0 )
-                                    goto fail;
-                            }
-                            else
-                            {
-                                /* All LPCMFrame is a sync sample. */
-                                info.prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
-                                /* OK. Let's add its info. */
-                                if( sample_count == 0 && sample_number == 1 )
-                                    isom_update_bunch( &bunch, &info );
-                                else if( isom_compare_lpcm_sample_info( &bunch, &info ) )
-                                {
-                                    if( (err = isom_add_lpcm_bunch_entry( timeline, &bunch )) < 0 )
-                                        goto fail;
-                                    isom_update_bunch( &bunch, &info );
-                                }
-                                else
-                                    ++ bunch.sample_count;
-                            }
-                            if( timeline-> info_list->entry_count
-                             && timeline->bunch_list->entry_count )
-                            {
-                                lsmash_log( timeline, LSMASH_LOG_ERROR, "LPCM + non-LPCM track is not supported.\n" );
-                                err = LSMASH_ERR_PATCH_WELCOME;
-                                goto fail;
+                                if( cursor->tfra_entry )
+                                    cursor->tfra_entry = cursor->tfra_entry->next;
+                                cursor->rap = cursor->tfra_entry ? (isom_tfra_location_time_entry_t *)cursor->tfra_entry->data : NULL;
                             }
                         }
-                        data_offset += info.length;
-                        last_sample_end_pos = data_offset;
-                        if( row_entry )
-                            row_entry = row_entry->next;
-                        ++sample_number;
+                        /* Set up distance from the previous random access point. */
+                        if( cursor->distance != NO_RANDOM_ACCESS_POINT )
+                        {
+                            if( info.prop.pre_roll.distance == 0 )
+                                info.prop.pre_roll.distance = cursor->distance;
+                            ++cursor->distance;
+                        }
+                        /* OK. Let's add its info. */
+                        if( (err = isom_add_sample_info_entry( timeline, &info )) < 0 )
+                            return err;
+                    }
+                    else
+                    {
+                        /* All LPCMFrame is a sync sample. */
+                        info.prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
+                        /* OK. Let's add its info. */
+                        if( cursor->sample_count == 0 && cursor->sample_number == 1 )
+                            isom_update_bunch( &cursor->bunch, &info );
+                        else if( isom_compare_lpcm_sample_info( &cursor->bunch, &info ) )
+                        {
+                            if( (err = isom_add_lpcm_bunch_entry( timeline, &cursor->bunch )) < 0 )
+                                return err;
+                            isom_update_bunch( &cursor->bunch, &info );
+                        }
+                        else
+                            ++ cursor->bunch.sample_count;
                     }
-                    if( !need_data_offset_only )
-                        sample_count += sample_number - 1;
-                    ++trun_number;
-                }   /* Track runs */
-                ++traf_number;
-            }   /* Track fragments */
-        }   /* Movie fragments */
+                    if( timeline-> info_list->entry_count
+                     && timeline->bunch_list->entry_count )
+                    {
+                        lsmash_log( timeline, LSMASH_LOG_ERROR, "LPCM + non-LPCM track is not supported.\n" );
+                        return LSMASH_ERR_PATCH_WELCOME;
+                    }
+                }
+                cursor->data_offset += info.length;
+                last_sample_end_pos = cursor->data_offset;
+                if( row_entry )
+                    row_entry = row_entry->next;
+                ++cursor->sample_number;
+            }
+            if( !need_data_offset_only )
+                cursor->sample_count += cursor->sample_number - 1;
+            ++trun_number;
+        }   /* Track runs */
+        ++traf_number;
+    }   /* Track fragments */
+    return 0;
+}
+
+/* Expand movie fragments into the sample info until the timeline has at least a given number of samples
+ * or reaches the end of movie fragments. Return 1 if no more movie fragments. */
+static int isom_expand_movie_fragments
+(
+    isom_timeline_t            *timeline,
+    isom_sample_table_cursor_t *cursor,
+    uint32_t                    sample_number_limit
+)
+{
+    while( cursor->sample_count < sample_number_limit )
+    {
+        isom_moof_t *moof = isom_get_movie_fragment( cursor->file, cursor->fragment_number );
+        if( !moof )
+            return 1;
+        int err = isom_expand_movie_fragment( timeline, cursor, moof );
+        if( err < 0 )
+            return err;
+        ++cursor->fragment_number;
+    }
+    return 0;
+}
+
+/* Calculate the media duration, the maximum sample size and the composition to decode timeline shift
+ * from the sample tables without expanding them.
+ * This is available only if every packet consists of a single sample. */
+static void isom_calculate_timeline_statistics
+(
+    isom_timeline_t            *timeline,
+    isom_sample_table_cursor_t *cursor
+)
+{
+    isom_stts_entry_t *stts_data = cursor->stts_data;
+    isom_ctts_entry_t *ctts_data = cursor->allow_negative_sample_offset ? cursor->ctts_data : NULL;
+    isom_stsz_entry_t *stsz_data = cursor->stsz_data;
+    uint32_t sample_number_in_stts_entry = 1;
+    uint32_t sample_number_in_ctts_entry = 1;
+    uint32_t last_duration = UINT32_MAX;
+    uint64_t dts           = 0;
+    for( uint32_t sample_number = 1; sample_number <= cursor->stsz->sample_count; sample_number++ )
+    {
+        if( stts_data )
+        {
+            last_duration = stts_data->sample_delta;
+            stts_data = isom_increment_sample_number_in_array_entry( &sample_number_in_stts_entry, cursor->stts->list, stts_data, stts_data->sample_count );
+        }
+        dts += last_duration;
+        if( ctts_data )
+        {
+            uint64_t cts = dts + (int32_t)ctts_data->sample_offset;
+            if( (cts + timeline->ctd_shift) < dts )
+                timeline->ctd_shift = dts - cts;
+            ctts_data = isom_increment_sample_number_in_array_entry( &sample_number_in_ctts_entry, cursor->ctts->list, ctts_data, ctts_data->sample_count );
+        }
+        if( stsz_data )
+        {
+            timeline->max_sample_size = LSMASH_MAX( timeline->max_sample_size, stsz_data->entry_size );
+            stsz_data = isom_get_next_array_entry( cursor->stsz->list, stsz_data );
+        }
+        else
+            timeline->max_sample_size = LSMASH_MAX( timeline->max_sample_size, cursor->constant_sample_size );
+    }
+    timeline->media_duration = dts;
+}
+
+static int isom_expand_timeline( isom_timeline_t *timeline, uint32_t sample_number )
+{
+    isom_sample_table_cursor_t *cursor = timeline->cursor;
+    if( !cursor )
+        return 0;
+    /* Expand a window of samples beyond the requested one at once. */
+    uint32_t sample_number_limit = sample_number < UINT32_MAX - ISOM_TIMELINE_EXPANSION_WINDOW
+                                 ? sample_number + ISOM_TIMELINE_EXPANSION_WINDOW
+                                 : UINT32_MAX;
+    int err;
+    int end;
+    if( cursor->fragmented )
+    {
+        /* The statistics of the track are accumulated as movie fragments are expanded. */
+        err = isom_expand_movie_fragments( timeline, cursor, sample_number_limit );
+        end = (err != 0);
+        timeline->sample_count = cursor->sample_count;
+    }
+    else
+    {
+        /* The statistics of the whole track have been already calculated. */
+        uint64_t media_duration = timeline->media_duration;
+        uint32_t ctd_shift      = timeline->ctd_shift;
+        err = isom_expand_sample_tables( timeline, cursor, sample_number_limit );
+        end = (err < 0 || cursor->sample_number > cursor->stsz->sample_count);
+        timeline->media_duration = media_duration;
+        timeline->ctd_shift      = ctd_shift;
+    }
+    if( end )
+    {
+        /* Nothing to be expanded any more. */
+        lsmash_free( cursor );
+        timeline->cursor = NULL;
+    }
+    return err < 0 ? err : 0;
+}
+
+/* Expand the timeline if a given sample is not expanded yet, and check if the sample is present. */
+static int isom_check_sample_number( isom_timeline_t *timeline, uint32_t sample_number )
+{
+    if( sample_number > timeline->sample_count && timeline->cursor )
+        (void)isom_expand_timeline( timeline, sample_number );
+    return sample_number <= timeline->sample_count;
+}
+
+/* Expand all the movie fragments since the totals of a fragmented track are unknown until then. */
+static void isom_complete_fragmented_timeline( isom_timeline_t *timeline )
+{
+    if( timeline->cursor && timeline->cursor->fragmented )
+        (void)isom_expand_timeline( timeline, UINT32_MAX );
+}
+
+void isom_complete_timelines( lsmash_file_t *file )
+{
+    if( !file
+     || !file->timeline )
+        return;
+    for( lsmash_entry_t *entry = file->timeline->head; entry; entry = entry->next )
+    {
+        isom_timeline_t *timeline = (isom_timeline_t *)entry->data;
+        if( timeline && timeline->cursor )
+            isom_expand_timeline( timeline, UINT32_MAX );
+    }
+}
+
+/* Check if the sample tables of a track can be expanded on demand. */
+static int isom_check_lazy_timeline_availability
+(
+    lsmash_file_t              *file,
+    isom_sample_table_cursor_t *cursor
+)
+{
+    if( !isom_check_movie_fragments_present( file )
+     && cursor->stsz->sample_count == 0 )
+        return 0;
+    /* LPCM and fixed compression audio are gathered into bunches, which require the whole sample tables. */
+    for( lsmash_entry_t *entry = cursor->stsd->list.head; entry; entry = entry->next )
+    {
+        isom_sample_entry_t *description = (isom_sample_entry_t *)entry->data;
+        if( !description
+         || isom_is_lpcm_audio( description )
+         || isom_is_qt_fixed_compressed_audio( description ) )
+            return 0;
+    }
+    return 1;
+}
+
+static int isom_copy_edits( isom_timeline_t *timeline, isom_elst_t *elst )
+{
+    if( !elst || !elst->list )
+        return 0;
+    for( lsmash_entry_t *entry = elst->list->head; entry; entry = entry->next )
+    {
+        isom_elst_entry_t *edit = (isom_elst_entry_t *)lsmash_memdup( entry->data, sizeof(isom_elst_entry_t) );
+        if( !edit )
+            return LSMASH_ERR_MEMORY_ALLOC;
+        if( lsmash_add_entry( timeline->edit_list, edit ) < 0 )
+        {
+            lsmash_free( edit );
+            return LSMASH_ERR_MEMORY_ALLOC;
+        }
+    }
+    return 0;
+}
+
+int isom_timeline_construct( lsmash_root_t *root, uint32_t track_ID, int lazy )
+{
+    if( isom_check_initializer_present( root ) < 0 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    lsmash_file_t *file = root->file;
+    if( !file->moov
+     || !file->moov->mvhd
+     ||  file->moov->mvhd->timescale == 0 )
+        return LSMASH_ERR_INVALID_DATA;
+    /* Get track by track_ID. */
+    isom_trak_t *trak = isom_get_trak( file, track_ID );
+    if( !trak
+     || !trak->tkhd
+     || !trak->mdia
+     || !trak->mdia->mdhd
+     ||  trak->mdia->mdhd->timescale == 0
+     || !trak->mdia->minf
+     || !trak->mdia->minf->stbl )
+        return LSMASH_ERR_INVALID_DATA;
+    /* Create a timeline list if it doesn't exist. */
+    if( !file->timeline )
+    {
+        file->timeline = lsmash_create_entry_list();
+        if( !file->timeline )
+            return LSMASH_ERR_MEMORY_ALLOC;
+    }
+    /* Create a timeline. */
+    isom_timeline_t *timeline = isom_timeline_create();
+    if( !timeline )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    timeline->track_ID        = track_ID;
+    timeline->movie_timescale = file->moov->mvhd->timescale;
+    timeline->media_timescale = trak->mdia->mdhd->timescale;
+    timeline->track_duration  = trak->tkhd->duration;
+    /* Preparation for construction. */
+    isom_sample_table_cursor_t cursor;
+    int err;
+    if( (err = isom_copy_edits( timeline, trak->edts ? trak->edts->elst : NULL )) < 0
+     || (err = isom_setup_sample_table_cursor( timeline, file, trak, &cursor )) < 0 )
+        goto fail;
+    int movie_fragments_present = isom_check_movie_fragments_present( file );
+    if( lazy && isom_check_lazy_timeline_availability( file, &cursor ) )
+    {
+        /* Construct media timeline lazily.
+         * The sample info is expanded from the sample tables or movie fragments on demand. */
+        if( movie_fragments_present )
+        {
+            /* The sample tables, which are usually empty, are expanded at once,
+             * and then movie fragments are expanded on demand. */
+            if( (err = isom_expand_sample_tables( timeline, &cursor, UINT32_MAX )) < 0 )
+                goto fail;
+            cursor.sample_count = cursor.packet_number - 1;
+            isom_setup_movie_fragment_cursor( timeline, file, &cursor );
+        }
+        else
+            isom_calculate_timeline_statistics( timeline, &cursor );
+        timeline->cursor = lsmash_memdup( &cursor, sizeof(isom_sample_table_cursor_t) );
+        if( !timeline->cursor )
+        {
+            err = LSMASH_ERR_MEMORY_ALLOC;
+            goto fail;
+        }
+        if( (err = isom_expand_timeline( timeline, 1 )) < 0
+         || (err = lsmash_add_entry( file->timeline, timeline )) < 0 )
+            goto fail;
+        if( !movie_fragments_present )
+            timeline->sample_count = cursor.stsz->sample_count;
+        isom_timeline_set_sample_getter_funcs( timeline );
+        return 0;
+    }
+    /**--- Construct media timeline. ---**/
+    if( (err = isom_expand_sample_tables( timeline, &cursor, UINT32_MAX )) < 0 )
+        goto fail;
+    cursor.sample_count = cursor.packet_number - 1;
+    if( movie_fragments_present )
+    {
+        /* Movie fragments */
+        isom_setup_movie_fragment_cursor( timeline, file, &cursor );
+        if( (err = isom_expand_movie_fragments( timeline, &cursor, UINT32_MAX )) < 0 )
+            goto fail;
     }
     else if( timeline->chunk_list->entry_count == 0 )
         goto fail;  /* No samples in this track. */
-    if( bunch.sample_count && (err = isom_add_lpcm_bunch_entry( timeline, &bunch )) < 0 )
+    if( cursor.bunch.sample_count && (err = isom_add_lpcm_bunch_entry( timeline, &cursor.bunch )) < 0 )
         goto fail;
     if( (err = lsmash_add_entry( file->timeline, timeline )) < 0 )
         goto fail;
     /* Finish timeline construction. */
-    timeline->sample_count = sample_count;
+    timeline->sample_count = cursor.sample_count;
     if( timeline->info_list->entry_count )
         isom_timeline_set_sample_getter_funcs( timeline );
     else
@@ -1449,12 +1995,26 @@ int lsmash_construct_timeline( lsmash_root_t *root, uint32_t track_ID )
     return lsmash_importer_construct_timeline( root->file->importer, track_number );
 }
 
+int lsmash_construct_lazy_timeline( lsmash_root_t *root, uint32_t track_ID )
+{
+    if( !root
+     || !root->file
+     || track_ID == 0 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    if( !root->file->initializer
+     || !root->file->importer )
+        return lsmash_construct_timeline( root, track_ID );
+    if( !root->file->initializer->moov )
+        return LSMASH_ERR_INVALID_DATA;
+    return isom_timeline_construct( root, track_ID, 1 );
+}
+
 int lsmash_get_dts_from_media_timeline( lsmash_root_t *root, uint32_t track_ID, uint32_t sample_number, uint64_t *dts )
 {
     if( !sample_number || !dts )
         return LSMASH_ERR_FUNCTION_PARAM;
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
-    if( !timeline || sample_number > timeline->sample_count )
+    if( !timeline || !isom_check_sample_number( timeline, sample_number ) )
         return LSMASH_ERR_NAMELESS;
      return timeline->get_dts( timeline, sample_number, dts );
 }
@@ -1464,17 +2024,95 @@ int lsmash_get_cts_from_media_timeline( lsmash_root_t *root, uint32_t track_ID,
     if( !sample_number || !cts )
         return LSMASH_ERR_FUNCTION_PARAM;
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
-    if( !timeline || sample_number > timeline->sample_count )
+    if( !timeline || !isom_check_sample_number( timeline, sample_number ) )
         return LSMASH_ERR_NAMELESS;
      return timeline->get_cts( timeline, sample_number, cts );
 }
 
+int lsmash_get_sample_number_from_media_timeline( lsmash_root_t *root, uint32_t track_ID, uint64_t dts, uint32_t *sample_number )
+{
+    if( !sample_number )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
+    if( !timeline )
+        return LSMASH_ERR_NAMELESS;
+    return timeline->get_sample_number( timeline, dts, sample_number );
+}
+
 lsmash_sample_t *lsmash_get_sample_from_media_timeline( lsmash_root_t *root, uint32_t track_ID, uint32_t sample_number )
 {
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
     return timeline ? timeline->get_sample( timeline, sample_number ) : NULL;
 }
 
+int lsmash_get_samples_from_media_timeline
+(
+    lsmash_root_t   *root,
+    uint32_t         track_ID,
+    uint32_t         sample_number,
+    uint32_t         sample_count,
+    lsmash_sample_t *samples,
+    uint8_t         *buffer,
+    uint32_t         buffer_size
+)
+{
+    if( !sample_number || !samples || !buffer )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
+    if( !timeline )
+        return LSMASH_ERR_NAMELESS;
+    if( !isom_check_sample_number( timeline, sample_number ) )
+        return 0;
+    if( sample_count > timeline->sample_count - sample_number + 1 )
+        (void)isom_check_sample_number( timeline, sample_count <= UINT32_MAX - sample_number ? sample_number + sample_count - 1 : UINT32_MAX );
+    sample_count = LSMASH_MIN( sample_count, timeline->sample_count - sample_number + 1 );
+    sample_count = LSMASH_MIN( sample_count, INT_MAX );
+    uint32_t got_count = 0;
+    uint32_t used_size = 0;
+    while( got_count < sample_count )
+    {
+        /* Gather the following samples as long as they are stored contiguously in the same file,
+         * and then read their data at a time. */
+        lsmash_sample_t *first_sample = &samples[got_count];
+        lsmash_file_t   *file         = NULL;
+        uint32_t         run_count    = 0;
+        uint32_t         run_size     = 0;
+        int              ret          = 0;
+        while( got_count + run_count < sample_count )
+        {
+            lsmash_sample_t *sample = &samples[got_count + run_count];
+            lsmash_file_t   *sample_file;
+            if( (ret = timeline->get_sample_location( timeline, sample_number + got_count + run_count, sample, &sample_file )) < 0 )
+                break;
+            if( sample->length > buffer_size - used_size - run_size )
+            {
+                ret = LSMASH_ERR_FUNCTION_PARAM;
+                break;
+            }
+            if( run_count
+             && (sample_file != file || sample->pos != first_sample->pos + run_size) )
+                break;
+            file          = sample_file;
+            sample->data  = buffer + used_size + run_size;
+            run_size     += sample->length;
+            ++run_count;
+        }
+        if( run_count == 0 )
+            /* Fail only if no sample is gotten. Otherwise, the next call will tell the reason. */
+            return got_count ? (int)got_count : ret;
+        if( run_size )
+        {
+            lsmash_bs_t *bs = file->bs;
+            if( lsmash_bs_read_seek( bs, first_sample->pos, SEEK_SET ) < 0
+             || lsmash_bs_get_bytes_ex( bs, run_size, buffer + used_size ) != run_size )
+                return LSMASH_ERR_NAMELESS;
+        }
+        got_count += run_count;
+        used_size += run_size;
+    }
+    return (int)got_count;
+}
+
 int lsmash_get_sample_info_from_media_timeline( lsmash_root_t *root, uint32_t track_ID, uint32_t sample_number, lsmash_sample_t *sample )
 {
     if( !sample )
@@ -1498,47 +2136,40 @@ int lsmash_get_composition_to_decode_shift_from_media_timeline( lsmash_root_t *r
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
     if( !timeline )
         return LSMASH_ERR_NAMELESS;
+    isom_complete_fragmented_timeline( timeline );
     *ctd_shift = timeline->ctd_shift;
     return 0;
 }
 
 static int isom_get_closest_past_random_accessible_point_from_media_timeline( isom_timeline_t *timeline, uint32_t sample_number, uint32_t *rap_number )
 {
-    lsmash_entry_t *entry = lsmash_get_entry( timeline->info_list, sample_number-- );
-    if( !entry
-     || !entry->data )
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
+    if( !info )
         return LSMASH_ERR_NAMELESS;
-    isom_sample_info_t *info = (isom_sample_info_t *)entry->data;
+    isom_sample_info_t *first_info = (isom_sample_info_t *)timeline->info_list->data;
     while( info->prop.ra_flags == ISOM_SAMPLE_RANDOM_ACCESS_FLAG_NONE )
     {
-        entry = entry->prev;
-        if( !entry
-         || !entry->data )
+        if( info == first_info )
             return LSMASH_ERR_NAMELESS;
-        info = (isom_sample_info_t *)entry->data;
-        --sample_number;
+        --info;
     }
-    *rap_number = sample_number + 1;
+    *rap_number = (uint32_t)(info - first_info) + 1;
     return 0;
 }
 
 static inline int isom_get_closest_future_random_accessible_point_from_media_timeline( isom_timeline_t *timeline, uint32_t sample_number, uint32_t *rap_number )
 {
-    lsmash_entry_t *entry = lsmash_get_entry( timeline->info_list, sample_number++ );
-    if( !entry
-     || !entry->data )
+    isom_sample_info_t *info = isom_get_sample_info( timeline, sample_number );
+    if( !info )
         return LSMASH_ERR_NAMELESS;
-    isom_sample_info_t *info = (isom_sample_info_t *)entry->data;
     while( info->prop.ra_flags == ISOM_SAMPLE_RANDOM_ACCESS_FLAG_NONE )
     {
-        entry = entry->next;
-        if( !entry
-         || !entry->data )
+        /* The timeline may be expanded and then reallocated here. */
+        info = isom_get_sample_info( timeline, ++sample_number );
+        if( !info )
             return LSMASH_ERR_NAMELESS;
-        info = (isom_sample_info_t *)entry->data;
-        ++sample_number;
     }
-    *rap_number = sample_number - 1;
+    *rap_number = sample_number;
     return 0;
 }
 
@@ -1591,7 +2222,7 @@ int lsmash_get_closest_random_accessible_point_detail_from_media_timeline( lsmas
     int ret = isom_get_closest_random_accessible_point_from_media_timeline_internal( timeline, sample_number, rap_number );
     if( ret < 0 )
         return ret;
-    isom_sample_info_t *info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, *rap_number );
+    isom_sample_info_t *info = isom_get_sample_info( timeline, *rap_number );
     if( !info )
         return LSMASH_ERR_NAMELESS;
     if( ra_flags )
@@ -1609,16 +2240,14 @@ int lsmash_get_closest_random_accessible_point_detail_from_media_timeline( lsmas
         {
             /* Count leading samples. */
             uint32_t current_sample_number = *rap_number + 1;
-            uint64_t dts;
-            if( (ret = isom_get_dts_from_info_list( timeline, *rap_number, &dts )) < 0 )
-                return ret;
+            uint64_t dts = info->dts;
             uint64_t rap_cts = timeline->ctd_shift ? (dts + (int32_t)info->offset + timeline->ctd_shift) : (dts + info->offset);
             do
             {
                 dts += info->duration;
                 if( rap_cts <= dts )
                     break;  /* leading samples of this random accessible point must not be present more. */
-                info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, current_sample_number++ );
+                info = isom_get_sample_info( timeline, current_sample_number++ );
                 if( !info )
                     break;
                 uint64_t cts = timeline->ctd_shift ? (dts + (int32_t)info->offset + timeline->ctd_shift) : (dts + info->offset);
@@ -1635,7 +2264,7 @@ int lsmash_get_closest_random_accessible_point_detail_from_media_timeline( lsmas
             if( isom_get_closest_past_random_accessible_point_from_media_timeline( timeline, prev_rap_number - 1, &prev_rap_number ) < 0 )
                 /* The previous random accessible point is not present. */
                 return 0;
-            info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, prev_rap_number );
+            info = isom_get_sample_info( timeline, prev_rap_number );
             if( !info )
                 return LSMASH_ERR_NAMELESS;
             if( !(info->prop.ra_flags & ISOM_SAMPLE_RANDOM_ACCESS_FLAG_GDR) )
@@ -1708,7 +2337,7 @@ int lsmash_get_closest_random_accessible_point_detail_from_media_timeline( lsmas
         if( isom_get_closest_past_random_accessible_point_from_media_timeline( timeline, prev_rap_number - 1, &prev_rap_number ) < 0 )
             /* The previous random accessible point is not present. */
             return 0;
-        info = (isom_sample_info_t *)lsmash_get_entry_data( timeline->info_list, prev_rap_number );
+        info = isom_get_sample_info( timeline, prev_rap_number );
         if( !info )
             return LSMASH_ERR_NAMELESS;
         if( !(info->prop.ra_flags & ISOM_SAMPLE_RANDOM_ACCESS_FLAG_GDR) || sample_number >= info->prop.post_roll.complete )
@@ -1730,7 +2359,10 @@ int lsmash_get_last_sample_delta_from_media_timeline( lsmash_root_t *root, uint3
     if( !last_sample_delta )
         return LSMASH_ERR_FUNCTION_PARAM;
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
-    return timeline ? timeline->get_sample_duration( timeline, timeline->sample_count, last_sample_delta ) : -1;
+    if( !timeline )
+        return -1;
+    isom_complete_fragmented_timeline( timeline );
+    return timeline->get_sample_duration( timeline, timeline->sample_count, last_sample_delta );
 }
 
 int lsmash_get_sample_delta_from_media_timeline( lsmash_root_t *root, uint32_t track_ID, uint32_t sample_number, uint32_t *sample_delta )
@@ -1746,6 +2378,7 @@ uint32_t lsmash_get_sample_count_in_media_timeline( lsmash_root_t *root, uint32_
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
     if( !timeline )
         return 0;
+    isom_complete_fragmented_timeline( timeline );
     return timeline->sample_count;
 }
 
@@ -1754,6 +2387,7 @@ uint32_t lsmash_get_max_sample_size_in_media_timeline( lsmash_root_t *root, uint
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
     if( !timeline )
         return 0;
+    isom_complete_fragmented_timeline( timeline );
     return timeline->max_sample_size;
 }
 
@@ -1762,6 +2396,7 @@ uint64_t lsmash_get_media_duration_from_media_timeline( lsmash_root_t *root, uin
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
     if( !timeline )
         return 0;
+    isom_complete_fragmented_timeline( timeline );
     return timeline->media_duration;
 }
 
@@ -1807,6 +2442,7 @@ int lsmash_copy_timeline_map( lsmash_root_t *dst, uint32_t dst_track_ID, lsmash_
          && src_timeline->movie_timescale
          && src_timeline->media_timescale )
         {
+            isom_complete_fragmented_timeline( src_timeline );
             src_entry = src_timeline->edit_list->head;
             if( !src_entry )
                 return 0;
@@ -1893,6 +2529,9 @@ int lsmash_set_media_timestamps( lsmash_root_t *root, uint32_t track_ID, lsmash_
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
     if( !timeline )
         return LSMASH_ERR_NAMELESS;
+    int err = isom_expand_timeline( timeline, UINT32_MAX );
+    if( err < 0 )
+        return err;
     if( timeline->info_list->entry_count == 0 )
     {
         lsmash_log( timeline, LSMASH_LOG_ERROR, "Changing timestamps of LPCM track is not supported.\n" );
@@ -1904,46 +2543,30 @@ int lsmash_set_media_timestamps( lsmash_root_t *root, uint32_t track_ID, lsmash_
     if( ts[0].dts )
         return LSMASH_ERR_INVALID_DATA; /* DTS must start from value zero. */
     /* Update DTSs. */
-    uint32_t sample_count  = ts_list->sample_count;
-    uint32_t i;
-    if( timeline->info_list->entry_count > 1 )
+    uint32_t sample_count = ts_list->sample_count;
+    isom_sample_info_t *info = (isom_sample_info_t *)timeline->info_list->data;
+    if( sample_count > 1 )
     {
-        i = 1;
-        lsmash_entry_t *entry = timeline->info_list->head;
-        isom_sample_info_t *info = NULL;
-        while( i < sample_count )
-        {
-            info = (isom_sample_info_t *)entry->data;
-            if( !info || (ts[i].dts < ts[i - 1].dts) )
-                return LSMASH_ERR_INVALID_DATA;
-            info->duration = ts[i].dts - ts[i - 1].dts;
-            entry = entry->next;
-            ++i;
-        }
-        if( i > 1 )
+        for( uint32_t i = 1; i < sample_count; i++ )
         {
-            if( !entry
-             || !entry->data )
+            if( ts[i].dts < ts[i - 1].dts )
                 return LSMASH_ERR_INVALID_DATA;
-            /* Copy the previous duration. */
-            ((isom_sample_info_t *)entry->data)->duration = info->duration;
+            info[i - 1].duration = ts[i].dts - ts[i - 1].dts;
         }
-        else
-            return LSMASH_ERR_INVALID_DATA; /* Irregular case: sample_count this timeline has is incorrect. */
+        /* Copy the previous duration. */
+        info[sample_count - 1].duration = info[sample_count - 2].duration;
     }
     else    /* still image */
-        ((isom_sample_info_t *)timeline->info_list->head->data)->duration = UINT32_MAX;
+        info[0].duration = UINT32_MAX;
     /* Update CTSs.
      * ToDo: hint track must not have any sample_offset. */
-    i = 0;
     timeline->ctd_shift = 0;
-    for( lsmash_entry_t *entry = timeline->info_list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < sample_count; i++ )
     {
-        isom_sample_info_t *info = (isom_sample_info_t *)entry->data;
         if( (ts[i].cts + timeline->ctd_shift) < ts[i].dts )
             timeline->ctd_shift = ts[i].dts - ts[i].cts;
-        info->offset = ts[i].cts - ts[i].dts;
-        ++i;
+        info[i].dts    = ts[i].dts;
+        info[i].offset = ts[i].cts - ts[i].dts;
     }
     if( timeline->ctd_shift && (!root->file->qt_compatible || root->file->max_isom_version < 4) )
         return LSMASH_ERR_INVALID_DATA; /* Don't allow composition to decode timeline shift. */
@@ -1957,6 +2580,9 @@ int lsmash_get_media_timestamps( lsmash_root_t *root, uint32_t track_ID, lsmash_
     isom_timeline_t *timeline = isom_get_timeline( root, track_ID );
     if( !timeline )
         return LSMASH_ERR_NAMELESS;
+    int err = isom_expand_timeline( timeline, UINT32_MAX );
+    if( err < 0 )
+        return err;
     uint32_t sample_count = timeline->info_list->entry_count;
     if( !sample_count )
     {
@@ -1970,17 +2596,10 @@ int lsmash_get_media_timestamps( lsmash_root_t *root, uint32_t track_ID, lsmash_
     uint64_t dts = 0;
     uint32_t i = 0;
     if( timeline->info_list->entry_count )
-        for( lsmash_entry_t *entry = timeline->info_list->head; entry; entry = entry->next )
+        for( isom_sample_info_t *info = (isom_sample_info_t *)timeline->info_list->data; i < sample_count; info++ )
         {
-            isom_sample_info_t *info = (isom_sample_info_t *)entry->data;
-            if( !info )
-            {
-                lsmash_free( ts );
-                return LSMASH_ERR_NAMELESS;
-            }
-            ts[i].dts = dts;
-            ts[i].cts = timeline->ctd_shift ? (dts + (int32_t)info->offset) : (dts + info->offset);
-            dts += info->duration;
+            ts[i].dts = info->dts;
+            ts[i].cts = timeline->ctd_shift ? (info->dts + (int32_t)info->offset) : (info->dts + info->offset);
             ++i;
         }
     else
@@ -94,11 +94,24 @@ int isom_timeline_set_track_duration
     uint32_t         track_duration
 );
 
+void isom_timeline_set_sample_getter_funcs
+(
+    isom_timeline_t *timeline
+);
+
 void isom_timeline_set_lpcm_sample_getter_funcs
 (
     isom_timeline_t *timeline
 );
 
+/* Set the function which converts the data of a sample read from the stream into the data the sample shall have.
+ * The function shall update sample->data and sample->length. */
+void isom_timeline_set_sample_converter
+(
+    isom_timeline_t *timeline,
+    int (*convert_sample)( lsmash_sample_t *sample )
+);
+
 isom_timeline_t *isom_get_timeline
 (
     lsmash_root_t *root,
@@ -113,7 +126,13 @@ void isom_remove_timelines
 int isom_timeline_construct
 (
     lsmash_root_t *root,
-    uint32_t       track_ID
+    uint32_t       track_ID,
+    int            lazy
+);
+
+void isom_complete_timelines
+(
+    lsmash_file_t *file
 );
 
 int isom_add_lpcm_bunch_entry
@@ -122,4 +141,14 @@ int isom_add_lpcm_bunch_entry
     isom_lpcm_bunch_t *src_bunch
 );
 
+/* Add a sample which is stored at sample->pos in the file as is.
+ * The decoding time of the sample is given by the sum of durations of all preceding samples. */
+int isom_add_stream_sample_entry
+(
+    isom_timeline_t *timeline,
+    lsmash_file_t   *file,
+    lsmash_sample_t *sample,
+    uint32_t         sample_duration
+);
+
 #endif /* LSMASH_TIMELINE_H */
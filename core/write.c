@@ -25,6 +25,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <limits.h>
+
+#ifdef LSMASH_ZLIB_ENABLED
+#include <zlib.h>
+#endif
 
 #include "box.h"
 #include "write.h"
@@ -714,11 +719,9 @@ static int isom_write_stts( lsmash_bs_t *bs, isom_box_t *box )
     assert( stts->list );
     isom_bs_put_box_common( bs, stts );
     lsmash_bs_put_be32( bs, stts->list->entry_count );
-    for( lsmash_entry_t *entry = stts->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < stts->list->entry_count; i++ )
     {
-        isom_stts_entry_t *data = (isom_stts_entry_t *)entry->data;
-        if( !data )
-            return LSMASH_ERR_NAMELESS;
+        isom_stts_entry_t *data = (isom_stts_entry_t *)stts->list->data + i;
         lsmash_bs_put_be32( bs, data->sample_count );
         lsmash_bs_put_be32( bs, data->sample_delta );
     }
@@ -731,11 +734,9 @@ static int isom_write_ctts( lsmash_bs_t *bs, isom_box_t *box )
     assert( ctts->list );
     isom_bs_put_box_common( bs, ctts );
     lsmash_bs_put_be32( bs, ctts->list->entry_count );
-    for( lsmash_entry_t *entry = ctts->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < ctts->list->entry_count; i++ )
     {
-        isom_ctts_entry_t *data = (isom_ctts_entry_t *)entry->data;
-        if( !data )
-            return LSMASH_ERR_NAMELESS;
+        isom_ctts_entry_t *data = (isom_ctts_entry_t *)ctts->list->data + i;
         lsmash_bs_put_be32( bs, data->sample_count );
         lsmash_bs_put_be32( bs, data->sample_offset );
     }
@@ -761,27 +762,48 @@ static int isom_write_stsz( lsmash_bs_t *bs, isom_box_t *box )
     lsmash_bs_put_be32( bs, stsz->sample_size );
     lsmash_bs_put_be32( bs, stsz->sample_count );
     if( stsz->sample_size == 0 && stsz->list )
-        for( lsmash_entry_t *entry = stsz->list->head; entry; entry = entry->next )
+        for( uint32_t i = 0; i < stsz->list->entry_count; i++ )
         {
-            isom_stsz_entry_t *data = (isom_stsz_entry_t *)entry->data;
-            if( !data )
-                return LSMASH_ERR_NAMELESS;
+            isom_stsz_entry_t *data = (isom_stsz_entry_t *)stsz->list->data + i;
             lsmash_bs_put_be32( bs, data->entry_size );
         }
     return 0;
 }
 
+static int isom_write_stz2( lsmash_bs_t *bs, isom_box_t *box )
+{
+    isom_stsz_t *stz2 = (isom_stsz_t *)box;
+    assert( stz2->list && stz2->sample_size == 0 );
+    isom_bs_put_box_common( bs, stz2 );
+    lsmash_bs_put_be24( bs, 0 );    /* reserved */
+    lsmash_bs_put_byte( bs, stz2->field_size );
+    lsmash_bs_put_be32( bs, stz2->sample_count );
+    isom_stsz_entry_t *data = (isom_stsz_entry_t *)stz2->list->data;
+    uint32_t entry_count = stz2->list->entry_count;
+    if( stz2->field_size == 4 )
+    {
+        /* Two entries are packed into a byte. The first one is in the upper nibble, and the last byte is padded with 0. */
+        for( uint32_t i = 0; i < entry_count; i += 2 )
+            lsmash_bs_put_byte( bs, (data[i].entry_size << 4) | (i + 1 < entry_count ? data[i + 1].entry_size : 0) );
+    }
+    else if( stz2->field_size == 8 )
+        for( uint32_t i = 0; i < entry_count; i++ )
+            lsmash_bs_put_byte( bs, data[i].entry_size );
+    else
+        for( uint32_t i = 0; i < entry_count; i++ )
+            lsmash_bs_put_be16( bs, data[i].entry_size );
+    return 0;
+}
+
 static int isom_write_stss( lsmash_bs_t *bs, isom_box_t *box )
 {
     isom_stss_t *stss = (isom_stss_t *)box;
     assert( stss->list );
     isom_bs_put_box_common( bs, stss );
     lsmash_bs_put_be32( bs, stss->list->entry_count );
-    for( lsmash_entry_t *entry = stss->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < stss->list->entry_count; i++ )
     {
-        isom_stss_entry_t *data = (isom_stss_entry_t *)entry->data;
-        if( !data )
-            return LSMASH_ERR_NAMELESS;
+        isom_stss_entry_t *data = (isom_stss_entry_t *)stss->list->data + i;
         lsmash_bs_put_be32( bs, data->sample_number );
     }
     return 0;
@@ -793,11 +815,9 @@ static int isom_write_stps( lsmash_bs_t *bs, isom_box_t *box )
     assert( stps->list );
     isom_bs_put_box_common( bs, stps );
     lsmash_bs_put_be32( bs, stps->list->entry_count );
-    for( lsmash_entry_t *entry = stps->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < stps->list->entry_count; i++ )
     {
-        isom_stps_entry_t *data = (isom_stps_entry_t *)entry->data;
-        if( !data )
-            return LSMASH_ERR_NAMELESS;
+        isom_stps_entry_t *data = (isom_stps_entry_t *)stps->list->data + i;
         lsmash_bs_put_be32( bs, data->sample_number );
     }
     return 0;
@@ -828,11 +848,9 @@ static int isom_write_stsc( lsmash_bs_t *bs, isom_box_t *box )
     assert( stsc->list );
     isom_bs_put_box_common( bs, stsc );
     lsmash_bs_put_be32( bs, stsc->list->entry_count );
-    for( lsmash_entry_t *entry = stsc->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < stsc->list->entry_count; i++ )
     {
-        isom_stsc_entry_t *data = (isom_stsc_entry_t *)entry->data;
-        if( !data )
-            return LSMASH_ERR_NAMELESS;
+        isom_stsc_entry_t *data = (isom_stsc_entry_t *)stsc->list->data + i;
         lsmash_bs_put_be32( bs, data->first_chunk );
         lsmash_bs_put_be32( bs, data->samples_per_chunk );
         lsmash_bs_put_be32( bs, data->sample_description_index );
@@ -846,11 +864,9 @@ static int isom_write_co64( lsmash_bs_t *bs, isom_box_t *box )
     assert( co64->list );
     isom_bs_put_box_common( bs, co64 );
     lsmash_bs_put_be32( bs, co64->list->entry_count );
-    for( lsmash_entry_t *entry = co64->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < co64->list->entry_count; i++ )
     {
-        isom_co64_entry_t *data = (isom_co64_entry_t *)entry->data;
-        if( !data )
-            return LSMASH_ERR_NAMELESS;
+        isom_co64_entry_t *data = (isom_co64_entry_t *)co64->list->data + i;
         lsmash_bs_put_be64( bs, data->chunk_offset );
     }
     return 0;
@@ -864,11 +880,9 @@ static int isom_write_stco( lsmash_bs_t *bs, isom_box_t *box )
     assert( stco->list );
     isom_bs_put_box_common( bs, stco );
     lsmash_bs_put_be32( bs, stco->list->entry_count );
-    for( lsmash_entry_t *entry = stco->list->head; entry; entry = entry->next )
+    for( uint32_t i = 0; i < stco->list->entry_count; i++ )
     {
-        isom_stco_entry_t *data = (isom_stco_entry_t *)entry->data;
-        if( !data )
-            return LSMASH_ERR_NAMELESS;
+        isom_stco_entry_t *data = (isom_stco_entry_t *)stco->list->data + i;
         lsmash_bs_put_be32( bs, data->chunk_offset );
     }
     return 0;
@@ -1298,7 +1312,9 @@ static int isom_write_mdat( lsmash_bs_t *bs, isom_box_t *box )
             isom_sample_pool_t *pool = (isom_sample_pool_t *)entry->data;
             if( !pool )
                 return LSMASH_ERR_NAMELESS;
-            lsmash_bs_put_bytes( bs, pool->size, pool->data );
+            int err = isom_write_sample_pool( bs, pool );
+            if( err < 0 )
+                return err;
         }
         mdat->media_size = file->fragment->pool_size;
         return 0;
@@ -1309,12 +1325,23 @@ static int isom_write_mdat( lsmash_bs_t *bs, isom_box_t *box )
         if( !file->free && !isom_add_free( file ) )
             return LSMASH_ERR_NAMELESS;
         isom_free_t *skip = file->free;
+        uint64_t reserve_size = file->moov_reserve_size ? LSMASH_MAX( file->moov_reserve_size, ISOM_BASEBOX_COMMON_SIZE ) : 0;
         skip->pos      = bs->offset;
-        skip->size     = ISOM_BASEBOX_COMMON_SIZE;
+        skip->size     = ISOM_BASEBOX_COMMON_SIZE + reserve_size;
         skip->manager |= LSMASH_PLACEHOLDER;
         int ret = isom_write_box( bs, (isom_box_t *)skip );
         if( ret < 0 )
             return ret;
+        /* Fill the space reserved for the Movie Box. */
+        static const uint8_t zero[4096] = { 0 };
+        while( reserve_size )
+        {
+            uint32_t fill_size = LSMASH_MIN( reserve_size, sizeof(zero) );
+            lsmash_bs_put_bytes( bs, fill_size, (void *)zero );
+            if( (ret = lsmash_bs_flush_buffer( bs )) < 0 )
+                return ret;
+            reserve_size -= fill_size;
+        }
         /* Write an incomplete Media Data Box. */
         mdat->pos      = bs->offset;
         mdat->size     = ISOM_BASEBOX_COMMON_SIZE;
@@ -1330,11 +1357,26 @@ static int isom_write_mdat( lsmash_bs_t *bs, isom_box_t *box )
         mdat->size = ISOM_BASEBOX_COMMON_SIZE + mdat->media_size;
         if( mdat->size > UINT32_MAX )
         {
-            /* The placeholder is overwritten by the Media Data Box. */
             assert( file->free );
-            mdat->pos   = file->free->pos;
-            mdat->size += file->free->size;
-            isom_remove_box_by_itself( file->free );
+            if( file->free->size > ISOM_BASEBOX_COMMON_SIZE )
+            {
+                /* The tail of the reserved space is overwritten by the Media Data Box. */
+                file->free->size -= ISOM_BASEBOX_COMMON_SIZE;
+                mdat->pos        -= ISOM_BASEBOX_COMMON_SIZE;
+                mdat->size       += ISOM_BASEBOX_COMMON_SIZE;
+                lsmash_bs_write_seek( bs, file->free->pos, SEEK_SET );
+                isom_bs_put_box_common( bs, file->free );
+                int ret = lsmash_bs_flush_buffer( bs );
+                if( ret < 0 )
+                    return ret;
+            }
+            else
+            {
+                /* The placeholder is overwritten by the Media Data Box. */
+                mdat->pos   = file->free->pos;
+                mdat->size += file->free->size;
+                isom_remove_box_by_itself( file->free );
+            }
         }
         lsmash_bs_write_seek( bs, mdat->pos, SEEK_SET );
         isom_bs_put_box_common( bs, mdat );
@@ -1440,6 +1482,97 @@ int isom_write_box( lsmash_bs_t *bs, isom_box_t *box )
     return isom_write_children( bs, box );
 }
 
+/* Compress the Movie Box with zlib into a Movie Box containing only a Compressed Movie Box,
+ * which isom_write_movie() writes instead of the original one.
+ * If 'min_size' exceeds the size of the compressed Movie Box by ISOM_BASEBOX_COMMON_SIZE or more,
+ * a Free Space Box is placed after the Compressed Movie Box to make the Movie Box 'min_size' bytes.
+ * Return the size of the compressed Movie Box if successful.
+ * Return a negative value otherwise. */
+int64_t isom_compress_movie( lsmash_file_t *file, uint64_t min_size )
+{
+#ifdef LSMASH_ZLIB_ENABLED
+    isom_moov_t *moov = file->moov;
+    if( !moov || moov->size > INT_MAX )
+        return LSMASH_ERR_PATCH_WELCOME;
+    /* Get the uncompressed Movie Box. */
+    lsmash_bs_t *bs = lsmash_bs_create();
+    if( !bs )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    int64_t ret = isom_write_box( bs, (isom_box_t *)moov );
+    if( ret == 0 && (bs->error || lsmash_bs_get_valid_data_size( bs ) != moov->size) )
+        ret = LSMASH_ERR_NAMELESS;
+    if( ret < 0 )
+        goto fail;
+    /* moov + cmov + dcom + cmvd, and then the compressed data follows */
+    const uint64_t header_size = 4 * ISOM_BASEBOX_COMMON_SIZE + 8;
+    uLongf   compressed_size = compressBound( moov->size );
+    uint8_t *data            = lsmash_malloc( header_size + compressed_size );
+    if( !data )
+    {
+        ret = LSMASH_ERR_MEMORY_ALLOC;
+        goto fail;
+    }
+    if( compress2( data + header_size, &compressed_size, lsmash_bs_get_buffer_data_start( bs ), moov->size, Z_BEST_COMPRESSION ) != Z_OK
+     || header_size + compressed_size + ISOM_BASEBOX_COMMON_SIZE > INT_MAX )
+    {
+        lsmash_free( data );
+        ret = LSMASH_ERR_NAMELESS;
+        goto fail;
+    }
+    uint64_t cmov_size = header_size - ISOM_BASEBOX_COMMON_SIZE + compressed_size;
+    uint64_t free_size = min_size >= cmov_size + 2 * ISOM_BASEBOX_COMMON_SIZE ? min_size - cmov_size - ISOM_BASEBOX_COMMON_SIZE : 0;
+    uint64_t moov_size = ISOM_BASEBOX_COMMON_SIZE + cmov_size + free_size;
+    if( free_size )
+    {
+        uint8_t *temp = lsmash_realloc( data, moov_size );
+        if( !temp )
+        {
+            lsmash_free( data );
+            ret = LSMASH_ERR_MEMORY_ALLOC;
+            goto fail;
+        }
+        data = temp;
+        memset( data + moov_size - free_size, 0, free_size );
+        LSMASH_SET_BE32( &data[moov_size - free_size    ], free_size );
+        LSMASH_SET_BE32( &data[moov_size - free_size + 4], ISOM_BOX_TYPE_FREE.fourcc );
+    }
+    uint32_t compression_type = QT_COMPRESSION_TYPE_ZLIB;
+    LSMASH_SET_BE32( &data[ 0], moov_size );
+    LSMASH_SET_BE32( &data[ 4], ISOM_BOX_TYPE_MOOV.fourcc );
+    LSMASH_SET_BE32( &data[ 8], cmov_size );
+    LSMASH_SET_BE32( &data[12], QT_BOX_TYPE_CMOV.fourcc );
+    LSMASH_SET_BE32( &data[16], ISOM_BASEBOX_COMMON_SIZE + 4 );
+    LSMASH_SET_BE32( &data[20], QT_BOX_TYPE_DCOM.fourcc );
+    LSMASH_SET_BE32( &data[24], compression_type );
+    LSMASH_SET_BE32( &data[28], ISOM_BASEBOX_COMMON_SIZE + 4 + compressed_size );
+    LSMASH_SET_BE32( &data[32], QT_BOX_TYPE_CMVD.fourcc );
+    LSMASH_SET_BE32( &data[36], moov->size );
+    lsmash_free( file->compressed_movie );
+    file->compressed_movie      = data;
+    file->compressed_movie_size = moov_size;
+    ret = moov_size;
+fail:
+    lsmash_bs_cleanup( bs );
+    return ret;
+#else
+    return LSMASH_ERR_PATCH_WELCOME;
+#endif
+}
+
+/* Write the Movie Box, or the compressed one if any. */
+int isom_write_movie( lsmash_bs_t *bs, lsmash_file_t *file )
+{
+    if( !file->compressed_movie )
+        return isom_write_box( bs, (isom_box_t *)file->moov );
+    int err = lsmash_bs_write_data( bs, file->compressed_movie, file->compressed_movie_size );
+    lsmash_freep( &file->compressed_movie );
+    file->compressed_movie_size = 0;
+    if( err < 0 )
+        return err;
+    file->moov->manager |= LSMASH_WRITTEN_BOX;
+    return 0;
+}
+
 void isom_set_box_writer( isom_box_t *box )
 {
     if( box->manager & LSMASH_BINARY_CODED_BOX )
@@ -1495,6 +1628,8 @@ void isom_set_box_writer( isom_box_t *box )
         lsmash_box_type_t       type;
         isom_extension_writer_t writer_func;
     } box_writer_table[128] = { { LSMASH_BOX_TYPE_INITIALIZER, NULL } };
+    static isom_fourcc_index_t box_writer_index[128];
+    static uint32_t            box_writer_count;
     if( !box_writer_table[0].writer_func )
     {
         /* Initialize the table. */
@@ -1557,6 +1692,7 @@ void isom_set_box_writer( isom_box_t *box )
         ADD_BOX_WRITER_TABLE_ELEMENT( ISOM_BOX_TYPE_SDTP, isom_write_sdtp );
         ADD_BOX_WRITER_TABLE_ELEMENT( ISOM_BOX_TYPE_STSC, isom_write_stsc );
         ADD_BOX_WRITER_TABLE_ELEMENT( ISOM_BOX_TYPE_STSZ, isom_write_stsz );
+        ADD_BOX_WRITER_TABLE_ELEMENT( ISOM_BOX_TYPE_STZ2, isom_write_stz2 );
         ADD_BOX_WRITER_TABLE_ELEMENT( ISOM_BOX_TYPE_STCO, isom_write_stco );
         ADD_BOX_WRITER_TABLE_ELEMENT( ISOM_BOX_TYPE_CO64, isom_write_stco );
         ADD_BOX_WRITER_TABLE_ELEMENT( ISOM_BOX_TYPE_SGPD, isom_write_sgpd );
@@ -1584,11 +1720,15 @@ void isom_set_box_writer( isom_box_t *box )
         ADD_BOX_WRITER_TABLE_ELEMENT( ISOM_BOX_TYPE_MFRO, isom_write_mfro );
         ADD_BOX_WRITER_TABLE_ELEMENT( LSMASH_BOX_TYPE_UNSPECIFIED, NULL );
 #undef ADD_BOX_WRITER_TABLE_ELEMENT
+        box_writer_count = i - 1;
+        isom_create_fourcc_index( box_writer_index, box_writer_table, sizeof(struct box_writer_table_tag), box_writer_count );
     }
-    for( int i = 0; box_writer_table[i].writer_func; i++ )
-        if( lsmash_check_box_type_identical( box->type, box_writer_table[i].type ) )
+    for( uint32_t i = isom_search_fourcc_index( box_writer_index, box_writer_count, box->type.fourcc );
+         i < box_writer_count && box_writer_index[i].fourcc == box->type.fourcc;
+         i++ )
+        if( lsmash_check_box_type_identical( box->type, box_writer_table[ box_writer_index[i].number ].type ) )
         {
-            box->write = box_writer_table[i].writer_func;
+            box->write = box_writer_table[ box_writer_index[i].number ].writer_func;
             return;
         }
     if( lsmash_check_box_type_identical( parent->type, ISOM_BOX_TYPE_ILST )
@@ -25,5 +25,7 @@
 
 int isom_write_box( lsmash_bs_t *bs, isom_box_t *box );
 void isom_set_box_writer( isom_box_t *box );
+int64_t isom_compress_movie( lsmash_file_t *file, uint64_t min_size );
+int isom_write_movie( lsmash_bs_t *bs, lsmash_file_t *file );
 
 #endif
@@ -185,6 +185,7 @@ static int ac3_importer_get_accessunit( importer_t *importer, uint32_t track_num
         return LSMASH_ERR_MEMORY_ALLOC;
     *p_sample = sample;
     memcpy( sample->data, ac3_imp->buffer, frame_size );
+    sample->pos                    = ac3_imp->next_frame_pos;
     sample->length                 = frame_size;
     sample->dts                    = ac3_imp->au_number++ * summary->samples_in_frame;
     sample->cts                    = sample->dts;
@@ -287,7 +288,9 @@ const importer_functions ac3_importer =
     ac3_importer_probe,
     ac3_importer_get_accessunit,
     ac3_importer_get_last_delta,
-    ac3_importer_cleanup
+    ac3_importer_cleanup,
+    NULL,
+    lsmash_importer_index_accessunits
 };
 
 /***************************************************************************
@@ -307,6 +310,8 @@ typedef struct
     lsmash_multiple_buffers_t *au_buffers;
     uint8_t *au;
     uint8_t *incomplete_au;
+    uint64_t au_pos;
+    uint64_t incomplete_au_pos;
     uint32_t au_length;
     uint32_t incomplete_au_length;
     uint32_t au_number;
@@ -455,6 +460,7 @@ static int eac3_importer_get_next_accessunit_internal( importer_t *importer )
         if( au_completed )
         {
             memcpy( eac3_imp->au, eac3_imp->incomplete_au, eac3_imp->incomplete_au_length );
+            eac3_imp->au_pos                = eac3_imp->incomplete_au_pos;
             eac3_imp->au_length             = eac3_imp->incomplete_au_length;
             eac3_imp->incomplete_au_length  = 0;
             eac3_imp->syncframe_count_in_au = info->syncframe_count;
@@ -474,6 +480,8 @@ static int eac3_importer_get_next_accessunit_internal( importer_t *importer )
             eac3_imp->incomplete_au = lsmash_withdraw_buffer( eac3_imp->au_buffers, 2 );
         }
         /* Append syncframe data. */
+        if( eac3_imp->incomplete_au_length == 0 )
+            eac3_imp->incomplete_au_pos = eac3_imp->next_frame_pos;
         memcpy( eac3_imp->incomplete_au + eac3_imp->incomplete_au_length, eac3_imp->buffer, info->frame_size );
         eac3_imp->incomplete_au_length += info->frame_size;
         ++ info->syncframe_count;
@@ -515,6 +523,7 @@ static int eac3_importer_get_accessunit( importer_t *importer, uint32_t track_nu
         return LSMASH_ERR_MEMORY_ALLOC;
     *p_sample = sample;
     memcpy( sample->data, eac3_imp->au, eac3_imp->au_length );
+    sample->pos                    = eac3_imp->au_pos;
     sample->length                 = eac3_imp->au_length;
     sample->dts                    = eac3_imp->au_number++ * summary->samples_in_frame;
     sample->cts                    = sample->dts;
@@ -637,5 +646,7 @@ const importer_functions eac3_importer =
     eac3_importer_probe,
     eac3_importer_get_accessunit,
     eac3_importer_get_last_delta,
-    eac3_importer_cleanup
+    eac3_importer_cleanup,
+    NULL,
+    lsmash_importer_index_accessunits
 };
@@ -336,6 +336,7 @@ static int mp4sys_adts_get_accessunit
     if( !sample )
         return LSMASH_ERR_MEMORY_ALLOC;
     *p_sample = sample;
+    sample->pos = lsmash_bs_get_stream_pos( bs );
     if( lsmash_bs_get_bytes_ex( bs, raw_data_block_size, sample->data ) != raw_data_block_size )
     {
         importer->status = IMPORTER_ERROR;
@@ -520,5 +521,7 @@ const importer_functions mp4sys_adts_importer =
     mp4sys_adts_probe,
     mp4sys_adts_get_accessunit,
     mp4sys_adts_get_last_delta,
-    mp4sys_adts_cleanup
+    mp4sys_adts_cleanup,
+    NULL,
+    lsmash_importer_index_accessunits
 };
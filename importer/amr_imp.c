@@ -119,6 +119,7 @@ static int amr_get_accessunit
     if( !sample )
         return LSMASH_ERR_MEMORY_ALLOC;
     *p_sample = sample;
+    sample->pos = lsmash_bs_get_stream_pos( bs );
     if( lsmash_bs_get_bytes_ex( bs, read_size, sample->data ) != read_size )
     {
         lsmash_log( importer, LSMASH_LOG_WARNING, "the stream is truncated at the end.\n" );
@@ -284,5 +285,7 @@ const importer_functions amr_importer =
     amr_probe,
     amr_get_accessunit,
     amr_get_last_delta,
-    amr_cleanup
+    amr_cleanup,
+    NULL,
+    lsmash_importer_index_accessunits
 };
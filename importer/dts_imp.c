@@ -45,6 +45,8 @@ typedef struct
     uint32_t au_length;
     uint8_t *incomplete_au;
     uint32_t incomplete_au_length;
+    uint64_t au_pos;
+    uint64_t incomplete_au_pos;
     uint32_t au_number;
 } dts_importer_t;
 
@@ -177,6 +179,7 @@ static int dts_importer_get_next_accessunit_internal( importer_t *importer )
         if( au_completed )
         {
             memcpy( dts_imp->au, dts_imp->incomplete_au, dts_imp->incomplete_au_length );
+            dts_imp->au_pos               = dts_imp->incomplete_au_pos;
             dts_imp->au_length            = dts_imp->incomplete_au_length;
             dts_imp->incomplete_au_length = 0;
             info->exss_count = (info->substream_type == DTS_SUBSTREAM_TYPE_EXTENSION);
@@ -195,6 +198,8 @@ static int dts_importer_get_next_accessunit_internal( importer_t *importer )
             dts_imp->incomplete_au = lsmash_withdraw_buffer( dts_imp->au_buffers, 2 );
         }
         /* Append frame data. */
+        if( dts_imp->incomplete_au_length == 0 )
+            dts_imp->incomplete_au_pos = dts_imp->next_frame_pos;
         memcpy( dts_imp->incomplete_au + dts_imp->incomplete_au_length, dts_imp->buffer, info->frame_size );
         dts_imp->incomplete_au_length += info->frame_size;
     }
@@ -224,6 +229,7 @@ static int dts_importer_get_accessunit( importer_t *importer, uint32_t track_num
         return LSMASH_ERR_MEMORY_ALLOC;
     *p_sample = sample;
     memcpy( sample->data, dts_imp->au, dts_imp->au_length );
+    sample->pos                    = dts_imp->au_pos;
     sample->length                 = dts_imp->au_length;
     sample->dts                    = dts_imp->au_number++ * summary->samples_in_frame;
     sample->cts                    = sample->dts;
@@ -355,5 +361,7 @@ const importer_functions dts_importer =
     dts_importer_probe,
     dts_importer_get_accessunit,
     dts_importer_get_last_delta,
-    dts_importer_cleanup
+    dts_importer_cleanup,
+    NULL,
+    lsmash_importer_index_accessunits
 };
@@ -24,10 +24,13 @@
 #include "common/internal.h" /* must be placed first */
 
 #include <string.h>
+#include <inttypes.h>
 
 #define LSMASH_IMPORTER_INTERNAL
 #include "importer.h"
 
+#include "core/timeline.h"
+
 /***************************************************************************
     importer classes
 ***************************************************************************/
@@ -216,26 +219,65 @@ int lsmash_importer_get_access_unit( importer_t *importer, uint32_t track_number
     if( !importer->funcs.get_accessunit )
         return LSMASH_ERR_NAMELESS;
     *p_sample = NULL;
+    if( importer->indexed_track_ID )
+    {
+        /* The importer has left the first access unit for indexing, so get access units via the timeline. */
+        if( track_number != 1 )
+            return LSMASH_ERR_FUNCTION_PARAM;
+        if( importer->indexed_sample_number >= lsmash_get_sample_count_in_media_timeline( importer->root, importer->indexed_track_ID ) )
+            return IMPORTER_EOF;
+        *p_sample = lsmash_get_sample_from_media_timeline( importer->root, importer->indexed_track_ID, importer->indexed_sample_number + 1 );
+        if( !*p_sample )
+            return LSMASH_ERR_NAMELESS;
+        ++ importer->indexed_sample_number;
+        return IMPORTER_OK;
+    }
+    importer->started = 1;
     return importer->funcs.get_accessunit( importer, track_number, p_sample );
 }
 
 /* Return 0 if failed, otherwise succeeded. */
 uint32_t lsmash_importer_get_last_delta( importer_t *importer, uint32_t track_number )
 {
-    if( !importer || !importer->funcs.get_last_delta )
+    if( !importer )
+        return 0;
+    if( importer->indexed_track_ID )
+    {
+        uint32_t last_sample_delta;
+        if( track_number != 1
+         || importer->indexed_sample_number < lsmash_get_sample_count_in_media_timeline( importer->root, importer->indexed_track_ID )
+         || lsmash_get_last_sample_delta_from_media_timeline( importer->root, importer->indexed_track_ID, &last_sample_delta ) < 0 )
+            return 0;
+        return last_sample_delta;
+    }
+    if( !importer->funcs.get_last_delta )
         return 0;
     return importer->funcs.get_last_delta( importer, track_number );
 }
 
+int lsmash_importer_index_stream( importer_t *importer, uint32_t track_number, const char *index_name )
+{
+    if( !importer )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    if( !importer->funcs.index_stream )
+        return LSMASH_ERR_PATCH_WELCOME;
+    return importer->funcs.index_stream( importer, track_number, index_name );
+}
+
 int lsmash_importer_construct_timeline( importer_t *importer, uint32_t track_number )
 {
     if( !importer )
         return LSMASH_ERR_FUNCTION_PARAM;
     if( !importer->funcs.construct_timeline )
-        return LSMASH_ERR_PATCH_WELCOME;
+        return lsmash_importer_index_stream( importer, track_number, NULL );
     return importer->funcs.construct_timeline( importer, track_number );
 }
 
+int lsmash_importer_needs_timeline( importer_t *importer )
+{
+    return importer && importer->funcs.construct_timeline;
+}
+
 uint32_t lsmash_importer_get_track_count( importer_t *importer )
 {
     if( !importer || !importer->summaries )
@@ -322,3 +364,453 @@ void lsmash_importer_break_fake_movie( importer_t *importer )
         return;
     isom_remove_box_by_itself( importer->file->moov );
 }
+
+
+/* Probe the stream again to get back to the first access unit. */
+static int importer_rewind( importer_t *importer )
+{
+    if( importer->funcs.cleanup )
+        importer->funcs.cleanup( importer );
+    importer->info    = NULL;
+    importer->status  = IMPORTER_OK;
+    importer->started = 0;
+    lsmash_remove_entries( importer->summaries, lsmash_cleanup_summary );
+    if( lsmash_bs_read_seek( importer->bs, 0, SEEK_SET ) != 0 )
+        return LSMASH_ERR_NAMELESS;
+    lsmash_log_level log_level = importer->log_level;
+    importer->log_level = LSMASH_LOG_QUIET;
+    int err = importer->funcs.probe( importer );
+    importer->log_level = log_level;
+    return err;
+}
+
+/* Get the size of the stream without moving the read position of the bytestream. */
+static int64_t importer_get_stream_size( importer_t *importer )
+{
+    lsmash_bs_t *bs = importer->bs;
+    if( bs->unseekable || !bs->seek )
+        return LSMASH_ERR_NAMELESS;
+    int64_t size = bs->seek( bs->stream, 0, SEEK_END );
+    if( size < 0 || bs->seek( bs->stream, bs->offset, SEEK_SET ) != (int64_t)bs->offset )
+        return LSMASH_ERR_NAMELESS;
+    return size;
+}
+
+static uint32_t importer_get_timescale( importer_t *importer, uint32_t track_number )
+{
+    lsmash_summary_t *summary = (lsmash_summary_t *)lsmash_get_entry_data( importer->summaries, track_number );
+    if( summary && summary->summary_type == LSMASH_SUMMARY_TYPE_AUDIO )
+        return ((lsmash_audio_summary_t *)summary)->frequency;
+    else if( summary && summary->summary_type == LSMASH_SUMMARY_TYPE_VIDEO )
+        return ((lsmash_video_summary_t *)summary)->timescale;
+    return 0;
+}
+
+/* Make a fake movie so that the timeline is accessible via the track as well as an ISOBMFF/QTFF input. */
+static int importer_make_fake_track_from_summary( importer_t *importer, lsmash_summary_t *summary, uint32_t timescale, uint32_t *track_ID )
+{
+    lsmash_media_type media_type = summary->summary_type == LSMASH_SUMMARY_TYPE_VIDEO
+                                 ? ISOM_MEDIA_HANDLER_TYPE_VIDEO_TRACK
+                                 : ISOM_MEDIA_HANDLER_TYPE_AUDIO_TRACK;
+    lsmash_movie_parameters_t movie_param = { 0 };
+    int err;
+    if( (err = lsmash_importer_make_fake_movie( importer )) < 0
+     || (err = lsmash_importer_make_fake_track( importer, media_type, track_ID )) < 0
+     || (err = lsmash_get_movie_parameters( importer->root, &movie_param )) < 0 )
+        return err;
+    movie_param.timescale = timescale;
+    if( (err = lsmash_set_movie_parameters( importer->root, &movie_param )) < 0 )
+        return err;
+    /* lsmash_set_media_parameters() can't be used here since the fake movie has no brands to decide the language code. */
+    isom_trak_t *trak = isom_get_trak( importer->file, *track_ID );
+    trak->mdia->mdhd->timescale = timescale;
+    return lsmash_add_sample_entry( importer->root, *track_ID, summary ) == 1 ? 0 : LSMASH_ERR_NAMELESS;
+}
+
+/* Make the indexed access units accessible via the timeline, and get access units from it after this. */
+static int importer_complete_index
+(
+    importer_t      *importer,
+    uint32_t         track_number,
+    isom_timeline_t *timeline,
+    uint32_t         sample_count,
+    uint32_t         max_au_length,
+    uint64_t         duration,
+    int (*convert_sample)( lsmash_sample_t *sample )
+)
+{
+    lsmash_summary_t *summary   = (lsmash_summary_t *)lsmash_get_entry_data( importer->summaries, track_number );
+    uint32_t          timescale = importer_get_timescale( importer, track_number );
+    if( timescale == 0 )
+        return LSMASH_ERR_NAMELESS;
+    uint32_t track_ID;
+    int err;
+    if( (err = importer_make_fake_track_from_summary( importer, summary, timescale, &track_ID )) < 0
+     || (err = isom_timeline_set_track_ID( timeline, track_ID )) < 0
+     || (err = isom_timeline_set_movie_timescale( timeline, timescale )) < 0
+     || (err = isom_timeline_set_media_timescale( timeline, timescale )) < 0
+     || (err = isom_timeline_set_sample_count( timeline, sample_count )) < 0
+     || (err = isom_timeline_set_max_sample_size( timeline, max_au_length )) < 0
+     || (err = isom_timeline_set_media_duration( timeline, duration )) < 0
+     || (err = isom_timeline_set_track_duration( timeline, duration )) < 0 )
+        return err;
+    isom_timeline_set_sample_getter_funcs( timeline );
+    isom_timeline_set_sample_converter( timeline, convert_sample );
+    if( (err = lsmash_add_entry( importer->file->timeline, timeline )) < 0 )
+        return err;
+    importer->indexed_track_ID      = track_ID;
+    importer->indexed_sample_number = 0;
+    return 0;
+}
+
+/* The index file consists of the header and the records of access units in decoding order.
+ * All fields are stored in big-endian. */
+#define IMPORTER_INDEX_TYPE            LSMASH_4CC( 'l', 's', 'i', 'x' )
+#define IMPORTER_INDEX_VERSION         1
+#define IMPORTER_INDEX_HEADER_SIZE     36
+#define IMPORTER_INDEX_RECORD_SIZE     47
+
+static lsmash_bs_t *importer_open_index( const char *index_name, const char *mode )
+{
+    FILE *fp = lsmash_fopen( index_name, mode );
+    if( !fp )
+        return NULL;
+    lsmash_bs_t *bs = lsmash_bs_create();
+    if( !bs )
+    {
+        fclose( fp );
+        return NULL;
+    }
+    bs->stream = fp;
+    bs->read   = lsmash_fread_wrapper;
+    bs->write  = lsmash_fwrite_wrapper;
+    return bs;
+}
+
+static int importer_close_index( lsmash_bs_t *bs )
+{
+    int err = fclose( (FILE *)bs->stream ) != 0 || bs->error ? LSMASH_ERR_NAMELESS : 0;
+    lsmash_bs_cleanup( bs );
+    return err;
+}
+
+/* Load the index saved by importer_save_index() if it describes the stream. */
+static int importer_load_index
+(
+    importer_t *importer,
+    uint32_t    track_number,
+    const char *index_name,
+    int (*convert_sample)( lsmash_sample_t *sample )
+)
+{
+    int64_t stream_size = importer_get_stream_size( importer );
+    if( stream_size < 0 )
+        return (int)stream_size;
+    lsmash_bs_t *bs = importer_open_index( index_name, "rb" );
+    if( !bs )
+        return LSMASH_ERR_NAMELESS;
+    isom_timeline_t *timeline = NULL;
+    int err = LSMASH_ERR_INVALID_DATA;
+    if( lsmash_bs_read( bs, IMPORTER_INDEX_HEADER_SIZE ) < 0
+     || lsmash_bs_get_remaining_buffer_size( bs ) < IMPORTER_INDEX_HEADER_SIZE )
+        goto fail;
+    uint32_t type          = lsmash_bs_get_be32( bs );
+    uint32_t version       = lsmash_bs_get_be32( bs );
+    uint64_t size          = lsmash_bs_get_be64( bs );
+    uint32_t timescale     = lsmash_bs_get_be32( bs );
+    uint32_t sample_count  = lsmash_bs_get_be32( bs );
+    uint32_t max_au_length = lsmash_bs_get_be32( bs );
+    uint32_t last_duration = lsmash_bs_get_be32( bs );
+    uint32_t converted     = lsmash_bs_get_be32( bs );
+    if( type          != IMPORTER_INDEX_TYPE
+     || version       != IMPORTER_INDEX_VERSION
+     || size          != (uint64_t)stream_size
+     || timescale     != importer_get_timescale( importer, track_number )
+     || converted     != !!convert_sample
+     || sample_count  == 0
+     || last_duration == 0 )
+        goto fail;
+    if( !importer->file->timeline )
+    {
+        importer->file->timeline = lsmash_create_entry_list();
+        if( !importer->file->timeline )
+        {
+            err = LSMASH_ERR_MEMORY_ALLOC;
+            goto fail;
+        }
+    }
+    timeline = isom_timeline_create();
+    if( !timeline )
+    {
+        err = LSMASH_ERR_NAMELESS;
+        goto fail;
+    }
+    /* The duration of each access unit is the difference of DTSs except for the last one. */
+    lsmash_sample_t sample = { 0 };
+    lsmash_sample_t prev_sample;
+    uint64_t        duration = 0;
+    for( uint32_t i = 0; i < sample_count; i++ )
+    {
+        if( lsmash_bs_read( bs, IMPORTER_INDEX_RECORD_SIZE ) < 0
+         || lsmash_bs_get_remaining_buffer_size( bs ) < IMPORTER_INDEX_RECORD_SIZE )
+            goto fail;
+        prev_sample = sample;
+        sample.pos                       = lsmash_bs_get_be64( bs );
+        sample.length                    = lsmash_bs_get_be32( bs );
+        sample.dts                       = lsmash_bs_get_be64( bs );
+        sample.cts                       = lsmash_bs_get_be64( bs );
+        sample.index                     = 1;
+        sample.prop.ra_flags             = lsmash_bs_get_be16( bs );
+        sample.prop.post_roll.identifier = lsmash_bs_get_be32( bs );
+        sample.prop.post_roll.complete   = lsmash_bs_get_be32( bs );
+        sample.prop.pre_roll.distance    = lsmash_bs_get_be32( bs );
+        sample.prop.allow_earlier        = lsmash_bs_get_byte( bs );
+        sample.prop.leading              = lsmash_bs_get_byte( bs );
+        sample.prop.independent          = lsmash_bs_get_byte( bs );
+        sample.prop.disposable           = lsmash_bs_get_byte( bs );
+        sample.prop.redundant            = lsmash_bs_get_byte( bs );
+        if( (uint64_t)sample.pos + sample.length > (uint64_t)stream_size
+         || (i && (sample.dts <= prev_sample.dts || sample.dts - prev_sample.dts > UINT32_MAX)) )
+            goto fail;
+        if( i && (err = isom_add_stream_sample_entry( timeline, importer->file, &prev_sample, sample.dts - prev_sample.dts )) < 0 )
+            goto fail;
+        err = LSMASH_ERR_INVALID_DATA;
+    }
+    if( (err = isom_add_stream_sample_entry( timeline, importer->file, &sample, last_duration )) < 0 )
+        goto fail;
+    duration = sample.dts + last_duration;
+    if( (err = importer_complete_index( importer, track_number, timeline, sample_count, max_au_length, duration, convert_sample )) < 0 )
+        goto fail;
+    importer_close_index( bs );
+    return 0;
+fail:
+    isom_timeline_destroy( timeline );
+    lsmash_importer_break_fake_movie( importer );
+    importer_close_index( bs );
+    return err;
+}
+
+/* Save the index of the timeline into the file so that importer_load_index() can load it. */
+static int importer_save_index
+(
+    importer_t *importer,
+    uint32_t    track_number,
+    const char *index_name,
+    int (*convert_sample)( lsmash_sample_t *sample )
+)
+{
+    lsmash_root_t *root     = importer->root;
+    uint32_t       track_ID = importer->indexed_track_ID;
+    uint32_t       sample_count = lsmash_get_sample_count_in_media_timeline( root, track_ID );
+    uint32_t       last_duration;
+    int64_t        stream_size  = importer_get_stream_size( importer );
+    int err;
+    if( stream_size < 0 )
+        return (int)stream_size;
+    if( (err = lsmash_get_last_sample_delta_from_media_timeline( root, track_ID, &last_duration )) < 0 )
+        return err;
+    lsmash_bs_t *bs = importer_open_index( index_name, "wb" );
+    if( !bs )
+        return LSMASH_ERR_NAMELESS;
+    lsmash_bs_put_be32( bs, IMPORTER_INDEX_TYPE );
+    lsmash_bs_put_be32( bs, IMPORTER_INDEX_VERSION );
+    lsmash_bs_put_be64( bs, stream_size );
+    lsmash_bs_put_be32( bs, importer_get_timescale( importer, track_number ) );
+    lsmash_bs_put_be32( bs, sample_count );
+    lsmash_bs_put_be32( bs, lsmash_get_max_sample_size_in_media_timeline( root, track_ID ) );
+    lsmash_bs_put_be32( bs, last_duration );
+    lsmash_bs_put_be32( bs, !!convert_sample );
+    for( uint32_t i = 1; i <= sample_count; i++ )
+    {
+        lsmash_sample_t sample;
+        if( (err = lsmash_get_sample_info_from_media_timeline( root, track_ID, i, &sample )) < 0 )
+            break;
+        lsmash_bs_put_be64( bs, sample.pos );
+        lsmash_bs_put_be32( bs, sample.length );
+        lsmash_bs_put_be64( bs, sample.dts );
+        lsmash_bs_put_be64( bs, sample.cts );
+        lsmash_bs_put_be16( bs, sample.prop.ra_flags );
+        lsmash_bs_put_be32( bs, sample.prop.post_roll.identifier );
+        lsmash_bs_put_be32( bs, sample.prop.post_roll.complete );
+        lsmash_bs_put_be32( bs, sample.prop.pre_roll.distance );
+        lsmash_bs_put_byte( bs, sample.prop.allow_earlier );
+        lsmash_bs_put_byte( bs, sample.prop.leading );
+        lsmash_bs_put_byte( bs, sample.prop.independent );
+        lsmash_bs_put_byte( bs, sample.prop.disposable );
+        lsmash_bs_put_byte( bs, sample.prop.redundant );
+        if( (err = lsmash_bs_flush_buffer( bs )) < 0 )
+            break;
+    }
+    if( err == 0 )
+        err = lsmash_bs_flush_buffer( bs );
+    int close_err = importer_close_index( bs );
+    if( err == 0 )
+        err = close_err;
+    if( err < 0 )
+        remove( index_name );   /* Never leave a broken index. */
+    return err;
+}
+
+/* Index access units by reading the stream from the position where the probe left off. */
+static int importer_scan_stream
+(
+    importer_t *importer,
+    uint32_t    track_number,
+    int      (*convert_sample)( lsmash_sample_t *sample ),
+    uint64_t (*get_span_end)( importer_t *importer )
+)
+{
+    lsmash_file_t *file = importer->file;
+    isom_timeline_t *timeline = isom_timeline_create();
+    if( !timeline )
+        return LSMASH_ERR_NAMELESS;
+    /* If the data of access units is converted by the importer, each access unit spans in the stream
+     * up to the next one since the importer gets the data of access units contiguously from the stream.
+     * The maximum sample size covers both the spans and the converted data. */
+    lsmash_sample_t *prev_sample   = NULL;
+    uint32_t         prev_duration = 0;
+    uint32_t         sample_count  = 0;
+    uint32_t         max_au_length = 0;
+    uint64_t         duration      = 0;
+    uint64_t         span_end      = 0;
+    int              truncated     = 0;
+    int err = 0;
+    if( importer->started && (err = importer_rewind( importer )) < 0 )
+        goto fail;
+    importer->started = 1;
+    while( 1 )
+    {
+        lsmash_sample_t *sample = NULL;
+        int ret = importer->funcs.get_accessunit( importer, track_number, &sample );
+        if( ret == IMPORTER_EOF || (ret < 0 && sample_count) )
+        {
+            /* Index access units until the stream is truncated as the importer outputs them. */
+            lsmash_delete_sample( sample );
+            if( ret < 0 && convert_sample )
+                span_end = get_span_end( importer );
+            truncated = (ret < 0);
+            break;
+        }
+        if( ret < 0 || (ret == IMPORTER_CHANGE && sample_count) )
+        {
+            /* Any change of the stream properties requires another sample description, which is not supported yet. */
+            lsmash_delete_sample( sample );
+            lsmash_delete_sample( prev_sample );
+            err = ret < 0 ? ret : LSMASH_ERR_PATCH_WELCOME;
+            goto fail;
+        }
+        sample->index = 1;
+        max_au_length = LSMASH_MAX( max_au_length, sample->length );
+        if( prev_sample )
+        {
+            if( convert_sample )
+            {
+                prev_sample->length = sample->pos - prev_sample->pos;
+                max_au_length       = LSMASH_MAX( max_au_length, prev_sample->length );
+            }
+            prev_duration = sample->dts - prev_sample->dts;
+            duration     += prev_duration;
+            err = isom_add_stream_sample_entry( timeline, file, prev_sample, prev_duration );
+            lsmash_delete_sample( prev_sample );
+            if( err < 0 )
+            {
+                lsmash_delete_sample( sample );
+                goto fail;
+            }
+        }
+        prev_sample = sample;
+        ++sample_count;
+    }
+    if( !prev_sample )
+    {
+        err = LSMASH_ERR_INVALID_DATA;
+        goto fail;
+    }
+    if( convert_sample )
+    {
+        /* The last access unit spans up to the end of the stream unless the stream is broken after it. */
+        if( !truncated )
+        {
+            int64_t stream_size = importer_get_stream_size( importer );
+            span_end = stream_size < 0 ? 0 : stream_size;
+        }
+        if( span_end <= prev_sample->pos )
+        {
+            lsmash_delete_sample( prev_sample );
+            err = LSMASH_ERR_NAMELESS;
+            goto fail;
+        }
+        prev_sample->length = span_end - prev_sample->pos;
+        max_au_length       = LSMASH_MAX( max_au_length, prev_sample->length );
+    }
+    uint32_t last_duration = truncated ? 0 : importer->funcs.get_last_delta( importer, track_number );
+    if( last_duration == 0 || last_duration == UINT32_MAX )
+        last_duration = prev_duration;
+    err = last_duration ? isom_add_stream_sample_entry( timeline, file, prev_sample, last_duration ) : LSMASH_ERR_INVALID_DATA;
+    lsmash_delete_sample( prev_sample );
+    if( err < 0 )
+        goto fail;
+    duration += last_duration;
+    if( truncated )
+        lsmash_log( importer, LSMASH_LOG_WARNING, "the stream is indexed up to the access unit %"PRIu32" since the rest is broken.\n", sample_count );
+    if( (err = importer_complete_index( importer, track_number, timeline, sample_count, max_au_length, duration, convert_sample )) < 0 )
+        goto fail;
+    return 0;
+fail:
+    isom_timeline_destroy( timeline );
+    lsmash_importer_break_fake_movie( importer );
+    /* Leave the importer at the first access unit as far as possible. */
+    (void)importer_rewind( importer );
+    return err;
+}
+
+static int importer_index
+(
+    importer_t *importer,
+    uint32_t    track_number,
+    const char *index_name,
+    int      (*convert_sample)( lsmash_sample_t *sample ),
+    uint64_t (*get_span_end)( importer_t *importer )
+)
+{
+    if( track_number != 1 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    if( importer->is_stdin )
+        return LSMASH_ERR_PATCH_WELCOME;    /* The timeline can't read access units at random. */
+    if( importer->indexed_track_ID )
+        return 0;   /* already indexed */
+    lsmash_file_t *file = importer->file;
+    if( !file->timeline )
+    {
+        file->timeline = lsmash_create_entry_list();
+        if( !file->timeline )
+            return LSMASH_ERR_MEMORY_ALLOC;
+    }
+    if( index_name && importer_load_index( importer, track_number, index_name, convert_sample ) == 0 )
+        return 0;
+    int err = importer_scan_stream( importer, track_number, convert_sample, get_span_end );
+    if( err < 0 )
+        return err;
+    if( index_name && importer_save_index( importer, track_number, index_name, convert_sample ) < 0 )
+        lsmash_log( importer, LSMASH_LOG_WARNING, "failed to save the index into %s.\n", index_name );
+    return 0;
+}
+
+int lsmash_importer_index_accessunits( importer_t *importer, uint32_t track_number, const char *index_name )
+{
+    return importer_index( importer, track_number, index_name, NULL, NULL );
+}
+
+int lsmash_importer_index_converted_accessunits
+(
+    importer_t *importer,
+    uint32_t    track_number,
+    const char *index_name,
+    int      (*convert_sample)( lsmash_sample_t *sample ),
+    uint64_t (*get_span_end)( importer_t *importer )
+)
+{
+    if( !convert_sample || !get_span_end )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    return importer_index( importer, track_number, index_name, convert_sample, get_span_end );
+}
@@ -39,6 +39,7 @@ typedef int      ( *importer_get_accessunit )    ( importer_t *, uint32_t, lsmas
 typedef int      ( *importer_probe )             ( importer_t * );
 typedef uint32_t ( *importer_get_last_duration ) ( importer_t *, uint32_t );
 typedef int      ( *importer_construct_timeline )( importer_t *, uint32_t );
+typedef int      ( *importer_index_stream )      ( importer_t *, uint32_t, const char * );
 
 typedef enum
 {
@@ -57,6 +58,7 @@ typedef struct
     importer_get_last_duration  get_last_delta;
     importer_cleanup            cleanup;
     importer_construct_timeline construct_timeline;
+    importer_index_stream       index_stream;
 } importer_functions;
 
 struct importer_tag
@@ -69,6 +71,9 @@ struct importer_tag
     lsmash_bs_t            *bs;
     lsmash_file_parameters_t file_param;
     int                     is_stdin;
+    int                     started;                /* If set to 1, any access unit has been got after the probe. */
+    uint32_t                indexed_track_ID;       /* If nonzero, access units are got from the timeline of this track. */
+    uint32_t                indexed_sample_number;  /* the number of access units got from the timeline */
     void                   *info;      /* importer internal status information. */
     importer_functions      funcs;
     lsmash_entry_list_t    *summaries;
@@ -91,6 +96,37 @@ void lsmash_importer_break_fake_movie
     importer_t *importer
 );
 
+/* Index a stream which consists of access units stored as they are, and construct its timeline.
+ * This function reads the stream through the get_accessunit function of the importer from the first access unit
+ * the probe found, which shall set the position of each access unit in the stream into sample->pos.
+ * Access units are indexed until the end of the stream or the last one the importer gets successfully.
+ * The importer doesn't probe the stream again after this; lsmash_importer_get_access_unit() gets access units
+ * from the timeline instead.
+ * If 'index_name' is not NULL, the index is loaded from the file of the name if it describes the stream,
+ * otherwise the index is saved into it after indexing. */
+int lsmash_importer_index_accessunits
+(
+    importer_t *importer,
+    uint32_t    track_number,
+    const char *index_name
+);
+
+/* Same as lsmash_importer_index_accessunits() except that the data of access units is converted by the importer,
+ * e.g. start codes are replaced with lengths.
+ * The importer shall get every access unit contiguously from the stream, and each access unit is indexed
+ * as the range from its position up to the position of the next one, which 'convert_sample' converts
+ * into the data the importer outputs when the timeline gets the access unit.
+ * 'get_span_end' shall return the position in the stream where the access units got so far end,
+ * which is used for the last access unit when the importer fails in the middle of the stream. */
+int lsmash_importer_index_converted_accessunits
+(
+    importer_t *importer,
+    uint32_t    track_number,
+    const char *index_name,
+    int      (*convert_sample)( lsmash_sample_t *sample ),
+    uint64_t (*get_span_end)( importer_t *importer )
+);
+
 #else
 
 int lsmash_importer_set_file
@@ -138,12 +174,42 @@ uint32_t lsmash_importer_get_last_delta
     uint32_t    track_number
 );
 
+/* Construct the media timeline of the track of 'track_number' in the root of the importer.
+ * For an elementary stream, this is the same as lsmash_importer_index_stream() without any index file.
+ *
+ * Return 0 if successful.
+ * Return a negative value otherwise. */
 int lsmash_importer_construct_timeline
 (
     importer_t *importer,
     uint32_t    track_number
 );
 
+/* Return 1 if the importer gets access units via the timeline, i.e. lsmash_importer_construct_timeline() shall be called
+ * before lsmash_importer_get_access_unit().
+ * Return 0 otherwise, i.e. for an elementary stream, which lsmash_importer_get_access_unit() reads sequentially. */
+int lsmash_importer_needs_timeline
+(
+    importer_t *importer
+);
+
+/* Index the position, size, timestamps and random access flags of every access unit in an elementary stream,
+ * and make them accessible via the media timeline of the track of 'track_number' in the root of the importer.
+ * This reads the whole stream, so call this only if you need random access to the stream.
+ * Any access unit gotten by lsmash_importer_get_access_unit() after this is read via the timeline.
+ * If 'index_name' is not NULL, the index is loaded from the file of the name if it describes the stream,
+ * otherwise the index is saved into it.
+ *
+ * Return 0 if successful.
+ * Return LSMASH_ERR_PATCH_WELCOME if the stream can't be indexed by the importer.
+ * Return a negative value otherwise. */
+int lsmash_importer_index_stream
+(
+    importer_t *importer,
+    uint32_t    track_number,
+    const char *index_name
+);
+
 uint32_t lsmash_importer_get_track_count
 (
     importer_t *importer
@@ -318,6 +318,7 @@ static int mp4sys_mp3_get_accessunit( importer_t *importer, uint32_t track_numbe
     uint8_t *frame_data = sample->data;
     memcpy( frame_data, mp3_imp->raw_header, MP4SYS_MP3_HEADER_LENGTH );
     frame_size -= MP4SYS_MP3_HEADER_LENGTH;
+    sample->pos = lsmash_bs_get_stream_pos( importer->bs ) - MP4SYS_MP3_HEADER_LENGTH;
     if( lsmash_bs_get_bytes_ex( importer->bs, frame_size, frame_data + MP4SYS_MP3_HEADER_LENGTH ) != frame_size )
     {
         importer->status = IMPORTER_ERROR;
@@ -508,5 +509,7 @@ const importer_functions mp4sys_mp3_importer =
     mp4sys_mp3_probe,
     mp4sys_mp3_get_accessunit,
     mp4sys_mp3_get_last_delta,
-    mp4sys_mp3_cleanup
+    mp4sys_mp3_cleanup,
+    NULL,
+    lsmash_importer_index_accessunits
 };
@@ -37,19 +37,322 @@
 #include "codecs/h264.h"
 #include "codecs/nalu.h"
 
+/* Streaming timestamp generator
+ * If the stream declares the upper bound of the number of pictures which precede any picture in decoding order
+ * and follow it in output order, the output order of each picture is determined after decoding at most the bound
+ * of pictures following it, just like the 'bumping' process of the decoded picture buffer. Therefore, timestamps
+ * can be generated while reading the stream, and we need not analyze the whole stream beforehand.
+ * Under the assumption of constant frame rate, DTS and CTS are derived from decoding order and output order:
+ *   DTS = decoding_order * delta
+ *   CTS = (output_order + num_reorder_frames) * delta
+ * The whole-stream analysis delays CTS by the maximum reordering which actually appears in the stream instead.
+ * Both are identical if the reordering reaches the bound, so the importer makes sure of it by reading ahead
+ * the first pictures, and analyzes the whole stream otherwise.
+ * Getting access units sequentially reads the stream only once in the former case. Note that indexing the stream
+ * by lsmash_importer_index_stream() reads it through as well, so the timeline is needed only for random access. */
+#define NALU_MAX_PICTURES_TO_EXAMINE 64
+typedef struct
+{
+    lsmash_sample_t        *sample;
+    lsmash_video_summary_t *summary;    /* the summary activated from this picture if any */
+    int64_t                 poc;
+    uint8_t                 undecodable;
+    uint8_t                 output;     /* CTS has been determined. */
+} nal_reorder_picture_t;
+
+typedef struct
+{
+    lsmash_entry_list_t pictures[1];    /* nal_reorder_picture_t in decoding order */
+    uint64_t next_dts;
+    uint64_t num_output;
+    uint64_t last_intra_cts;
+    int64_t  last_output_poc;
+    uint32_t num_reorder_frames;
+    uint32_t num_waiting;               /* the number of pictures whose CTS has not been determined yet */
+    uint32_t max_composition_delay;     /* the maximum number of pictures which precede any picture in decoding order
+                                         * and follow it in output order among the pictures output so far */
+    uint32_t delta;
+    uint8_t  output_present;            /* Any picture of the current coded video sequence has been output. */
+    uint8_t  poc_zero_present;
+} nal_reorder_buffer_t;
+
+static void nalu_remove_reorder_picture( nal_reorder_picture_t *picture )
+{
+    if( !picture )
+        return;
+    lsmash_delete_sample( picture->sample );
+    lsmash_cleanup_summary( (lsmash_summary_t *)picture->summary );
+    lsmash_free( picture );
+}
+
+static void nalu_setup_reorder_buffer
+(
+    nal_reorder_buffer_t *rb,
+    uint32_t              num_reorder_frames,
+    uint32_t             *timescale
+)
+{
+    /* Every picture is a frame, that is, its duration is 2 in field level. */
+    uint64_t gcd_delta = *timescale;
+    uint32_t delta     = 2;
+    if( gcd_delta > 1 )
+        gcd_delta = lsmash_get_gcd( gcd_delta, delta );
+    if( gcd_delta > 1 )
+    {
+        delta      /= gcd_delta;
+        *timescale /= gcd_delta;
+    }
+    lsmash_init_entry_list( rb->pictures );
+    rb->num_reorder_frames = num_reorder_frames;
+    rb->delta              = delta;
+}
+
+static void nalu_cleanup_reorder_buffer
+(
+    nal_reorder_buffer_t *rb
+)
+{
+    lsmash_remove_entries( rb->pictures, nalu_remove_reorder_picture );
+}
+
+static void nalu_output_picture
+(
+    nal_reorder_buffer_t *rb
+)
+{
+    /* Output the picture with the smallest POC among pictures waiting for output. */
+    nal_reorder_picture_t *output = NULL;
+    for( lsmash_entry_t *entry = rb->pictures->head; entry; entry = entry->next )
+    {
+        nal_reorder_picture_t *picture = (nal_reorder_picture_t *)entry->data;
+        if( !picture->output && (!output || picture->poc < output->poc) )
+            output = picture;
+    }
+    if( !output )
+        return;
+    uint64_t decoding_order = output->sample->dts / rb->delta;
+    if( decoding_order > rb->num_output )
+        rb->max_composition_delay = LSMASH_MAX( rb->max_composition_delay, decoding_order - rb->num_output );
+    output->sample->cts = (rb->num_output + rb->num_reorder_frames) * rb->delta;
+    output->output      = 1;
+    rb->last_output_poc = output->poc;
+    rb->output_present  = 1;
+    rb->num_output     += 1;
+    rb->num_waiting    -= 1;
+}
+
+static void nalu_flush_reorder_buffer
+(
+    nal_reorder_buffer_t *rb
+)
+{
+    while( rb->num_waiting )
+        nalu_output_picture( rb );
+}
+
+static int nalu_reorder_picture
+(
+    nal_reorder_buffer_t   *rb,
+    lsmash_sample_t        *sample,
+    lsmash_video_summary_t *summary,
+    int64_t                 poc,
+    int                     reset
+)
+{
+    if( poc == 0 || reset )
+    {
+        /* Encountered a new coded video sequence.
+         * All pictures of the previous coded video sequence precede this picture in output order. */
+        nalu_flush_reorder_buffer( rb );
+        rb->output_present   = 0;
+        rb->poc_zero_present = 1;
+        poc = 0;
+    }
+    else if( rb->output_present && poc <= rb->last_output_poc )
+        /* This picture should have been output before the picture already output.
+         * The stream violates the declared bound of reordering. */
+        return LSMASH_ERR_INVALID_DATA;
+    nal_reorder_picture_t *picture = lsmash_malloc( sizeof(nal_reorder_picture_t) );
+    if( !picture )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    if( lsmash_add_entry( rb->pictures, picture ) < 0 )
+    {
+        lsmash_free( picture );
+        return LSMASH_ERR_MEMORY_ALLOC;
+    }
+    sample->dts          = rb->next_dts;
+    picture->sample      = sample;
+    picture->summary     = summary;
+    picture->poc         = poc;
+    picture->undecodable = !rb->poc_zero_present;
+    picture->output      = 0;
+    rb->next_dts    += rb->delta;
+    rb->num_waiting += 1;
+    if( rb->num_waiting > rb->num_reorder_frames )
+        nalu_output_picture( rb );
+    return 0;
+}
+
+static lsmash_sample_t *nalu_get_reordered_sample
+(
+    nal_reorder_buffer_t    *rb,
+    lsmash_video_summary_t **summary
+)
+{
+    lsmash_entry_t *entry = rb->pictures->head;
+    if( !entry )
+        return NULL;
+    nal_reorder_picture_t *picture = (nal_reorder_picture_t *)entry->data;
+    if( !picture->output )
+        return NULL;
+    lsmash_sample_t *sample = picture->sample;
+    int independent = (sample->prop.independent == ISOM_SAMPLE_IS_INDEPENDENT);
+    if( sample->prop.leading == ISOM_SAMPLE_LEADING_UNKNOWN )
+    {
+        if( picture->undecodable )
+            sample->prop.leading = ISOM_SAMPLE_IS_UNDECODABLE_LEADING;
+        else
+            sample->prop.leading = independent || sample->cts >= rb->last_intra_cts
+                                 ? ISOM_SAMPLE_IS_NOT_LEADING : ISOM_SAMPLE_IS_UNDECODABLE_LEADING;
+    }
+    if( independent )
+        rb->last_intra_cts = sample->cts;
+    *summary = picture->summary;
+    picture->sample  = NULL;
+    picture->summary = NULL;
+    lsmash_remove_entry_direct( rb->pictures, entry, nalu_remove_reorder_picture );
+    return sample;
+}
+
+/* Get the number of pictures taken out of the reorder buffer. */
+static inline uint64_t nalu_count_reordered_samples
+(
+    nal_reorder_buffer_t *rb
+)
+{
+    return rb->next_dts / rb->delta - rb->pictures->entry_count;
+}
+
+/* Put a picture read ahead into the reorder buffer only to examine the reordering. */
+static int nalu_examine_reordering
+(
+    nal_reorder_buffer_t *rb,
+    int64_t               poc,
+    int                   reset
+)
+{
+    lsmash_sample_t *sample = lsmash_create_sample( 0 );
+    if( !sample )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    int err = nalu_reorder_picture( rb, sample, NULL, poc, reset );
+    if( err < 0 )
+    {
+        lsmash_delete_sample( sample );
+        return err;
+    }
+    lsmash_video_summary_t *summary;
+    while( (sample = nalu_get_reordered_sample( rb, &summary )) )
+        lsmash_delete_sample( sample );
+    return 0;
+}
+
+/* Convert the data of NALUs in the byte stream format into the one of NALUs prefixed with their lengths.
+ * NALUs which the importer doesn't store into samples, such as parameter sets, are dropped.
+ * If 'dst' is NULL, just return the length of the converted data. */
+static uint32_t nalu_convert_byte_stream
+(
+    uint8_t *dst,
+    uint8_t *src,
+    uint8_t *src_end,
+    int    (*is_stored)( uint8_t *nalu, uint32_t nalu_length )
+)
+{
+    uint32_t length = 0;
+    uint8_t *sc     = nalu_search_three_byte_code( src, src_end, 0x01 );
+    while( sc < src_end )
+    {
+        uint8_t *nalu     = sc + NALU_SHORT_START_CODE_LENGTH;
+        uint8_t *nalu_end = nalu_search_three_byte_code( nalu, src_end, 0x01 );
+        sc = nalu_end;
+        /* Any NALU has no consecutive zero bytes at the end. */
+        while( nalu_end > nalu && nalu_end[-1] == 0x00 )
+            --nalu_end;
+        uint32_t nalu_length = nalu_end - nalu;
+        if( nalu_length == 0 || !is_stored( nalu, nalu_length ) )
+            continue;
+        if( dst )
+        {
+            for( int i = NALU_DEFAULT_NALU_LENGTH_SIZE; i; i-- )
+                *dst++ = (nalu_length >> ((i - 1) * 8)) & 0xff;
+            memcpy( dst, nalu, nalu_length );
+            dst += nalu_length;
+        }
+        length += NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
+    }
+    return length;
+}
+
+/* Convert the data of an AU read from the stream into the one the importer outputs. */
+static int nalu_convert_sample
+(
+    lsmash_sample_t *sample,
+    int            (*is_stored)( uint8_t *nalu, uint32_t nalu_length )
+)
+{
+    uint8_t *src     = sample->data;
+    uint8_t *src_end = sample->data + sample->length;
+    uint32_t length  = nalu_convert_byte_stream( NULL, src, src_end, is_stored );
+    if( length == 0 )
+        return LSMASH_ERR_INVALID_DATA;
+    uint8_t *data = lsmash_malloc( length );
+    if( !data )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    nalu_convert_byte_stream( data, src, src_end, is_stored );
+    lsmash_free( sample->data );
+    sample->data   = data;
+    sample->length = length;
+    return 0;
+}
+
+/* Get the position in the stream where the AUs got so far end.
+ * The AUs read ahead into the reorder buffer follow them if any, otherwise the AU being assembled does. */
+static uint64_t nalu_get_span_end
+(
+    nal_reorder_buffer_t *rb,
+    int                   single_pass,
+    uint64_t              incomplete_au_head_pos
+)
+{
+    if( single_pass && rb->pictures->head )
+    {
+        nal_reorder_picture_t *picture = (nal_reorder_picture_t *)rb->pictures->head->data;
+        if( picture && picture->sample )
+            return picture->sample->pos;
+    }
+    return incomplete_au_head_pos;
+}
+
 typedef struct
 {
     h264_info_t            info;
     lsmash_entry_list_t    avcC_list[1];    /* stored as lsmash_codec_specific_t */
     lsmash_media_ts_list_t ts_list;
+    nal_reorder_buffer_t   reorder;         /* for single-pass import */
     uint32_t max_au_length;
     uint32_t num_undecodable;
     uint32_t avcC_number;
     uint32_t last_delta;
+    uint32_t ps_count;
     uint64_t last_intra_cts;
+    uint64_t first_sc_head_pos;
     uint64_t sc_head_pos;
+    uint64_t au_head_pos;               /* the position of the first start code of the latest AU */
+    uint64_t incomplete_au_head_pos;    /* the position of the first start code of the AU being assembled */
     uint8_t  composition_reordering_present;
     uint8_t  field_pic_present;
+    uint8_t  single_pass;
+    uint8_t  avcC_changed;
+    uint8_t  end_of_input;
 } h264_importer_t;
 
 typedef struct
@@ -65,6 +368,7 @@ static void remove_h264_importer( h264_importer_t *h264_imp )
     if( !h264_imp )
         return;
     lsmash_remove_entries( h264_imp->avcC_list, lsmash_destroy_codec_specific_data );
+    nalu_cleanup_reorder_buffer( &h264_imp->reorder );
     h264_cleanup_parser( &h264_imp->info );
     lsmash_free( h264_imp->ts_list.timestamp );
     lsmash_free( h264_imp );
@@ -95,17 +399,44 @@ static inline int h264_complete_au( h264_access_unit_t *au, int probe )
     if( !au->picture.has_primary || au->incomplete_length == 0 )
         return 0;
     if( !probe )
-        memcpy( au->data, au->incomplete_data, au->incomplete_length );
+    {
+        /* Hand over the assembled AU as it is, and assemble the next one in another buffer. */
+        lsmash_free( au->data );
+        au->data            = au->incomplete_data;
+        au->incomplete_data = NULL;
+    }
     au->length              = au->incomplete_length;
     au->incomplete_length   = 0;
     au->picture.has_primary = 0;
     return 1;
 }
 
-static void h264_append_nalu_to_au( h264_access_unit_t *au, uint8_t *src_nalu, uint32_t nalu_length, int probe )
+/* Complete the AU as h264_complete_au() does, and take over the position of its first start code in the stream.
+ * The next AU begins with the start code at 'next_au_head_pos'. */
+static int h264_complete_au_in_stream( h264_importer_t *h264_imp, int probe, uint64_t next_au_head_pos )
+{
+    if( !h264_complete_au( &h264_imp->info.au, probe ) )
+        return 0;
+    h264_imp->au_head_pos            = h264_imp->incomplete_au_head_pos;
+    h264_imp->incomplete_au_head_pos = next_au_head_pos;
+    return 1;
+}
+
+static int h264_append_nalu_to_au( h264_access_unit_t *au, uint8_t *src_nalu, uint32_t nalu_length, int probe )
 {
     if( !probe )
     {
+        uint32_t possible_au_length = au->incomplete_length + NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
+        if( !au->incomplete_data || au->incomplete_alloc < possible_au_length )
+        {
+            /* The buffer is given to a sample when the AU completes, so the next AU gets a new one here. */
+            uint32_t alloc = au->incomplete_alloc >= possible_au_length ? au->incomplete_alloc : 2 * possible_au_length;
+            uint8_t *data  = lsmash_realloc( au->incomplete_data, alloc );
+            if( !data )
+                return LSMASH_ERR_MEMORY_ALLOC;
+            au->incomplete_data  = data;
+            au->incomplete_alloc = alloc;
+        }
         uint8_t *dst_nalu = au->incomplete_data + au->incomplete_length + NALU_DEFAULT_NALU_LENGTH_SIZE;
         for( int i = NALU_DEFAULT_NALU_LENGTH_SIZE; i; i-- )
             *(dst_nalu - i) = (nalu_length >> ((i - 1) * 8)) & 0xff;
@@ -115,6 +446,7 @@ static void h264_append_nalu_to_au( h264_access_unit_t *au, uint8_t *src_nalu, u
      * Therefore, possible_au_length in h264_get_access_unit_internal() can't be used here
      * to avoid increasing AU length monotonously through the entire stream. */
     au->incomplete_length += NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
+    return 0;
 }
 
 static int h264_get_au_internal_succeeded( h264_importer_t *h264_imp, h264_access_unit_t *au )
@@ -239,7 +571,7 @@ static int h264_get_access_unit_internal
             /* For the last NALU.
              * This NALU already has been appended into the latest access unit and parsed. */
             h264_update_picture_info( info, picture, slice, &info->sei );
-            complete_au = h264_complete_au( au, probe );
+            complete_au = h264_complete_au_in_stream( h264_imp, probe, h264_imp->sc_head_pos );
             if( complete_au )
                 return h264_get_au_internal_succeeded( h264_imp, au );
             else
@@ -275,7 +607,7 @@ static int h264_get_access_unit_internal
             /* Increase the buffer if needed. */
             uint64_t possible_au_length = au->incomplete_length + NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
             if( sb->bank->buffer_size < possible_au_length
-             && (err = h264_supplement_buffer( sb, au, 2 * possible_au_length )) < 0 )
+             && (err = h264_supplement_buffer( sb, 2 * possible_au_length )) < 0 )
             {
                 lsmash_log( importer, LSMASH_LOG_ERROR, "failed to increase the buffer size.\n" );
                 return h264_get_au_internal_failed( h264_imp, au, complete_au, err );
@@ -306,12 +638,13 @@ static int h264_get_access_unit_internal
                         /* The current NALU is the first VCL NALU of the primary coded picture of an new AU.
                          * Therefore, the previous slice belongs to the AU you want at this time. */
                         h264_update_picture_info( info, picture, &prev_slice, &info->sei );
-                        complete_au = h264_complete_au( au, probe );
+                        complete_au = h264_complete_au_in_stream( h264_imp, probe, h264_imp->sc_head_pos );
                     }
                     else
                         h264_update_picture_info_for_slice( info, picture, &prev_slice );
                 }
-                h264_append_nalu_to_au( au, nalu, nalu_length, probe );
+                if( (err = h264_append_nalu_to_au( au, nalu, nalu_length, probe )) < 0 )
+                    return h264_get_au_internal_failed( h264_imp, au, complete_au, err );
                 slice->present = 1;
             }
             else
@@ -320,7 +653,7 @@ static int h264_get_access_unit_internal
                 {
                     /* The last slice belongs to the AU you want at this time. */
                     h264_update_picture_info( info, picture, slice, &info->sei );
-                    complete_au = h264_complete_au( au, probe );
+                    complete_au = h264_complete_au_in_stream( h264_imp, probe, h264_imp->sc_head_pos );
                 }
                 switch( nalu_type )
                 {
@@ -330,7 +663,8 @@ static int h264_get_access_unit_internal
                                                    nalu        + nuh.length,
                                                    nalu_length - nuh.length )) < 0 )
                             return h264_get_au_internal_failed( h264_imp, au, complete_au, err );
-                        h264_append_nalu_to_au( au, nalu, nalu_length, probe );
+                        if( (err = h264_append_nalu_to_au( au, nalu, nalu_length, probe )) < 0 )
+                            return h264_get_au_internal_failed( h264_imp, au, complete_au, err );
                         break;
                     }
                     case H264_NALU_TYPE_SPS :
@@ -348,7 +682,8 @@ static int h264_get_access_unit_internal
                             return h264_get_au_internal_failed( h264_imp, au, complete_au, err );
                         break;
                     default :
-                        h264_append_nalu_to_au( au, nalu, nalu_length, probe );
+                        if( (err = h264_append_nalu_to_au( au, nalu, nalu_length, probe )) < 0 )
+                            return h264_get_au_internal_failed( h264_imp, au, complete_au, err );
                         break;
                 }
                 if( info->avcC_pending )
@@ -369,7 +704,7 @@ static int h264_get_access_unit_internal
         else if( au->incomplete_length && au->length == 0 )
         {
             h264_update_picture_info( info, picture, slice, &info->sei );
-            h264_complete_au( au, probe );
+            h264_complete_au_in_stream( h264_imp, probe, h264_imp->sc_head_pos );
             return h264_get_au_internal_succeeded( h264_imp, au );
         }
         if( complete_au )
@@ -386,24 +721,72 @@ static inline void h264_importer_check_eof( importer_t *importer, h264_access_un
         importer->status = IMPORTER_OK;
 }
 
-static int h264_importer_get_accessunit
+/* Create a sample from the latest access unit.
+ * Timestamps and the property of leading are not set here. */
+static lsmash_sample_t *h264_create_sample
+(
+    h264_importer_t *h264_imp
+)
+{
+    h264_info_t         *info    = &h264_imp->info;
+    h264_access_unit_t  *au      = &info->au;
+    h264_picture_info_t *picture = &au->picture;
+    /* Take over the buffer in which the AU has been assembled, trimmed to its size. */
+    uint8_t *data = lsmash_realloc( au->data, au->length );
+    if( !data )
+        return NULL;
+    au->data = data;
+    lsmash_sample_t *sample = lsmash_create_sample( 0 );
+    if( !sample )
+        return NULL;
+    if( h264_imp->composition_reordering_present && !picture->disposable && !picture->idr )
+        sample->prop.allow_earlier = QT_SAMPLE_EARLIER_PTS_ALLOWED;
+    sample->prop.independent = picture->independent    ? ISOM_SAMPLE_IS_INDEPENDENT : ISOM_SAMPLE_IS_NOT_INDEPENDENT;
+    sample->prop.disposable  = picture->disposable     ? ISOM_SAMPLE_IS_DISPOSABLE  : ISOM_SAMPLE_IS_NOT_DISPOSABLE;
+    sample->prop.redundant   = picture->has_redundancy ? ISOM_SAMPLE_HAS_REDUNDANCY : ISOM_SAMPLE_HAS_NO_REDUNDANCY;
+    sample->prop.post_roll.identifier = picture->frame_num;
+    if( picture->random_accessible )
+    {
+        if( picture->idr )
+            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
+        else if( picture->recovery_frame_cnt )
+        {
+            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_POST_ROLL_START;
+            sample->prop.post_roll.complete = (picture->frame_num + picture->recovery_frame_cnt) % info->sps.MaxFrameNum;
+        }
+        else
+        {
+            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_RAP;
+            if( !picture->broken_link_flag )
+                sample->prop.ra_flags |= QT_SAMPLE_RANDOM_ACCESS_FLAG_PARTIAL_SYNC;
+        }
+    }
+    sample->data   = au->data;
+    sample->length = au->length;
+    sample->pos    = h264_imp->au_head_pos;
+    au->data       = NULL;
+    return sample;
+}
+
+static uint32_t h264_count_parameter_sets
+(
+    lsmash_h264_specific_parameters_t *param
+)
+{
+    lsmash_h264_parameter_sets_t *ps = param->parameter_sets;
+    return ps ? ps->sps_list->entry_count + ps->pps_list->entry_count + ps->spsext_list->entry_count : 0;
+}
+
+/* Get the next access unit in decoding order with the timestamps from the whole-stream analysis. */
+static int h264_importer_get_analyzed_accessunit
 (
     importer_t       *importer,
-    uint32_t          track_number,
     lsmash_sample_t **p_sample
 )
 {
-    if( !importer->info )
-        return LSMASH_ERR_NAMELESS;
-    if( track_number != 1 )
-        return LSMASH_ERR_FUNCTION_PARAM;
     h264_importer_t *h264_imp = (h264_importer_t *)importer->info;
     h264_info_t     *info     = &h264_imp->info;
     importer_status current_status = importer->status;
-    if( current_status == IMPORTER_ERROR )
-        return LSMASH_ERR_NAMELESS;
-    if( current_status == IMPORTER_EOF )
-        return IMPORTER_EOF;
     int err = h264_get_access_unit_internal( importer, 0 );
     if( err < 0 )
     {
@@ -423,7 +806,7 @@ static int h264_importer_get_accessunit
         lsmash_video_summary_t *summary = h264_create_summary( avcC_param, &info->sps, h264_imp->max_au_length );
         if( !summary )
             return LSMASH_ERR_NAMELESS;
-        lsmash_remove_entry( importer->summaries, track_number, lsmash_cleanup_summary );
+        lsmash_remove_entry( importer->summaries, 1, lsmash_cleanup_summary );
         if( lsmash_add_entry( importer->summaries, summary ) < 0 )
         {
             lsmash_cleanup_summary( (lsmash_summary_t *)summary );
@@ -431,7 +814,7 @@ static int h264_importer_get_accessunit
         }
         importer->status = IMPORTER_OK;
     }
-    lsmash_sample_t *sample = lsmash_create_sample( h264_imp->max_au_length );
+    lsmash_sample_t *sample = h264_create_sample( h264_imp );
     if( !sample )
         return LSMASH_ERR_MEMORY_ALLOC;
     *p_sample = sample;
@@ -446,31 +829,135 @@ static int h264_importer_get_accessunit
                                       ? ISOM_SAMPLE_IS_NOT_LEADING : ISOM_SAMPLE_IS_UNDECODABLE_LEADING;
     if( picture->independent )
         h264_imp->last_intra_cts = sample->cts;
-    if( h264_imp->composition_reordering_present && !picture->disposable && !picture->idr )
-        sample->prop.allow_earlier = QT_SAMPLE_EARLIER_PTS_ALLOWED;
-    sample->prop.independent = picture->independent    ? ISOM_SAMPLE_IS_INDEPENDENT : ISOM_SAMPLE_IS_NOT_INDEPENDENT;
-    sample->prop.disposable  = picture->disposable     ? ISOM_SAMPLE_IS_DISPOSABLE  : ISOM_SAMPLE_IS_NOT_DISPOSABLE;
-    sample->prop.redundant   = picture->has_redundancy ? ISOM_SAMPLE_HAS_REDUNDANCY : ISOM_SAMPLE_HAS_NO_REDUNDANCY;
-    sample->prop.post_roll.identifier = picture->frame_num;
-    if( picture->random_accessible )
+    return current_status;
+}
+
+static int h264_importer_fall_back_to_analysis( importer_t *importer );
+
+/* Get the next access unit in decoding order without the whole-stream analysis.
+ * Access units are read ahead until CTS of the next one is determined by the reorder buffer. */
+static int h264_importer_get_reordered_accessunit
+(
+    importer_t       *importer,
+    lsmash_sample_t **p_sample
+)
+{
+    h264_importer_t        *h264_imp = (h264_importer_t *)importer->info;
+    h264_info_t            *info     = &h264_imp->info;
+    nal_reorder_buffer_t   *rb       = &h264_imp->reorder;
+    lsmash_video_summary_t *summary  = NULL;
+    lsmash_sample_t        *sample;
+    int err;
+    while( !(sample = nalu_get_reordered_sample( rb, &summary )) )
     {
-        if( picture->idr )
-            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
-        else if( picture->recovery_frame_cnt )
+        if( h264_imp->end_of_input )
         {
-            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_POST_ROLL_START;
-            sample->prop.post_roll.complete = (picture->frame_num + picture->recovery_frame_cnt) % info->sps.MaxFrameNum;
+            if( rb->num_waiting == 0 )
+            {
+                importer->status = IMPORTER_EOF;
+                return IMPORTER_EOF;
+            }
+            nalu_flush_reorder_buffer( rb );
+            continue;
         }
-        else
+        h264_picture_info_t     *picture = &info->au.picture;
+        h264_picture_info_t prev_picture = *picture;
+        importer->status = IMPORTER_OK;
+        if( (err = h264_get_access_unit_internal( importer, 0 ))       < 0
+         || (err = h264_calculate_poc( info, picture, &prev_picture )) < 0 )
+            goto fail;
+        if( importer->status == IMPORTER_CHANGE )
+            h264_imp->avcC_changed = 1;
+        h264_importer_check_eof( importer, &info->au );
+        h264_imp->end_of_input = (importer->status == IMPORTER_EOF);
+        importer->status = IMPORTER_OK;
+        if( picture->delta != 2 )
         {
-            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_RAP;
-            if( !picture->broken_link_flag )
-                sample->prop.ra_flags |= QT_SAMPLE_RANDOM_ACCESS_FLAG_PARTIAL_SYNC;
+            lsmash_log( importer, LSMASH_LOG_ERROR, "field pictures or picture timing appeared in the middle of the stream.\n" );
+            err = LSMASH_ERR_PATCH_WELCOME;
+            goto fail;
+        }
+        h264_imp->max_au_length = LSMASH_MAX( h264_imp->max_au_length, info->au.length );
+        /* Create a new summary if the active parameter sets have been changed or supplemented. */
+        lsmash_video_summary_t *new_summary = NULL;
+        uint32_t ps_count = h264_count_parameter_sets( &info->avcC_param );
+        if( (h264_imp->avcC_changed && !info->avcC_pending) || ps_count != h264_imp->ps_count )
+        {
+            new_summary = h264_create_summary( &info->avcC_param, &info->sps, h264_imp->max_au_length );
+            if( !new_summary )
+            {
+                err = LSMASH_ERR_NAMELESS;
+                goto fail;
+            }
+            h264_imp->avcC_changed = 0;
+            h264_imp->ps_count     = ps_count;
+        }
+        lsmash_sample_t *new_sample = h264_create_sample( h264_imp );
+        if( !new_sample )
+        {
+            lsmash_cleanup_summary( (lsmash_summary_t *)new_summary );
+            err = LSMASH_ERR_MEMORY_ALLOC;
+            goto fail;
+        }
+        if( (err = nalu_reorder_picture( rb, new_sample, new_summary, picture->PicOrderCnt, picture->has_mmco5 )) < 0 )
+        {
+            lsmash_delete_sample( new_sample );
+            lsmash_cleanup_summary( (lsmash_summary_t *)new_summary );
+            if( err != LSMASH_ERR_INVALID_DATA )
+                goto fail;
+            lsmash_log( importer, LSMASH_LOG_WARNING,
+                        "picture %"PRIu32" exceeds max_num_reorder_frames declared in the stream.\n", info->au.number );
+            if( (err = h264_importer_fall_back_to_analysis( importer )) < 0 )
+                goto fail;
+            return h264_importer_get_analyzed_accessunit( importer, p_sample );
         }
     }
-    sample->length = au->length;
-    memcpy( sample->data, au->data, au->length );
+    importer_status current_status = IMPORTER_OK;
+    if( summary )
+    {
+        /* Update the active summary. */
+        lsmash_remove_entry( importer->summaries, 1, lsmash_cleanup_summary );
+        if( lsmash_add_entry( importer->summaries, summary ) < 0 )
+        {
+            lsmash_cleanup_summary( (lsmash_summary_t *)summary );
+            lsmash_delete_sample( sample );
+            return LSMASH_ERR_MEMORY_ALLOC;
+        }
+        current_status = IMPORTER_CHANGE;
+    }
+    /* The access units read ahead may be larger than any access unit before. */
+    summary = (lsmash_video_summary_t *)lsmash_get_entry_data( importer->summaries, 1 );
+    if( summary )
+        summary->max_au_length = h264_imp->max_au_length;
+    if( h264_imp->end_of_input && rb->pictures->entry_count == 0 )
+        importer->status = IMPORTER_EOF;
+    *p_sample = sample;
     return current_status;
+fail:
+    importer->status = IMPORTER_ERROR;
+    return err;
+}
+
+static int h264_importer_get_accessunit
+(
+    importer_t       *importer,
+    uint32_t          track_number,
+    lsmash_sample_t **p_sample
+)
+{
+    if( !importer->info )
+        return LSMASH_ERR_NAMELESS;
+    if( track_number != 1 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    h264_importer_t *h264_imp = (h264_importer_t *)importer->info;
+    importer_status current_status = importer->status;
+    if( current_status == IMPORTER_ERROR )
+        return LSMASH_ERR_NAMELESS;
+    if( current_status == IMPORTER_EOF )
+        return IMPORTER_EOF;
+    if( h264_imp->single_pass )
+        return h264_importer_get_reordered_accessunit( importer, p_sample );
+    return h264_importer_get_analyzed_accessunit( importer, p_sample );
 }
 
 static void nalu_deduplicate_poc
@@ -819,13 +1306,155 @@ fail:
     return err;
 }
 
-static int h264_importer_probe( importer_t *importer )
+static void h264_importer_rewind
+(
+    importer_t *importer,
+    uint64_t    first_sc_head_pos
+)
 {
-    /* Find the first start code. */
-    h264_importer_t *h264_imp = create_h264_importer( importer );
-    if( !h264_imp )
-        return LSMASH_ERR_MEMORY_ALLOC;
-    lsmash_bs_t *bs = importer->bs;
+    /* Go back to the start code of the first NALU. */
+    h264_importer_t *h264_imp = (h264_importer_t *)importer->info;
+    h264_info_t     *info     = &h264_imp->info;
+    importer->status = IMPORTER_OK;
+    lsmash_bs_read_seek( importer->bs, first_sc_head_pos, SEEK_SET );
+    h264_imp->sc_head_pos            = first_sc_head_pos;
+    h264_imp->incomplete_au_head_pos = first_sc_head_pos;
+    info->prev_nalu_type             = H264_NALU_TYPE_UNSPECIFIED0;
+    uint8_t *temp_au                 = info->au.data;
+    uint8_t *temp_incomplete_au      = info->au.incomplete_data;
+    uint32_t temp_alloc              = info->au.incomplete_alloc;
+    memset( &info->au, 0, sizeof(h264_access_unit_t) );
+    info->au.data                    = temp_au;
+    info->au.incomplete_data         = temp_incomplete_au;
+    info->au.incomplete_alloc        = temp_alloc;
+    memset( &info->slice, 0, sizeof(h264_slice_info_t) );
+    memset( &info->sps, 0, sizeof(h264_sps_t) );
+    memset( &info->pps, 0, sizeof(h264_pps_t) );
+    lsmash_remove_entries( info->avcC_param.parameter_sets->sps_list,    isom_remove_dcr_ps );
+    lsmash_remove_entries( info->avcC_param.parameter_sets->pps_list,    isom_remove_dcr_ps );
+    lsmash_remove_entries( info->avcC_param.parameter_sets->spsext_list, isom_remove_dcr_ps );
+    lsmash_destroy_h264_parameter_sets( &info->avcC_param_next );
+    info->avcC_pending = 0;
+}
+
+/* Set up the single-pass import if the first pictures show that the reordering reaches the declared bound.
+ * Then, the timestamps are the same as the ones from the whole-stream analysis unless the stream violates the bound. */
+static int h264_setup_single_pass
+(
+    importer_t *importer
+)
+{
+    h264_importer_t *h264_imp = (h264_importer_t *)importer->info;
+    h264_info_t     *info     = &h264_imp->info;
+    lsmash_video_summary_t *summary = h264_create_summary( &info->avcC_param, &info->sps, info->au.length );
+    if( !summary )
+        return LSMASH_ERR_NAMELESS;
+    if( lsmash_add_entry( importer->summaries, summary ) < 0 )
+    {
+        lsmash_cleanup_summary( (lsmash_summary_t *)summary );
+        return LSMASH_ERR_MEMORY_ALLOC;
+    }
+    uint32_t num_reorder_frames = info->sps.vui.max_num_reorder_frames;
+    uint32_t ps_count           = h264_count_parameter_sets( &info->avcC_param );
+    /* Read ahead the first pictures. */
+    nal_reorder_buffer_t rb     = { 0 };
+    uint32_t timescale          = summary->timescale;
+    nalu_setup_reorder_buffer( &rb, num_reorder_frames, &timescale );
+    h264_importer_rewind( importer, h264_imp->first_sc_head_pos );
+    int err = 0;
+    for( int i = 0; i < NALU_MAX_PICTURES_TO_EXAMINE && importer->status != IMPORTER_EOF; i++ )
+    {
+        h264_picture_info_t     *picture = &info->au.picture;
+        h264_picture_info_t prev_picture = *picture;
+        if( (err = h264_get_access_unit_internal( importer, 1 ))       < 0
+         || (err = h264_calculate_poc( info, picture, &prev_picture )) < 0 )
+            break;
+        h264_importer_check_eof( importer, &info->au );
+        if( picture->delta != 2 )
+        {
+            err = LSMASH_ERR_PATCH_WELCOME;
+            break;
+        }
+        h264_imp->max_au_length = LSMASH_MAX( h264_imp->max_au_length, info->au.length );
+        if( (err = nalu_examine_reordering( &rb, picture->PicOrderCnt, picture->has_mmco5 )) < 0 )
+            break;
+    }
+    if( importer->status == IMPORTER_EOF )
+        nalu_flush_reorder_buffer( &rb );
+    int reached = (err == 0 && rb.max_composition_delay == num_reorder_frames);
+    nalu_cleanup_reorder_buffer( &rb );
+    lsmash_remove_entries( h264_imp->avcC_list, lsmash_destroy_codec_specific_data );
+    if( !reached )
+    {
+        /* Leave the stream to the whole-stream analysis. */
+        lsmash_remove_entries( importer->summaries, lsmash_cleanup_summary );
+        h264_imp->max_au_length = 0;
+        return err == LSMASH_ERR_MEMORY_ALLOC ? err : 0;
+    }
+    summary->max_au_length = h264_imp->max_au_length;
+    nalu_setup_reorder_buffer( &h264_imp->reorder, num_reorder_frames, &summary->timescale );
+    h264_imp->composition_reordering_present = (num_reorder_frames > 0);
+    h264_imp->last_delta                     = h264_imp->reorder.delta;
+    h264_imp->ps_count                       = ps_count;
+    h264_imp->single_pass                    = 1;
+    return 0;
+}
+
+/* Analyze the whole stream since the stream violates the declared bound of reordering,
+ * and get back to the access unit following the ones already output. */
+static int h264_importer_fall_back_to_analysis
+(
+    importer_t *importer
+)
+{
+    h264_importer_t      *h264_imp = (h264_importer_t *)importer->info;
+    nal_reorder_buffer_t *rb       = &h264_imp->reorder;
+    lsmash_video_summary_t *summary = (lsmash_video_summary_t *)lsmash_get_entry_data( importer->summaries, 1 );
+    uint64_t num_output = nalu_count_reordered_samples( rb );
+    uint32_t timescale  = summary ? summary->timescale : 0;
+    if( num_output )
+        lsmash_log( importer, LSMASH_LOG_WARNING,
+                    "timestamps of the first %"PRIu64" pictures may be inconsistent with the rest.\n", num_output );
+    nalu_cleanup_reorder_buffer( rb );
+    memset( rb, 0, sizeof(nal_reorder_buffer_t) );
+    lsmash_remove_entries( importer->summaries, lsmash_cleanup_summary );
+    lsmash_remove_entries( h264_imp->avcC_list, lsmash_destroy_codec_specific_data );
+    h264_imp->avcC_number     = 0;
+    h264_imp->avcC_changed    = 0;
+    h264_imp->max_au_length   = 0;
+    h264_imp->num_undecodable = 0;
+    h264_imp->last_intra_cts  = 0;
+    h264_imp->single_pass     = 0;
+    h264_imp->end_of_input    = 0;
+    h264_importer_rewind( importer, h264_imp->first_sc_head_pos );
+    int err = h264_analyze_whole_stream( importer );
+    if( err < 0 )
+        return err;
+    summary = (lsmash_video_summary_t *)lsmash_get_entry_data( importer->summaries, 1 );
+    if( !summary || summary->timescale != timescale )
+    {
+        lsmash_log( importer, LSMASH_LOG_ERROR, "the timescale of the stream is changed by the whole-stream analysis.\n" );
+        return LSMASH_ERR_PATCH_WELCOME;
+    }
+    h264_importer_rewind( importer, h264_imp->first_sc_head_pos );
+    for( uint64_t i = 0; i < num_output; i++ )
+    {
+        lsmash_sample_t *sample = NULL;
+        err = h264_importer_get_analyzed_accessunit( importer, &sample );
+        lsmash_delete_sample( sample );
+        if( err < 0 )
+            return err;
+    }
+    return 0;
+}
+
+static int h264_importer_probe( importer_t *importer )
+{
+    /* Find the first start code. */
+    h264_importer_t *h264_imp = create_h264_importer( importer );
+    if( !h264_imp )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    lsmash_bs_t *bs = importer->bs;
     uint64_t first_sc_head_pos = nalu_find_first_start_code( bs );
     int err;
     if( first_sc_head_pos == NALU_NO_START_CODE_FOUND )
@@ -837,26 +1466,24 @@ static int h264_importer_probe( importer_t *importer )
     importer->info = h264_imp;
     h264_info_t *info = &h264_imp->info;
     lsmash_bs_read_seek( bs, first_sc_head_pos, SEEK_SET );
-    h264_imp->sc_head_pos = first_sc_head_pos;
-    if( (err = h264_analyze_whole_stream( importer )) < 0 )
-        goto fail;
-    /* Go back to the start code of the first NALU. */
-    importer->status = IMPORTER_OK;
-    lsmash_bs_read_seek( bs, first_sc_head_pos, SEEK_SET );
+    h264_imp->first_sc_head_pos = first_sc_head_pos;
     h264_imp->sc_head_pos       = first_sc_head_pos;
-    info->prev_nalu_type        = H264_NALU_TYPE_UNSPECIFIED0;
-    uint8_t *temp_au            = info->au.data;
-    uint8_t *temp_incomplete_au = info->au.incomplete_data;
-    memset( &info->au, 0, sizeof(h264_access_unit_t) );
-    info->au.data               = temp_au;
-    info->au.incomplete_data    = temp_incomplete_au;
-    memset( &info->slice, 0, sizeof(h264_slice_info_t) );
-    memset( &info->sps, 0, sizeof(h264_sps_t) );
-    memset( &info->pps, 0, sizeof(h264_pps_t) );
-    lsmash_remove_entries( info->avcC_param.parameter_sets->sps_list,    isom_remove_dcr_ps );
-    lsmash_remove_entries( info->avcC_param.parameter_sets->pps_list,    isom_remove_dcr_ps );
-    lsmash_remove_entries( info->avcC_param.parameter_sets->spsext_list, isom_remove_dcr_ps );
-    lsmash_destroy_h264_parameter_sets( &info->avcC_param_next );
+    /* If the first SPS declares the bound of reordering and every picture is a frame without picture timing,
+     * timestamps can be generated while reading the stream. Otherwise, analyze the whole stream beforehand. */
+    importer->status = IMPORTER_OK;
+    if( (err = h264_get_access_unit_internal( importer, 1 )) < 0 )
+        goto fail;
+    h264_sps_t *sps = &info->sps;
+    if( sps->vui.bitstream_restriction_flag && sps->frame_mbs_only_flag && !sps->vui.pic_struct_present_flag
+     && (err = h264_setup_single_pass( importer )) < 0 )
+        goto fail;
+    if( !h264_imp->single_pass )
+    {
+        h264_importer_rewind( importer, first_sc_head_pos );
+        if( (err = h264_analyze_whole_stream( importer )) < 0 )
+            goto fail;
+    }
+    h264_importer_rewind( importer, first_sc_head_pos );
     return 0;
 fail:
     remove_h264_importer( h264_imp );
@@ -872,11 +1499,38 @@ static uint32_t h264_importer_get_last_delta( importer_t *importer, uint32_t tra
     h264_importer_t *h264_imp = (h264_importer_t *)importer->info;
     if( !h264_imp || track_number != 1 || importer->status != IMPORTER_EOF )
         return 0;
-    return h264_imp->ts_list.sample_count
+    return h264_imp->ts_list.sample_count || h264_imp->info.au.number
          ? h264_imp->last_delta
          : UINT32_MAX;    /* arbitrary */
 }
 
+static int h264_is_stored_nalu( uint8_t *nalu, uint32_t nalu_length )
+{
+    /* Same as h264_get_access_unit_internal(). */
+    uint8_t nalu_type = nalu[0] & 0x1f;
+    return (nalu_type >= H264_NALU_TYPE_SLICE_N_IDR && nalu_type <= H264_NALU_TYPE_SEI)
+        ||  nalu_type == H264_NALU_TYPE_EOS
+        ||  nalu_type == H264_NALU_TYPE_EOB
+        ||  nalu_type == H264_NALU_TYPE_SLICE_AUX;
+}
+
+static int h264_convert_sample( lsmash_sample_t *sample )
+{
+    return nalu_convert_sample( sample, h264_is_stored_nalu );
+}
+
+static uint64_t h264_importer_get_span_end( importer_t *importer )
+{
+    h264_importer_t *h264_imp = (h264_importer_t *)importer->info;
+    return nalu_get_span_end( &h264_imp->reorder, h264_imp->single_pass, h264_imp->incomplete_au_head_pos );
+}
+
+static int h264_importer_index_stream( importer_t *importer, uint32_t track_number, const char *index_name )
+{
+    return lsmash_importer_index_converted_accessunits( importer, track_number, index_name,
+                                                        h264_convert_sample, h264_importer_get_span_end );
+}
+
 const importer_functions h264_importer =
 {
     { "H.264", offsetof( importer_t, log_level ) },
@@ -884,7 +1538,9 @@ const importer_functions h264_importer =
     h264_importer_probe,
     h264_importer_get_accessunit,
     h264_importer_get_last_delta,
-    h264_importer_cleanup
+    h264_importer_cleanup,
+    NULL,
+    h264_importer_index_stream
 };
 
 /***************************************************************************
@@ -899,15 +1555,23 @@ typedef struct
     hevc_info_t            info;
     lsmash_entry_list_t    hvcC_list[1];    /* stored as lsmash_codec_specific_t */
     lsmash_media_ts_list_t ts_list;
+    nal_reorder_buffer_t   reorder;         /* for single-pass import */
     uint32_t max_au_length;
     uint32_t num_undecodable;
     uint32_t hvcC_number;
     uint32_t last_delta;
+    uint32_t ps_count;
     uint64_t last_intra_cts;
+    uint64_t first_sc_head_pos;
     uint64_t sc_head_pos;
+    uint64_t au_head_pos;               /* the position of the first start code of the latest AU */
+    uint64_t incomplete_au_head_pos;    /* the position of the first start code of the AU being assembled */
     uint8_t  composition_reordering_present;
     uint8_t  field_pic_present;
     uint8_t  max_TemporalId;
+    uint8_t  single_pass;
+    uint8_t  hvcC_changed;
+    uint8_t  end_of_input;
 } hevc_importer_t;
 
 static void remove_hevc_importer( hevc_importer_t *hevc_imp )
@@ -915,6 +1579,7 @@ static void remove_hevc_importer( hevc_importer_t *hevc_imp )
     if( !hevc_imp )
         return;
     lsmash_remove_entries( hevc_imp->hvcC_list, lsmash_destroy_codec_specific_data );
+    nalu_cleanup_reorder_buffer( &hevc_imp->reorder );
     hevc_cleanup_parser( &hevc_imp->info );
     lsmash_free( hevc_imp->ts_list.timestamp );
     lsmash_free( hevc_imp );
@@ -946,7 +1611,12 @@ static inline int hevc_complete_au( hevc_access_unit_t *au, int probe )
     if( !au->picture.has_primary || au->incomplete_length == 0 )
         return 0;
     if( !probe )
-        memcpy( au->data, au->incomplete_data, au->incomplete_length );
+    {
+        /* Hand over the assembled AU as it is, and assemble the next one in another buffer. */
+        lsmash_free( au->data );
+        au->data            = au->incomplete_data;
+        au->incomplete_data = NULL;
+    }
     au->TemporalId          = au->picture.TemporalId;
     au->length              = au->incomplete_length;
     au->incomplete_length   = 0;
@@ -954,10 +1624,32 @@ static inline int hevc_complete_au( hevc_access_unit_t *au, int probe )
     return 1;
 }
 
-static void hevc_append_nalu_to_au( hevc_access_unit_t *au, uint8_t *src_nalu, uint32_t nalu_length, int probe )
+/* Complete the AU as hevc_complete_au() does, and take over the position of its first start code in the stream.
+ * The next AU begins with the start code at 'next_au_head_pos'. */
+static int hevc_complete_au_in_stream( hevc_importer_t *hevc_imp, int probe, uint64_t next_au_head_pos )
+{
+    if( !hevc_complete_au( &hevc_imp->info.au, probe ) )
+        return 0;
+    hevc_imp->au_head_pos            = hevc_imp->incomplete_au_head_pos;
+    hevc_imp->incomplete_au_head_pos = next_au_head_pos;
+    return 1;
+}
+
+static int hevc_append_nalu_to_au( hevc_access_unit_t *au, uint8_t *src_nalu, uint32_t nalu_length, int probe )
 {
     if( !probe )
     {
+        uint32_t possible_au_length = au->incomplete_length + NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
+        if( !au->incomplete_data || au->incomplete_alloc < possible_au_length )
+        {
+            /* The buffer is given to a sample when the AU completes, so the next AU gets a new one here. */
+            uint32_t alloc = au->incomplete_alloc >= possible_au_length ? au->incomplete_alloc : 2 * possible_au_length;
+            uint8_t *data  = lsmash_realloc( au->incomplete_data, alloc );
+            if( !data )
+                return LSMASH_ERR_MEMORY_ALLOC;
+            au->incomplete_data  = data;
+            au->incomplete_alloc = alloc;
+        }
         uint8_t *dst_nalu = au->incomplete_data + au->incomplete_length + NALU_DEFAULT_NALU_LENGTH_SIZE;
         for( int i = NALU_DEFAULT_NALU_LENGTH_SIZE; i; i-- )
             *(dst_nalu - i) = (nalu_length >> ((i - 1) * 8)) & 0xff;
@@ -967,6 +1659,7 @@ static void hevc_append_nalu_to_au( hevc_access_unit_t *au, uint8_t *src_nalu, u
      * Therefore, possible_au_length in hevc_get_access_unit_internal() can't be used here
      * to avoid increasing AU length monotonously through the entire stream. */
     au->incomplete_length += NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
+    return 0;
 }
 
 static int hevc_get_au_internal_succeeded( hevc_importer_t *hevc_imp, hevc_access_unit_t *au )
@@ -1085,7 +1778,7 @@ static int hevc_get_access_unit_internal
             /* For the last NALU.
              * This NALU already has been appended into the latest access unit and parsed. */
             hevc_update_picture_info( info, picture, slice, &info->sps, &info->sei );
-            complete_au = hevc_complete_au( au, probe );
+            complete_au = hevc_complete_au_in_stream( hevc_imp, probe, hevc_imp->sc_head_pos );
             if( complete_au )
                 return hevc_get_au_internal_succeeded( hevc_imp, au );
             else
@@ -1125,7 +1818,7 @@ static int hevc_get_access_unit_internal
             /* Increase the buffer if needed. */
             uint64_t possible_au_length = au->incomplete_length + NALU_DEFAULT_NALU_LENGTH_SIZE + nalu_length;
             if( sb->bank->buffer_size < possible_au_length
-             && (err = hevc_supplement_buffer( sb, au, 2 * possible_au_length )) < 0 )
+             && (err = hevc_supplement_buffer( sb, 2 * possible_au_length )) < 0 )
             {
                 lsmash_log( importer, LSMASH_LOG_ERROR, "failed to increase the buffer size.\n" );
                 return hevc_get_au_internal_failed( hevc_imp, au, complete_au, err );
@@ -1156,12 +1849,13 @@ static int hevc_get_access_unit_internal
                         /* The current NALU is the first VCL NALU of the primary coded picture of a new AU.
                          * Therefore, the previous slice belongs to the AU you want at this time. */
                         hevc_update_picture_info( info, picture, &prev_slice, &info->sps, &info->sei );
-                        complete_au = hevc_complete_au( au, probe );
+                        complete_au = hevc_complete_au_in_stream( hevc_imp, probe, hevc_imp->sc_head_pos );
                     }
                     else
                         hevc_update_picture_info_for_slice( info, picture, &prev_slice );
                 }
-                hevc_append_nalu_to_au( au, nalu, nalu_length, probe );
+                if( (err = hevc_append_nalu_to_au( au, nalu, nalu_length, probe )) < 0 )
+                    return hevc_get_au_internal_failed( hevc_imp, au, complete_au, err );
                 slice->present = 1;
             }
             else
@@ -1170,7 +1864,7 @@ static int hevc_get_access_unit_internal
                 {
                     /* The last slice belongs to the AU you want at this time. */
                     hevc_update_picture_info( info, picture, slice, &info->sps, &info->sei );
-                    complete_au = hevc_complete_au( au, probe );
+                    complete_au = hevc_complete_au_in_stream( hevc_imp, probe, hevc_imp->sc_head_pos );
                 }
                 switch( nalu_type )
                 {
@@ -1180,7 +1874,8 @@ static int hevc_get_access_unit_internal
                         if( (err = hevc_parse_sei( info->bits, &info->vps, &info->sps, &info->sei, &nuh,
                                                    sb->rbsp, nalu + nuh.length, nalu_length - nuh.length )) < 0 )
                             return hevc_get_au_internal_failed( hevc_imp, au, complete_au, err );
-                        hevc_append_nalu_to_au( au, nalu, nalu_length, probe );
+                        if( (err = hevc_append_nalu_to_au( au, nalu, nalu_length, probe )) < 0 )
+                            return hevc_get_au_internal_failed( hevc_imp, au, complete_au, err );
                         break;
                     }
                     case HEVC_NALU_TYPE_VPS :
@@ -1198,7 +1893,8 @@ static int hevc_get_access_unit_internal
                     case HEVC_NALU_TYPE_AUD :   /* We drop access unit delimiters. */
                         break;
                     default :
-                        hevc_append_nalu_to_au( au, nalu, nalu_length, probe );
+                        if( (err = hevc_append_nalu_to_au( au, nalu, nalu_length, probe )) < 0 )
+                            return hevc_get_au_internal_failed( hevc_imp, au, complete_au, err );
                         break;
                 }
                 if( info->hvcC_pending )
@@ -1218,7 +1914,7 @@ static int hevc_get_access_unit_internal
         else if( au->incomplete_length && au->length == 0 )
         {
             hevc_update_picture_info( info, picture, slice, &info->sps, &info->sei );
-            hevc_complete_au( au, probe );
+            hevc_complete_au_in_stream( hevc_imp, probe, hevc_imp->sc_head_pos );
             return hevc_get_au_internal_succeeded( hevc_imp, au );
         }
         if( complete_au )
@@ -1235,19 +1931,83 @@ static inline void hevc_importer_check_eof( importer_t *importer, hevc_access_un
         importer->status = IMPORTER_OK;
 }
 
-static int hevc_importer_get_accessunit( importer_t *importer, uint32_t track_number, lsmash_sample_t **p_sample )
+/* Create a sample from the latest access unit.
+ * Timestamps are not set here, and the property of leading is set only for RADL and RASL pictures. */
+static lsmash_sample_t *hevc_create_sample
+(
+    hevc_importer_t *hevc_imp
+)
+{
+    hevc_info_t         *info    = &hevc_imp->info;
+    hevc_access_unit_t  *au      = &info->au;
+    hevc_picture_info_t *picture = &au->picture;
+    /* Take over the buffer in which the AU has been assembled, trimmed to its size. */
+    uint8_t *data = lsmash_realloc( au->data, au->length );
+    if( !data )
+        return NULL;
+    au->data = data;
+    lsmash_sample_t *sample = lsmash_create_sample( 0 );
+    if( !sample )
+        return NULL;
+    /* Set property of disposability. */
+    if( picture->sublayer_nonref && au->TemporalId == hevc_imp->max_TemporalId )
+        /* Sub-layer non-reference pictures are not referenced by subsequent pictures of
+         * the same sub-layer in decoding order. */
+        sample->prop.disposable = ISOM_SAMPLE_IS_DISPOSABLE;
+    else
+        sample->prop.disposable = ISOM_SAMPLE_IS_NOT_DISPOSABLE;
+    /* Set property of leading. */
+    if( picture->radl || picture->rasl )
+        sample->prop.leading = picture->radl ? ISOM_SAMPLE_IS_DECODABLE_LEADING : ISOM_SAMPLE_IS_UNDECODABLE_LEADING;
+    /* Set property of independence. */
+    sample->prop.independent = picture->independent ? ISOM_SAMPLE_IS_INDEPENDENT : ISOM_SAMPLE_IS_NOT_INDEPENDENT;
+    sample->prop.redundant   = ISOM_SAMPLE_HAS_NO_REDUNDANCY;
+    sample->prop.post_roll.identifier = picture->poc;
+    if( picture->random_accessible )
+    {
+        if( picture->irap )
+        {
+            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
+            if( picture->closed_rap )
+                sample->prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_CLOSED_RAP;
+            else
+                sample->prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_RAP;
+        }
+        else if( picture->recovery_poc_cnt )
+        {
+            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_POST_ROLL_START;
+            sample->prop.post_roll.complete = picture->poc + picture->recovery_poc_cnt;
+        }
+        else
+            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_RAP;
+    }
+    sample->data   = au->data;
+    sample->length = au->length;
+    sample->pos    = hevc_imp->au_head_pos;
+    au->data       = NULL;
+    return sample;
+}
+
+static uint32_t hevc_count_parameter_sets
+(
+    lsmash_hevc_specific_parameters_t *param
+)
+{
+    lsmash_hevc_parameter_arrays_t *arrays = param->parameter_arrays;
+    if( !arrays )
+        return 0;
+    uint32_t count = 0;
+    for( int i = 0; i < HEVC_DCR_NALU_TYPE_NUM; i++ )
+        count += arrays->ps_array[i].list->entry_count;
+    return count;
+}
+
+/* Get the next access unit in decoding order with the timestamps from the whole-stream analysis. */
+static int hevc_importer_get_analyzed_accessunit( importer_t *importer, lsmash_sample_t **p_sample )
 {
-    if( !importer->info )
-        return LSMASH_ERR_NAMELESS;
-    if( track_number != 1 )
-        return LSMASH_ERR_FUNCTION_PARAM;
     hevc_importer_t *hevc_imp = (hevc_importer_t *)importer->info;
     hevc_info_t     *info     = &hevc_imp->info;
     importer_status current_status = importer->status;
-    if( current_status == IMPORTER_ERROR )
-        return LSMASH_ERR_NAMELESS;
-    if( current_status == IMPORTER_EOF )
-        return IMPORTER_EOF;
     int err = hevc_get_access_unit_internal( importer, 0 );
     if( err < 0 )
     {
@@ -1267,7 +2027,7 @@ static int hevc_importer_get_accessunit( importer_t *importer, uint32_t track_nu
         lsmash_video_summary_t *summary = hevc_create_summary( hvcC_param, &info->sps, hevc_imp->max_au_length );
         if( !summary )
             return LSMASH_ERR_NAMELESS;
-        lsmash_remove_entry( importer->summaries, track_number, lsmash_cleanup_summary );
+        lsmash_remove_entry( importer->summaries, 1, lsmash_cleanup_summary );
         if( lsmash_add_entry( importer->summaries, summary ) < 0 )
         {
             lsmash_cleanup_summary( (lsmash_summary_t *)summary );
@@ -1275,7 +2035,7 @@ static int hevc_importer_get_accessunit( importer_t *importer, uint32_t track_nu
         }
         importer->status = IMPORTER_OK;
     }
-    lsmash_sample_t *sample = lsmash_create_sample( hevc_imp->max_au_length );
+    lsmash_sample_t *sample = hevc_create_sample( hevc_imp );
     if( !sample )
         return LSMASH_ERR_MEMORY_ALLOC;
     *p_sample = sample;
@@ -1283,17 +2043,8 @@ static int hevc_importer_get_accessunit( importer_t *importer, uint32_t track_nu
     hevc_picture_info_t *picture = &au->picture;
     sample->dts = hevc_imp->ts_list.timestamp[ au->number - 1 ].dts;
     sample->cts = hevc_imp->ts_list.timestamp[ au->number - 1 ].cts;
-    /* Set property of disposability. */
-    if( picture->sublayer_nonref && au->TemporalId == hevc_imp->max_TemporalId )
-        /* Sub-layer non-reference pictures are not referenced by subsequent pictures of
-         * the same sub-layer in decoding order. */
-        sample->prop.disposable = ISOM_SAMPLE_IS_DISPOSABLE;
-    else
-        sample->prop.disposable = ISOM_SAMPLE_IS_NOT_DISPOSABLE;
     /* Set property of leading. */
-    if( picture->radl || picture->rasl )
-        sample->prop.leading = picture->radl ? ISOM_SAMPLE_IS_DECODABLE_LEADING : ISOM_SAMPLE_IS_UNDECODABLE_LEADING;
-    else
+    if( !(picture->radl || picture->rasl) )
     {
         if( au->number < hevc_imp->num_undecodable )
             sample->prop.leading = ISOM_SAMPLE_IS_UNDECODABLE_LEADING;
@@ -1307,31 +2058,133 @@ static int hevc_importer_get_accessunit( importer_t *importer, uint32_t track_nu
     }
     if( picture->independent )
         hevc_imp->last_intra_cts = sample->cts;
-    /* Set property of independence. */
-    sample->prop.independent = picture->independent ? ISOM_SAMPLE_IS_INDEPENDENT : ISOM_SAMPLE_IS_NOT_INDEPENDENT;
-    sample->prop.redundant   = ISOM_SAMPLE_HAS_NO_REDUNDANCY;
-    sample->prop.post_roll.identifier = picture->poc;
-    if( picture->random_accessible )
+    return current_status;
+}
+
+static int hevc_importer_fall_back_to_analysis( importer_t *importer );
+
+/* Get the next access unit in decoding order without the whole-stream analysis.
+ * Access units are read ahead until CTS of the next one is determined by the reorder buffer. */
+static int hevc_importer_get_reordered_accessunit
+(
+    importer_t       *importer,
+    lsmash_sample_t **p_sample
+)
+{
+    hevc_importer_t        *hevc_imp = (hevc_importer_t *)importer->info;
+    hevc_info_t            *info     = &hevc_imp->info;
+    nal_reorder_buffer_t   *rb       = &hevc_imp->reorder;
+    lsmash_video_summary_t *summary  = NULL;
+    lsmash_sample_t        *sample;
+    int err;
+    while( !(sample = nalu_get_reordered_sample( rb, &summary )) )
     {
-        if( picture->irap )
+        if( hevc_imp->end_of_input )
         {
-            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
-            if( picture->closed_rap )
-                sample->prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_CLOSED_RAP;
-            else
-                sample->prop.ra_flags |= ISOM_SAMPLE_RANDOM_ACCESS_FLAG_RAP;
+            if( rb->num_waiting == 0 )
+            {
+                importer->status = IMPORTER_EOF;
+                return IMPORTER_EOF;
+            }
+            nalu_flush_reorder_buffer( rb );
+            continue;
         }
-        else if( picture->recovery_poc_cnt )
+        hevc_picture_info_t     *picture = &info->au.picture;
+        hevc_picture_info_t prev_picture = *picture;
+        importer->status = IMPORTER_OK;
+        if( (err = hevc_get_access_unit_internal( importer, 0 )) < 0 )
+            goto fail;
+        /* An IRAP picture with NoRaslOutputFlag equal to 1 starts a new coded video sequence. */
+        int new_cvs = picture->irap && (picture->idr || picture->broken_link || info->eos);
+        if( (err = hevc_calculate_poc( info, picture, &prev_picture )) < 0 )
+            goto fail;
+        if( importer->status == IMPORTER_CHANGE )
+            hevc_imp->hvcC_changed = 1;
+        hevc_importer_check_eof( importer, &info->au );
+        hevc_imp->end_of_input = (importer->status == IMPORTER_EOF);
+        importer->status = IMPORTER_OK;
+        if( picture->delta != 2 )
         {
-            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_POST_ROLL_START;
-            sample->prop.post_roll.complete = picture->poc + picture->recovery_poc_cnt;
+            lsmash_log( importer, LSMASH_LOG_ERROR, "field pictures or picture timing appeared in the middle of the stream.\n" );
+            err = LSMASH_ERR_PATCH_WELCOME;
+            goto fail;
+        }
+        hevc_imp->max_au_length = LSMASH_MAX( hevc_imp->max_au_length, info->au.length );
+        /* Create a new summary if the active parameter sets have been changed or supplemented. */
+        lsmash_video_summary_t *new_summary = NULL;
+        uint32_t ps_count = hevc_count_parameter_sets( &info->hvcC_param );
+        if( (hevc_imp->hvcC_changed && !info->hvcC_pending) || ps_count != hevc_imp->ps_count )
+        {
+            new_summary = hevc_create_summary( &info->hvcC_param, &info->sps, hevc_imp->max_au_length );
+            if( !new_summary )
+            {
+                err = LSMASH_ERR_NAMELESS;
+                goto fail;
+            }
+            hevc_imp->hvcC_changed = 0;
+            hevc_imp->ps_count     = ps_count;
+        }
+        lsmash_sample_t *new_sample = hevc_create_sample( hevc_imp );
+        if( !new_sample )
+        {
+            lsmash_cleanup_summary( (lsmash_summary_t *)new_summary );
+            err = LSMASH_ERR_MEMORY_ALLOC;
+            goto fail;
+        }
+        if( (err = nalu_reorder_picture( rb, new_sample, new_summary, picture->poc, new_cvs )) < 0 )
+        {
+            lsmash_delete_sample( new_sample );
+            lsmash_cleanup_summary( (lsmash_summary_t *)new_summary );
+            if( err != LSMASH_ERR_INVALID_DATA )
+                goto fail;
+            lsmash_log( importer, LSMASH_LOG_WARNING,
+                        "picture %"PRIu32" exceeds sps_max_num_reorder_pics declared in the stream.\n", info->au.number );
+            if( (err = hevc_importer_fall_back_to_analysis( importer )) < 0 )
+                goto fail;
+            return hevc_importer_get_analyzed_accessunit( importer, p_sample );
         }
-        else
-            sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_RAP;
     }
-    sample->length = au->length;
-    memcpy( sample->data, au->data, au->length );
+    importer_status current_status = IMPORTER_OK;
+    if( summary )
+    {
+        /* Update the active summary. */
+        lsmash_remove_entry( importer->summaries, 1, lsmash_cleanup_summary );
+        if( lsmash_add_entry( importer->summaries, summary ) < 0 )
+        {
+            lsmash_cleanup_summary( (lsmash_summary_t *)summary );
+            lsmash_delete_sample( sample );
+            return LSMASH_ERR_MEMORY_ALLOC;
+        }
+        current_status = IMPORTER_CHANGE;
+    }
+    /* The access units read ahead may be larger than any access unit before. */
+    summary = (lsmash_video_summary_t *)lsmash_get_entry_data( importer->summaries, 1 );
+    if( summary )
+        summary->max_au_length = hevc_imp->max_au_length;
+    if( hevc_imp->end_of_input && rb->pictures->entry_count == 0 )
+        importer->status = IMPORTER_EOF;
+    *p_sample = sample;
     return current_status;
+fail:
+    importer->status = IMPORTER_ERROR;
+    return err;
+}
+
+static int hevc_importer_get_accessunit( importer_t *importer, uint32_t track_number, lsmash_sample_t **p_sample )
+{
+    if( !importer->info )
+        return LSMASH_ERR_NAMELESS;
+    if( track_number != 1 )
+        return LSMASH_ERR_FUNCTION_PARAM;
+    hevc_importer_t *hevc_imp = (hevc_importer_t *)importer->info;
+    importer_status current_status = importer->status;
+    if( current_status == IMPORTER_ERROR )
+        return LSMASH_ERR_NAMELESS;
+    if( current_status == IMPORTER_EOF )
+        return IMPORTER_EOF;
+    if( hevc_imp->single_pass )
+        return hevc_importer_get_reordered_accessunit( importer, p_sample );
+    return hevc_importer_get_analyzed_accessunit( importer, p_sample );
 }
 
 static lsmash_video_summary_t *hevc_setup_first_summary
@@ -1467,6 +2320,157 @@ fail:
     return err;
 }
 
+static void hevc_importer_rewind
+(
+    importer_t *importer,
+    uint64_t    first_sc_head_pos
+)
+{
+    /* Go back to the start code of the first NALU. */
+    hevc_importer_t *hevc_imp = (hevc_importer_t *)importer->info;
+    hevc_info_t     *info     = &hevc_imp->info;
+    importer->status = IMPORTER_OK;
+    lsmash_bs_read_seek( importer->bs, first_sc_head_pos, SEEK_SET );
+    hevc_imp->sc_head_pos            = first_sc_head_pos;
+    hevc_imp->incomplete_au_head_pos = first_sc_head_pos;
+    info->prev_nalu_type             = HEVC_NALU_TYPE_UNKNOWN;
+    uint8_t *temp_au                 = info->au.data;
+    uint8_t *temp_incomplete_au      = info->au.incomplete_data;
+    uint32_t temp_alloc              = info->au.incomplete_alloc;
+    memset( &info->au, 0, sizeof(hevc_access_unit_t) );
+    info->au.data                    = temp_au;
+    info->au.incomplete_data         = temp_incomplete_au;
+    info->au.incomplete_alloc        = temp_alloc;
+    memset( &info->slice, 0, sizeof(hevc_slice_info_t) );
+    memset( &info->vps,   0, sizeof(hevc_vps_t) );
+    memset( &info->sps,   0, sizeof(hevc_sps_t) );
+    memset( &info->pps,   0, SIZEOF_PPS_EXCLUDING_HEAP );
+    for( int i = 0; i < HEVC_DCR_NALU_TYPE_NUM; i++ )
+        lsmash_remove_entries( info->hvcC_param.parameter_arrays->ps_array[i].list, isom_remove_dcr_ps );
+    lsmash_destroy_hevc_parameter_arrays( &info->hvcC_param_next );
+    info->hvcC_pending = 0;
+}
+
+/* Set up the single-pass import if the first pictures show that the reordering reaches the declared bound
+ * and that the highest sub-layer the SPS declares is present.
+ * Then, the timestamps and the disposability are the same as the ones from the whole-stream analysis
+ * unless the stream violates the bound. */
+static int hevc_setup_single_pass
+(
+    importer_t *importer
+)
+{
+    hevc_importer_t *hevc_imp = (hevc_importer_t *)importer->info;
+    hevc_info_t     *info     = &hevc_imp->info;
+    lsmash_video_summary_t *summary = hevc_create_summary( &info->hvcC_param, &info->sps, info->au.length );
+    if( !summary )
+        return LSMASH_ERR_NAMELESS;
+    if( lsmash_add_entry( importer->summaries, summary ) < 0 )
+    {
+        lsmash_cleanup_summary( (lsmash_summary_t *)summary );
+        return LSMASH_ERR_MEMORY_ALLOC;
+    }
+    summary->timescale *= 2;    /* See hevc_analyze_whole_stream(). */
+    uint32_t num_reorder_pics = info->sps.max_num_reorder_pics;
+    uint8_t  max_sub_layers   = info->sps.max_sub_layers_minus1 + 1;
+    uint32_t ps_count         = hevc_count_parameter_sets( &info->hvcC_param );
+    /* Read ahead the first pictures. */
+    nal_reorder_buffer_t rb   = { 0 };
+    uint32_t timescale        = summary->timescale;
+    nalu_setup_reorder_buffer( &rb, num_reorder_pics, &timescale );
+    hevc_importer_rewind( importer, hevc_imp->first_sc_head_pos );
+    int err = 0;
+    for( int i = 0; i < NALU_MAX_PICTURES_TO_EXAMINE && importer->status != IMPORTER_EOF; i++ )
+    {
+        hevc_picture_info_t     *picture = &info->au.picture;
+        hevc_picture_info_t prev_picture = *picture;
+        if( (err = hevc_get_access_unit_internal( importer, 1 )) < 0 )
+            break;
+        int new_cvs = picture->irap && (picture->idr || picture->broken_link || info->eos);
+        if( (err = hevc_calculate_poc( info, picture, &prev_picture )) < 0 )
+            break;
+        hevc_importer_check_eof( importer, &info->au );
+        if( picture->delta != 2 )
+        {
+            err = LSMASH_ERR_PATCH_WELCOME;
+            break;
+        }
+        hevc_imp->max_au_length  = LSMASH_MAX( hevc_imp->max_au_length,  info->au.length );
+        hevc_imp->max_TemporalId = LSMASH_MAX( hevc_imp->max_TemporalId, info->au.TemporalId );
+        if( (err = nalu_examine_reordering( &rb, picture->poc, new_cvs )) < 0 )
+            break;
+    }
+    if( importer->status == IMPORTER_EOF )
+        nalu_flush_reorder_buffer( &rb );
+    int reached = (err == 0 && rb.max_composition_delay == num_reorder_pics && hevc_imp->max_TemporalId + 1 == max_sub_layers);
+    nalu_cleanup_reorder_buffer( &rb );
+    lsmash_remove_entries( hevc_imp->hvcC_list, lsmash_destroy_codec_specific_data );
+    if( !reached )
+    {
+        /* Leave the stream to the whole-stream analysis. */
+        lsmash_remove_entries( importer->summaries, lsmash_cleanup_summary );
+        hevc_imp->max_au_length  = 0;
+        hevc_imp->max_TemporalId = 0;
+        return err == LSMASH_ERR_MEMORY_ALLOC ? err : 0;
+    }
+    summary->max_au_length = hevc_imp->max_au_length;
+    nalu_setup_reorder_buffer( &hevc_imp->reorder, num_reorder_pics, &summary->timescale );
+    hevc_imp->composition_reordering_present = (num_reorder_pics > 0);
+    hevc_imp->last_delta                     = hevc_imp->reorder.delta;
+    hevc_imp->ps_count                       = ps_count;
+    hevc_imp->single_pass                    = 1;
+    return 0;
+}
+
+/* Analyze the whole stream since the stream violates the declared bound of reordering,
+ * and get back to the access unit following the ones already output. */
+static int hevc_importer_fall_back_to_analysis
+(
+    importer_t *importer
+)
+{
+    hevc_importer_t      *hevc_imp = (hevc_importer_t *)importer->info;
+    nal_reorder_buffer_t *rb       = &hevc_imp->reorder;
+    lsmash_video_summary_t *summary = (lsmash_video_summary_t *)lsmash_get_entry_data( importer->summaries, 1 );
+    uint64_t num_output = nalu_count_reordered_samples( rb );
+    uint32_t timescale  = summary ? summary->timescale : 0;
+    if( num_output )
+        lsmash_log( importer, LSMASH_LOG_WARNING,
+                    "timestamps of the first %"PRIu64" pictures may be inconsistent with the rest.\n", num_output );
+    nalu_cleanup_reorder_buffer( rb );
+    memset( rb, 0, sizeof(nal_reorder_buffer_t) );
+    lsmash_remove_entries( importer->summaries, lsmash_cleanup_summary );
+    lsmash_remove_entries( hevc_imp->hvcC_list, lsmash_destroy_codec_specific_data );
+    hevc_imp->hvcC_number     = 0;
+    hevc_imp->hvcC_changed    = 0;
+    hevc_imp->max_au_length   = 0;
+    hevc_imp->max_TemporalId  = 0;
+    hevc_imp->num_undecodable = 0;
+    hevc_imp->last_intra_cts  = 0;
+    hevc_imp->single_pass     = 0;
+    hevc_imp->end_of_input    = 0;
+    hevc_importer_rewind( importer, hevc_imp->first_sc_head_pos );
+    int err = hevc_analyze_whole_stream( importer );
+    if( err < 0 )
+        return err;
+    summary = (lsmash_video_summary_t *)lsmash_get_entry_data( importer->summaries, 1 );
+    if( !summary || summary->timescale != timescale )
+    {
+        lsmash_log( importer, LSMASH_LOG_ERROR, "the timescale of the stream is changed by the whole-stream analysis.\n" );
+        return LSMASH_ERR_PATCH_WELCOME;
+    }
+    hevc_importer_rewind( importer, hevc_imp->first_sc_head_pos );
+    for( uint64_t i = 0; i < num_output; i++ )
+    {
+        lsmash_sample_t *sample = NULL;
+        err = hevc_importer_get_analyzed_accessunit( importer, &sample );
+        lsmash_delete_sample( sample );
+        if( err < 0 )
+            return err;
+    }
+    return 0;
+}
+
 static int hevc_importer_probe( importer_t *importer )
 {
     /* Find the first start code. */
@@ -1485,26 +2489,26 @@ static int hevc_importer_probe( importer_t *importer )
     importer->info = hevc_imp;
     hevc_info_t *info = &hevc_imp->info;
     lsmash_bs_read_seek( bs, first_sc_head_pos, SEEK_SET );
-    hevc_imp->sc_head_pos = first_sc_head_pos;
-    if( (err = hevc_analyze_whole_stream( importer )) < 0 )
-        goto fail;
-    /* Go back to the start code of the first NALU. */
-    importer->status = IMPORTER_OK;
-    lsmash_bs_read_seek( bs, first_sc_head_pos, SEEK_SET );
+    hevc_imp->first_sc_head_pos = first_sc_head_pos;
     hevc_imp->sc_head_pos       = first_sc_head_pos;
-    info->prev_nalu_type        = HEVC_NALU_TYPE_UNKNOWN;
-    uint8_t *temp_au            = info->au.data;
-    uint8_t *temp_incomplete_au = info->au.incomplete_data;
-    memset( &info->au, 0, sizeof(hevc_access_unit_t) );
-    info->au.data            = temp_au;
-    info->au.incomplete_data = temp_incomplete_au;
-    memset( &info->slice, 0, sizeof(hevc_slice_info_t) );
-    memset( &info->vps,   0, sizeof(hevc_vps_t) );
-    memset( &info->sps,   0, sizeof(hevc_sps_t) );
-    memset( &info->pps,   0, SIZEOF_PPS_EXCLUDING_HEAP );
-    for( int i = 0; i < HEVC_DCR_NALU_TYPE_NUM; i++ )
-        lsmash_remove_entries( info->hvcC_param.parameter_arrays->ps_array[i].list, isom_remove_dcr_ps );
-    lsmash_destroy_hevc_parameter_arrays( &info->hvcC_param_next );
+    /* The SPS always declares the bound of reordering.
+     * If every picture is a frame without picture timing, timestamps can be generated while reading the stream.
+     * Otherwise, analyze the whole stream beforehand. */
+    importer->status = IMPORTER_OK;
+    if( (err = hevc_get_access_unit_internal( importer, 1 )) < 0 )
+        goto fail;
+    if( !info->sps.vui.field_seq_flag
+     && !info->sps.vui.frame_field_info_present_flag
+     && !info->vps.frame_field_info_present_flag
+     && (err = hevc_setup_single_pass( importer )) < 0 )
+        goto fail;
+    if( !hevc_imp->single_pass )
+    {
+        hevc_importer_rewind( importer, first_sc_head_pos );
+        if( (err = hevc_analyze_whole_stream( importer )) < 0 )
+            goto fail;
+    }
+    hevc_importer_rewind( importer, first_sc_head_pos );
     return 0;
 fail:
     remove_hevc_importer( hevc_imp );
@@ -1520,11 +2524,41 @@ static uint32_t hevc_importer_get_last_delta( importer_t *importer, uint32_t tra
     hevc_importer_t *hevc_imp = (hevc_importer_t *)importer->info;
     if( !hevc_imp || track_number != 1 || importer->status != IMPORTER_EOF )
         return 0;
-    return hevc_imp->ts_list.sample_count
+    return hevc_imp->ts_list.sample_count || hevc_imp->info.au.number
          ? hevc_imp->last_delta
          : UINT32_MAX;    /* arbitrary */
 }
 
+static int hevc_is_stored_nalu( uint8_t *nalu, uint32_t nalu_length )
+{
+    /* Same as hevc_get_access_unit_internal(). */
+    if( nalu_length < 2 )
+        return 0;   /* no room for the NALU header */
+    uint8_t nalu_type = (nalu[0] >> 1) & 0x3f;
+    return  nalu_type <= HEVC_NALU_TYPE_RASL_R
+        || (nalu_type >= HEVC_NALU_TYPE_BLA_W_LP   && nalu_type <= HEVC_NALU_TYPE_CRA)
+        ||  nalu_type == HEVC_NALU_TYPE_EOS
+        ||  nalu_type == HEVC_NALU_TYPE_EOB
+        || (nalu_type >= HEVC_NALU_TYPE_PREFIX_SEI && nalu_type <= HEVC_NALU_TYPE_SUFFIX_SEI);
+}
+
+static int hevc_convert_sample( lsmash_sample_t *sample )
+{
+    return nalu_convert_sample( sample, hevc_is_stored_nalu );
+}
+
+static uint64_t hevc_importer_get_span_end( importer_t *importer )
+{
+    hevc_importer_t *hevc_imp = (hevc_importer_t *)importer->info;
+    return nalu_get_span_end( &hevc_imp->reorder, hevc_imp->single_pass, hevc_imp->incomplete_au_head_pos );
+}
+
+static int hevc_importer_index_stream( importer_t *importer, uint32_t track_number, const char *index_name )
+{
+    return lsmash_importer_index_converted_accessunits( importer, track_number, index_name,
+                                                        hevc_convert_sample, hevc_importer_get_span_end );
+}
+
 const importer_functions hevc_importer =
 {
     { "HEVC", offsetof( importer_t, log_level ) },
@@ -1532,5 +2566,7 @@ const importer_functions hevc_importer =
     hevc_importer_probe,
     hevc_importer_get_accessunit,
     hevc_importer_get_last_delta,
-    hevc_importer_cleanup
+    hevc_importer_cleanup,
+    NULL,
+    hevc_importer_index_stream
 };
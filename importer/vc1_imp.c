@@ -44,6 +44,8 @@ typedef struct
     uint32_t max_au_length;
     uint32_t num_undecodable;
     uint64_t last_ref_intra_cts;
+    uint64_t au_head_pos;               /* the position of the first EBDU of the latest access unit */
+    uint64_t incomplete_au_head_pos;    /* the position of the first EBDU of the access unit being assembled */
 } vc1_importer_t;
 
 static void remove_vc1_importer( vc1_importer_t *vc1_imp )
@@ -86,6 +88,17 @@ static inline int vc1_complete_au( vc1_access_unit_t *access_unit, vc1_picture_i
     return 1;
 }
 
+/* Complete the access unit as vc1_complete_au() does, and take over the position of its first EBDU in the stream.
+ * The next access unit begins with the EBDU at 'next_au_head_pos'. */
+static int vc1_complete_au_in_stream( vc1_importer_t *vc1_imp, int probe, uint64_t next_au_head_pos )
+{
+    if( !vc1_complete_au( &vc1_imp->info.access_unit, &vc1_imp->info.picture, probe ) )
+        return 0;
+    vc1_imp->au_head_pos            = vc1_imp->incomplete_au_head_pos;
+    vc1_imp->incomplete_au_head_pos = next_au_head_pos;
+    return 1;
+}
+
 static inline void vc1_append_ebdu_to_au( vc1_access_unit_t *access_unit, uint8_t *ebdu, uint32_t ebdu_length, int probe )
 {
     if( !probe )
@@ -130,7 +143,7 @@ static int vc1_importer_get_access_unit_internal( importer_t *importer, int prob
         {
             /* For the last EBDU.
              * This EBDU already has been appended into the latest access unit and parsed. */
-            vc1_complete_au( access_unit, &info->picture, probe );
+            vc1_complete_au_in_stream( vc1_imp, probe, info->ebdu_head_pos );
             return vc1_get_au_internal_succeeded( vc1_imp );
         }
         else if( bdu_type == 0xFF )
@@ -156,7 +169,7 @@ static int vc1_importer_get_access_unit_internal( importer_t *importer, int prob
             /* Complete the current access unit if encountered delimiter of current access unit. */
             if( vc1_find_au_delimit_by_bdu_type( bdu_type, info->prev_bdu_type ) )
                 /* The last video coded EBDU belongs to the access unit you want at this time. */
-                complete_au = vc1_complete_au( access_unit, &info->picture, probe );
+                complete_au = vc1_complete_au_in_stream( vc1_imp, probe, info->ebdu_head_pos );
             /* Increase the buffer if needed. */
             uint64_t possible_au_length = access_unit->incomplete_data_length + ebdu_length;
             if( sb->bank->buffer_size < possible_au_length
@@ -250,7 +263,7 @@ static int vc1_importer_get_access_unit_internal( importer_t *importer, int prob
         /* If there is no more data in the stream, and flushed chunk of EBDUs, flush it as complete AU here. */
         else if( access_unit->incomplete_data_length && access_unit->data_length == 0 )
         {
-            vc1_complete_au( access_unit, &info->picture, probe );
+            vc1_complete_au_in_stream( vc1_imp, probe, info->ebdu_head_pos );
             return vc1_get_au_internal_succeeded( vc1_imp );
         }
         if( complete_au )
@@ -308,6 +321,7 @@ static int vc1_importer_get_accessunit( importer_t *importer, uint32_t track_num
         /* All random access point is a sync sample even if it's an open RAP. */
         sample->prop.ra_flags = ISOM_SAMPLE_RANDOM_ACCESS_FLAG_SYNC;
     sample->length = access_unit->data_length;
+    sample->pos    = vc1_imp->au_head_pos;
     memcpy( sample->data, access_unit->data, access_unit->data_length );
     return current_status;
 }
@@ -500,6 +514,7 @@ static int vc1_importer_probe( importer_t *importer )
     lsmash_bs_read_seek( bs, first_ebdu_head_pos, SEEK_SET );
     info->prev_bdu_type                  = 0xFF;    /* 0xFF is a forbidden value. */
     info->ebdu_head_pos                  = first_ebdu_head_pos;
+    vc1_imp->incomplete_au_head_pos      = first_ebdu_head_pos;
     uint8_t *temp_access_unit            = info->access_unit.data;
     uint8_t *temp_incomplete_access_unit = info->access_unit.incomplete_data;
     memset( &info->access_unit, 0, sizeof(vc1_access_unit_t) );
@@ -526,6 +541,67 @@ static uint32_t vc1_importer_get_last_delta( importer_t *importer, uint32_t trac
          : UINT32_MAX;    /* arbitrary */
 }
 
+static uint8_t *vc1_find_start_code_prefix( uint8_t *buf, uint8_t *buf_end )
+{
+    for( ; buf + VC1_START_CODE_PREFIX_LENGTH <= buf_end; buf++ )
+        if( buf[0] == 0x00 && buf[1] == 0x00 && buf[2] == 0x01 )
+            return buf;
+    return buf_end;
+}
+
+/* Drop the zero bytes trailing EBDUs as vc1_importer_get_access_unit_internal() does.
+ * If 'dst' is NULL, just return the length of the data without them. */
+static uint32_t vc1_drop_trailing_zero_bytes( uint8_t *dst, uint8_t *src, uint8_t *src_end )
+{
+    uint32_t length = 0;
+    uint8_t *ebdu   = vc1_find_start_code_prefix( src, src_end );
+    while( ebdu < src_end )
+    {
+        uint8_t *ebdu_end = vc1_find_start_code_prefix( ebdu + VC1_START_CODE_PREFIX_LENGTH, src_end );
+        uint8_t *next     = ebdu_end;
+        /* Any EBDU has no consecutive zero bytes at the end. */
+        while( ebdu_end > ebdu + VC1_START_CODE_PREFIX_LENGTH && ebdu_end[-1] == 0x00 )
+            --ebdu_end;
+        if( dst )
+        {
+            memcpy( dst, ebdu, ebdu_end - ebdu );
+            dst += ebdu_end - ebdu;
+        }
+        length += ebdu_end - ebdu;
+        ebdu    = next;
+    }
+    return length;
+}
+
+static int vc1_convert_sample( lsmash_sample_t *sample )
+{
+    uint8_t *src     = sample->data;
+    uint8_t *src_end = sample->data + sample->length;
+    uint32_t length  = vc1_drop_trailing_zero_bytes( NULL, src, src_end );
+    if( length == 0 )
+        return LSMASH_ERR_INVALID_DATA;
+    uint8_t *data = lsmash_malloc( length );
+    if( !data )
+        return LSMASH_ERR_MEMORY_ALLOC;
+    vc1_drop_trailing_zero_bytes( data, src, src_end );
+    lsmash_free( sample->data );
+    sample->data   = data;
+    sample->length = length;
+    return 0;
+}
+
+static uint64_t vc1_importer_get_span_end( importer_t *importer )
+{
+    vc1_importer_t *vc1_imp = (vc1_importer_t *)importer->info;
+    return vc1_imp->incomplete_au_head_pos;
+}
+
+static int vc1_importer_index_stream( importer_t *importer, uint32_t track_number, const char *index_name )
+{
+    return lsmash_importer_index_converted_accessunits( importer, track_number, index_name,
+                                                        vc1_convert_sample, vc1_importer_get_span_end );
+}
+
 const importer_functions vc1_importer =
 {
     { "VC-1", offsetof( importer_t, log_level ) },
@@ -533,5 +609,7 @@ const importer_functions vc1_importer =
     vc1_importer_probe,
     vc1_importer_get_accessunit,
     vc1_importer_get_last_delta,
-    vc1_importer_cleanup
+    vc1_importer_cleanup,
+    NULL,
+    vc1_importer_index_stream
 };
@@ -34,8 +34,8 @@
  * Version
  ****************************************************************************/
 #define LSMASH_VERSION_MAJOR  2
-#define LSMASH_VERSION_MINOR  5
-#define LSMASH_VERSION_MICRO  5
+#define LSMASH_VERSION_MINOR  6
+#define LSMASH_VERSION_MICRO  0
 
 #define LSMASH_VERSION_INT( a, b, c ) (((a) << 16) | ((b) << 8) | (c))
 
@@ -238,6 +238,39 @@ typedef struct
     uint64_t max_chunk_size;            /* max size per chunk in bytes. 4*1024*1024 (4MiB) is default value. */
     /** demuxing only **/
     uint64_t max_read_size;             /* max size of reading from the file at a time. 4*1024*1024 (4MiB) is default value. */
+    int      memory_map;                /* If set to 1, the whole file opened by lsmash_open_file() is mapped into memory if possible,
+                                         * and boxes and samples are read from the mapping instead of through 'read' and 'seek'.
+                                         * If the mapping fails, reading falls back to 'read' and 'seek' silently.
+                                         * 0 is default value. */
+    /** muxing only **/
+    uint32_t async_write_depth;         /* If set to n > 0, output to the file is done by a background thread, and up to n flushed buffers
+                                         * wait for it while muxing continues. lsmash_finish_movie(), lsmash_switch_media_segment() and
+                                         * lsmash_write_top_level_box() return after all the queued output is done.
+                                         * Ignored if the library is built without thread support. 0 is default value. */
+    uint64_t moov_reserve_size;         /* If set to n > 0, a zero-filled Free Space Box of at least n bytes is placed ahead of the Media Data Box.
+                                         * lsmash_finish_movie() writes the Movie Box and the Meta Box into it if they fit, without moving
+                                         * any media data. Otherwise, with 'remux', they are moved to the front reusing the reserved space
+                                         * and the media data is shifted only by the shortfall; without 'remux', they are written at the end
+                                         * of the file and the Free Space Box is left in place.
+                                         * lsmash_estimate_movie_size() gives a hint. 0 is default value. */
+    /** demuxing only **/
+    uint32_t max_resident_fragments;    /* If set to n > 0, Movie Fragment Boxes of a seekable file are not read by lsmash_read_file()
+                                         * but found and read when the timeline reaches them, and at most n of them are kept in memory;
+                                         * the least recently used one is discarded first.
+                                         * The Movie Fragment Random Access Box, if any, is located through its offset box at the end of the file,
+                                         * and lsmash_read_file() resumes reading from it, or stops at the end of the file if it is absent.
+                                         * The other top level boxes following the first Movie Fragment Box, such as Segment Index Boxes
+                                         * or trailing Meta Boxes, are not read by lsmash_read_file(). They are read when the timeline
+                                         * walks over them to find Movie Fragment Boxes, and never read if the Track Fragment Random Access Boxes
+                                         * for all tracks locate the Movie Fragment Boxes, which are confirmed by their sequence numbers.
+                                         * 0 is default value. */
+    /** muxing only **/
+    int      compact_sample_size;       /* If set to 1, lsmash_finish_movie() replaces the Sample Size Box of each track by a Compact Sample Size Box
+                                         * when every sample size fits in 16 bits. The field size, 4, 8 or 16 bits, is chosen from the largest sample.
+                                         * Ignored for QuickTime file format and movie fragments. 0 is default value. */
+    int      compress_movie;            /* If set to 1, lsmash_finish_movie() compresses the Movie Box with zlib into a Compressed Movie Box
+                                         * if it gets smaller. Only for QuickTime file format, and ignored if the library is built without zlib
+                                         * or the file is fragmented. 0 is default value. */
 } lsmash_file_parameters_t;
 
 typedef int (*lsmash_adhoc_remux_callback)( void *param, uint64_t done, uint64_t total );
@@ -287,6 +320,19 @@ int lsmash_close_file
     lsmash_file_parameters_t *param
 );
 
+/* Estimate the size of the Movie Box of a non-fragmented movie, which is sufficient in most cases,
+ * from the number of tracks, the total number of samples over all tracks and the duration in seconds.
+ * The estimation is based on the chunk duration in 'param' and doesn't cover the Meta Box.
+ *
+ * Return the estimated size in bytes. */
+uint64_t lsmash_estimate_movie_size
+(
+    lsmash_file_parameters_t *param,
+    uint32_t                  track_count,
+    uint64_t                  sample_count,
+    double                    duration
+);
+
 /* Associate a file with a ROOT and allocate the handle of that file.
  * The all allocated handles can be deallocated by lsmash_destroy_root().
  * If the ROOT has no associated file yet, the first associated file is activated.
@@ -2334,6 +2380,41 @@ int lsmash_print_movie
     const char    *filename     /* the path of a file as the destination */
 );
 
+typedef enum
+{
+    LSMASH_PRINT_FORMAT_TEXT       = 0,     /* the same text as lsmash_print_movie() prints */
+    LSMASH_PRINT_FORMAT_JSON_LINES = 1,     /* a JSON object describing the box header per line */
+} lsmash_print_format;
+
+typedef struct
+{
+    lsmash_print_format        format;      /* the output format */
+    int                        max_level;   /* the deepest nesting level of boxes to be printed
+                                             * The top level boxes are at level 1.
+                                             * If set to 0, boxes at any level are printed. */
+    uint32_t                   type_count;  /* the number of box types in 'types' */
+    lsmash_compact_box_type_t *types;       /* If present, print only boxes of these types and their descendants.
+                                             * In text, the outermost box of these types is indented as a top level box
+                                             * since its ancestors are not printed. */
+} lsmash_print_parameters_t;
+
+/* Set up a destination into which box structure of the file is printed progressively by lsmash_read_file().
+ * Each box is printed as soon as it is read, and top level boxes which are not needed to read the rest of the file,
+ * such as Movie Fragment Boxes and Media Data Boxes, are released just after being printed.
+ * Therefore, the memory usage doesn't grow with the number of movie fragments in the file.
+ * The file shall be opened with LSMASH_FILE_MODE_DUMP, and this function shall be called before lsmash_read_file().
+ * lsmash_print_movie() is unavailable for the file if this function succeeded.
+ * If 'param' is NULL, the default parameters, i.e. all boxes printed in text, are used.
+ *
+ * Return 0 if successful.
+ * Return a negative value otherwise. */
+int lsmash_set_print_stream
+(
+    lsmash_file_t                   *file,      /* the address of a file opened with LSMASH_FILE_MODE_DUMP */
+    const char                      *filename,  /* the path of a file as the destination */
+    const lsmash_print_parameters_t *param      /* the parameters of printing */
+);
+
 /* Print a chapter list written as a user data on stdout.
  * This function might output BOM on Windows.
  *
@@ -2370,6 +2451,27 @@ int lsmash_construct_timeline
     uint32_t       track_ID
 );
 
+/* Construct the timeline for a track lazily.
+ * Only the statistics of the track are calculated at this time, and the information of each sample is constructed
+ * from the sample tables on demand when accessed. This saves time and memory when only a part of a large track is
+ * accessed. Access beyond the constructed part expands the timeline forward by a window of samples at once.
+ * For a fragmented track, movie fragments are expanded in order as accessed, and the number of samples, the media
+ * duration, the maximum sample size and the composition to decode shift are settled by expanding all of them when
+ * they are requested. This is effective when combined with max_resident_fragments in lsmash_file_parameters_t.
+ * The timeline is constructed at once as lsmash_construct_timeline() does if the track consists of LPCM or fixed
+ * compression audio samples, or if the track is not read from an ISO Base Media or QuickTime file.
+ * The sample tables must not be modified while the timeline is constructed lazily.
+ * lsmash_discard_boxes() completes the construction before discarding boxes.
+ * The constructed timeline can be destructed by lsmash_destruct_timeline().
+ *
+ * Return 0 if successful.
+ * Return a negative value otherwise. */
+int lsmash_construct_lazy_timeline
+(
+    lsmash_root_t *root,
+    uint32_t       track_ID
+);
+
 /* Destruct the timeline for a given track. */
 void lsmash_destruct_timeline
 (
@@ -2424,6 +2526,19 @@ int lsmash_get_cts_from_media_timeline
     uint64_t      *cts              /* the address of a variable to which a composition timestamp will be set */
 );
 
+/* Get the number of the sample which has the greatest decoding timestamp not greater than a given one
+ * from the media timeline for a track.
+ *
+ * Return 0 if successful.
+ * Return a negative value otherwise. */
+int lsmash_get_sample_number_from_media_timeline
+(
+    lsmash_root_t *root,
+    uint32_t       track_ID,
+    uint64_t       dts,
+    uint32_t      *sample_number    /* the address of a variable to which the sample number will be set */
+);
+
 /* Get the shift of composition timeline to decode timeline from the media timeline for a track.
  *
  * Return 0 if successful.
@@ -2515,6 +2630,29 @@ lsmash_sample_t *lsmash_get_sample_from_media_timeline
     uint32_t       sample_number
 );
 
+/* Get consecutive samples starting from a given sample number from the media timeline for a track.
+ * The data of the samples is read into 'buffer' given by the caller, and the data of samples stored contiguously
+ * in the file is read at a time, so no per-sample allocation is done.
+ * The 'data' of each gotten sample points into 'buffer', therefore you shall not deallocate any gotten sample
+ * by lsmash_delete_sample() and shall not use it after 'buffer' is reused or deallocated.
+ * Getting samples stops at the end of the media timeline or before the first sample that doesn't fit in the rest of 'buffer'.
+ * The size of 'buffer' returned by lsmash_get_max_sample_size_in_media_timeline() is enough to get at least one sample.
+ * If you want to get samples from a time range, get the first sample number by lsmash_get_sample_number_from_media_timeline().
+ *
+ * Return the number of gotten samples if successful.
+ * Return 0 if the given sample number is beyond the media timeline.
+ * Return a negative value otherwise. */
+int lsmash_get_samples_from_media_timeline
+(
+    lsmash_root_t   *root,
+    uint32_t         track_ID,
+    uint32_t         sample_number,     /* the sample number of the first sample you want to get */
+    uint32_t         sample_count,      /* the maximum number of samples you want to get */
+    lsmash_sample_t *samples,           /* the array of 'sample_count' samples to be filled */
+    uint8_t         *buffer,            /* the buffer to store the data of the samples */
+    uint32_t         buffer_size        /* the size of 'buffer' */
+);
+
 /* Get the information of the sample correspondint to a given sample number from the media timeline for a track.
  * The information includes the size, timestamps and properties of the sample.
  *